@@ -0,0 +1,484 @@
+// =========
+// Benchmark
+// =========
+//
+// Load generator and echo peer. Measures messages per second, payload MB per
+// second and the round-trip latency (send until the echo is received) for a
+// sweep of payload size, synchronous mode, encryption, MAX_SLOTS (and
+// ACK_WINDOW in synchronous mode) and count of connections. The echo peer
+// runs on its own thread and loop, each connection is a chirp instance on the
+// main loop.
+//
+// .. code-block:: text
+//
+//    bench [-n messages] [-w window] [-p port] [-s sizes] [-y sync]
+//          [-e encrypt] [-m max_slots] [-c connections]
+//
+// Lists are comma-separated, for example: bench -s 64,4000 -e 0. Encrypted
+// runs always follow the unencrypted ones, since
+// :c:func:`ch_chirp_set_always_encrypt` can't be undone. The time includes
+// connecting and the handshakes.
+//
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+#include "libchirp.h"
+
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Declarations
+// ============
+//
+// .. code-block:: cpp
+
+#define CH_BN_MAX_WINDOW 256
+#define CH_BN_MAX_CONNS 64
+#define CH_BN_MAX_LIST 16
+
+#define CH_BN_SEND_DONE 1 << 0
+#define CH_BN_ECHOED 1 << 1
+
+// .. c:type:: _ch_bn_client_t
+//
+//    A connection of the load generator.
+//
+// .. code-block:: cpp
+//
+typedef struct _ch_bn_client_s {
+    ch_chirp_t   chirp;
+    ch_message_t msgs[CH_BN_MAX_WINDOW];
+    uint64_t     send_time[CH_BN_MAX_WINDOW];
+    uint8_t      state[CH_BN_MAX_WINDOW];
+    int          sent;
+    int          started;
+} _ch_bn_client_t;
+
+// .. c:type:: _ch_bn_list_t
+//
+//    A list of values to sweep.
+//
+// .. code-block:: cpp
+//
+typedef struct _ch_bn_list_s {
+    int values[CH_BN_MAX_LIST];
+    int count;
+} _ch_bn_list_t;
+
+static _ch_bn_client_t _ch_bn_clients[CH_BN_MAX_CONNS];
+static ch_chirp_t*     _ch_bn_peer;
+static uv_sem_t        _ch_bn_peer_started;
+static int             _ch_bn_peer_up;
+static uv_loop_t       _ch_bn_loop;
+static ch_config_t     _ch_bn_config;
+static ch_buf*         _ch_bn_data;
+static uint64_t*       _ch_bn_latency;
+static int             _ch_bn_latency_count;
+static int             _ch_bn_messages = 10000;
+static int             _ch_bn_window   = 16;
+static int             _ch_bn_port     = 3090;
+static int             _ch_bn_size;
+static int             _ch_bn_conns;
+static int             _ch_bn_errors;
+
+// Definitions
+// ============
+//
+// Echo peer
+// ---------
+//
+// .. code-block:: cpp
+//
+static void
+_ch_bn_peer_start_cb(ch_chirp_t* chirp)
+{
+    (void) (chirp);
+    _ch_bn_peer_up = 1;
+    uv_sem_post(&_ch_bn_peer_started);
+}
+
+static void
+_ch_bn_peer_sent_cb(ch_chirp_t* chirp, ch_message_t* msg, ch_error_t status)
+{
+    if (status != CH_SUCCESS) {
+        _ch_bn_errors += 1;
+    }
+    ch_chirp_release_msg_slot(chirp, msg, NULL);
+}
+
+static void
+_ch_bn_peer_recv_cb(ch_chirp_t* chirp, ch_message_t* msg)
+{
+    ch_chirp_send(chirp, msg, _ch_bn_peer_sent_cb);
+}
+
+static void
+_ch_bn_peer_run(void* arg)
+{
+    ch_config_t* config  = arg;
+    ch_error_t   tmp_err = ch_chirp_run(
+            config,
+            &_ch_bn_peer,
+            _ch_bn_peer_recv_cb,
+            _ch_bn_peer_start_cb,
+            NULL,
+            NULL);
+    if (tmp_err != CH_SUCCESS && !_ch_bn_peer_up) {
+        /* The start callback was never called, wake up _ch_bn_run */
+        fprintf(stderr, "Could not run the echo peer: %d.\n", tmp_err);
+        uv_sem_post(&_ch_bn_peer_started);
+    }
+}
+
+// Load generator
+// --------------
+//
+// Each message of the window is sent again, after its send callback was
+// called and its echo was received.
+//
+// .. code-block:: cpp
+//
+static void
+_ch_bn_send(_ch_bn_client_t* client, int index);
+
+static void
+_ch_bn_finish_client(_ch_bn_client_t* client)
+{
+    for (int i = 0; i < _ch_bn_window; i++) {
+        if (client->state[i] != (CH_BN_SEND_DONE | CH_BN_ECHOED)) {
+            return;
+        }
+    }
+    if (client->sent < _ch_bn_messages) {
+        return;
+    }
+    ch_chirp_close_ts(&client->chirp);
+}
+
+static void
+_ch_bn_next(_ch_bn_client_t* client, int index)
+{
+    if (client->state[index] != (CH_BN_SEND_DONE | CH_BN_ECHOED)) {
+        return;
+    }
+    if (client->sent < _ch_bn_messages) {
+        _ch_bn_send(client, index);
+    } else {
+        _ch_bn_finish_client(client);
+    }
+}
+
+static void
+_ch_bn_sent_cb(ch_chirp_t* chirp, ch_message_t* msg, ch_error_t status)
+{
+    _ch_bn_client_t* client = chirp->user_data;
+    int              index  = msg - client->msgs;
+    if (status != CH_SUCCESS) {
+        /* Count it as echoed, the benchmark continues */
+        _ch_bn_errors += 1;
+        client->state[index] |= CH_BN_ECHOED;
+    }
+    client->state[index] |= CH_BN_SEND_DONE;
+    _ch_bn_next(client, index);
+}
+
+static void
+_ch_bn_send(_ch_bn_client_t* client, int index)
+{
+    ch_message_t* msg = &client->msgs[index];
+    client->state[index]     = 0;
+    client->send_time[index] = uv_hrtime();
+    client->sent += 1;
+    ch_chirp_send(&client->chirp, msg, _ch_bn_sent_cb);
+}
+
+static void
+_ch_bn_recv_cb(ch_chirp_t* chirp, ch_message_t* msg)
+{
+    _ch_bn_client_t* client = chirp->user_data;
+    int              index;
+    memcpy(&index, msg->identity, sizeof(index));
+    ch_chirp_release_msg_slot(chirp, msg, NULL);
+    if (index < 0 || index >= _ch_bn_window) {
+        _ch_bn_errors += 1;
+        return;
+    }
+    _ch_bn_latency[_ch_bn_latency_count] =
+            uv_hrtime() - client->send_time[index];
+    _ch_bn_latency_count += 1;
+    client->state[index] |= CH_BN_ECHOED;
+    _ch_bn_next(client, index);
+}
+
+static void
+_ch_bn_start_cb(ch_chirp_t* chirp)
+{
+    _ch_bn_client_t* client = chirp->user_data;
+    client->started         = 1;
+    for (int i = 0; i < _ch_bn_window; i++) {
+        ch_message_t* msg = &client->msgs[i];
+        ch_msg_init(msg);
+        /* The echo has the same identity */
+        memcpy(msg->identity, &i, sizeof(i));
+        ch_msg_set_address(msg, AF_INET, "127.0.0.1", _ch_bn_port);
+        ch_msg_set_data(msg, _ch_bn_data, _ch_bn_size);
+        _ch_bn_send(client, i);
+    }
+}
+
+static int
+_ch_bn_cmp(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+static double
+_ch_bn_percentile(double percentile)
+{
+    if (_ch_bn_latency_count == 0) {
+        return 0;
+    }
+    int index = (int) (percentile * (_ch_bn_latency_count - 1));
+    return _ch_bn_latency[index] / 1000.0; /* us */
+}
+
+// .. c:function::
+static int
+_ch_bn_run(int size, int sync, int slots, int conns)
+//
+//    Run one benchmark with the echo peer and conns connections. In
+//    synchronous mode :c:func:`ch_chirp_init` sets MAX_SLOTS to ACK_WINDOW,
+//    so slots is used as ACK_WINDOW too. Returns 1 if the echo peer could
+//    not be started.
+//
+// .. code-block:: cpp
+//
+{
+    uv_thread_t thread;
+    ch_config_t peer_config = _ch_bn_config;
+    peer_config.PORT        = _ch_bn_port;
+    peer_config.SYNCHRONOUS = sync;
+    peer_config.MAX_SLOTS   = slots;
+    if (sync) {
+        peer_config.ACK_WINDOW = slots;
+    }
+    _ch_bn_size             = size;
+    _ch_bn_conns            = conns;
+    _ch_bn_latency_count    = 0;
+    _ch_bn_errors           = 0;
+    _ch_bn_peer_up          = 0;
+    uv_sem_init(&_ch_bn_peer_started, 0);
+    if (uv_thread_create(&thread, _ch_bn_peer_run, &peer_config) != 0) {
+        fprintf(stderr, "Could not start the echo peer.\n");
+        return 1;
+    }
+    uv_sem_wait(&_ch_bn_peer_started);
+    uv_sem_destroy(&_ch_bn_peer_started);
+    if (!_ch_bn_peer_up) {
+        uv_thread_join(&thread);
+        return 1;
+    }
+
+    uv_loop_init(&_ch_bn_loop);
+    uint64_t start = uv_hrtime();
+    for (int i = 0; i < conns; i++) {
+        _ch_bn_client_t* client = &_ch_bn_clients[i];
+        ch_config_t      config = peer_config;
+        memset(client, 0, sizeof(*client));
+        config.PORT = _ch_bn_port + 1 + i;
+        if (ch_chirp_init(
+                    &client->chirp,
+                    &config,
+                    &_ch_bn_loop,
+                    _ch_bn_recv_cb,
+                    _ch_bn_start_cb,
+                    NULL,
+                    NULL) != CH_SUCCESS) {
+            fprintf(stderr, "Could not initialize chirp.\n");
+            exit(1);
+        }
+        /* ch_chirp_init clears the chirp object */
+        client->chirp.user_data = client;
+    }
+    ch_run(&_ch_bn_loop);
+    uint64_t end = uv_hrtime();
+    ch_loop_close(&_ch_bn_loop);
+    ch_chirp_close_ts(_ch_bn_peer);
+    uv_thread_join(&thread);
+
+    qsort(_ch_bn_latency,
+          _ch_bn_latency_count,
+          sizeof(*_ch_bn_latency),
+          _ch_bn_cmp);
+    double seconds = (end - start) / 1e9;
+    double msgs    = _ch_bn_latency_count / seconds;
+    printf("%7d %4d %3d %5d %5d %10.0f %8.2f %8.1f %8.1f %8.1f %6d\n",
+           size,
+           sync,
+           !_ch_bn_config.DISABLE_ENCRYPTION,
+           slots,
+           conns,
+           msgs,
+           msgs * size / (1024 * 1024),
+           _ch_bn_percentile(0.5),
+           _ch_bn_percentile(0.99),
+           _ch_bn_percentile(0.999),
+           _ch_bn_errors);
+    fflush(stdout);
+    return 0;
+}
+
+static void
+_ch_bn_parse_list(char* arg, _ch_bn_list_t* list, int min, int max)
+{
+    list->count = 0;
+    for (char* tok = strtok(arg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        errno     = 0;
+        int value = strtol(tok, NULL, 10);
+        if (errno || value < min || value > max) {
+            fprintf(stderr, "%s must be between %d and %d.\n", tok, min, max);
+            exit(1);
+        }
+        if (list->count == CH_BN_MAX_LIST) {
+            fprintf(stderr, "At most %d values.\n", CH_BN_MAX_LIST);
+            exit(1);
+        }
+        list->values[list->count] = value;
+        list->count += 1;
+    }
+}
+
+static int
+_ch_bn_parse_int(char* arg, int min, int max)
+{
+    _ch_bn_list_t list;
+    _ch_bn_parse_list(arg, &list, min, max);
+    if (list.count != 1) {
+        fprintf(stderr, "Expected one value.\n");
+        exit(1);
+    }
+    return list.values[0];
+}
+
+int
+main(int argc, char* argv[])
+{
+    /* Below and above CH_BF_PREALLOC_DATA and above CH_WR_CHUNK_SIZE */
+    _ch_bn_list_t sizes = {{64, 1000, 4000, 100000}, 4};
+    _ch_bn_list_t syncs = {{1, 0}, 2};
+    _ch_bn_list_t encs  = {{0, 1}, 2};
+    _ch_bn_list_t slots = {{1, 16}, 2};
+    _ch_bn_list_t conns = {{1, 4}, 2};
+    signal(SIGPIPE, SIG_IGN);
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 == argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+            fprintf(stderr,
+                    "%s [-n messages] [-w window] [-p port] [-s sizes] "
+                    "[-y sync] [-e encrypt] [-m max_slots] "
+                    "[-c connections]\n",
+                    argv[0]);
+            exit(1);
+        }
+        char* arg = argv[i + 1];
+        switch (argv[i][1]) {
+        case 'n':
+            _ch_bn_messages = _ch_bn_parse_int(arg, 1, 100000000);
+            break;
+        case 'w':
+            _ch_bn_window = _ch_bn_parse_int(arg, 1, CH_BN_MAX_WINDOW);
+            break;
+        case 'p':
+            _ch_bn_port = _ch_bn_parse_int(arg, 1025, 0xFFFF - CH_BN_MAX_CONNS);
+            break;
+        case 's':
+            _ch_bn_parse_list(arg, &sizes, 0, 100000000);
+            break;
+        case 'y':
+            _ch_bn_parse_list(arg, &syncs, 0, 1);
+            break;
+        case 'e':
+            _ch_bn_parse_list(arg, &encs, 0, 1);
+            break;
+        case 'm':
+            _ch_bn_parse_list(arg, &slots, 1, 32);
+            break;
+        case 'c':
+            _ch_bn_parse_list(arg, &conns, 1, CH_BN_MAX_CONNS);
+            break;
+        default:
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+        i += 1;
+    }
+    if (_ch_bn_messages < _ch_bn_window) {
+        _ch_bn_window = _ch_bn_messages;
+    }
+    int max_size = 0;
+    for (int i = 0; i < sizes.count; i++) {
+        if (sizes.values[i] > max_size) {
+            max_size = sizes.values[i];
+        }
+    }
+    /* Each connection sends at least a window of messages */
+    _ch_bn_latency = malloc(
+            sizeof(*_ch_bn_latency) * CH_BN_MAX_CONNS *
+            (_ch_bn_messages + _ch_bn_window));
+    _ch_bn_data = malloc(max_size + 1);
+    if (_ch_bn_latency == NULL || _ch_bn_data == NULL) {
+        fprintf(stderr, "Could not allocate memory.\n");
+        exit(1);
+    }
+    memset(_ch_bn_data, 'b', max_size + 1);
+
+    ch_libchirp_init();
+    ch_chirp_config_init(&_ch_bn_config);
+    _ch_bn_config.CERT_CHAIN_PEM = "./tests/cert.pem";
+    _ch_bn_config.DH_PARAMS_PEM  = "./tests/dh.pem";
+    _ch_bn_config.DISABLE_SIGNALS = 1;
+    printf("   size sync enc slots conns      msg/s     MB/s  p50(us)  "
+           "p99(us) p999(us) errors\n");
+    for (int enc = 0; enc < 2; enc++) {
+        int found = 0;
+        for (int i = 0; i < encs.count; i++) {
+            found |= encs.values[i] == enc;
+        }
+        if (!found) {
+            continue;
+        }
+        if (enc) {
+            ch_chirp_set_always_encrypt();
+        }
+        _ch_bn_config.DISABLE_ENCRYPTION = !enc;
+        for (int a = 0; a < sizes.count; a++) {
+            for (int b = 0; b < syncs.count; b++) {
+                for (int c = 0; c < slots.count; c++) {
+                    for (int d = 0; d < conns.count; d++) {
+                        if (_ch_bn_run(
+                                    sizes.values[a],
+                                    syncs.values[b],
+                                    slots.values[c],
+                                    conns.values[d])) {
+                            exit(1);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    ch_libchirp_cleanup();
+    free(_ch_bn_latency);
+    free(_ch_bn_data);
+    return 0;
+}
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""Benchmark the queue, pool and asyncio interfaces.
+
+Sends requests to the echo_test peer and reports messages per second, payload
+MB per second and the round-trip latency. Compare with bench.c to see the cost
+of the binding. Encryption is only measured by bench.c, since the python
+binding can't force encryption on localhost.
+
+.. code-block:: text
+
+   python3 bench.py [-n messages] [-w window] [-s sizes] [-y sync]
+                    [-f frontends]
+"""
+
+import argparse
+import asyncio
+from subprocess import Popen
+import threading
+import time
+
+from libchirp import Config, Loop
+import libchirp.asyncio
+import libchirp.pool
+import libchirp.queue
+
+
+def make_config(port, sync):
+    """Return a config of the benchmark."""
+    config = Config()
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.DISABLE_ENCRYPTION = True
+    config.DISABLE_SIGNALS = True
+    config.SYNCHRONOUS = sync
+    config.PORT = port
+    return config
+
+
+class Result(object):
+    """Collect the latencies of a benchmark."""
+
+    def __init__(self):
+        self.latency = []
+        self.errors = 0
+        self.start = time.perf_counter()
+        self.end = self.start
+
+    def done(self, sent, fut):
+        """Record the latency of a answered request."""
+        self.end = time.perf_counter()
+        if fut.cancelled() or fut.exception() is not None:
+            self.errors += 1
+        else:
+            self.latency.append(self.end - sent)
+
+    def percentile(self, percentile):
+        """Return the percentile of the latency in microseconds."""
+        if not self.latency:
+            return 0
+        return self.latency[int(percentile * (len(self.latency) - 1))] * 1e6
+
+    def report(self, frontend, size, sync):
+        """Print a line of the report."""
+        self.latency.sort()
+        seconds = self.end - self.start
+        msgs = len(self.latency) / seconds
+        print("%-8s %7d %4d %10.0f %8.2f %8.1f %8.1f %8.1f %6d" % (
+            frontend,
+            size,
+            sync,
+            msgs,
+            msgs * size / (1024 * 1024),
+            self.percentile(0.5),
+            self.percentile(0.99),
+            self.percentile(0.999),
+            self.errors,
+        ), flush=True)
+
+
+def run_threaded(module, args, config, data):
+    """Run the benchmark of the queue or the pool interface."""
+    loop = Loop()
+    chirp = None
+    try:
+        window = threading.Semaphore(args.window)
+        result = Result()
+
+        def done(sent, fut):
+            result.done(sent, fut)
+            window.release()
+
+        if module is libchirp.pool:
+            chirp = module.Chirp(loop, config, max_workers=1)
+        else:
+            chirp = module.Chirp(loop, config)
+        for _ in range(args.messages):
+            window.acquire()
+            msg = module.Message()
+            msg.data = data
+            msg.address = "127.0.0.1"
+            msg.port = args.port
+            sent = time.perf_counter()
+            chirp.request(msg).add_done_callback(
+                lambda fut, sent=sent: done(sent, fut)
+            )
+        for _ in range(args.window):
+            window.acquire()
+        return result
+    finally:
+        if chirp is not None:
+            chirp.stop()
+        loop.stop()
+
+
+async def run_async(chirp, args, data):
+    """Send the requests of the asyncio interface."""
+    window = asyncio.Semaphore(args.window)
+    result = Result()
+
+    def done(sent, fut):
+        result.done(sent, fut)
+        window.release()
+
+    for _ in range(args.messages):
+        await window.acquire()
+        msg = libchirp.asyncio.Message()
+        msg.data = data
+        msg.address = "127.0.0.1"
+        msg.port = args.port
+        sent = time.perf_counter()
+        chirp.request(msg).add_done_callback(
+            lambda fut, sent=sent: done(sent, fut)
+        )
+    for _ in range(args.window):
+        await window.acquire()
+    return result
+
+
+def run_asyncio(args, config, data):
+    """Run the benchmark of the asyncio interface."""
+    loop = Loop()
+    aio_loop = asyncio.new_event_loop()
+    chirp = None
+    try:
+        chirp = libchirp.asyncio.Chirp(loop, config, aio_loop)
+        return aio_loop.run_until_complete(run_async(chirp, args, data))
+    finally:
+        if chirp is not None:
+            chirp.stop()
+        loop.stop()
+        aio_loop.close()
+
+
+def parse_list(value):
+    """Parse a comma-separated list of values."""
+    return value.split(",")
+
+
+def main():
+    """Run the benchmarks."""
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-n", dest="messages", type=int, default=10000)
+    parser.add_argument("-w", dest="window", type=int, default=16)
+    parser.add_argument("-p", dest="port", type=int, default=3090)
+    parser.add_argument("-s", dest="sizes", type=parse_list,
+                        default=["64", "1000", "4000", "100000"])
+    parser.add_argument("-y", dest="sync", type=parse_list,
+                        default=["1", "0"])
+    parser.add_argument("-f", dest="frontends", type=parse_list,
+                        default=["queue", "pool", "asyncio"])
+    args = parser.parse_args()
+    peer = Popen(["./echo_test", str(args.port), "0"])
+    try:
+        # Wait until the echo peer listens
+        time.sleep(1)
+        print("frontend    size sync      msg/s     MB/s  p50(us)  p99(us) "
+              "p999(us) errors")
+        for frontend in args.frontends:
+            for size in args.sizes:
+                data = b'b' * int(size)
+                for sync in args.sync:
+                    config = make_config(args.port + 1, int(sync))
+                    if frontend == "asyncio":
+                        result = run_asyncio(args, config, data)
+                    else:
+                        module = getattr(libchirp, frontend)
+                        result = run_threaded(module, args, config, data)
+                    result.report(frontend, int(size), int(sync))
+    finally:
+        peer.terminate()
+        peer.wait()
+
+
+if __name__ == "__main__":
+    main()
@@ -1,6 +1,6 @@
 #!/bin/sh
 
-PKGS="python3 libuv libffi openssl"
+PKGS="python3 libuv libffi openssl lz4"
 
 brew update > /dev/null
 brew install $PKGS
@@ -10,4 +10,9 @@ python3 libchirp_cffi.py
 clang echo_test.c libchirp.c \
     -luv -lssl -lcrypto -lm -lpthread -o echo_test -Os -DNDEBUG \
     -I/usr/local/opt/openssl/include -L/usr/local/opt/openssl/lib
+clang bench.c libchirp.c \
+    -luv -lssl -lcrypto -lm -lpthread -o bench -Os -DNDEBUG \
+    -I/usr/local/opt/openssl/include -L/usr/local/opt/openssl/lib
 pytest || exit 1
+LIBCHIRP_COMPRESSION=True python3 libchirp_cffi.py
+LIBCHIRP_COMPRESSION=True pytest || exit 1
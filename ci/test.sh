@@ -4,10 +4,14 @@ set -e
 
 cd /outside
 apk update
-apk add --no-progress gcc musl-dev py3-cffi python3-dev libuv-dev libressl-dev
+apk add --no-progress gcc musl-dev py3-cffi python3-dev libuv-dev libressl-dev \
+    lz4-dev
 pip3 install -r requirements.txt
 gcc echo_test.c libchirp.c \
     -pthread -luv -lssl -lcrypto -lm -lpthread -lrt -o echo_test -Os -DNDEBUG
+gcc bench.c libchirp.c \
+    -pthread -luv -lssl -lcrypto -lm -lpthread -lrt -o bench -Os -DNDEBUG
+./bench -n 200 -s 64,4000 -c 1,2
 python3 libchirp_cffi.py
 python3 -m pytest
 gcc echo_test.c libchirp.c \
@@ -15,4 +19,9 @@ gcc echo_test.c libchirp.c \
     -DCH_ENABLE_ASSERTS -DCH_ENABLE_LOGGING
 python3 libchirp_cffi.py debug
 python3 -m pytest
+gcc echo_test.c libchirp.c \
+    -pthread -luv -lssl -lcrypto -llz4 -lm -lpthread -lrt -o echo_test -O0 \
+    -DCH_ENABLE_ASSERTS -DCH_ENABLE_LOGGING -DCH_ENABLE_COMPRESSION
+LIBCHIRP_COMPRESSION=True python3 libchirp_cffi.py debug
+LIBCHIRP_COMPRESSION=True python3 -m pytest
 flake8 --ignore=D107,E221 --exclude=examples/
@@ -52,30 +52,22 @@ class MyChirp(Chirp):
             print(e)
 
 
-    async def send_to_peer(self, peer, msg, remove_peers):
-        try:
-            await self.send(msg)
-        except Exception:
-            remove_peers.add(peer)
-
     async def update(self):
         while True:
             try:
                 info = get_info()
                 infos[info[0]] = info
                 print_info()
-                remove_peers = set()
-                wait = []
-                for peer in peers:
-                    info = random.choice(list(infos.values()))
-                    msg = Message()
-                    msg.port = config.PORT
-                    msg.address = peer
-                    msg.data = json.dumps(info).encode("UTF-8")
-                    wait.append(self.send_to_peer(peer, msg, remove_peers))
-                await asyncio.gather(*wait, return_exceptions=True)
-                for peer in remove_peers:
-                    peers.remove(peer)
+                info = random.choice(list(infos.values()))
+                msg = Message()
+                msg.data = json.dumps(info).encode("UTF-8")
+                send_peers = list(peers)
+                results = await self.multicast(
+                    msg, [(peer, config.PORT) for peer in send_peers]
+                )
+                for peer, error in zip(send_peers, results):
+                    if error is not None:
+                        peers.remove(peer)
                 remove_info = set()
                 now = time.time()
                 for info in infos.values():
@@ -53,6 +53,16 @@
 /* 16k */
 #define CH_ENC_BUFFER_SIZE 16384
 
+// .. c:macro:: CH_IDLE_BUFFER_SIZE
+//
+//    Size of the read buffer shared by idle connections, if
+//    :c:member:`ch_config_t.ADAPTIVE_BUFFERS` is enabled.
+//
+// .. code-block:: cpp
+
+/* 4k */
+#define CH_IDLE_BUFFER_SIZE 4096
+
 // .. c:macro:: CH_BF_PREALLOC_HEADER
 //
 //    Preallocated buffer size for header. If the header is bigger memory will
@@ -71,6 +81,25 @@
 
 #define CH_BF_PREALLOC_DATA 1024
 
+// .. c:macro:: CH_BF_SLAB_HIGH_WATER
+//
+//    Bytes the slab allocator caches for reuse, before freed buffers are
+//    returned to the system. Can be overridden in :c:type:`ch_config_t`.
+//
+// .. code-block:: cpp
+
+/* 4M */
+#define CH_BF_SLAB_HIGH_WATER 4194304
+
+// .. c:macro:: CH_COMPRESSION_THRESHOLD
+//
+//    Messages with less data are sent uncompressed. Can be overridden in
+//    :c:type:`ch_config_t`.
+//
+// .. code-block:: cpp
+
+#define CH_COMPRESSION_THRESHOLD 1024
+
 // .. c:macro:: CH_TCP_KEEPALIVE
 //
 //    TCP keep-alive time.
@@ -79,6 +108,15 @@
 
 #define CH_TCP_KEEPALIVE 60
 
+// .. c:macro:: CH_LOCAL_PATH
+//
+//    Format of the local socket path, the arguments are
+//    :c:member:`ch_config_t.LOCAL_DIR` and the port.
+//
+// .. code-block:: cpp
+
+#define CH_LOCAL_PATH "%s/libchirp-%d.sock"
+
 // .. c:macro:: CH_MAX_MSG_SIZE
 //
 //    Hard limit for message size.  Can be overridden in :c:type:`ch_config_t`.
@@ -87,6 +125,47 @@
 
 #define CH_MAX_MSG_SIZE 1024 * 1024 * 100 // 100M
 
+// .. c:macro:: CH_WR_MAX_BATCH
+//
+//    Maximum count of messages the writer coalesces into a single write. Also
+//    the default of :c:member:`ch_config_t.MAX_WRITE_BATCH`.
+//
+// .. code-block:: cpp
+
+#define CH_WR_MAX_BATCH 16
+
+// .. c:macro:: CH_WR_BATCH_BYTES
+//
+//    The writer stops adding messages to a batch once this many bytes
+//    (including the wire headers) are reached. A single message larger than
+//    this is always sent on its own.
+//
+// .. code-block:: cpp
+
+/* 64k */
+#define CH_WR_BATCH_BYTES 65536
+
+// .. c:macro:: CH_WR_CHUNK_SIZE
+//
+//    Recommended :c:member:`ch_config_t.CHUNK_SIZE` to enable streaming: Large
+//    enough to keep the overhead of the chunk frames small, small enough not
+//    to delay the messages interleaved with the chunks.
+//
+// .. code-block:: cpp
+
+/* 64k */
+#define CH_WR_CHUNK_SIZE 65536
+
+// .. c:macro:: CH_MAX_ACK_WINDOW
+//
+//    Maximum count of unacknowledged messages per remote in synchronous mode.
+//    Upper bound of :c:member:`ch_config_t.ACK_WINDOW`. Can't be more than 32,
+//    one bit per ack message is used.
+//
+// .. code-block:: cpp
+
+#define CH_MAX_ACK_WINDOW 32
+
 // .. c:macro:: CH_WITHOUT_TLS
 //
 //    Build chirp without SSL code. The functions from encryption.h become
@@ -96,6 +175,17 @@
 
 /* #define CH_WITHOUT_TLS */
 
+// .. c:macro:: CH_ENABLE_COMPRESSION
+//
+//    Build chirp with LZ4 message compression, see
+//    :c:member:`ch_config_t.COMPRESSION`. Requires liblz4 (lz4.h is not
+//    bundled). The python binding is built with it, if LIBCHIRP_COMPRESSION
+//    is set to True.
+//
+// .. code-block:: cpp
+
+/* #define CH_ENABLE_COMPRESSION */
+
 // .. c:macro:: CH_ENABLE_LOGGING
 //
 //    Logging is done via a macro which is disabled by default. You can enable
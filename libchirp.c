@@ -102,14 +102,13 @@ typedef enum {
     CH_UNINIT_ASYNC_DONE    = 1 << 3,
     CH_UNINIT_ASYNC_START   = 1 << 4,
     CH_UNINIT_ASYNC_SEND_TS = 1 << 5,
-    CH_UNINIT_SEND_TS_LOCK  = 1 << 6,
-    CH_UNINIT_ASYNC_RELE_TS = 1 << 7,
-    CH_UNINIT_RELE_TS_LOCK  = 1 << 8,
-    CH_UNINIT_SERVERV4      = 1 << 9,
-    CH_UNINIT_SERVERV6      = 1 << 10,
-    CH_UNINIT_TIMER_GC      = 1 << 11,
-    CH_UNINIT_TIMER_RECON   = 1 << 12,
-    CH_UNINIT_SIGNAL        = 1 << 13,
+    CH_UNINIT_ASYNC_RELE_TS = 1 << 6,
+    CH_UNINIT_SERVERV4      = 1 << 7,
+    CH_UNINIT_SERVERV6      = 1 << 8,
+    CH_UNINIT_TIMER_GC      = 1 << 9,
+    CH_UNINIT_TIMER_RECON   = 1 << 10,
+    CH_UNINIT_SIGNAL        = 1 << 11,
+    CH_UNINIT_SERVER_LOCAL  = 1 << 12,
 } ch_chirp_uninit_t;
 
 
@@ -318,6 +317,66 @@ typedef enum {
     static type ch_max_##type(type a, type b) { return (a > b) ? a : b; }      \
     static type ch_min_##type(type a, type b) { return (a < b) ? a : b; }
 
+// Atomic operations
+// =================
+//
+// Pointer-sized atomic operations used for the lock-free handoff between
+// threads. All of them are full barriers.
+//
+// .. c:function::
+static inline int
+ch_atomic_cas_ptr(void** ptr, void* expected, void* desired)
+//
+//    Set ``*ptr`` to ``desired`` if it is ``expected``.
+//
+//    :return: 1 if ``*ptr`` was replaced.
+//
+// .. code-block:: cpp
+//
+{
+#ifdef _MSC_VER
+    return InterlockedCompareExchangePointer(ptr, desired, expected) ==
+           expected;
+#else
+    return __atomic_compare_exchange_n(
+            ptr, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// .. c:function::
+static inline void*
+ch_atomic_load_ptr(void** ptr)
+//
+//    Read ``*ptr``.
+//
+// .. code-block:: cpp
+//
+{
+#ifdef _MSC_VER
+    return InterlockedCompareExchangePointer(ptr, NULL, NULL);
+#else
+    return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// .. c:function::
+static inline void*
+ch_atomic_xchg_ptr(void** ptr, void* value)
+//
+//    Set ``*ptr`` to ``value``.
+//
+//    :return: The previous value of ``*ptr``.
+//
+// .. code-block:: cpp
+//
+{
+#ifdef _MSC_VER
+    return InterlockedExchangePointer(ptr, value);
+#else
+    return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
 #endif // ch_common_h
 // =================
 // Queue / Stack 0.8
@@ -3383,6 +3442,53 @@ do { \
 #define ch_msg_next_m(x) (x)->_next
 qs_queue_bind_decl_cx_m(ch_msg, ch_message_t) CH_ALLOW_NL;
 
+// Lock-free handoff
+// =================
+//
+// Multi-producer/single-consumer stack used to hand messages from other
+// threads to the loop thread. Any thread pushes, the loop thread takes all
+// messages in one swap. It uses the same _next pointer as the queue, a
+// message can't be in both.
+//
+// .. c:function::
+int
+ch_msg_mpsc_push(ch_message_t** stack, ch_message_t* msg);
+//
+//    Push a message onto the stack. Thread-safe.
+//
+//    :param ch_message_t** stack: The stack to push to.
+//    :param ch_message_t* msg:    The message to push.
+//    :return: 1 if the stack was empty and the consumer has to be signalled,
+//             otherwise it is already signalled.
+//    :rtype:  int
+
+// .. c:function::
+int
+ch_msg_mpsc_push_batch(ch_message_t** stack, ch_message_t** msgs, size_t count);
+//
+//    Push ``count`` messages onto the stack with one atomic operation, the
+//    consumer takes them in array order. Thread-safe.
+//
+//    :param ch_message_t** stack: The stack to push to.
+//    :param ch_message_t** msgs:  The messages to push.
+//    :param size_t count:         Count of messages, at least one.
+//    :return: 1 if the stack was empty and the consumer has to be signalled,
+//             otherwise it is already signalled.
+//    :rtype:  int
+
+// .. c:function::
+ch_message_t*
+ch_msg_mpsc_take_all(ch_message_t** stack);
+//
+//    Take all messages from the stack, only called by the consumer (the loop
+//    thread). The messages are returned as a NULL-terminated list via _next
+//    in the order they were pushed. The consumer has to set _next to NULL
+//    before using a message.
+//
+//    :param ch_message_t** stack: The stack to take from.
+//    :return: The first message pushed or NULL.
+//    :rtype:  ch_message_t*
+
 // .. c:type:: ch_msg_type_t
 //
 //    Represents message type flags.
@@ -3395,12 +3501,37 @@ qs_queue_bind_decl_cx_m(ch_msg, ch_message_t) CH_ALLOW_NL;
 //
 //       Message is an ack.
 //
+//    .. c:member:: CH_MSG_COMPRESSED
+//
+//       The data of the message is compressed, only used on the wire.
+//
+//    .. c:member:: CH_MSG_STREAM
+//
+//       A frame of a streamed message, only used on the wire. The first frame
+//       contains the header and the size of the data, the following frames
+//       the chunks of the data.
+//
+//    .. c:member:: CH_MSG_PIN
+//
+//       Pin the remote, set by :c:func:`ch_chirp_connect_ts` and replaced by
+//       CH_MSG_NOOP before the message is queued. Never used on the wire.
+//
+//    .. c:member:: CH_MSG_FEATURES
+//
+//       A NOOP announcing the features of the node in its serial, see
+//       :c:type:`ch_sr_hs_flags_t`. Sent right after the handshake, nodes
+//       that do not know it handle it as NOOP.
+//
 // .. code-block:: cpp
 //
 typedef enum {
-    CH_MSG_REQ_ACK = 1 << 0,
-    CH_MSG_ACK     = 1 << 1,
-    CH_MSG_NOOP    = 1 << 2,
+    CH_MSG_REQ_ACK    = 1 << 0,
+    CH_MSG_ACK        = 1 << 1,
+    CH_MSG_NOOP       = 1 << 2,
+    CH_MSG_COMPRESSED = 1 << 3,
+    CH_MSG_STREAM     = 1 << 4,
+    CH_MSG_PIN        = 1 << 5,
+    CH_MSG_FEATURES   = 1 << 6,
 } ch_msg_types_t;
 
 // .. c:type:: ch_msg_flags_t
@@ -3437,6 +3568,11 @@ typedef enum {
 //       The message has a slot and therefore you have to call
 //       :c:func:`ch_chirp_release_msg_slot`
 //
+//    .. c:member:: CH_MSG_CONNECT
+//
+//       The message was passed to :c:func:`ch_chirp_connect_ts`, its type is
+//       kept.
+//
 // .. code-block:: cpp
 //
 typedef enum {
@@ -3448,6 +3584,7 @@ typedef enum {
     CH_MSG_FAILURE      = CH_MSG_ACK_RECEIVED | CH_MSG_WRITE_DONE,
     CH_MSG_HAS_SLOT     = 1 << 5,
     CH_MSG_SEND_ACK     = 1 << 6,
+    CH_MSG_CONNECT      = 1 << 7,
 } ch_msg_flags_t;
 
 #endif // ch_msg_message_h
@@ -3481,6 +3618,16 @@ ch_alloc(size_t size);
 //    Allocate fixed amount of memory.
 //
 //    :param size_t size: The amount of memory in bytes to allocate
+
+// .. c:function::
+void*
+ch_alloc_with(ch_alloc_cb_t alloc, size_t size);
+//
+//    Allocate fixed amount of memory using the given callback. If alloc is
+//    NULL the callback of :c:func:`ch_set_alloc_funcs` is used.
+//
+//    :param ch_alloc_cb_t alloc: Memory allocation callback or NULL
+//    :param size_t size: The amount of memory in bytes to allocate
 //
 // Debug alloc tracking
 // --------------------
@@ -3489,6 +3636,15 @@ ch_alloc(size_t size);
 
 #ifdef CH_ENABLE_ASSERTS
 // .. c:function::
+void*
+ch_at_alloc(void* buf);
+//
+//    Track a memory allocation. Used for memory not allocated by
+//    :c:func:`ch_alloc`, for example objects of a pool. Returns buf.
+//
+//    :param void* buf: Pointer to the buffer to track.
+//
+// .. c:function::
 int
 ch_at_allocated(void* buf);
 //
@@ -3509,6 +3665,14 @@ ch_at_cleanup(void);
 //
 //    Cleanup and print memory leak summary.
 //
+// .. c:function::
+void
+ch_at_free(void* buf);
+//
+//    Track a freed memory allocation, see :c:func:`ch_at_alloc`.
+//
+//    :param void* buf: Pointer to the buffer to track.
+//
 //
 #endif
 
@@ -3531,6 +3695,16 @@ ch_free(void* buf);
 //
 //    :param void* buf: The handle to free.
 
+// .. c:function::
+void
+ch_free_with(ch_free_cb_t free, void* buf);
+//
+//    Free a memory handle using the given callback. If free is NULL the
+//    callback of :c:func:`ch_set_alloc_funcs` is used.
+//
+//    :param ch_free_cb_t free: Callback to free memory or NULL
+//    :param void* buf: The handle to free.
+
 // .. c:function::
 int
 ch_is_local_addr(ch_text_address_t* addr);
@@ -3560,6 +3734,17 @@ ch_realloc(void* buf, size_t size);
 //    :param void* buf:    The handle to resize.
 //    :param size_t size:  The new size of the memory in bytes.
 
+// .. c:function::
+void*
+ch_realloc_with(ch_realloc_cb_t realloc, void* buf, size_t size);
+//
+//    Resize allocated memory using the given callback. If realloc is NULL the
+//    callback of :c:func:`ch_set_alloc_funcs` is used.
+//
+//    :param ch_realloc_cb_t realloc: Memory reallocation callback or NULL
+//    :param void* buf:    The handle to resize.
+//    :param size_t size:  The new size of the memory in bytes.
+
 // .. c:function::
 ch_error_t
 ch_textaddr_to_sockaddr(
@@ -3602,6 +3787,35 @@ ch_textaddr_to_sockaddr(
 // Declarations
 // ============
 
+// .. c:macro:: CH_PR_REMOTE_INDEX_SIZE
+//
+//    Initial size of the remote hash index. It grows by doubling once more
+//    than half of the entries are used.
+//
+// .. code-block:: cpp
+//
+#define CH_PR_REMOTE_INDEX_SIZE 64
+
+// .. c:macro:: CH_PR_GC_SLICE
+//
+//    Maximum count of expired remotes a garbage-collection tick visits. If
+//    more remotes expired, the next tick is scheduled right away, so large
+//    collections do not block the loop.
+//
+// .. code-block:: cpp
+//
+#define CH_PR_GC_SLICE 256
+
+// .. c:macro:: CH_PR_LOCAL_PATH_SIZE
+//
+//    Size of the buffer formatting :c:macro:`CH_LOCAL_PATH`, the unix domain
+//    socket path is limited to about 100 bytes. LOCAL_DIR must leave room
+//    for the name of the socket.
+//
+// .. code-block:: cpp
+//
+#define CH_PR_LOCAL_PATH_SIZE 104
+
 // .. c:type:: ch_protocol_t
 //
 //    Protocol object.
@@ -3622,10 +3836,49 @@ ch_textaddr_to_sockaddr(
 //
 //       Reference to the libuv tcp server handle, IPv6.
 //
+//    .. c:member:: uv_pipe_t server_local
+//
+//       Reference to the libuv pipe server handle, the local socket.
+//
+//    .. c:member:: char local_init
+//
+//       server_local has been initialized.
+//
+//    .. c:member:: char local_listen
+//
+//       Listening on the local socket, announced after the handshake.
+//
 //    .. c:member:: ch_remote_t* remotes
 //
 //       Pointer to tree of remotes. They can have a connection.
 //
+//    .. c:member:: ch_remote_t** remote_index
+//
+//       Hash index of the remotes in the tree, open addressing with linear
+//       probing. Used to lookup remotes on the send path. NULL until the
+//       first remote is inserted.
+//
+//    .. c:member:: uint32_t remote_index_size
+//
+//       Size of remote_index, a power of two.
+//
+//    .. c:member:: uint32_t remote_count
+//
+//       Count of remotes in remote_index.
+//
+//    .. c:member:: ch_remote_t* remotes_lru
+//
+//       List of the remotes in the tree ordered by timestamp, the least
+//       recently used first. Garbage-collection only visits expired remotes.
+//
+//    .. c:member:: ch_remote_t* remotes_lru_tail
+//
+//       The most recently used remote.
+//
+//    .. c:member:: ch_remote_t* pinned_remotes
+//
+//       List of the pinned remotes, garbage-collection keeps them alive.
+//
 //    .. c:member:: ch_remote_t* reconnect_remotes
 //
 //       A stack of remotes that should be reconnected after a timeout.
@@ -3657,7 +3910,16 @@ struct ch_protocol_s {
     struct sockaddr_in6 addrv6;
     uv_tcp_t            serverv4;
     uv_tcp_t            serverv6;
+    uv_pipe_t           server_local;
+    char                local_init;
+    char                local_listen;
     ch_remote_t*        remotes;
+    ch_remote_t**       remote_index;
+    uint32_t            remote_index_size;
+    uint32_t            remote_count;
+    ch_remote_t*        remotes_lru;
+    ch_remote_t*        remotes_lru_tail;
+    ch_remote_t*        pinned_remotes;
     ch_remote_t*        reconnect_remotes;
     uv_timer_t          reconnect_timeout;
     uv_timer_t          gc_timeout;
@@ -3669,17 +3931,45 @@ struct ch_protocol_s {
 // .. c:function::
 ch_error_t
 ch_pr_conn_start(
-        ch_chirp_t* chirp, ch_connection_t* conn, uv_tcp_t* client, int accept);
+        ch_chirp_t*      chirp,
+        ch_connection_t* conn,
+        uv_stream_t*     client,
+        int              accept);
 //
 //    Start the given connection
 //
 //    :param ch_chirp_t* chirp: Chirp object
 //    :param ch_connection_t* conn: Connection object
-//    :param uv_tcp_t* client: Client to start
+//    :param uv_stream_t* client: Client to start, a tcp or a pipe handle
 //    :param int accept: Is accepted connection
 //
 //    :return: Void since only called from callbacks.
 
+// .. c:function::
+void
+ch_pr_local_path(char* path, const char* dir, int port);
+//
+//    Format the path of the local socket of port, see
+//    :c:macro:`CH_LOCAL_PATH`.
+//
+//    :param char* path: Buffer of :c:macro:`CH_PR_LOCAL_PATH_SIZE` bytes
+//    :param char* dir: Directory of the socket, LOCAL_DIR
+//    :param int port: Port of the node
+//
+
+// .. c:function::
+int
+ch_pr_local_peer_ok(ch_chirp_t* chirp, uv_pipe_t* pipe);
+//
+//    Check that the peer connected to the local socket runs as the same
+//    user, using SO_PEERCRED or getpeereid().
+//
+//    :param ch_chirp_t* chirp: Chirp object
+//    :param uv_pipe_t* pipe: Connected pipe handle
+//    :return: 1 if the peer runs as the same user, else 0
+//    :rtype: int
+//
+
 // .. c:function::
 void
 ch_pr_close_free_remotes(ch_chirp_t* chirp, int only_conns);
@@ -3714,6 +4004,53 @@ ch_pr_decrypt_read(ch_connection_t* conn, int* stop);
 //
 #endif
 
+// .. c:function::
+void
+ch_pr_delete_remote(ch_protocol_t* protocol, ch_remote_t* remote);
+//
+//    Remove the remote from the remotes tree and the hash index.
+//
+//    :param ch_protocol_t* protocol: Protocol object
+//    :param ch_remote_t* remote: Remote to remove
+//
+
+// .. c:function::
+ch_remote_t*
+ch_pr_find_remote(ch_protocol_t* protocol, ch_remote_t* key);
+//
+//    Lookup the remote matching key (IP protocol, address and port) in the
+//    hash index.
+//
+//    :param ch_protocol_t* protocol: Protocol object
+//    :param ch_remote_t* key: Remote initialized as key
+//    :return: The remote or NULL if not found.
+//    :rtype:  ch_remote_t*
+//
+
+// .. c:function::
+ch_error_t
+ch_pr_insert_remote(ch_protocol_t* protocol, ch_remote_t* remote);
+//
+//    Insert the remote into the remotes tree and the hash index.
+//
+//    :param ch_protocol_t* protocol: Protocol object
+//    :param ch_remote_t* remote: Remote to insert
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+//
+
+// .. c:function::
+void
+ch_pr_pin_remote(ch_protocol_t* protocol, ch_remote_t* remote, int pin);
+//
+//    Pin or unpin the remote. Pinned remotes are not garbage-collected,
+//    instead a NOOP is sent after REUSE_TIME / 2, which also reconnects them.
+//
+//    :param ch_protocol_t* protocol: Protocol object
+//    :param ch_remote_t* remote: Remote to pin
+//    :param int pin: 1 to pin, 0 to unpin
+//
+
 // .. c:function::
 void
 ch_pr_reconnect_remotes_cb(uv_timer_t* handle);
@@ -3730,6 +4067,16 @@ ch_pr_restart_stream(ch_connection_t* conn);
 //
 //    :param ch_connection_t* conn: Connection to restart.
 
+// .. c:function::
+void
+ch_pr_touch_remote(ch_remote_t* remote, uint64_t now);
+//
+//    Set the timestamp of the remote and move it to the end of the
+//    garbage-collection list.
+//
+//    :param ch_remote_t* remote: Remote that was used
+//    :param uint64_t now: Current loop time
+
 // .. c:function::
 ch_error_t
 ch_pr_start(ch_protocol_t* protocol, uint16_t* uninit);
@@ -3844,6 +4191,46 @@ typedef enum {
     CH_EN_OP_SHUTDOWN  = 3,
 } ch_en_tls_ops_t;
 
+// .. c:macro:: CH_EN_SESSION_CACHE_SIZE
+//
+//    Count of TLS sessions cached for resumption, has to be a power of two.
+//    Remotes are mapped directly to a slot, colliding remotes replace each
+//    other's session.
+//
+// .. code-block:: cpp
+//
+#define CH_EN_SESSION_CACHE_SIZE 64
+
+// .. c:type:: ch_en_session_t
+//
+//    TLS session of outgoing connections to a remote. The cache outlives the
+//    remote, which gets garbage-collected together with its connection.
+//
+//    .. c:member:: uint8_t ip_protocol
+//
+//       What IP protocol (IPv4 or IPv6) the remote uses.
+//
+//    .. c:member:: uint8_t[16] address
+//
+//       IPv4/6 address of the remote.
+//
+//    .. c:member:: int32_t port
+//
+//       The public port of the remote.
+//
+//    .. c:member:: SSL_SESSION* session
+//
+//       The session, the cache owns a reference. NULL if the slot is free.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_en_session_s {
+    uint8_t      ip_protocol;
+    uint8_t      address[CH_IP_ADDR_SIZE];
+    int32_t      port;
+    SSL_SESSION* session;
+} ch_en_session_t;
+
 // .. c:type:: ch_encryption_t
 //
 //    Encryption object.
@@ -3852,13 +4239,46 @@ typedef enum {
 //
 //       reference back to chirp
 //
+//    .. c:member:: ch_en_session_t[CH_EN_SESSION_CACHE_SIZE] sessions
+//
+//       Sessions of outgoing connections, used for resumption.
+//
+//    .. c:member:: uint64_t handshakes_full
+//
+//       Count of TLS handshakes that negotiated a new session.
+//
+//    .. c:member:: uint64_t handshakes_resumed
+//
+//       Count of TLS handshakes that resumed a session.
+//
 // .. code-block:: cpp
 //
 typedef struct ch_encryption_s {
-    ch_chirp_t* chirp;
-    SSL_CTX*    ssl_ctx;
+    ch_chirp_t*     chirp;
+    SSL_CTX*        ssl_ctx;
+    ch_en_session_t sessions[CH_EN_SESSION_CACHE_SIZE];
+    uint64_t        handshakes_full;
+    uint64_t        handshakes_resumed;
 } ch_encryption_t;
 
+// .. c:function::
+SSL_SESSION*
+ch_en_find_session(
+        ch_encryption_t* enc,
+        uint8_t          ip_protocol,
+        const uint8_t*   address,
+        int32_t          port);
+//
+//    Find the cached TLS session of a remote.
+//
+//    :param ch_encryption_t* enc: Pointer to a encryption object
+//    :param uint8_t ip_protocol: IP protocol of the remote
+//    :param const uint8_t* address: Address of the remote
+//    :param int32_t port: Port of the remote
+//
+//   :return: The session or NULL. The cache keeps the reference.
+//   :rtype:  SSL_SESSION*
+
 // .. c:function::
 ch_error_t
 ch_en_start(ch_encryption_t* enc);
@@ -3932,10 +4352,34 @@ ch_en_init(ch_chirp_t* chirp, ch_encryption_t* enc);
 //
 //       Indicates that the remote has been garbage-collected
 //
+//    .. c:member:: CH_RM_CONNECTED
+//
+//       The remote had a connection, the next one is a reconnect
+//
+//    .. c:member:: CH_RM_LOCAL
+//
+//       The remote announced its local socket after a handshake over TCP, the
+//       next connection uses the local socket. Cleared if connecting to it
+//       fails.
+//
+//    .. c:member:: CH_RM_PINNED
+//
+//       The remote is not garbage-collected, its connection is kept alive,
+//       see :c:func:`ch_chirp_connect_ts`.
+//
+//    .. c:member:: CH_RM_QUEUE_FULL
+//
+//       A send failed, because the queue reached the high watermark, see
+//       :c:member:`ch_config_t.MAX_QUEUE_MSGS`.
+//
 // .. code-block:: cpp
 
 typedef enum {
     CH_RM_CONN_BLOCKED = 1 << 0,
+    CH_RM_CONNECTED    = 1 << 1,
+    CH_RM_LOCAL        = 1 << 2,
+    CH_RM_PINNED       = 1 << 3,
+    CH_RM_QUEUE_FULL   = 1 << 4,
 } ch_rm_flags_t;
 
 // .. c:type:: ch_remote_t
@@ -3963,15 +4407,38 @@ typedef enum {
 //       connection to NULL has to notify the user. So callbacks can safely
 //       abort if conn is NULL.
 //
-//    .. c:member:: ch_message_t* msg_queue
+//    .. c:member:: ch_message_t*[CH_MSG_PRIORITIES] msg_queue
+//
+//       Queues of messages, one per priority. See
+//       :c:func:`ch_msg_set_priority`.
+//
+//    .. c:member:: uint32_t queue_msgs
+//
+//       Count of messages in msg_queue.
 //
-//       Queue of messages.
+//    .. c:member:: uint32_t queue_bytes
+//
+//       Bytes of header and data in msg_queue.
 //
 //    .. c:member:: ch_message_t* cntl_msg_queue
 //
-//       Queue of ack/noop messages. There can max be two acks plus a noop
-//       in the queue, one ack from the current (new) connection and one the
-//       old connection and noop from the remote.
+//       Queue of ack/noop messages. There can be one ack per message waiting
+//       for an ack on the current (new) and the old connection plus a noop
+//       from the remote.
+//
+//    .. c:member:: ch_message_t*[CH_MAX_ACK_WINDOW] wait_ack_messages
+//
+//       Messages sent in synchronous mode waiting for their ACK, in the order
+//       they were sent. See :c:member:`ch_config_t.ACK_WINDOW`.
+//
+//    .. c:member:: uint32_t[CH_MAX_ACK_WINDOW] wait_ack_times
+//
+//       Loop time (truncated) when the write of each message in
+//       wait_ack_messages started.
+//
+//    .. c:member:: uint8_t wait_ack_count
+//
+//       Count of messages in wait_ack_messages.
 //
 //    .. c:member:: ch_chirp_t* chirp
 //
@@ -3990,6 +4457,22 @@ typedef enum {
 //       Timestamp when the connection was last used. Used to determine
 //       garbage-collection.
 //
+//    .. c:member:: uint32_t hash
+//
+//       Hash of IP protocol, address and port, used by the remote index.
+//
+//    .. c:member:: ch_remote_t* lru_prev
+//
+//       Previous (less recently used) remote in the garbage-collection list.
+//
+//    .. c:member:: ch_remote_t* lru_next
+//
+//       Next (more recently used) remote in the garbage-collection list.
+//
+//    .. c:member:: ch_remote_t* pinned_next
+//
+//       Next remote in the list of pinned remotes.
+//
 //    .. c:member:: char color
 //
 //       rbtree member
@@ -4018,13 +4501,21 @@ struct ch_remote_s {
     int32_t          port;
     ch_connection_t* conn;
     ch_message_t*    noop;
-    ch_message_t*    msg_queue;
+    ch_message_t*    msg_queue[CH_MSG_PRIORITIES];
+    uint32_t         queue_msgs;
+    uint32_t         queue_bytes;
     ch_message_t*    cntl_msg_queue;
-    ch_message_t*    wait_ack_message;
+    ch_message_t*    wait_ack_messages[CH_MAX_ACK_WINDOW];
+    uint32_t         wait_ack_times[CH_MAX_ACK_WINDOW];
+    uint8_t          wait_ack_count;
     ch_chirp_t*      chirp;
     uint32_t         serial;
     uint8_t          flags;
     uint64_t         timestamp;
+    uint32_t         hash;
+    ch_remote_t*     lru_prev;
+    ch_remote_t*     lru_next;
+    ch_remote_t*     pinned_next;
     char             color;
     ch_remote_t*     parent;
     ch_remote_t*     left;
@@ -4039,6 +4530,18 @@ struct ch_remote_s {
 //
 #define ch_rm_cmp_m(x, y) ch_remote_cmp(x, y)
 
+// .. c:function::
+int
+ch_remote_cmp(ch_remote_t* x, ch_remote_t* y);
+//
+//    Compare operator for remotes.
+//
+//    :param ch_remote_t* x: First remote instance to compare
+//    :param ch_remote_t* y: Second remote instance to compare
+//    :return: 0 if equal, see :c:func:`ch_remote_cmp`
+//    :rtype: int
+//
+
 // stack prototypes
 // ----------------
 //
@@ -4048,6 +4551,19 @@ qs_stack_bind_decl_m(ch_rm_st, ch_remote_t) CH_ALLOW_NL;
 
 rb_bind_decl_m(ch_rm, ch_remote_t) CH_ALLOW_NL;
 
+// .. c:function::
+uint32_t
+ch_rm_hash(uint8_t ip_protocol, const uint8_t* address, int32_t port);
+//
+//    Calculate the hash (FNV-1a) of IP protocol, address and port, the fields
+//    compared by :c:func:`ch_remote_cmp`.
+//
+//    :param uint8_t ip_protocol: AF_INET or AF_INET6
+//    :param uint8_t* address: IPv4/6 address
+//    :param int32_t port: Port
+//    :return: The hash
+//    :rtype: uint32_t
+
 // .. c:function::
 void
 ch_rm_init_from_msg(
@@ -4071,19 +4587,70 @@ ch_rm_init_from_conn(
 //    :param ch_remote_t*   remote: Remote to initialize
 //    :param ch_connection_t* conn: Connection to initialize from
 //    :param int               key: Used as a key only
+
+// .. c:function::
+ch_message_t**
+ch_rm_msg_queue(ch_remote_t* remote);
+//
+//    Get the message queue with the highest priority that isn't empty.
+//
+//    :param ch_remote_t* remote: Remote to get the queue from
+//    :return: Pointer to the queue or NULL if all queues are empty
+//    :rtype: ch_message_t**
 //
 // .. c:function::
 void
-ch_rm_free(ch_remote_t* remote);
+ch_rm_check_drain(ch_remote_t* remote);
 //
-//    Free the remote data-structure.
+//    Call the drain callback, if the full queue of the remote or of chirp
+//    dropped to the low watermark.
 //
-//    :param ch_remote_t* remote: Remote to initialize
+//    :param ch_remote_t* remote: Remote messages were removed from
 //
-// .. code-block:: cpp
+// .. c:function::
+void
+ch_rm_msg_dequeued(ch_remote_t* remote, ch_message_t* msg);
 //
-#endif // ch_remote_h
-// =================
+//    Count a message removed from msg_queue. The drain callback is called
+//    by :c:func:`ch_rm_check_drain`, once the writer is in a consistent state.
+//
+//    :param ch_remote_t* remote: Remote the message was queued on
+//    :param ch_message_t* msg: The message removed
+//
+// .. c:function::
+void
+ch_rm_msg_queued(ch_remote_t* remote, ch_message_t* msg);
+//
+//    Count a message added to msg_queue.
+//
+//    :param ch_remote_t* remote: Remote the message is queued on
+//    :param ch_message_t* msg: The message added
+//
+// .. c:function::
+int
+ch_rm_queue_full(ch_remote_t* remote, ch_message_t* msg);
+//
+//    Check if the message would exceed the high watermarks of the queue of
+//    the remote or of chirp, see :c:member:`ch_config_t.MAX_QUEUE_MSGS`.
+//    Marks the full queue, so the drain callback is called.
+//
+//    :param ch_remote_t* remote: Remote the message is sent to
+//    :param ch_message_t* msg: The message to send
+//    :return: 1 if the queue is full
+//    :rtype: int
+//
+// .. c:function::
+void
+ch_rm_free(ch_remote_t* remote);
+//
+//    Free the remote data-structure.
+//
+//    :param ch_remote_t* remote: Remote to initialize
+//
+// .. code-block:: cpp
+//
+#endif // ch_remote_h
+// =================
 // Serializer header
 // =================
 //
@@ -4133,8 +4700,81 @@ typedef struct ch_sr_handshake_s {
     uint8_t  identity[CH_ID_SIZE];
 } ch_sr_handshake_t;
 
+// .. c:type:: ch_sr_hs_flags_t
+//
+//    Feature flags announced by a CH_MSG_FEATURES NOOP after the handshake.
+//    The handshake itself keeps its size, so nodes without features can still
+//    connect.
+//
+//    .. c:member:: CH_SR_HS_COMPRESSION
+//
+//       Compression is enabled on the node, it can decompress messages.
+//
+//    .. c:member:: CH_SR_HS_STREAMING
+//
+//       The node can receive streamed messages.
+//
+//    .. c:member:: CH_SR_HS_LOCAL
+//
+//       The node listens on the local socket of its port.
+//
+//    .. c:member:: CH_SR_HS_ACKS
+//
+//       The node can receive coalesced ACKs: An ACK whose data contains the
+//       identities of further messages acknowledged, see
+//       :c:member:`ch_config_t.ACK_COALESCE`.
+//
+//    The bits from :c:macro:`CH_SR_HS_WINDOW_SHIFT` on contain the ACK_WINDOW
+//    of the node, if it is SYNCHRONOUS, else 0.
+//
+// .. code-block:: cpp
+//
+typedef enum {
+    CH_SR_HS_COMPRESSION = 1 << 0,
+    CH_SR_HS_STREAMING   = 1 << 1,
+    CH_SR_HS_LOCAL       = 1 << 2,
+    CH_SR_HS_ACKS        = 1 << 3,
+} ch_sr_hs_flags_t;
+
+// .. c:macro:: CH_SR_HS_WINDOW_SHIFT
+//
+//    Position of the ACK_WINDOW in the feature flags. A receiver does not
+//    coalesce more ACKs than the sender sends before it waits for them.
+//
+// .. code-block:: cpp
+//
+#define CH_SR_HS_WINDOW_SHIFT 8
+
 #define CH_SR_WIRE_MESSAGE_SIZE 27
 
+// .. c:macro:: CH_SR_ACKS_SIZE
+//
+//    Maximum size of the data of a coalesced ACK. The identity of the wire
+//    message is acknowledged and each CH_ID_SIZE bytes of the data are the
+//    identity of another message acknowledged.
+//
+// .. code-block:: cpp
+//
+#define CH_SR_ACKS_SIZE ((CH_MAX_ACK_WINDOW - 1) * CH_ID_SIZE)
+
+// .. c:macro:: CH_SR_COMPRESSED_PREFIX
+//
+//    The data of a compressed message starts with the size of the
+//    uncompressed data (uint32_t in network order).
+//
+// .. code-block:: cpp
+//
+#define CH_SR_COMPRESSED_PREFIX 4
+
+// .. c:macro:: CH_SR_STREAM_PREFIX
+//
+//    The data of the first frame of a streamed message is the size of the
+//    data (uint32_t in network order).
+//
+// .. code-block:: cpp
+//
+#define CH_SR_STREAM_PREFIX 4
+
 #ifdef CH_ENABLE_ASSERTS
 #define CH_SR_WIRE_MESSAGE_CHECK                                               \
     pos += 1;                                                                  \
@@ -4185,13 +4825,37 @@ ch_sr_msg_to_buf(ch_message_t* msg, ch_buf* buf, uint32_t msg_serial);
 //                        CH_SR_WIRE_MESSAGE_SIZE
 //    :param uint32_t msg_serial: Serial of the message
 //
+
+// .. c:function::
+void
+ch_sr_compressed_to_buf(ch_buf* buf, uint32_t compressed_len);
+//
+//    Mark a wire message serialized by :c:func:`ch_sr_msg_to_buf` as
+//    compressed and set the size of the compressed data.
+//
+//    :param ch_buf* buf: Pointer to the packed buffer of at least
+//                        CH_SR_WIRE_MESSAGE_SIZE
+//    :param uint32_t compressed_len: Size of the compressed data including
+//                                    CH_SR_COMPRESSED_PREFIX
+
+// .. c:function::
+void
+ch_sr_stream_to_buf(ch_buf* buf, uint16_t header_len, uint32_t data_len);
+//
+//    Mark a wire message serialized by :c:func:`ch_sr_msg_to_buf` as frame of
+//    a streamed message and set the sizes of the frame.
+//
+//    :param ch_buf* buf: Pointer to the packed buffer of at least
+//                        CH_SR_WIRE_MESSAGE_SIZE
+//    :param uint16_t header_len: Size of the header in the frame
+//    :param uint32_t data_len: Size of the data in the frame
+//
 // .. code-block:: cpp
 
 #define CH_SR_HANDSHAKE_SIZE 18
 
 #ifdef CH_ENABLE_ASSERTS
 #define CH_SR_HANDSHAKE_CHECK                                                  \
-    pos += CH_ID_SIZE;                                                         \
     A(pos == CH_SR_HANDSHAKE_SIZE, "Bad handshake serialization size");
 #else
 #define CH_SR_HANDSHAKE_CHECK
@@ -4203,6 +4867,7 @@ ch_sr_msg_to_buf(ch_message_t* msg, ch_buf* buf, uint32_t msg_serial);
     pos += 2;                                                                  \
                                                                                \
     uint8_t* identity = (void*) &buf[pos];                                     \
+    pos += CH_ID_SIZE;                                                         \
     CH_SR_HANDSHAKE_CHECK
 
 // .. c:function::
@@ -4251,6 +4916,26 @@ ch_sr_hs_to_buf(ch_sr_handshake_t* hs, ch_buf* buf);
 /* #include "libchirp/message.h" */
 /* #include "serializer.h" */
 
+// .. c:macro:: CH_WR_MAX_BUFS
+//
+//    Maximum count of buffers written at once: A wire message, header and data
+//    per message of a batch. A message with a list of buffers is always
+//    allowed, see :c:func:`ch_msg_set_data_iov`.
+//
+// .. code-block:: cpp
+//
+#define CH_WR_MAX_BUFS (CH_WR_MAX_BATCH * 3 + CH_MSG_MAX_IOV)
+
+// .. c:macro:: CH_WR_CHUNK_BUFS
+//
+//    Maximum count of buffers of a chunk of a streamed message, written after
+//    the batch: The first frame, header, the size of the data and the chunk
+//    frame, plus the data.
+//
+// .. code-block:: cpp
+//
+#define CH_WR_CHUNK_BUFS (3 + CH_MSG_MAX_IOV)
+
 // Declarations
 // ============
 //
@@ -4268,24 +4953,63 @@ ch_sr_hs_to_buf(ch_sr_handshake_t* hs, ch_buf* buf);
 //    .. c:member:: uv_timer_t send_timeout
 //
 //       Libuv timer handle for setting a timeout when trying to send a
-//       message. At the end of the defined timeout time, the timer triggers
-//       the :c:func:`_ch_wr_write_timeout_cb` callback.
+//       message. The timer is started when the writer becomes busy and
+//       re-armed by :c:func:`_ch_wr_write_timeout_cb` until deadline is
+//       reached.
 //
-//    .. c:member:: ch_message_t* msg
+//    .. c:member:: uint64_t deadline
+//
+//       Loop time when the last write times out: TIMEOUT after its start, 0
+//       if the writer is idle. The oldest message waiting for an ACK can time
+//       out earlier, see :c:func:`_ch_wr_write_timeout_cb`.
+//
+//    .. c:member:: ch_message_t* batch
+//
+//       Queue of the messages being written. The messages are dequeued from
+//       the remote by :c:func:`ch_wr_process_queues`, written by
+//       :c:func:`ch_wr_write` and finished in order during the callbacks.
+//
+//    .. c:member:: ch_buf[] net_msg
+//
+//       Used to serialize the wire messages of the batch to, one after
+//       another.
+//
+//    .. c:member:: ch_buf*[] compressed
+//
+//       Compressed data of the messages in the batch, NULL if the data of a
+//       message is sent as is. Freed once the batch is written.
+//
+//    .. c:member:: ch_message_t* stream
 //
-//       Pointer to a message. The message is set when sending through
-//       :c:func:`ch_wr_write` and being read again during the callbacks.
+//       The message being streamed in chunks or NULL. It is dequeued from the
+//       remote when streaming starts, and added to the batch with its last
+//       chunk.
 //
-//    .. c:member:: ch_msg_message_t net_msg
+//    .. c:member:: uint32_t stream_offset
 //
-//       Used to serialize the wire message to.
+//       Bytes of the data of the streamed message written so far.
+//
+//    .. c:member:: uint32_t stream_chunk
+//
+//       Size of the chunk being written, 0 if no chunk is being written.
+//
+//    .. c:member:: ch_buf[] stream_msg
+//
+//       Used to serialize the frames of the streamed message to: The first
+//       frame followed by the size of the data and the chunk frame.
 //
 // .. code-block:: cpp
 //
 typedef struct ch_writer_s {
     uv_timer_t    send_timeout;
-    ch_message_t* msg;
-    ch_buf        net_msg[CH_SR_WIRE_MESSAGE_SIZE];
+    uint64_t      deadline;
+    ch_message_t* batch;
+    ch_buf        net_msg[CH_SR_WIRE_MESSAGE_SIZE * CH_WR_MAX_BATCH];
+    ch_buf*       compressed[CH_WR_MAX_BATCH];
+    ch_message_t* stream;
+    uint32_t      stream_offset;
+    uint32_t      stream_chunk;
+    ch_buf stream_msg[CH_SR_WIRE_MESSAGE_SIZE * 2 + CH_SR_STREAM_PREFIX];
 } ch_writer_t;
 
 // .. c:function::
@@ -4297,6 +5021,15 @@ ch_wr_free(ch_writer_t* writer);
 //    :param ch_writer_t* writer: Pointer to writer (data-) structure.
 //
 
+// .. c:function::
+void
+ch_wr_enqueue_probe(ch_remote_t* remote);
+//
+//    Enqueue the NOOP of the remote, if it is not queued yet. Does not
+//    process the queues.
+//
+//    :param ch_remote_t* remote: The remote to probe
+
 // .. c:function::
 ch_error_t
 ch_wr_init(ch_writer_t* writer, ch_connection_t* conn);
@@ -4321,6 +5054,10 @@ ch_wr_process_queues(ch_remote_t* remote);
 //    3. Send messages that require an ack
 //    4. Do nothing
 //
+//    Up to :c:member:`ch_config_t.MAX_WRITE_BATCH` messages (or about
+//    :c:macro:`CH_WR_BATCH_BYTES`) are taken in this order and sent in a
+//    single write.
+//
 //    :param ch_remote_t* remote: The remote to process queues
 
 // .. c:function::
@@ -4342,14 +5079,16 @@ ch_wr_send_ts_cb(uv_async_t* handle);
 
 // .. c:function::
 void
-ch_wr_write(ch_connection_t* conn, ch_message_t* msg);
+ch_wr_write(ch_connection_t* conn);
 //
-//    Send the message after a connection has been established.
+//    Send the batch of the writer after a connection has been established.
+//    The wire messages of all messages in the batch are serialized and
+//    written together with their headers and data in a single
+//    :c:func:`ch_cn_write`.
 //
-//    :param ch_connection_t* conn:  Connection to send the message over.
-//    :param ch_message_t msg:       The message to send. The memory of the
-//                                   message must stay valid until the callback
-//                                   is called.
+//    :param ch_connection_t* conn:  Connection to send the batch over. The
+//                                   memory of the messages must stay valid
+//                                   until the callback is called.
 
 #endif // ch_writer_h
 // =============
@@ -4376,6 +5115,182 @@ ch_wr_write(ch_connection_t* conn, ch_message_t* msg);
 // Declarations
 // ============
 
+// .. c:type:: ch_bf_shared_t
+//
+//    Reference counted read buffer. Messages received in one piece point
+//    into the buffer instead of copying header and data. The data follows the
+//    structure, see :c:macro:`ch_bf_shared_data`.
+//
+//    .. c:member:: unsigned int refcnt
+//
+//       Reference count, one for the connection and one for each message
+//       pointing into the buffer.
+//
+//    .. c:member:: size_t size
+//
+//       Size of the data.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_bf_shared_s {
+    unsigned int refcnt;
+    size_t       size;
+} ch_bf_shared_t;
+
+// .. c:macro:: ch_bf_shared_data
+//
+//    Get the data of a :c:type:`ch_bf_shared_t`.
+//
+// .. code-block:: cpp
+//
+#define ch_bf_shared_data(shared) ((ch_buf*) ((shared) + 1))
+
+// .. c:macro:: CH_BF_SLAB_MIN_CLASS
+//
+//    Smallest size class of the slab allocator: 1 << 6 = 64 bytes.
+//
+// .. c:macro:: CH_BF_SLAB_MAX_CLASS
+//
+//    Largest size class of the slab allocator: 1 << 20 = 1M. Larger buffers
+//    are allocated and freed directly.
+//
+// .. code-block:: cpp
+//
+#define CH_BF_SLAB_MIN_CLASS 6
+#define CH_BF_SLAB_MAX_CLASS 20
+#define CH_BF_SLAB_CLASSES (CH_BF_SLAB_MAX_CLASS - CH_BF_SLAB_MIN_CLASS + 1)
+
+// .. c:type:: ch_bf_block_t
+//
+//    Header in front of each buffer allocated by the slab allocator.
+//
+//    .. c:member:: struct ch_bf_slab_s* slab
+//
+//       The slab the buffer belongs to.
+//
+//    .. c:member:: struct ch_bf_block_s* next
+//
+//       Next free block of the size class, while the block is cached.
+//
+//    .. c:member:: size_t cls
+//
+//       Size class of the block, while the block is used.
+//       CH_BF_SLAB_CLASSES if the buffer is larger than the largest class.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_bf_block_s {
+    struct ch_bf_slab_s* slab;
+    union {
+        struct ch_bf_block_s* next;
+        size_t                cls;
+    };
+} ch_bf_block_t;
+
+// .. c:type:: ch_bf_slab_t
+//
+//    Slab allocator of a chirp instance with power-of-two size classes. Backs
+//    the header and data buffers of received messages that do not fit into
+//    the slot. Freed buffers are kept in a free list per size class, as long
+//    as less than high_water bytes are cached. The slots are allocated
+//    directly, an array of 16 slots would waste most of the 32k class.
+//
+//    .. c:member:: unsigned int refcnt
+//
+//       Reference count, one for chirp and one for each buffer in use.
+//
+//    .. c:member:: size_t high_water
+//
+//       Above this many cached bytes, freed buffers are returned to the
+//       system.
+//
+//    .. c:member:: size_t cached
+//
+//       Bytes currently kept in the free lists.
+//
+//    .. c:member:: ch_bf_block_t* free[CH_BF_SLAB_CLASSES]
+//
+//       Free lists per size class.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_bf_slab_s {
+    unsigned int   refcnt;
+    size_t         high_water;
+    size_t         cached;
+    ch_bf_block_t* free[CH_BF_SLAB_CLASSES];
+} ch_bf_slab_t;
+
+// .. c:macro:: CH_BF_OBJECTS_CHUNK
+//
+//    Count of objects an object pool allocates at once.
+//
+// .. c:macro:: CH_BF_OBJECTS_ALIGN
+//
+//    Alignment of the objects of an object pool.
+//
+// .. code-block:: cpp
+//
+#define CH_BF_OBJECTS_CHUNK 16
+#define CH_BF_OBJECTS_ALIGN 16
+
+// .. c:type:: ch_bf_object_t
+//
+//    Link of a free object and of the allocated chunks of an object pool.
+//
+//    .. c:member:: struct ch_bf_object_s* next
+//
+//       The next free object or chunk.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_bf_object_s {
+    struct ch_bf_object_s* next;
+} ch_bf_object_t;
+
+// .. c:type:: ch_bf_objects_t
+//
+//    Pool of fixed-size objects of a chirp instance, used for remotes and
+//    connections. Objects are allocated in chunks of
+//    :c:macro:`CH_BF_OBJECTS_CHUNK` and freed objects are kept in a free list.
+//    The chunks are only returned when the pool is reset, which happens in
+//    bulk when chirp is closed.
+//
+//    .. c:member:: size_t size
+//
+//       Size of an object, aligned to :c:macro:`CH_BF_OBJECTS_ALIGN`.
+//
+//    .. c:member:: uint32_t used
+//
+//       Count of objects in use.
+//
+//    .. c:member:: ch_bf_object_t* free
+//
+//       List of free objects.
+//
+//    .. c:member:: ch_bf_object_t* chunks
+//
+//       List of the allocated chunks.
+//
+//    .. c:member:: ch_alloc_cb_t alloc_cb
+//
+//       Allocator of the chunks, NULL for the process-wide allocator.
+//
+//    .. c:member:: ch_free_cb_t free_cb
+//
+//       Callback to free the chunks, NULL for the process-wide allocator.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_bf_objects_s {
+    size_t          size;
+    uint32_t        used;
+    ch_bf_object_t* free;
+    ch_bf_object_t* chunks;
+    ch_alloc_cb_t   alloc_cb;
+    ch_free_cb_t    free_cb;
+} ch_bf_objects_t;
+
 // .. c:type:: ch_bf_slot_t
 //
 //    Preallocated buffer for a chirp message-slot.
@@ -4392,6 +5307,14 @@ ch_wr_write(ch_connection_t* conn, ch_message_t* msg);
 //
 //       Preallocated buffer for the data.
 //
+//    .. c:member:: ch_bf_shared_t* shared
+//
+//       Read buffer the header and data of the message point into or NULL.
+//
+//    .. c:member:: struct ch_bf_slot_s* next
+//
+//       Next free slot of a :c:type:`ch_bf_chirp_pool_t`.
+//
 //    .. c:member:: uint8_t id
 //
 //       Identifier of the buffer.
@@ -4403,13 +5326,73 @@ ch_wr_write(ch_connection_t* conn, ch_message_t* msg);
 // .. code-block:: cpp
 //
 typedef struct ch_bf_slot_s {
-    ch_message_t msg;
-    ch_buf       header[CH_BF_PREALLOC_HEADER];
-    ch_buf       data[CH_BF_PREALLOC_DATA];
-    uint8_t      id;
-    uint8_t      used;
+    ch_message_t    msg;
+    ch_buf          header[CH_BF_PREALLOC_HEADER];
+    ch_buf          data[CH_BF_PREALLOC_DATA];
+    ch_bf_shared_t*      shared;
+    struct ch_bf_slot_s* next;
+    uint8_t              id;
+    uint8_t              used;
 } ch_bf_slot_t;
 
+// .. c:type:: ch_bf_flags_t
+//
+//    Flags of a buffer pool.
+//
+//    .. c:member:: CH_BF_LIMITED
+//
+//       The connection was refused a slot, because it reached its share of the
+//       chirp pool. It is restarted when it releases a slot.
+//
+// .. code-block:: cpp
+//
+typedef enum {
+    CH_BF_LIMITED = 1 << 0,
+} ch_bf_flags_t;
+
+// .. c:type:: ch_bf_chirp_pool_t
+//
+//    Slots shared by all connections of a chirp instance, see
+//    :c:member:`ch_config_t.SHARED_SLOTS`. Slots are allocated on demand and
+//    kept in a free list, so memory depends on the messages in flight, not on
+//    the count of connections.
+//
+//    .. c:member:: unsigned int refcnt
+//
+//       Reference count, one for chirp and one for each connection pool.
+//
+//    .. c:member:: uint32_t max_slots
+//
+//       The maximum number of slots.
+//
+//    .. c:member:: uint32_t alloc_slots
+//
+//       How many slots are allocated.
+//
+//    .. c:member:: uint32_t active
+//
+//       How many connections currently use slots. The slots are shared evenly
+//       between these connections.
+//
+//    .. c:member:: ch_bf_slot_t* free_list
+//
+//       Slots that are allocated but not used.
+//
+//    .. c:member:: struct ch_buffer_pool_s* wait_queue
+//
+//       Connection pools waiting for a slot to be released.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_bf_chirp_pool_s {
+    unsigned int             refcnt;
+    uint32_t                 max_slots;
+    uint32_t                 alloc_slots;
+    uint32_t                 active;
+    ch_bf_slot_t*            free_list;
+    struct ch_buffer_pool_s* wait_queue;
+} ch_bf_chirp_pool_t;
+
 // .. c:type:: ch_buffer_pool_t
 //
 //    Contains the preallocated buffers for the chirp message-slot.
@@ -4418,11 +5401,11 @@ typedef struct ch_bf_slot_s {
 //
 //       Reference count
 //
-//    .. c:member:: uint8_t max_slots
+//    .. c:member:: uint32_t max_slots
 //
 //       The maximum number of buffers (slots).
 //
-//    .. c:member:: uint8_t used_slots
+//    .. c:member:: uint32_t used_slots
 //
 //       How many slots are currently used.
 //
@@ -4430,26 +5413,48 @@ typedef struct ch_bf_slot_s {
 //
 //       Bit mask of slots that are currently free (and therefore may be used).
 //
+//    .. c:member:: uint8_t flags
+//
+//       Flags of the pool, see :c:type:`ch_bf_flags_t`.
+//
 //    .. c:member:: ch_bf_slot_t* slots
 //
 //       Pointer of type ch_bf_slot_t to the actual slots. See
-//       :c:type:`ch_bf_slot_t`.
+//       :c:type:`ch_bf_slot_t`. NULL if the slots are taken from chirp_pool.
 //
 //    .. c:member:: ch_connection_t*
 //
 //       Pointer to connection that owns the pool
 //
+//    .. c:member:: ch_bf_chirp_pool_t* chirp_pool
+//
+//       Pool of the chirp instance the slots are taken from or NULL.
+//
+//    .. c:member:: struct ch_buffer_pool_s* next
+//
+//       Next pool in the wait_queue of the chirp_pool. NULL if not waiting.
+//
 // .. code-block:: cpp
 //
 typedef struct ch_buffer_pool_s {
-    unsigned int     refcnt;
-    uint8_t          max_slots;
-    uint8_t          used_slots;
-    uint32_t         free_slots;
-    ch_bf_slot_t*    slots;
-    ch_connection_t* conn;
+    unsigned int             refcnt;
+    uint32_t                 max_slots;
+    uint32_t                 used_slots;
+    uint32_t                 free_slots;
+    uint8_t                  flags;
+    ch_bf_slot_t*            slots;
+    ch_connection_t*         conn;
+    ch_bf_chirp_pool_t*      chirp_pool;
+    struct ch_buffer_pool_s* next;
 } ch_buffer_pool_t;
 
+// Queue declarations
+// ==================
+//
+// .. code-block:: cpp
+//
+qs_queue_bind_decl_m(ch_bf_wait, ch_buffer_pool_t) CH_ALLOW_NL;
+
 // .. c:function::
 void
 ch_bf_free(ch_buffer_pool_t* pool);
@@ -4461,52 +5466,237 @@ ch_bf_free(ch_buffer_pool_t* pool);
 
 // .. c:function::
 ch_error_t
-ch_bf_init(ch_buffer_pool_t* pool, ch_connection_t* conn, uint8_t max_slots);
+ch_bf_init(
+        ch_buffer_pool_t*   pool,
+        ch_connection_t*    conn,
+        uint32_t            max_slots,
+        ch_bf_chirp_pool_t* chirp_pool);
 //
-//    Initialize the given buffer pool structure using given max slots.
+//    Initialize the given buffer pool structure using given max slots. If
+//    chirp_pool is not NULL, no slots are allocated, they are taken from
+//    chirp_pool and max_slots is the limit of the connection.
 //
 //    :param ch_buffer_pool_t* pool: The buffer pool object
 //    :param ch_connection_t* conn: Connection that owns the pool
-//    :param uint8_t max_slots: Slots to allocate
+//    :param uint32_t max_slots: Slots to allocate
+//    :param ch_bf_chirp_pool_t* chirp_pool: Shared pool or NULL
 //
 
 // .. c:function::
-ch_bf_slot_t*
-ch_bf_acquire(ch_buffer_pool_t* pool);
+ch_bf_chirp_pool_t*
+ch_bf_chirp_pool_new(uint32_t max_slots);
 //
-//    Acquire and return a new buffer from the pool. If no slot can
-//    be reserved NULL is returned.
+//    Allocate a slot pool shared by the connections of a chirp instance.
 //
-//    :param ch_buffer_pool_t* pool: The buffer pool structure which the
-//                                   reservation shall be made from.
-//    :return: a pointer to a reserved buffer from the given buffer
-//            pool. See :c:type:`ch_bf_slot_t`
-//    :rtype:  ch_bf_slot_t
+//    :param uint32_t max_slots: The maximum number of slots.
+//    :return: The pool or NULL if out of memory.
+//    :rtype:  ch_bf_chirp_pool_t*
 //
+
 // .. c:function::
-static inline int
-ch_bf_is_exhausted(ch_buffer_pool_t* pool)
+ch_bf_slab_t*
+ch_bf_slab_new(size_t high_water);
 //
-//    Returns 1 if the pool is exhausted.
+//    Allocate a slab allocator with a reference count of one.
 //
-//    :param ch_buffer_pool_t* pool: The buffer pool object
+//    :param size_t high_water: Maximum of bytes cached in the free lists.
+//    :return: The slab or NULL if out of memory.
+//    :rtype:  ch_bf_slab_t*
 //
-// .. code-block:: cpp
+
+// .. c:function::
+void*
+ch_bf_slab_alloc(ch_bf_slab_t* slab, size_t size);
+//
+//    Allocate a buffer of at least size bytes from the slab. Takes the
+//    buffer from the free list of the size class if possible.
+//
+//    :param ch_bf_slab_t* slab: The slab
+//    :param size_t size: The amount of memory in bytes to allocate
+//    :return: The buffer or NULL if out of memory.
+//    :rtype:  void*
 //
-{
-    return pool->used_slots >= pool->max_slots;
-}
 
 // .. c:function::
 void
-ch_bf_release(ch_buffer_pool_t* pool, int id);
+ch_bf_slab_free(void* buf);
 //
-//    Set given slot as unused in the buffer pool structure and (re-)add it to
-//    the list of free slots.
+//    Free a buffer allocated by :c:func:`ch_bf_slab_alloc`. It is cached in
+//    the free list of its size class unless the slab reached its high-water
+//    mark or is closed.
 //
-//    :param int id: The id of the slot that should be marked free
+//    :param void* buf: The buffer to free
 //
-// .. code-block:: cpp
+
+// .. c:function::
+void
+ch_bf_slab_close(ch_bf_slab_t* slab);
+//
+//    Drop the reference of chirp and free the cached buffers. Buffers of
+//    outstanding messages keep the slab, it is freed once they are freed.
+//    Until then freed buffers are not cached anymore.
+//
+//    :param ch_bf_slab_t* slab: The slab
+//
+
+// .. c:function::
+void
+ch_bf_objects_init(
+        ch_bf_objects_t* objects,
+        size_t           size,
+        ch_alloc_cb_t    alloc_cb,
+        ch_free_cb_t     free_cb);
+//
+//    Initialize an empty object pool. Nothing is allocated until the first
+//    object is requested.
+//
+//    :param ch_bf_objects_t* objects: The object pool
+//    :param size_t size: Size of an object
+//    :param ch_alloc_cb_t alloc_cb: Allocator of the chunks or NULL
+//    :param ch_free_cb_t free_cb: Callback to free the chunks or NULL
+//
+
+// .. c:function::
+void*
+ch_bf_objects_alloc(ch_bf_objects_t* objects);
+//
+//    Take an object from the pool, allocates a new chunk if no object is
+//    free. The object is not initialized.
+//
+//    :param ch_bf_objects_t* objects: The object pool
+//    :return: The object or NULL if out of memory.
+//    :rtype:  void*
+//
+
+// .. c:function::
+void
+ch_bf_objects_free(ch_bf_objects_t* objects, void* obj);
+//
+//    Return an object to the free list of the pool.
+//
+//    :param ch_bf_objects_t* objects: The object pool
+//    :param void* obj: The object to return
+//
+
+// .. c:function::
+void
+ch_bf_objects_reset(ch_bf_objects_t* objects);
+//
+//    Free all chunks of the pool at once. All objects must have been returned,
+//    else an error is logged and the chunks are not freed.
+//
+//    :param ch_bf_objects_t* objects: The object pool
+//
+
+// .. c:function::
+void
+ch_bf_chirp_pool_free(ch_bf_chirp_pool_t* chirp_pool);
+//
+//    Decrement the reference count of the shared pool and free it and its
+//    slots if zero.
+//
+//    :param ch_bf_chirp_pool_t* chirp_pool: The shared pool
+//
+
+// .. c:function::
+void
+ch_bf_chirp_pool_close(ch_bf_chirp_pool_t* chirp_pool);
+//
+//    Drop the waiting connection pools and the reference of chirp. Called
+//    when chirp is closed.
+//
+//    :param ch_bf_chirp_pool_t* chirp_pool: The shared pool
+//
+
+// .. c:function::
+ch_bf_shared_t*
+ch_bf_shared_new(size_t size);
+//
+//    Allocate a read buffer of the given size with a reference count of one.
+//
+//    :param size_t size: Size of the data.
+//    :return: The read buffer or NULL if out of memory.
+//    :rtype:  ch_bf_shared_t*
+//
+
+// .. c:function::
+static inline void
+ch_bf_shared_ref(ch_bf_shared_t* shared)
+//
+//    Increment the reference count of the read buffer.
+//
+//    :param ch_bf_shared_t* shared: The read buffer
+//
+// .. code-block:: cpp
+//
+{
+    shared->refcnt += 1;
+}
+
+// .. c:function::
+void
+ch_bf_shared_free(ch_bf_shared_t* shared);
+//
+//    Decrement the reference count of the read buffer and free it if zero.
+//
+//    :param ch_bf_shared_t* shared: The read buffer
+//
+
+// .. c:function::
+ch_bf_slot_t*
+ch_bf_acquire(ch_buffer_pool_t* pool);
+//
+//    Acquire and return a new buffer from the pool. If no slot can
+//    be reserved NULL is returned.
+//
+//    :param ch_buffer_pool_t* pool: The buffer pool structure which the
+//                                   reservation shall be made from.
+//    :return: a pointer to a reserved buffer from the given buffer
+//            pool. See :c:type:`ch_bf_slot_t`
+//    :rtype:  ch_bf_slot_t
+//
+// .. c:function::
+static inline int
+ch_bf_is_exhausted(ch_buffer_pool_t* pool)
+//
+//    Returns 1 if the pool is exhausted. A connection using the shared pool
+//    is exhausted if it was refused a slot because of its limit.
+//
+//    :param ch_buffer_pool_t* pool: The buffer pool object
+//
+// .. code-block:: cpp
+//
+{
+    if (pool->chirp_pool != NULL) {
+        return pool->flags & CH_BF_LIMITED;
+    }
+    return pool->used_slots >= pool->max_slots;
+}
+
+// .. c:function::
+void
+ch_bf_release(ch_buffer_pool_t* pool, ch_bf_slot_t* slot_buf);
+//
+//    Set given slot as unused in the buffer pool structure and (re-)add it to
+//    the list of free slots.
+//
+//    :param ch_buffer_pool_t* pool: The buffer pool object
+//    :param ch_bf_slot_t* slot_buf: The slot that should be marked free
+//
+
+// .. c:function::
+ch_buffer_pool_t*
+ch_bf_take_waiter(ch_buffer_pool_t* pool);
+//
+//    After releasing a slot of the shared pool, get the next connection pool
+//    waiting for a slot. The caller has to restart the stream of its
+//    connection and call :c:func:`ch_bf_free` on it.
+//
+//    :param ch_buffer_pool_t* pool: The pool a slot was released to
+//    :return: A waiting pool with a connection or NULL.
+//    :rtype:  ch_buffer_pool_t*
+//
+// .. code-block:: cpp
 //
 #endif // ch_buffer_h
 // =============
@@ -4558,6 +5748,14 @@ ch_bf_release(ch_buffer_pool_t* pool, int id);
 //
 //       Read data.
 //
+//    .. c:member:: CH_RD_STREAM
+//
+//       Read a chunk of the streamed message.
+//
+//    .. c:member:: CH_RD_ACKS
+//
+//       Read the identities of a coalesced ACK.
+//
 // .. code-block:: cpp
 //
 typedef enum {
@@ -4566,6 +5764,8 @@ typedef enum {
     CH_RD_SLOT      = 2,
     CH_RD_HEADER    = 3,
     CH_RD_DATA      = 4,
+    CH_RD_STREAM    = 5,
+    CH_RD_ACKS      = 6,
 } ch_rd_state_t;
 
 // .. c:type:: ch_reader_t
@@ -4600,6 +5800,15 @@ typedef enum {
 //       Data structure containing preallocated buffers for the chirp
 //       message-slots.
 //
+//    .. c:member:: ch_bf_slot_t* stream
+//
+//       Slot of the message being streamed or NULL. Other messages are read
+//       between the chunks of the stream.
+//
+//    .. c:member:: uint32_t stream_offset
+//
+//       Bytes of the data of the streamed message read so far.
+//
 // .. code-block:: cpp
 //
 typedef struct ch_reader_s {
@@ -4609,6 +5818,8 @@ typedef struct ch_reader_s {
     size_t            bytes_read;
     ch_buf            net_msg[CH_SR_WIRE_MESSAGE_SIZE];
     ch_buffer_pool_t* pool;
+    ch_bf_slot_t*     stream;
+    uint32_t          stream_offset;
 } ch_reader_t;
 
 // .. c:function::
@@ -4774,7 +5985,7 @@ ch_rd_read(ch_connection_t* conn, ch_buf* buffer, size_t bytes_read, int* stop);
 // connections are gone and we start fresh. We do not solve that problem by
 // randomized reconnect timeouts, but rather by allowing two connections for
 // REUSE_TIME + random time. That is the reason, the queues and
-// wait_ack_message are in a shared structure called ch_remote_t. If both
+// wait_ack_messages are in a shared structure called ch_remote_t. If both
 // connections are used they will stay.
 //
 // .. code-block:: cpp
@@ -4808,6 +6019,16 @@ ch_rd_read(ch_connection_t* conn, ch_buf* buffer, size_t bytes_read, int* stop);
 // Declarations
 // ============
 
+// .. c:macro:: CH_CN_MIN_BIO_SIZE
+//
+//    Minimum size of the BIO pair, the default size of OpenSSL. The handshake
+//    is only driven by reads, so a whole handshake flight has to fit into the
+//    pair.
+//
+// .. code-block:: cpp
+//
+#define CH_CN_MIN_BIO_SIZE (17 * 1024)
+
 // .. c:type:: ch_cn_flags_t
 //
 //    Represents connection flags.
@@ -4869,6 +6090,43 @@ ch_rd_read(ch_connection_t* conn, ch_buf* buffer, size_t bytes_read, int* stop);
 //
 //       The buffers have been initialized.
 //
+//    .. c:member:: CH_CN_COMPRESSION
+//
+//       Compress messages, the remote announced it can decompress them.
+//
+//    .. c:member:: CH_CN_STREAMING
+//
+//       Stream large messages in chunks, the remote announced it can receive
+//       them.
+//
+//    .. c:member:: CH_CN_LOCAL
+//
+//       The client is a pipe handle connected to the local socket.
+//
+//    .. c:member:: CH_CN_BUF_BORROWED
+//
+//       The read buffer is the idle buffer of chirp, borrowed for the current
+//       read. See :c:member:`ch_config_t.ADAPTIVE_BUFFERS`.
+//
+//    .. c:member:: CH_CN_BUF_BUSY
+//
+//       A read filled the read buffer since the last garbage-collection.
+//
+//    .. c:member:: CH_CN_BUFFERED
+//
+//       The connection owns buffers and is in the buffered_conns list of
+//       chirp.
+//
+//    .. c:member:: CH_CN_ACKS
+//
+//       Coalesce the ACKs sent, the remote announced it can receive them. See
+//       :c:member:`ch_config_t.ACK_COALESCE`.
+//
+//    .. c:member:: CH_CN_ACKS_PENDING
+//
+//       ACKs wait to be coalesced, the connection is in the ack_conns list of
+//       chirp.
+//
 // .. code-block:: cpp
 
 typedef enum {
@@ -4889,11 +6147,39 @@ typedef enum {
     CH_CN_INIT_CONNECT_TIMEOUT = 1 << 14,
     CH_CN_INIT_ENCRYPTION      = 1 << 15,
     CH_CN_INIT_BUFFERS         = 1 << 16,
+    CH_CN_COMPRESSION          = 1 << 17,
+    CH_CN_STREAMING            = 1 << 18,
+    CH_CN_LOCAL                = 1 << 19,
+    CH_CN_BUF_BORROWED         = 1 << 20,
+    CH_CN_BUF_BUSY             = 1 << 21,
+    CH_CN_BUFFERED             = 1 << 22,
+    CH_CN_ACKS                 = 1 << 23,
+    CH_CN_ACKS_PENDING         = 1 << 24,
     CH_CN_INIT =
             (CH_CN_INIT_CLIENT | CH_CN_INIT_READER_WRITER |
              CH_CN_INIT_ENCRYPTION | CH_CN_INIT_BUFFERS)
 } ch_cn_flags_t;
 
+// .. c:type:: ch_cn_client_t
+//
+//    The stream of a connection. Both handles are streams, the stream
+//    functions are called through a cast of the union.
+//
+//    .. c:member:: uv_tcp_t tcp
+//
+//       TCP handle.
+//
+//    .. c:member:: uv_pipe_t pipe
+//
+//       Pipe handle, if the connection has :c:macro:`CH_CN_LOCAL` set.
+//
+// .. code-block:: cpp
+//
+typedef union ch_cn_client_u {
+    uv_tcp_t  tcp;
+    uv_pipe_t pipe;
+} ch_cn_client_t;
+
 // .. c:type:: ch_resume_state_t
 //
 //    Defines the state of a reader.
@@ -4914,6 +6200,26 @@ typedef struct ch_resume_state_s {
     size_t bytes_to_read;
 } ch_resume_state_t;
 
+// .. c:type:: ch_cn_acks_t
+//
+//    The coalesced ACK of a connection. Only allocated if the remote can
+//    receive coalesced ACKs, see :c:member:`ch_config_t.ACK_COALESCE`.
+//
+//    .. c:member:: ch_message_t msg
+//
+//       The coalesced ACK, acknowledges the messages of acks_slots.
+//
+//    .. c:member:: ch_buf data[CH_SR_ACKS_SIZE]
+//
+//       The data of msg.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_cn_acks_s {
+    ch_message_t msg;
+    ch_buf       data[CH_SR_ACKS_SIZE];
+} ch_cn_acks_t;
+
 // .. c:type:: ch_connection_t
 //
 //    Connection dictionary implemented as red-black tree.
@@ -4936,18 +6242,26 @@ typedef struct ch_resume_state_s {
 //       The identity of the remote target. This is used for getting the remote
 //       address.
 //
-//    .. c:member:: uv_tcp_t client
+//    .. c:member:: ch_cn_client_t client
 //
 //       The TCP handle (TCP stream) of the client, which is used to get the
-//       address of the peer connected to the handle.
+//       address of the peer connected to the handle. Or the pipe handle of
+//       the local socket, see :c:type:`ch_cn_client_t`.
 //
 //    .. c:member:: uv_connect_t connect
 //
 //       Libuv connect handler.
 //
+//    .. c:member:: ch_bf_shared_t* buffer_shared
+//
+//       Reference counted read buffer, messages that were received in one
+//       piece point into it. If messages still reference it, the next read
+//       gets a new buffer.
+//
 //    .. c:member:: uv_buf* buffer_uv
 //
-//       Pointer to the libuv (data-) buffer data type.
+//       Pointer to the libuv (data-) buffer data type, the data of
+//       buffer_shared.
 //
 //    .. c:member:: uv_buf* buffer_wtls
 //
@@ -4957,6 +6271,20 @@ typedef struct ch_resume_state_s {
 //
 //       Pointer to the libuv buffer data type for reading data over TLS.
 //
+//    .. c:member:: ch_buf* buffer_ptls
+//
+//       Plaintext staging buffer of one TLS record. Small buffers to be
+//       written over TLS are gathered into it, so they are encrypted as full
+//       records instead of one record per buffer.
+//
+//    .. c:member:: size_t ptls_len
+//
+//       Bytes gathered into buffer_ptls.
+//
+//    .. c:member:: size_t ptls_written
+//
+//       Bytes of buffer_ptls that have been passed to SSL_write.
+//
 //    .. c:member:: uv_buf_t buffer_uv_uv
 //
 //       The actual libuv (data-) buffer (using the buffer_uv data type).
@@ -4980,7 +6308,8 @@ typedef struct ch_resume_state_s {
 //
 //    .. c:member:: unsigned int bufs_index
 //
-//       The bufs index that is currently writing
+//       The bufs index that is currently writing. Equals nbufs once all bufs
+//       have been passed to the TLS library.
 //
 //    .. c:member:: size_t buffer_size
 //
@@ -4997,8 +6326,9 @@ typedef struct ch_resume_state_s {
 //
 //    .. c:member:: size_t write_written
 //
-//       Holds how many bytes have been written over a connection. This is
-//       typically zero at first and gets increased with each partial write.
+//       Holds how many bytes of the current buffer (bufs_index) have been
+//       written over a connection. This is typically zero at first and gets
+//       increased with each partial write.
 //
 //    .. c:member:: ch_remote_t* remote
 //
@@ -5070,13 +6400,53 @@ typedef struct ch_resume_state_s {
 //       Timestamp when the connection was last used. Used to determine
 //       garbage-collection.
 //
-//    .. c:member:: uint32_t release_serial
+//    .. c:member:: uint32_t free_acks
+//
+//       Bit mask of ack messages that are currently free (and therefore may
+//       be used).
 //
-//       The serial of the message currently released.
+//    .. c:member:: uint32_t[CH_MAX_ACK_WINDOW] release_serials
 //
-//    .. c:member:: ch_message_t ack_msg
+//       The serials of the messages released, one per ack message.
 //
-//       Buffer used for ack message
+//    .. c:member:: ch_message_t[CH_MAX_ACK_WINDOW] ack_msgs
+//
+//       Buffers used for ack messages. The peer can send up to
+//       :c:macro:`CH_MAX_ACK_WINDOW` messages before it waits for acks.
+//
+//    .. c:member:: ch_connection_t* buffered_prev
+//
+//       Previous connection in the buffered_conns list of chirp.
+//
+//    .. c:member:: ch_connection_t* buffered_next
+//
+//       Next connection in the buffered_conns list of chirp.
+//
+//    .. c:member:: uint32_t pending_acks
+//
+//       Bit mask of the ack messages released, but not sent yet, since they
+//       wait to be coalesced. Uses the bits of free_acks.
+//
+//    .. c:member:: uint8_t ack_coalesce
+//
+//       Count of ACKs coalesced: :c:member:`ch_config_t.ACK_COALESCE`, at most
+//       the ACK_WINDOW the peer announced.
+//
+//    .. c:member:: uint32_t acks_slots
+//
+//       Bit mask of the ack messages sent by the coalesced ACK.
+//
+//    .. c:member:: ch_cn_acks_t* acks
+//
+//       The coalesced ACK, allocated when CH_CN_ACKS is set, else NULL.
+//
+//    .. c:member:: ch_connection_t* ack_prev
+//
+//       Previous connection in the ack_conns list of chirp.
+//
+//    .. c:member:: ch_connection_t* ack_next
+//
+//       Next connection in the ack_conns list of chirp.
 //
 //    .. c:member:: char color
 //
@@ -5104,11 +6474,15 @@ struct ch_connection_s {
     ch_chirp_t*       chirp;
     ch_remote_t*      remote;
     ch_remote_t*      delete_remote;
-    uv_tcp_t          client;
+    ch_cn_client_t    client;
     uv_connect_t      connect;
+    ch_bf_shared_t*   buffer_shared;
     ch_buf*           buffer_uv;
     ch_buf*           buffer_wtls;
     ch_buf*           buffer_rtls;
+    ch_buf*           buffer_ptls;
+    size_t            ptls_len;
+    size_t            ptls_written;
     uv_buf_t          buffer_uv_uv;
     uv_buf_t          buffer_wtls_uv;
     unsigned int      nbufs;
@@ -5134,8 +6508,17 @@ struct ch_connection_s {
     ch_reader_t      reader;
     ch_writer_t      writer;
     uint64_t         timestamp;
-    uint32_t         release_serial;
-    ch_message_t     ack_msg;
+    uint32_t         free_acks;
+    uint32_t         release_serials[CH_MAX_ACK_WINDOW];
+    ch_message_t     ack_msgs[CH_MAX_ACK_WINDOW];
+    ch_connection_t* buffered_prev;
+    ch_connection_t* buffered_next;
+    uint32_t         pending_acks;
+    uint8_t          ack_coalesce;
+    uint32_t         acks_slots;
+    ch_cn_acks_t*    acks;
+    ch_connection_t* ack_prev;
+    ch_connection_t* ack_next;
     char             color;
     ch_connection_t* parent;
     ch_connection_t* left;
@@ -5162,6 +6545,16 @@ ch_cn_abort_one_message(ch_remote_t* remote, ch_error_t error);
 //    :param ch_remote_t* remote: Remote failed to connect.
 //    :param ch_error_t error: Status returned by connect.
 
+// .. c:function::
+void
+ch_cn_abort_cntl_messages(ch_remote_t* remote, ch_error_t error);
+//
+//    Abort all ack/noop messages in the control queue of the remote. The
+//    ack messages are returned to the connection they belong to.
+//
+//    :param ch_remote_t* remote: Remote of the connection shut down.
+//    :param ch_error_t error: Reason of the shutdown.
+
 // .. c:function::
 void
 ch_cn_close_cb(uv_handle_t* handle);
@@ -5186,6 +6579,28 @@ ch_cn_read_alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
 //    :param uv_buf_t* buf: Libuv buffer which will hold the
 //                          connection
 
+// .. c:function::
+void
+ch_cn_read_done(ch_connection_t* conn, ssize_t nread);
+//
+//    Called after a read was handled. Marks the connection busy if the read
+//    filled the buffer and gives back the borrowed idle buffer. If the
+//    connection stopped reading, it keeps the idle buffer, since the rest of
+//    it is read on resume.
+//
+//    :param ch_connection_t* conn: Connection
+//    :param ssize_t nread: Bytes read or an error
+
+// .. c:function::
+void
+ch_cn_shrink_buffers(ch_connection_t* conn);
+//
+//    Called by garbage-collection. Frees the buffers of the connection, if it
+//    was not busy since the last garbage-collection and does not use them.
+//    See :c:member:`ch_config_t.ADAPTIVE_BUFFERS`.
+//
+//    :param ch_connection_t* conn: Connection
+
 // .. c:function::
 ch_error_t
 ch_cn_shutdown(ch_connection_t* conn, int reason);
@@ -5199,6 +6614,18 @@ ch_cn_shutdown(ch_connection_t* conn, int reason);
 //    :return: A chirp error. see: :c:type:`ch_error_t`
 //    :rtype: ch_error_t
 
+// .. c:function::
+ch_error_t
+ch_cn_alloc_tls_buffers(ch_connection_t* conn);
+//
+//    Allocate the TLS buffers of the connection. With
+//    :c:member:`ch_config_t.ADAPTIVE_BUFFERS` they are allocated on first
+//    use.
+//
+//    :param ch_connection_t* conn: Connection
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype: ch_error_t
+
 // .. c:function::
 ch_error_t
 ch_cn_init(ch_chirp_t* chirp, ch_connection_t* conn, uint8_t flags);
@@ -5229,6 +6656,19 @@ ch_cn_init_enc(ch_chirp_t* chirp, ch_connection_t* conn);
 //
 #endif
 
+#ifndef CH_WITHOUT_TLS
+// .. c:function::
+void
+ch_cn_keep_tls_session(ch_connection_t* conn);
+//
+//    Mark the TLS connection as cleanly shut down. Chirp closes connections
+//    without close_notify, OpenSSL would invalidate the session otherwise.
+//    Called for orderly closes only, so failed connections don't get resumed.
+//
+//    :param ch_connection_t* conn: Connection
+//
+#endif
+
 #ifndef CH_WITHOUT_TLS
 // .. c:function::
 void
@@ -5356,6 +6796,14 @@ ch_cn_write(
 // Declarations
 // ============
 
+// .. c:macro:: CH_CHIRP_RECV_BATCH_SIZE
+//
+//    Initial count of messages the recv batch holds, it grows by doubling.
+//
+// .. code-block:: cpp
+//
+#define CH_CHIRP_RECV_BATCH_SIZE 16
+
 // .. c:type:: ch_chirp_flags_t
 //
 //    Represents chirps flags.
@@ -5373,12 +6821,28 @@ ch_cn_write(
 //
 //       Chirp is being closed.
 //
+//    .. c:member:: CH_CHIRP_RECV_BATCH
+//
+//       The check handle of the recv batch is initialized.
+//
+//    .. c:member:: CH_CHIRP_QUEUE_FULL
+//
+//       A send failed, because the queues of all remotes reached the high
+//       watermark, see :c:member:`ch_config_t.MAX_TOTAL_QUEUE_MSGS`.
+//
+//    .. c:member:: CH_CHIRP_ACK_TIMER
+//
+//       The timer flushing coalesced ACKs is initialized.
+//
 // .. code-block:: cpp
 //
 typedef enum {
-    CH_CHIRP_AUTO_STOP = 1 << 0,
-    CH_CHIRP_CLOSED    = 1 << 1,
-    CH_CHIRP_CLOSING   = 1 << 2,
+    CH_CHIRP_AUTO_STOP  = 1 << 0,
+    CH_CHIRP_CLOSED     = 1 << 1,
+    CH_CHIRP_CLOSING    = 1 << 2,
+    CH_CHIRP_RECV_BATCH = 1 << 3,
+    CH_CHIRP_QUEUE_FULL = 1 << 4,
+    CH_CHIRP_ACK_TIMER  = 1 << 5,
 } ch_chirp_flags_t;
 
 // .. c:type:: ch_chirp_int_t
@@ -5448,66 +6912,401 @@ typedef enum {
 //
 //    .. c:member:: ch_message_t* send_ts_queue
 //
-//       The send queue for ch_chirp_send_ts
+//       The lock-free send stack for ch_chirp_send_ts, see
+//       :c:func:`ch_msg_mpsc_push`.
 //
 //    .. c:member:: uv_async_t send_ts
 //
 //       Async event for waking up ch_wr_send_ts_cb
 //
-//    .. c:member:: uv_mutex_t send_ts_queue_lock
+//    .. c:member:: ch_message_t* release_ts_queue
+//
+//       The lock-free release stack for ch_chirp_release_msg_slot_ts.
+//
+//    .. c:member:: uv_async_t release_ts
 //
-//       Mutex to lock the send_ts_queue
+//       Async event for waking up ch_chirp_release_ts_cb
 //
 //    .. c:member:: ch_recv_cb_t recv_cb
 //
 //       Callback when message is received
 //
-// .. code-block:: cpp
+//    .. c:member:: ch_stream_cb_t stream_cb
 //
-struct ch_chirp_int_s {
-    ch_config_t   config;
-    int           closing_tasks;
-    uint8_t       flags;
-    uv_async_t    close;
-    uv_async_t    start;
-    ch_start_cb_t start_cb;
-    uv_signal_t   signals[2];
-    uv_prepare_t  close_check;
-    ch_protocol_t protocol;
-#ifndef CH_WITHOUT_TLS
-    ch_encryption_t encryption;
-#endif
-    uv_loop_t*    loop;
-    uint8_t       identity[CH_ID_SIZE];
-    uint16_t      public_port;
-    ch_message_t* send_ts_queue;
-    uv_async_t    send_ts;
-    uv_mutex_t    send_ts_queue_lock;
-    ch_message_t* release_ts_queue;
-    uv_async_t    release_ts;
-    uv_mutex_t    release_ts_queue_lock;
-    ch_recv_cb_t  recv_cb;
-    uv_async_t    done;
-    ch_done_cb_t  done_cb;
-};
-
-
-// .. c:function::
-void
-ch_chirp_close_cb(uv_handle_t* handle);
+//       Callback when a part of a streamed message is received
 //
-//    Reduce closing callback semaphore.
+//    .. c:member:: ch_recv_batch_cb_t recv_batch_cb
 //
-//    :param uv_handle_t* handle: A libuv handle containing the chirp object
+//       Callback with the messages received in a loop iteration, see
+//       :c:func:`ch_chirp_set_recv_batch_callback`.
 //
-
-// .. c:function::
-void
-ch_chirp_finish_message(
-        ch_chirp_t*      chirp,
-        ch_connection_t* conn,
-        ch_message_t*    msg,
-        int              status);
+//    .. c:member:: uv_check_t recv_check
+//
+//       Check handle calling recv_batch_cb after polling.
+//
+//    .. c:member:: ch_message_t** recv_batch
+//
+//       The messages received in the current loop iteration.
+//
+//    .. c:member:: uint32_t recv_batch_len
+//
+//       Count of messages in recv_batch.
+//
+//    .. c:member:: uint32_t recv_batch_size
+//
+//       Count of messages recv_batch can hold.
+//
+//    .. c:member:: ch_bf_chirp_pool_t* slot_pool
+//
+//       Slots shared by all connections or NULL, see
+//       :c:member:`ch_config_t.SHARED_SLOTS`.
+//
+//    .. c:member:: ch_bf_slab_t* slab
+//
+//       Slab allocator for message buffers and slots, see
+//       :c:member:`ch_config_t.SLAB_HIGH_WATER`.
+//
+//    .. c:member:: ch_bf_shared_t* idle_buffer
+//
+//       Read buffer borrowed by idle connections, see
+//       :c:member:`ch_config_t.ADAPTIVE_BUFFERS`.
+//
+//    .. c:member:: ch_connection_t* buffered_conns
+//
+//       List of the connections owning buffers, garbage-collection frees the
+//       buffers of idle connections.
+//
+//    .. c:member:: ch_connection_t* ack_conns
+//
+//       List of the connections with ACKs waiting to be coalesced.
+//
+//    .. c:member:: uv_timer_t ack_timer
+//
+//       Timer sending the ACKs waiting to be coalesced, see
+//       :c:member:`ch_config_t.ACK_DELAY`.
+//
+//    .. c:member:: ch_drain_cb_t drain_cb
+//
+//       Callback when a full send queue drained, see
+//       :c:func:`ch_chirp_set_drain_callback`.
+//
+//    .. c:member:: char full_total
+//
+//       The last send that failed with CH_FULL hit the watermark of chirp,
+//       see :c:func:`ch_chirp_full_is_total`.
+//
+//    .. c:member:: uint32_t queue_msgs
+//
+//       Count of messages in the send queues of all remotes.
+//
+//    .. c:member:: uint64_t queue_bytes
+//
+//       Bytes of header and data in the send queues of all remotes.
+//
+//    .. c:member:: ch_bf_objects_t remote_pool
+//
+//       Object pool of the remotes, see :c:member:`ch_config_t.ALLOC_CB`.
+//
+//    .. c:member:: ch_bf_objects_t conn_pool
+//
+//       Object pool of the connections.
+//
+//    .. c:member:: ch_stats_t stats
+//
+//       The counters of :c:func:`ch_chirp_get_stats`, the current values are
+//       collected when the statistics are requested.
+//
+//    .. c:member:: ch_trace_event_t* trace
+//
+//       The tracing ring of :c:member:`ch_config_t.TRACE_SIZE` events or NULL
+//       if tracing is disabled.
+//
+//    .. c:member:: uint32_t trace_pos
+//
+//       Position of the next event in the tracing ring.
+//
+//    .. c:member:: uint32_t trace_count
+//
+//       Count of events in the tracing ring.
+//
+//    .. c:member:: ch_trace_cb_t trace_cb
+//
+//       Callback on timeout, see :c:func:`ch_chirp_set_trace_callback`.
+//
+// .. code-block:: cpp
+//
+struct ch_chirp_int_s {
+    ch_config_t   config;
+    int           closing_tasks;
+    uint8_t       flags;
+    uv_async_t    close;
+    uv_async_t    start;
+    ch_start_cb_t start_cb;
+    uv_signal_t   signals[2];
+    uv_prepare_t  close_check;
+    ch_protocol_t protocol;
+#ifndef CH_WITHOUT_TLS
+    ch_encryption_t encryption;
+#endif
+    uv_loop_t*          loop;
+    uint8_t             identity[CH_ID_SIZE];
+    uint16_t            public_port;
+    ch_message_t*       send_ts_queue;
+    uv_async_t          send_ts;
+    ch_message_t*       release_ts_queue;
+    uv_async_t          release_ts;
+    ch_recv_cb_t        recv_cb;
+    ch_stream_cb_t      stream_cb;
+    ch_recv_batch_cb_t  recv_batch_cb;
+    uv_check_t          recv_check;
+    ch_message_t**      recv_batch;
+    uint32_t            recv_batch_len;
+    uint32_t            recv_batch_size;
+    ch_bf_chirp_pool_t* slot_pool;
+    ch_bf_slab_t*       slab;
+    ch_bf_shared_t*     idle_buffer;
+    ch_connection_t*    buffered_conns;
+    ch_connection_t*    ack_conns;
+    uv_timer_t          ack_timer;
+    ch_drain_cb_t       drain_cb;
+    char                full_total;
+    uint32_t            queue_msgs;
+    uint64_t            queue_bytes;
+    ch_bf_objects_t     remote_pool;
+    ch_bf_objects_t     conn_pool;
+    ch_stats_t          stats;
+    ch_trace_event_t*   trace;
+    uint32_t            trace_pos;
+    uint32_t            trace_count;
+    ch_trace_cb_t       trace_cb;
+    uv_async_t          done;
+    ch_done_cb_t        done_cb;
+};
+
+// .. c:function::
+static inline void*
+ch_chirp_alloc(ch_chirp_int_t* ichirp, size_t size)
+//
+//    Allocate memory using the allocator of the instance, see
+//    :c:member:`ch_config_t.ALLOC_CB`.
+//
+//    :param ch_chirp_int_t* ichirp: Chirp internals
+//    :param size_t size: The amount of memory in bytes to allocate
+//
+// .. code-block:: cpp
+//
+{
+    return ch_alloc_with(ichirp->config.ALLOC_CB, size);
+}
+
+// .. c:function::
+static inline void
+ch_chirp_free(ch_chirp_int_t* ichirp, void* buf)
+//
+//    Free memory allocated by :c:func:`ch_chirp_alloc`.
+//
+//    :param ch_chirp_int_t* ichirp: Chirp internals
+//    :param void* buf: The handle to free
+//
+// .. code-block:: cpp
+//
+{
+    ch_free_with(ichirp->config.FREE_CB, buf);
+}
+
+// .. c:function::
+static inline void*
+ch_chirp_realloc(ch_chirp_int_t* ichirp, void* buf, size_t size)
+//
+//    Resize memory allocated by :c:func:`ch_chirp_alloc`.
+//
+//    :param ch_chirp_int_t* ichirp: Chirp internals
+//    :param void* buf: The handle to resize
+//    :param size_t size: The new size of the memory in bytes
+//
+// .. code-block:: cpp
+//
+{
+    return ch_realloc_with(ichirp->config.REALLOC_CB, buf, size);
+}
+
+// .. c:function::
+static inline void
+ch_chirp_trace(
+        ch_chirp_int_t* ichirp,
+        uint8_t         type,
+        ch_message_t*   msg,
+        uint32_t        serial)
+//
+//    Record an event in the tracing ring, if tracing is enabled.
+//
+//    :param ch_chirp_int_t* ichirp: Chirp internals
+//    :param uint8_t type: The event, see :c:type:`ch_trace_type_t`
+//    :param ch_message_t* msg: The message or NULL
+//    :param uint32_t serial: Serial of the message
+//
+// .. code-block:: cpp
+//
+{
+    if (ichirp->trace == NULL) {
+        return;
+    }
+    ch_trace_event_t* event = &ichirp->trace[ichirp->trace_pos];
+    event->time             = uv_hrtime();
+    event->serial           = serial;
+    event->type             = type;
+    if (msg != NULL) {
+        memcpy(event->identity, msg->identity, CH_ID_SIZE);
+        event->msg_type = msg->type;
+    } else {
+        memset(event->identity, 0, CH_ID_SIZE);
+        event->msg_type = 0;
+    }
+    ichirp->trace_pos += 1;
+    if (ichirp->trace_pos == ichirp->config.TRACE_SIZE) {
+        ichirp->trace_pos = 0;
+    }
+    if (ichirp->trace_count < ichirp->config.TRACE_SIZE) {
+        ichirp->trace_count += 1;
+    }
+}
+
+// .. c:function::
+void
+ch_chirp_trace_timeout(ch_chirp_t* chirp);
+//
+//    Record a timeout in the tracing ring and call the trace callback.
+//
+//    :param ch_chirp_t* chirp: Chirp instance
+//
+
+// .. c:type:: ch_shard_t
+//
+//    A shard of :c:type:`ch_shards_t`.
+//
+//    .. c:member:: ch_chirp_t chirp
+//
+//       The chirp instance of the shard.
+//
+//    .. c:member:: uv_loop_t loop
+//
+//       The loop of the shard.
+//
+//    .. c:member:: uv_thread_t thread
+//
+//       The thread running the loop.
+//
+//    .. c:member:: ch_error_t status
+//
+//       Result of initializing the shard's chirp instance.
+//
+//    .. c:member:: ch_shards_t* shards
+//
+//       The shards object.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_shard_s {
+    ch_chirp_t   chirp;
+    uv_loop_t    loop;
+    uv_thread_t  thread;
+    ch_error_t   status;
+    ch_shards_t* shards;
+} ch_shard_t;
+
+// .. c:type:: ch_shards_int_t
+//
+//    Internal data of :c:type:`ch_shards_t`.
+//
+//    .. c:member:: ch_config_t config
+//
+//       Config of the shards, with identity and REUSE_PORT set.
+//
+//    .. c:member:: ch_recv_cb_t recv_cb
+//
+//       Callback when a shard receives a message.
+//
+//    .. c:member:: ch_start_cb_t start_cb
+//
+//       Callback when a shard is started.
+//
+//    .. c:member:: ch_done_cb_t done_cb
+//
+//       Callback when a shard is finished.
+//
+//    .. c:member:: ch_log_cb_t log_cb
+//
+//       Callback to the logging facility.
+//
+//    .. c:member:: uv_sem_t initialized
+//
+//       Posted by each shard once its chirp instance is initialized.
+//
+//    .. c:member:: ch_shard_t* shards
+//
+//       Array of count shards.
+//
+// .. code-block:: cpp
+//
+struct ch_shards_int_s {
+    ch_config_t   config;
+    ch_recv_cb_t  recv_cb;
+    ch_start_cb_t start_cb;
+    ch_done_cb_t  done_cb;
+    ch_log_cb_t   log_cb;
+    uv_sem_t      initialized;
+    ch_shard_t*   shards;
+};
+
+
+// .. c:function::
+void
+ch_chirp_close_cb(uv_handle_t* handle);
+//
+//    Reduce closing callback semaphore.
+//
+//    :param uv_handle_t* handle: A libuv handle containing the chirp object
+//
+
+// .. c:function::
+void
+ch_chirp_drop_acks(ch_connection_t* conn);
+//
+//    Drop the ACKs waiting to be coalesced, when the connection is shutdown.
+//    The release callbacks of the messages are called.
+//
+//    :param ch_connection_t* conn: The connection
+//
+
+// .. c:function::
+void
+ch_chirp_flush_acks(ch_connection_t* conn);
+//
+//    Send the ACKs waiting to be coalesced in one message, see
+//    :c:member:`ch_config_t.ACK_COALESCE`. If a coalesced ACK is being sent,
+//    they are sent once it is done.
+//
+//    :param ch_connection_t* conn: The connection
+//
+
+// .. c:function::
+void
+ch_chirp_add_recv_batch(ch_chirp_t* chirp, ch_message_t* msg);
+//
+//    Add a received message to the batch of the current loop iteration, see
+//    :c:func:`ch_chirp_set_recv_batch_callback`.
+//
+//    :param ch_chirp_t* chirp: Chirp instance
+//    :param ch_message_t* msg: The received message
+//
+
+// .. c:function::
+void
+ch_chirp_finish_message(
+        ch_chirp_t*      chirp,
+        ch_connection_t* conn,
+        ch_message_t*    msg,
+        int              status);
 //
 //    Call the user callback and then check the message queue for further
 //    messages and send them. It will finish once the writer is done and the
@@ -5519,6 +7318,17 @@ ch_chirp_finish_message(
 //    :param int status: Error code
 //
 
+// .. c:function::
+void
+ch_chirp_record_latency(uint64_t* histogram, uint64_t start);
+//
+//    Count the time since start in a latency histogram of
+//    :c:type:`ch_stats_t`.
+//
+//    :param uint64_t* histogram: Histogram of CH_STATS_BUCKETS buckets
+//    :param uint64_t start: Start time from uv_hrtime()
+//
+
 // .. c:function::
 void
 ch_chirp_release_ts_cb(uv_async_t* handle);
@@ -5541,6 +7351,13 @@ ch_chirp_release_ts_cb(uv_async_t* handle);
 /* #include "buffer.h" */
 /* #include "util.h" */
 
+// Data Struct Prototypes
+// ======================
+//
+// .. code-block:: cpp
+
+qs_queue_bind_impl_m(ch_bf_wait, ch_buffer_pool_t) CH_ALLOW_NL;
+
 // Definitions
 // ===========
 //
@@ -5589,649 +7406,2322 @@ ch_bf_free(ch_buffer_pool_t* pool)
 {
     pool->refcnt -= 1;
     if (pool->refcnt == 0) {
-        ch_free(pool->slots);
+        A(pool->next == NULL, "Pool is still waiting for a slot");
+        if (pool->chirp_pool != NULL) {
+            ch_bf_chirp_pool_free(pool->chirp_pool);
+        } else {
+            ch_free(pool->slots);
+        }
         ch_free(pool);
     }
 }
 
 // .. c:function::
-ch_error_t
-ch_bf_init(ch_buffer_pool_t* pool, ch_connection_t* conn, uint8_t max_slots)
-//    :noindex:
+static void
+_ch_bf_slab_drain(ch_bf_slab_t* slab)
 //
-//    See: :c:func:`ch_bf_init`
+//    Free the cached buffers of the slab.
+//
+//    :param ch_bf_slab_t* slab: The slab
 //
 // .. code-block:: cpp
 //
 {
-    int i;
-    A(max_slots <= 32, "can't handle more than 32 slots");
-    memset(pool, 0, sizeof(*pool));
-    pool->conn       = conn;
-    pool->refcnt     = 1;
-    size_t pool_mem  = max_slots * sizeof(ch_bf_slot_t);
-    pool->used_slots = 0;
-    pool->max_slots  = max_slots;
-    pool->slots      = ch_alloc(pool_mem);
-    if (!pool->slots) {
-        fprintf(stderr,
-                "%s:%d Fatal: Could not allocate memory for buffers. "
-                "ch_buffer_pool_t:%p\n",
-                __FILE__,
-                __LINE__,
-                (void*) pool);
-        return CH_ENOMEM;
-    }
-    memset(pool->slots, 0, pool_mem);
-    pool->free_slots = 0xFFFFFFFFU;
-    pool->free_slots <<= (32 - max_slots);
-    for (i = 0; i < max_slots; ++i) {
-        pool->slots[i].id   = i;
-        pool->slots[i].used = 0;
+    for (int i = 0; i < CH_BF_SLAB_CLASSES; i++) {
+        ch_bf_block_t* block = slab->free[i];
+        while (block != NULL) {
+            ch_bf_block_t* next = block->next;
+            ch_free(block);
+            block = next;
+        }
+        slab->free[i] = NULL;
     }
-    return CH_SUCCESS;
+    slab->cached = 0;
 }
 
 // .. c:function::
-ch_bf_slot_t*
-ch_bf_acquire(ch_buffer_pool_t* pool)
-//    :noindex:
+static void
+_ch_bf_slab_unref(ch_bf_slab_t* slab)
 //
-//    See: :c:func:`ch_bf_acquire`
+//    Decrement the reference count of the slab and free it if zero.
+//
+//    :param ch_bf_slab_t* slab: The slab
 //
 // .. code-block:: cpp
 //
 {
-    ch_bf_slot_t* slot_buf;
-    if (pool->used_slots < pool->max_slots) {
-        int free;
-        pool->used_slots += 1;
-        free = ch_msb32(pool->free_slots);
-        /* Reserve the buffer. */
-        pool->free_slots &= ~(1 << (free - 1));
-        /* The msb represents the first buffer. So the value is inverted. */
-        slot_buf = &pool->slots[32 - free];
-        A(slot_buf->used == 0, "Slot already used.");
-        slot_buf->used = 1;
-        memset(&slot_buf->msg, 0, sizeof(slot_buf->msg));
-        slot_buf->msg._slot  = slot_buf->id;
-        slot_buf->msg._pool  = pool;
-        slot_buf->msg._flags = CH_MSG_HAS_SLOT;
-        return slot_buf;
+    A(slab->refcnt > 0, "Slab already freed");
+    slab->refcnt -= 1;
+    if (slab->refcnt == 0) {
+        _ch_bf_slab_drain(slab);
+        ch_free(slab);
     }
-    return NULL;
 }
 
 // .. c:function::
-void
-ch_bf_release(ch_buffer_pool_t* pool, int id)
+ch_bf_slab_t*
+ch_bf_slab_new(size_t high_water)
 //    :noindex:
 //
-//    See: :c:func:`ch_bf_release`
+//    See: :c:func:`ch_bf_slab_new`
 //
 // .. code-block:: cpp
 //
 {
-    ch_bf_slot_t* slot_buf = &pool->slots[id];
-    A(slot_buf->used == 1, "Double release of slot.");
-    A(pool->used_slots > 0, "Buffer pool inconsistent.");
-    A(slot_buf->id == id, "Id changed.");
-    A(slot_buf->msg._slot == id, "Id changed.");
-    int in_pool = pool->free_slots & (1 << (31 - id));
-    A(!in_pool, "Buffer already in pool");
-    if (in_pool) {
-        fprintf(stderr,
-                "%s:%d Fatal: Double release of slot. "
-                "ch_buffer_pool_t:%p\n",
-                __FILE__,
-                __LINE__,
-                (void*) pool);
-        return;
+    ch_bf_slab_t* slab = ch_alloc(sizeof(*slab));
+    if (slab == NULL) {
+        return NULL;
     }
-    pool->used_slots -= 1;
-    /* Release the buffer. */
-    slot_buf->used = 0;
-    pool->free_slots |= (1 << (31 - id));
+    memset(slab, 0, sizeof(*slab));
+    slab->refcnt     = 1;
+    slab->high_water = high_water;
+    return slab;
 }
-// =====
-// Chirp
-// =====
 
-// Project includes
-// ================
-//
-// .. code-block:: cpp
+// .. c:function::
+void*
+ch_bf_slab_alloc(ch_bf_slab_t* slab, size_t size)
+//    :noindex:
 //
-/* #include "chirp.h" */
-/* #include "common.h" */
-/* #include "remote.h" */
-/* #include "util.h" */
-
-// System includes
-// ===============
+//    See: :c:func:`ch_bf_slab_alloc`
 //
 // .. code-block:: cpp
 //
-#include <openssl/err.h>
-#include <signal.h>
-#include <time.h>
-#ifdef _WIN32
-#define ch_access _access
-#include <io.h>
-#else
-#define ch_access access
-#include <unistd.h>
-#endif
-
-// Declarations
-// ============
-//
-// .. code-block:: cpp
-
-MINMAX_FUNCS(float)
+{
+    ch_bf_block_t* block;
+    size_t         cls = CH_BF_SLAB_CLASSES;
+    if (size <= ((size_t) 1 << CH_BF_SLAB_MAX_CLASS)) {
+        /* Smallest power of two >= size, ch_msb32 counts bits from one */
+        int bits = size > 1 ? ch_msb32((uint32_t) (size - 1)) : 0;
+        if (bits > CH_BF_SLAB_MIN_CLASS) {
+            cls = bits - CH_BF_SLAB_MIN_CLASS;
+        } else {
+            cls = 0;
+        }
+        size     = (size_t) 1 << (cls + CH_BF_SLAB_MIN_CLASS);
+        block    = slab->free[cls];
+        if (block != NULL) {
+            slab->free[cls] = block->next;
+            slab->cached -= size;
+            goto done;
+        }
+    }
+    block = ch_alloc(sizeof(*block) + size);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->slab = slab;
+done:
+    block->cls = cls;
+    slab->refcnt += 1;
+    return block + 1;
+}
 
-// .. c:var:: uv_mutex_t _ch_chirp_init_lock
+// .. c:function::
+void
+ch_bf_slab_free(void* buf)
+//    :noindex:
 //
-//    It seems that initializing signals accesses a shared data-structure. We
-//    lock during init, just to be sure.
+//    See: :c:func:`ch_bf_slab_free`
 //
 // .. code-block:: cpp
 //
-static uv_mutex_t _ch_chirp_init_lock;
+{
+    ch_bf_block_t* block = ((ch_bf_block_t*) buf) - 1;
+    ch_bf_slab_t*  slab  = block->slab;
+    size_t         cls   = block->cls;
+    A(cls <= CH_BF_SLAB_CLASSES, "Not a slab buffer");
+    if (cls < CH_BF_SLAB_CLASSES) {
+        size_t size = (size_t) 1 << (cls + CH_BF_SLAB_MIN_CLASS);
+        /* A closed slab has no high-water mark, nothing is cached */
+        if (slab->cached + size <= slab->high_water) {
+            block->next     = slab->free[cls];
+            slab->free[cls] = block;
+            slab->cached += size;
+            block = NULL;
+        }
+    }
+    if (block != NULL) {
+        ch_free(block);
+    }
+    _ch_bf_slab_unref(slab);
+}
 
-// .. c:var:: int _ch_libchirp_initialized
+// .. c:function::
+void
+ch_bf_slab_close(ch_bf_slab_t* slab)
+//    :noindex:
 //
-//    Variable to check if libchirp is already initialized.
+//    See: :c:func:`ch_bf_slab_close`
 //
 // .. code-block:: cpp
 //
-static int _ch_libchirp_initialized = 0;
+{
+    /* Buffers of outstanding messages keep the slab until they are freed */
+    slab->high_water = 0;
+    _ch_bf_slab_drain(slab);
+    _ch_bf_slab_unref(slab);
+}
 
-// .. c:var:: ch_config_t ch_config_defaults
+// .. c:function::
+void
+ch_bf_objects_init(
+        ch_bf_objects_t* objects,
+        size_t           size,
+        ch_alloc_cb_t    alloc_cb,
+        ch_free_cb_t     free_cb)
+//    :noindex:
 //
-//    Default config of chirp.
+//    See: :c:func:`ch_bf_objects_init`
 //
 // .. code-block:: cpp
 //
-static ch_config_t _ch_config_defaults = {
-        .REUSE_TIME         = 30,
-        .TIMEOUT            = 5.0,
-        .PORT               = 2998,
-        .BACKLOG            = 100,
-        .MAX_SLOTS          = 0,
-        .SYNCHRONOUS        = 1,
-        .DISABLE_SIGNALS    = 0,
-        .BUFFER_SIZE        = 0,
-        .MAX_MSG_SIZE       = CH_MAX_MSG_SIZE,
-        .BIND_V6            = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-        .BIND_V4            = {0, 0, 0, 0},
-        .IDENTITY           = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-        .CERT_CHAIN_PEM     = NULL,
-        .DH_PARAMS_PEM      = NULL,
-        .DISABLE_ENCRYPTION = 0,
-};
-
-
-// .. c:function::
-static void
-_ch_chirp_ack_send_cb(ch_chirp_t* chirp, ch_message_t* msg, ch_error_t status);
-//
-//    Called by chirp once ack_msg is sent.
-//
-//    :param ch_chirp_t* chirp: Chirp instance
-//    :param ch_message_t* msg: Ack message sent
+{
+    memset(objects, 0, sizeof(*objects));
+    objects->size = (size + CH_BF_OBJECTS_ALIGN - 1) &
+                    ~((size_t) CH_BF_OBJECTS_ALIGN - 1);
+    objects->alloc_cb = alloc_cb;
+    objects->free_cb  = free_cb;
+}
 
 // .. c:function::
-static void
-_ch_chirp_check_closing_cb(uv_prepare_t* handle);
+void*
+ch_bf_objects_alloc(ch_bf_objects_t* objects)
+//    :noindex:
 //
-//    Close chirp when the closing semaphore reaches zero.
+//    See: :c:func:`ch_bf_objects_alloc`
 //
-//    :param uv_prepare_t* handle: Prepare handle which will be stopped (and
-//                                 thus its callback)
+// .. code-block:: cpp
 //
+{
+    if (objects->free == NULL) {
+        /* The link of the chunk is padded to keep the objects aligned */
+        ch_buf* chunk = ch_alloc_with(
+                objects->alloc_cb,
+                CH_BF_OBJECTS_ALIGN + CH_BF_OBJECTS_CHUNK * objects->size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        ((ch_bf_object_t*) chunk)->next = objects->chunks;
+        objects->chunks                 = (ch_bf_object_t*) chunk;
+        for (int i = CH_BF_OBJECTS_CHUNK - 1; i >= 0; i--) {
+            ch_bf_object_t* obj =
+                    (ch_bf_object_t*) (chunk + CH_BF_OBJECTS_ALIGN +
+                                       i * objects->size);
+            obj->next     = objects->free;
+            objects->free = obj;
+        }
+    }
+    ch_bf_object_t* obj = objects->free;
+    objects->free       = obj->next;
+    objects->used += 1;
+#ifdef CH_ENABLE_ASSERTS
+    /* Keep ch_at_allocated working for pooled objects */
+    ch_at_alloc(obj);
+#endif
+    return obj;
+}
 
 // .. c:function::
-static void
-_ch_chirp_close_async_cb(uv_async_t* handle);
+void
+ch_bf_objects_free(ch_bf_objects_t* objects, void* obj)
+//    :noindex:
 //
-//    Internal callback to close chirp. Makes ch_chirp_close_ts thread-safe
+//    See: :c:func:`ch_bf_objects_free`
 //
-//    :param uv_async_t* handle: Async handle which is used to closed chirp
+// .. code-block:: cpp
 //
+{
+    A(objects->used > 0, "Object pool is empty");
+#ifdef CH_ENABLE_ASSERTS
+    ch_at_free(obj);
+#endif
+    ch_bf_object_t* link = obj;
+    link->next           = objects->free;
+    objects->free        = link;
+    objects->used -= 1;
+}
 
 // .. c:function::
-static void
-_ch_chirp_closing_down_cb(uv_handle_t* handle);
+void
+ch_bf_objects_reset(ch_bf_objects_t* objects)
+//    :noindex:
 //
-//    Close chirp after the check callback has been closed, calls
-//    done-callback in next uv-loop iteration. To make sure that any open
-//    requests are handled, before informing the user.
+//    See: :c:func:`ch_bf_objects_reset`
 //
-//    :param uv_handle_t* handle: Handle just closed
+// .. code-block:: cpp
 //
+{
+    if (objects->used != 0) {
+        /* Freeing the chunks would free objects still in use: leak them */
+        fprintf(stderr,
+                "%s:%d Error: %u objects of the pool still in use, not "
+                "freed. ch_bf_objects_t:%p\n",
+                __FILE__,
+                __LINE__,
+                (unsigned) objects->used,
+                (void*) objects);
+        return;
+    }
+    ch_bf_object_t* chunk = objects->chunks;
+    while (chunk != NULL) {
+        ch_bf_object_t* next = chunk->next;
+        ch_free_with(objects->free_cb, chunk);
+        chunk = next;
+    }
+    objects->chunks = NULL;
+    objects->free   = NULL;
+}
 
 // .. c:function::
-static void
-_ch_chirp_done_cb(uv_async_t* handle);
+static ch_bf_slot_t*
+_ch_bf_acquire_shared(ch_buffer_pool_t* pool)
 //
-//    The done async-callback calls the user supplied done callback when chirp
-//    is finished. Then closes itself, which calls _ch_chirp_stop_cb, which
-//    finally frees chirp.
-//
-//    :param uv_async_t* handle: Async handle
+//    Take a slot from the shared pool, if the connection did not reach its
+//    limit. The connections using slots share the pool evenly, idle
+//    connections are not counted.
 //
-
-// .. c:function::
-static void
-_ch_chirp_init_signals(ch_chirp_t* chirp);
+//    :param ch_buffer_pool_t* pool: The buffer pool of the connection
 //
-//    Setup signal handlers for chirp. Internally called from ch_chirp_init()
+// .. code-block:: cpp
 //
-//   :param   ch_chirp_t* chrip: Instance of a chirp object
+{
+    ch_bf_chirp_pool_t* chirp_pool = pool->chirp_pool;
+    uint32_t            active = chirp_pool->active + (pool->used_slots == 0);
+    uint32_t            share  = chirp_pool->max_slots / active;
+    if (share == 0) {
+        share = 1;
+    }
+    if (pool->used_slots >= pool->max_slots || pool->used_slots >= share) {
+        pool->flags |= CH_BF_LIMITED;
+        return NULL;
+    }
+    ch_bf_slot_t* slot_buf = chirp_pool->free_list;
+    if (slot_buf != NULL) {
+        chirp_pool->free_list = slot_buf->next;
+        slot_buf->next        = NULL;
+    } else if (chirp_pool->alloc_slots < chirp_pool->max_slots) {
+        slot_buf = ch_alloc(sizeof(*slot_buf));
+        if (slot_buf != NULL) {
+            memset(slot_buf, 0, sizeof(*slot_buf));
+            chirp_pool->alloc_slots += 1;
+        }
+    }
+    if (slot_buf == NULL) {
+        /* Wait for another connection to release a slot */
+        if (pool->next == NULL) {
+            pool->refcnt += 1;
+            ch_bf_wait_enqueue(&chirp_pool->wait_queue, pool);
+        }
+        return NULL;
+    }
+    if (pool->used_slots == 0) {
+        chirp_pool->active += 1;
+    }
+    pool->used_slots += 1;
+    return slot_buf;
+}
 
 // .. c:function::
-static void
-_ch_chirp_sig_handler(uv_signal_t*, int);
-//
-//    Closes all chirp instances on sig int.
+ch_bf_chirp_pool_t*
+ch_bf_chirp_pool_new(uint32_t max_slots)
+//    :noindex:
 //
-//    :param uv_signal_t* handle : The libuv signal handler structure
+//    See: :c:func:`ch_bf_chirp_pool_new`
 //
-//    :param int signo: The signal number, that tells which signal should be
-//                      handled.
+// .. code-block:: cpp
 //
+{
+    ch_bf_chirp_pool_t* chirp_pool = ch_alloc(sizeof(*chirp_pool));
+    if (chirp_pool == NULL) {
+        return NULL;
+    }
+    memset(chirp_pool, 0, sizeof(*chirp_pool));
+    chirp_pool->refcnt    = 1;
+    chirp_pool->max_slots = max_slots;
+    return chirp_pool;
+}
 
 // .. c:function::
-static void
-_ch_chirp_start_cb(uv_async_t* handle);
+void
+ch_bf_chirp_pool_free(ch_bf_chirp_pool_t* chirp_pool)
+//    :noindex:
 //
-//    Start callback calls the user supplied done callback.
+//    See: :c:func:`ch_bf_chirp_pool_free`
 //
-//    :param uv_async_t* handle: Async handler.
+// .. code-block:: cpp
 //
+{
+    chirp_pool->refcnt -= 1;
+    if (chirp_pool->refcnt == 0) {
+        A(chirp_pool->wait_queue == NULL, "Pools still waiting for slots");
+        ch_bf_slot_t* slot_buf = chirp_pool->free_list;
+        while (slot_buf != NULL) {
+            ch_bf_slot_t* next = slot_buf->next;
+            ch_free(slot_buf);
+            chirp_pool->alloc_slots -= 1;
+            slot_buf = next;
+        }
+        A(chirp_pool->alloc_slots == 0, "Slots still in use");
+        ch_free(chirp_pool);
+    }
+}
 
 // .. c:function::
-static void
-_ch_chirp_stop_cb(uv_handle_t* handle);
-//
-//    Last close callback when stopping chirp. Frees chirp.
-//
-//    :param uv_handle_t* handle: handle just closed
-//
-//
-// .. c:function::
-static void
-_ch_chirp_uninit(ch_chirp_t* chirp, uint16_t uninit);
+void
+ch_bf_chirp_pool_close(ch_bf_chirp_pool_t* chirp_pool)
+//    :noindex:
 //
-//    Uninitializes resources on failed ch_chirp_init.
+//    See: :c:func:`ch_bf_chirp_pool_close`
 //
-//    :param ch_chirp_t* chirp: Instance of a chirp object
-//    :param uint16_t   uninit: Initialization state
+// .. code-block:: cpp
 //
+{
+    ch_buffer_pool_t* pool;
+    ch_bf_wait_dequeue(&chirp_pool->wait_queue, &pool);
+    while (pool != NULL) {
+        ch_bf_free(pool);
+        ch_bf_wait_dequeue(&chirp_pool->wait_queue, &pool);
+    }
+    ch_bf_chirp_pool_free(chirp_pool);
+}
 
 // .. c:function::
-static ch_error_t
-_ch_chirp_verify_cfg(ch_chirp_t* chirp);
-//
-//    Verifies the configuration.
-//
-//    :param   ch_chirp_t* chirp: Instance of a chirp object
-//
-//    :return: A chirp error. see: :c:type:`ch_error_t`
-//    :rtype:  ch_error_t
-
-// .. c:var:: extern char* ch_version
+ch_bf_shared_t*
+ch_bf_shared_new(size_t size)
 //    :noindex:
 //
-//    Version of chirp.
+//    See: :c:func:`ch_bf_shared_new`
 //
 // .. code-block:: cpp
 //
-CH_EXPORT
-char* ch_version = CH_VERSION;
-
-// Definitions
-// ===========
+{
+    ch_bf_shared_t* shared = ch_alloc(sizeof(*shared) + size);
+    if (shared == NULL) {
+        return NULL;
+    }
+    shared->refcnt = 1;
+    shared->size   = size;
+    return shared;
+}
 
 // .. c:function::
-static void
-_ch_chirp_ack_send_cb(ch_chirp_t* chirp, ch_message_t* msg, ch_error_t status)
+void
+ch_bf_shared_free(ch_bf_shared_t* shared)
 //    :noindex:
 //
-//    see: :c:func:`_ch_rd_handshake`
+//    See: :c:func:`ch_bf_shared_free`
 //
 // .. code-block:: cpp
 //
 {
-    (void) (msg);
-    (void) (status);
-    ch_chirp_check_m(chirp);
-    if (msg->_release_cb != NULL) {
-        ch_chirp_t* rchirp = msg->user_data;
-        ch_chirp_check_m(rchirp);
-        ch_connection_t* conn = msg->_pool;
-        ch_release_cb_t  cb   = msg->_release_cb;
-        msg->_release_cb      = NULL;
-        cb(rchirp, msg->identity, conn->release_serial);
+    A(shared->refcnt > 0, "Read buffer already freed");
+    shared->refcnt -= 1;
+    if (shared->refcnt == 0) {
+        ch_free(shared);
     }
 }
 
 // .. c:function::
-static void
-_ch_chirp_check_closing_cb(uv_prepare_t* handle)
+ch_error_t
+ch_bf_init(
+        ch_buffer_pool_t*   pool,
+        ch_connection_t*    conn,
+        uint32_t            max_slots,
+        ch_bf_chirp_pool_t* chirp_pool)
 //    :noindex:
 //
-//    see: :c:func:`_ch_chirp_check_closing_cb`
+//    See: :c:func:`ch_bf_init`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t i;
+    memset(pool, 0, sizeof(*pool));
+    pool->conn       = conn;
+    pool->refcnt     = 1;
+    if (chirp_pool != NULL) {
+        chirp_pool->refcnt += 1;
+        pool->chirp_pool = chirp_pool;
+        pool->max_slots  = max_slots;
+        return CH_SUCCESS;
+    }
+    A(max_slots <= 32, "can't handle more than 32 slots");
+    size_t pool_mem  = max_slots * sizeof(ch_bf_slot_t);
+    pool->used_slots = 0;
+    pool->max_slots  = max_slots;
+    pool->slots      = ch_alloc(pool_mem);
+    if (!pool->slots) {
+        fprintf(stderr,
+                "%s:%d Fatal: Could not allocate memory for buffers. "
+                "ch_buffer_pool_t:%p\n",
+                __FILE__,
+                __LINE__,
+                (void*) pool);
+        return CH_ENOMEM;
+    }
+    memset(pool->slots, 0, pool_mem);
+    pool->free_slots = 0xFFFFFFFFU;
+    pool->free_slots <<= (32 - max_slots);
+    for (i = 0; i < max_slots; ++i) {
+        pool->slots[i].id   = i;
+        pool->slots[i].used = 0;
+    }
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+ch_bf_slot_t*
+ch_bf_acquire(ch_buffer_pool_t* pool)
+//    :noindex:
+//
+//    See: :c:func:`ch_bf_acquire`
+//
+// .. code-block:: cpp
+//
+{
+    ch_bf_slot_t* slot_buf;
+    if (pool->chirp_pool != NULL) {
+        slot_buf = _ch_bf_acquire_shared(pool);
+        if (slot_buf == NULL) {
+            return NULL;
+        }
+    } else if (pool->used_slots < pool->max_slots) {
+        int free;
+        pool->used_slots += 1;
+        free = ch_msb32(pool->free_slots);
+        /* Reserve the buffer. */
+        pool->free_slots &= ~(1 << (free - 1));
+        /* The msb represents the first buffer. So the value is inverted. */
+        slot_buf = &pool->slots[32 - free];
+    } else {
+        return NULL;
+    }
+    A(slot_buf->used == 0, "Slot already used.");
+    A(slot_buf->shared == NULL, "Slot still references a read buffer.");
+    slot_buf->used = 1;
+    memset(&slot_buf->msg, 0, sizeof(slot_buf->msg));
+    slot_buf->msg._slot  = slot_buf->id;
+    slot_buf->msg._pool  = pool;
+    slot_buf->msg._flags = CH_MSG_HAS_SLOT;
+    return slot_buf;
+}
+
+// .. c:function::
+void
+ch_bf_release(ch_buffer_pool_t* pool, ch_bf_slot_t* slot_buf)
+//    :noindex:
+//
+//    See: :c:func:`ch_bf_release`
+//
+// .. code-block:: cpp
+//
+{
+    int id = slot_buf->id;
+    A(slot_buf->used == 1, "Double release of slot.");
+    A(pool->used_slots > 0, "Buffer pool inconsistent.");
+    if (pool->chirp_pool != NULL) {
+        ch_bf_chirp_pool_t* chirp_pool = pool->chirp_pool;
+        pool->used_slots -= 1;
+        if (pool->used_slots == 0) {
+            chirp_pool->active -= 1;
+        }
+        pool->flags &= ~CH_BF_LIMITED;
+        slot_buf->used        = 0;
+        slot_buf->next        = chirp_pool->free_list;
+        chirp_pool->free_list = slot_buf;
+        return;
+    }
+    A(&pool->slots[id] == slot_buf, "Slot not in pool.");
+    A(slot_buf->msg._slot == id, "Id changed.");
+    int in_pool = pool->free_slots & (1 << (31 - id));
+    A(!in_pool, "Buffer already in pool");
+    if (in_pool) {
+        fprintf(stderr,
+                "%s:%d Fatal: Double release of slot. "
+                "ch_buffer_pool_t:%p\n",
+                __FILE__,
+                __LINE__,
+                (void*) pool);
+        return;
+    }
+    pool->used_slots -= 1;
+    /* Release the buffer. */
+    slot_buf->used = 0;
+    pool->free_slots |= (1 << (31 - id));
+}
+
+// .. c:function::
+ch_buffer_pool_t*
+ch_bf_take_waiter(ch_buffer_pool_t* pool)
+//    :noindex:
+//
+//    See: :c:func:`ch_bf_take_waiter`
+//
+// .. code-block:: cpp
+//
+{
+    if (pool->chirp_pool == NULL) {
+        return NULL;
+    }
+    ch_bf_chirp_pool_t* chirp_pool = pool->chirp_pool;
+    ch_buffer_pool_t*   waiter;
+    ch_bf_wait_dequeue(&chirp_pool->wait_queue, &waiter);
+    /* Skip pools whose connection is already closed */
+    while (waiter != NULL && waiter->conn == NULL) {
+        ch_bf_free(waiter);
+        ch_bf_wait_dequeue(&chirp_pool->wait_queue, &waiter);
+    }
+    return waiter;
+}
+// =====
+// Chirp
+// =====
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+/* #include "chirp.h" */
+/* #include "common.h" */
+/* #include "remote.h" */
+/* #include "util.h" */
+
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#include <openssl/err.h>
+#include <signal.h>
+#include <time.h>
+#ifdef _WIN32
+#define ch_access _access
+#include <io.h>
+#else
+#define ch_access access
+#include <unistd.h>
+#endif
+
+// Declarations
+// ============
+//
+// .. code-block:: cpp
+
+MINMAX_FUNCS(float)
+
+// .. c:var:: uv_mutex_t _ch_chirp_init_lock
+//
+//    It seems that initializing signals accesses a shared data-structure. We
+//    lock during init, just to be sure.
+//
+// .. code-block:: cpp
+//
+static uv_mutex_t _ch_chirp_init_lock;
+
+// .. c:var:: int _ch_libchirp_initialized
+//
+//    Variable to check if libchirp is already initialized.
+//
+// .. code-block:: cpp
+//
+static int _ch_libchirp_initialized = 0;
+
+// .. c:var:: ch_config_t ch_config_defaults
+//
+//    Default config of chirp.
+//
+// .. code-block:: cpp
+//
+static ch_config_t _ch_config_defaults = {
+        .REUSE_TIME         = 30,
+        .TIMEOUT            = 5.0,
+        .PORT               = 2998,
+        .BACKLOG            = 100,
+        .MAX_SLOTS          = 0,
+        .SYNCHRONOUS        = 1,
+        .DISABLE_SIGNALS    = 0,
+        .BUFFER_SIZE        = 0,
+        .MAX_MSG_SIZE       = CH_MAX_MSG_SIZE,
+        .BIND_V6            = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+        .BIND_V4            = {0, 0, 0, 0},
+        .IDENTITY           = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+        .CERT_CHAIN_PEM     = NULL,
+        .DH_PARAMS_PEM      = NULL,
+        .DISABLE_ENCRYPTION = 0,
+        .MAX_WRITE_BATCH    = 0,
+        .ACK_WINDOW         = 0,
+        .SHARED_SLOTS       = 0,
+        .SLAB_HIGH_WATER    = 0,
+        .REUSE_PORT         = 0,
+        .COMPRESSION        = 0,
+        .COMPRESS_THRESHOLD = 0,
+        .CHUNK_SIZE         = 0,
+        .TRACE_SIZE         = 0,
+        .LOCAL_DIR          = NULL,
+        .ADAPTIVE_BUFFERS      = 0,
+        .MAX_QUEUE_MSGS        = 0,
+        .MAX_QUEUE_BYTES       = 0,
+        .MAX_TOTAL_QUEUE_MSGS  = 0,
+        .MAX_TOTAL_QUEUE_BYTES = 0,
+        .QUEUE_LOW_WATER       = 50,
+        .ALLOC_CB              = NULL,
+        .REALLOC_CB            = NULL,
+        .FREE_CB               = NULL,
+        .ACK_COALESCE          = 0,
+        .ACK_DELAY             = 0,
+};
+
+
+// .. c:function::
+static void
+_ch_chirp_ack_send_cb(ch_chirp_t* chirp, ch_message_t* msg, ch_error_t status);
+//
+//    Called by chirp once ack_msg is sent.
+//
+//    :param ch_chirp_t* chirp: Chirp instance
+//    :param ch_message_t* msg: Ack message sent
+
+// .. c:function::
+static void
+_ch_chirp_acks_send_cb(ch_chirp_t* chirp, ch_message_t* msg, ch_error_t status);
+//
+//    Called by chirp once the coalesced ACK conn->acks is sent.
+//
+//    :param ch_chirp_t* chirp: Chirp instance
+//    :param ch_message_t* msg: Coalesced ACK sent
+
+// .. c:function::
+static void
+_ch_chirp_ack_timer_cb(uv_timer_t* handle);
+//
+//    Send the ACKs waiting to be coalesced of all connections.
+//
+//    :param uv_timer_t* handle: The ack timer of chirp
+
+// .. c:function::
+static void
+_ch_chirp_queue_ack(ch_connection_t* conn, int slot);
+//
+//    Let the ack message wait to be coalesced. It is sent once
+//    conn->ack_coalesce ACKs wait or after ACK_DELAY.
+//
+//    :param ch_connection_t* conn: The connection
+//    :param int slot: Index of the ack message in conn->ack_msgs
+
+// .. c:function::
+static void
+_ch_chirp_remove_pending_acks(ch_connection_t* conn);
+//
+//    Remove the connection from the ack_conns list of chirp.
+//
+//    :param ch_connection_t* conn: The connection
+
+// .. c:function::
+static void
+_ch_chirp_check_closing_cb(uv_prepare_t* handle);
+//
+//    Close chirp when the closing semaphore reaches zero.
+//
+//    :param uv_prepare_t* handle: Prepare handle which will be stopped (and
+//                                 thus its callback)
+//
+
+// .. c:function::
+static void
+_ch_chirp_close_async_cb(uv_async_t* handle);
+//
+//    Internal callback to close chirp. Makes ch_chirp_close_ts thread-safe
+//
+//    :param uv_async_t* handle: Async handle which is used to closed chirp
+//
+
+// .. c:function::
+static void
+_ch_chirp_closing_down_cb(uv_handle_t* handle);
+//
+//    Close chirp after the check callback has been closed, calls
+//    done-callback in next uv-loop iteration. To make sure that any open
+//    requests are handled, before informing the user.
+//
+//    :param uv_handle_t* handle: Handle just closed
+//
+
+// .. c:function::
+static void
+_ch_chirp_done_cb(uv_async_t* handle);
+//
+//    The done async-callback calls the user supplied done callback when chirp
+//    is finished. Then closes itself, which calls _ch_chirp_stop_cb, which
+//    finally frees chirp.
+//
+//    :param uv_async_t* handle: Async handle
+//
+
+// .. c:function::
+static void
+_ch_chirp_init_signals(ch_chirp_t* chirp);
+//
+//    Setup signal handlers for chirp. Internally called from ch_chirp_init()
+//
+//   :param   ch_chirp_t* chrip: Instance of a chirp object
+
+// .. c:function::
+static void
+_ch_chirp_sig_handler(uv_signal_t*, int);
+//
+//    Closes all chirp instances on sig int.
+//
+//    :param uv_signal_t* handle : The libuv signal handler structure
+//
+//    :param int signo: The signal number, that tells which signal should be
+//                      handled.
+//
+
+// .. c:function::
+static void
+_ch_chirp_start_cb(uv_async_t* handle);
+//
+//    Start callback calls the user supplied done callback.
+//
+//    :param uv_async_t* handle: Async handler.
+//
+
+// .. c:function::
+static void
+_ch_chirp_stop_cb(uv_handle_t* handle);
+//
+//    Last close callback when stopping chirp. Frees chirp.
+//
+//    :param uv_handle_t* handle: handle just closed
+//
+//
+// .. c:function::
+static void
+_ch_chirp_uninit(ch_chirp_t* chirp, uint16_t uninit);
+//
+//    Uninitializes resources on failed ch_chirp_init.
+//
+//    :param ch_chirp_t* chirp: Instance of a chirp object
+//    :param uint16_t   uninit: Initialization state
+//
+
+// .. c:function::
+static ch_error_t
+_ch_chirp_verify_cfg(ch_chirp_t* chirp);
+//
+//    Verifies the configuration.
+//
+//    :param   ch_chirp_t* chirp: Instance of a chirp object
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:var:: extern char* ch_version
+//    :noindex:
+//
+//    Version of chirp.
+//
+// .. code-block:: cpp
+//
+CH_EXPORT
+char* ch_version = CH_VERSION;
+
+// Definitions
+// ===========
+
+// .. c:function::
+static void
+_ch_chirp_ack_send_cb(ch_chirp_t* chirp, ch_message_t* msg, ch_error_t status)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_handshake`
+//
+// .. code-block:: cpp
+//
+{
+    (void) (status);
+    ch_chirp_check_m(chirp);
+    ch_connection_t* conn = msg->_pool;
+    /* Return the ack message to the connection */
+    A(!(conn->free_acks & (1U << (31 - msg->_slot))), "ack_msg not in use");
+    conn->free_acks |= (1U << (31 - msg->_slot));
+    if (msg->_release_cb != NULL) {
+        ch_chirp_t* rchirp = msg->user_data;
+        ch_chirp_check_m(rchirp);
+        ch_release_cb_t cb = msg->_release_cb;
+        msg->_release_cb   = NULL;
+        cb(rchirp, msg->identity, conn->release_serials[msg->_slot]);
+    }
+}
+
+// .. c:function::
+static void
+_ch_chirp_acks_send_cb(ch_chirp_t* chirp, ch_message_t* msg, ch_error_t status)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_acks_send_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_check_m(chirp);
+    ch_connection_t* conn  = msg->_pool;
+    uint32_t         slots = conn->acks_slots;
+    conn->acks_slots       = 0;
+    while (slots != 0) {
+        int bit = ch_msb32(slots);
+        slots &= ~(1U << (bit - 1));
+        _ch_chirp_ack_send_cb(chirp, &conn->ack_msgs[32 - bit], status);
+    }
+    /* The ACKs released meanwhile were waiting for the coalesced ACK */
+    if (!(conn->flags & CH_CN_SHUTTING_DOWN)) {
+        ch_chirp_flush_acks(conn);
+    }
+}
+
+// .. c:function::
+static void
+_ch_chirp_ack_timer_cb(uv_timer_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_ack_timer_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = handle->data;
+    ch_chirp_check_m(chirp);
+    ch_chirp_int_t* ichirp = chirp->_;
+    /* Flushing removes the connection from the list */
+    while (ichirp->ack_conns != NULL) {
+        ch_chirp_flush_acks(ichirp->ack_conns);
+    }
+}
+
+// .. c:function::
+static void
+_ch_chirp_queue_ack(ch_connection_t* conn, int slot)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_queue_ack`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t*     chirp  = conn->chirp;
+    ch_chirp_int_t* ichirp = chirp->_;
+    int             count  = 0;
+    conn->pending_acks |= 1U << (31 - slot);
+    for (uint32_t acks = conn->pending_acks; acks != 0; acks &= acks - 1) {
+        count += 1;
+    }
+    if (count >= conn->ack_coalesce) {
+        ch_chirp_flush_acks(conn);
+        return;
+    }
+    if (!(ichirp->flags & CH_CHIRP_ACK_TIMER)) {
+        if (ichirp->flags & CH_CHIRP_CLOSING ||
+            uv_timer_init(ichirp->loop, &ichirp->ack_timer) != CH_SUCCESS) {
+            ch_chirp_flush_acks(conn);
+            return;
+        }
+        ichirp->ack_timer.data = chirp;
+        ichirp->flags |= CH_CHIRP_ACK_TIMER;
+    }
+    if (!(conn->flags & CH_CN_ACKS_PENDING)) {
+        conn->flags |= CH_CN_ACKS_PENDING;
+        conn->ack_prev = NULL;
+        conn->ack_next = ichirp->ack_conns;
+        if (conn->ack_next != NULL) {
+            conn->ack_next->ack_prev = conn;
+        }
+        ichirp->ack_conns = conn;
+    }
+    if (!uv_is_active((uv_handle_t*) &ichirp->ack_timer)) {
+        uv_timer_start(
+                &ichirp->ack_timer,
+                _ch_chirp_ack_timer_cb,
+                ichirp->config.ACK_DELAY,
+                0);
+    }
+}
+
+// .. c:function::
+static void
+_ch_chirp_remove_pending_acks(ch_connection_t* conn)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_remove_pending_acks`
+//
+// .. code-block:: cpp
+//
+{
+    if (!(conn->flags & CH_CN_ACKS_PENDING)) {
+        return;
+    }
+    ch_chirp_int_t* ichirp = conn->chirp->_;
+    if (conn->ack_prev != NULL) {
+        conn->ack_prev->ack_next = conn->ack_next;
+    } else {
+        ichirp->ack_conns = conn->ack_next;
+    }
+    if (conn->ack_next != NULL) {
+        conn->ack_next->ack_prev = conn->ack_prev;
+    }
+    conn->ack_prev = NULL;
+    conn->ack_next = NULL;
+    conn->flags &= ~CH_CN_ACKS_PENDING;
+}
+
+// .. c:function::
+static void
+_ch_chirp_check_closing_cb(uv_prepare_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_check_closing_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = handle->data;
+    ch_chirp_check_m(chirp);
+    ch_chirp_int_t* ichirp = chirp->_;
+    A(ichirp->closing_tasks > -1, "Closing semaphore dropped below zero");
+    L(chirp, "Check closing semaphore (%d)", ichirp->closing_tasks);
+    /* In production we allow the semaphore to drop below zero but log it as
+     * an error. */
+    if (ichirp->closing_tasks < 1) {
+        int tmp_err;
+        tmp_err = uv_prepare_stop(handle);
+        A(tmp_err == CH_SUCCESS, "Could not stop prepare callback");
+        (void) (tmp_err);
+#ifndef CH_WITHOUT_TLS
+        if (!ichirp->config.DISABLE_ENCRYPTION) {
+            tmp_err = ch_en_stop(&ichirp->encryption);
+            A(tmp_err == CH_SUCCESS, "Could not stop encryption");
+        }
+#endif
+        uv_close((uv_handle_t*) handle, _ch_chirp_closing_down_cb);
+    }
+    if (ichirp->closing_tasks < 0) {
+        E(chirp, "Check closing semaphore dropped blow 0", CH_NO_ARG);
+    }
+}
+
+// .. c:function::
+static void
+_ch_chirp_flush_recv_batch(ch_chirp_t* chirp)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_flush_recv_batch`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_message_t**  msgs   = ichirp->recv_batch;
+    uint32_t        count  = ichirp->recv_batch_len;
+    uint32_t        size   = ichirp->recv_batch_size;
+    if (count == 0) {
+        return;
+    }
+    /* Messages received during the callback are added to a new batch */
+    ichirp->recv_batch      = NULL;
+    ichirp->recv_batch_len  = 0;
+    ichirp->recv_batch_size = 0;
+    ichirp->recv_batch_cb(chirp, msgs, count);
+    if (ichirp->recv_batch == NULL) {
+        ichirp->recv_batch      = msgs;
+        ichirp->recv_batch_size = size;
+    } else {
+        ch_free(msgs);
+    }
+}
+
+// .. c:function::
+static void
+_ch_chirp_recv_check_cb(uv_check_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_recv_check_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = handle->data;
+    ch_chirp_check_m(chirp);
+    uv_check_stop(handle);
+    _ch_chirp_flush_recv_batch(chirp);
+}
+
+// .. c:function::
+static void
+_ch_chirp_close_async_cb(uv_async_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_close_async_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = handle->data;
+    ch_chirp_check_m(chirp);
+    if (chirp->_ == NULL) {
+        E(chirp, "Chirp closing callback called on closed", CH_NO_ARG);
+        return;
+    }
+    ch_chirp_int_t* ichirp = chirp->_;
+    if (ichirp->flags & CH_CHIRP_CLOSED) {
+        E(chirp, "Chirp closing callback called on closed", CH_NO_ARG);
+        return;
+    }
+    L(chirp, "Chirp closing callback called", CH_NO_ARG);
+    if (ichirp->flags & CH_CHIRP_RECV_BATCH) {
+        /* Later messages are passed to the callback one by one */
+        _ch_chirp_flush_recv_batch(chirp);
+        ichirp->flags &= ~CH_CHIRP_RECV_BATCH;
+        uv_close((uv_handle_t*) &ichirp->recv_check, ch_chirp_close_cb);
+        ichirp->closing_tasks += 1;
+    }
+    if (ichirp->flags & CH_CHIRP_ACK_TIMER) {
+        while (ichirp->ack_conns != NULL) {
+            ch_chirp_flush_acks(ichirp->ack_conns);
+        }
+        ichirp->flags &= ~CH_CHIRP_ACK_TIMER;
+        uv_timer_stop(&ichirp->ack_timer);
+        uv_close((uv_handle_t*) &ichirp->ack_timer, ch_chirp_close_cb);
+        ichirp->closing_tasks += 1;
+    }
+    int tmp_err;
+    tmp_err = ch_pr_stop(&ichirp->protocol);
+    A(tmp_err == CH_SUCCESS, "Could not stop protocol");
+    (void) (tmp_err);
+#ifndef CH_DISABLE_SIGNALS
+    if (!ichirp->config.DISABLE_SIGNALS) {
+        uv_signal_stop(&ichirp->signals[0]);
+        uv_signal_stop(&ichirp->signals[1]);
+        uv_close((uv_handle_t*) &ichirp->signals[0], ch_chirp_close_cb);
+        uv_close((uv_handle_t*) &ichirp->signals[1], ch_chirp_close_cb);
+        ichirp->closing_tasks += 2;
+    }
+#endif
+    uv_close((uv_handle_t*) &ichirp->send_ts, ch_chirp_close_cb);
+    uv_close((uv_handle_t*) &ichirp->release_ts, ch_chirp_close_cb);
+    uv_close((uv_handle_t*) &ichirp->close, ch_chirp_close_cb);
+    ichirp->closing_tasks += 3;
+    tmp_err = uv_prepare_init(ichirp->loop, &ichirp->close_check);
+    A(tmp_err == CH_SUCCESS, "Could not init prepare callback");
+    ichirp->close_check.data = chirp;
+    /* We use a semaphore to wait until all callbacks are done:
+     * 1. Every time a new callback is scheduled we do
+     *    ichirp->closing_tasks += 1
+     * 2. Every time a callback is called we do ichirp->closing_tasks -= 1
+     * 3. Every uv_loop iteration before it blocks we check
+     *    ichirp->closing_tasks == 0
+     * -> if we reach 0 all callbacks are done and we continue freeing memory
+     * etc. */
+    tmp_err =
+            uv_prepare_start(&ichirp->close_check, _ch_chirp_check_closing_cb);
+    A(tmp_err == CH_SUCCESS, "Could not start prepare callback");
+}
+
+// .. c:function::
+void
+ch_chirp_close_cb(uv_handle_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_close_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = handle->data;
+    ch_chirp_check_m(chirp);
+    chirp->_->closing_tasks -= 1;
+    LC(chirp,
+       "Closing semaphore (%d). ",
+       "uv_handle_t:%p",
+       chirp->_->closing_tasks,
+       (void*) handle);
+}
+
+// .. c:function::
+static void
+_ch_chirp_closing_down_cb(uv_handle_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_closing_down_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = handle->data;
+    ch_chirp_check_m(chirp);
+    if (uv_async_send(&chirp->_->done) < 0) {
+        E(chirp, "Could not call done callback", CH_NO_ARG);
+    }
+}
+// .. c:function::
+static void
+_ch_chirp_stop_cb(uv_handle_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_stop_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_int_t* ichirp = handle->data;
+    if (ichirp->flags & CH_CHIRP_AUTO_STOP) {
+        uv_stop(ichirp->loop);
+    }
+    if (ichirp->slot_pool != NULL) {
+        /* Messages not released yet keep the pool */
+        ch_bf_chirp_pool_close(ichirp->slot_pool);
+    }
+    if (ichirp->slab != NULL) {
+        /* Buffers not released yet keep the slab */
+        ch_bf_slab_close(ichirp->slab);
+    }
+    if (ichirp->idle_buffer != NULL) {
+        /* Messages not released yet keep the buffer */
+        ch_bf_shared_free(ichirp->idle_buffer);
+    }
+    if (ichirp->trace != NULL) {
+        ch_free(ichirp->trace);
+    }
+    if (ichirp->recv_batch != NULL) {
+        ch_free(ichirp->recv_batch);
+    }
+    /* All connections are closed and all remotes freed */
+    ch_bf_objects_reset(&ichirp->remote_pool);
+    ch_bf_objects_reset(&ichirp->conn_pool);
+    ch_free(ichirp);
+}
+
+// .. c:function::
+static void
+_ch_chirp_uninit(ch_chirp_t* chirp, uint16_t uninit)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_uninit`
+//
+// .. code-block:: cpp
+//
+{
+    /* The existence of this function shows a little technical dept. Classes
+     * like chirp/protocol/encryption only know how to close themselves when
+     * they are fully initialized. This should be streamlined one day. */
+    if (uninit & CH_UNINIT_ASYNC_DONE) {
+        ch_chirp_int_t* ichirp   = chirp->_;
+        ch_protocol_t*  protocol = &ichirp->protocol;
+
+        if (uninit & CH_UNINIT_ASYNC_SEND_TS) {
+            uv_close((uv_handle_t*) &ichirp->send_ts, ch_chirp_close_cb);
+            ichirp->closing_tasks += 1;
+        }
+        if (uninit & CH_UNINIT_ASYNC_RELE_TS) {
+            uv_close((uv_handle_t*) &ichirp->release_ts, ch_chirp_close_cb);
+            ichirp->closing_tasks += 1;
+        }
+        if (uninit & CH_UNINIT_ASYNC_CLOSE) {
+            uv_close((uv_handle_t*) &ichirp->close, ch_chirp_close_cb);
+            ichirp->closing_tasks += 1;
+        }
+        if (uninit & CH_UNINIT_ASYNC_START) {
+            uv_close((uv_handle_t*) &ichirp->start, ch_chirp_close_cb);
+            ichirp->closing_tasks += 1;
+        }
+        if (uninit & CH_UNINIT_SERVERV4) {
+            uv_close((uv_handle_t*) &protocol->serverv4, ch_chirp_close_cb);
+            ichirp->closing_tasks += 1;
+        }
+        if (uninit & CH_UNINIT_SERVERV6) {
+            uv_close((uv_handle_t*) &protocol->serverv6, ch_chirp_close_cb);
+            ichirp->closing_tasks += 1;
+        }
+        if (uninit & CH_UNINIT_SERVER_LOCAL) {
+            uv_close((uv_handle_t*) &protocol->server_local, ch_chirp_close_cb);
+            ichirp->closing_tasks += 1;
+        }
+        if (uninit & CH_UNINIT_TIMER_GC) {
+            uv_timer_stop(&protocol->gc_timeout);
+            uv_close((uv_handle_t*) &protocol->gc_timeout, ch_chirp_close_cb);
+            ichirp->closing_tasks += 1;
+        }
+        if (uninit & CH_UNINIT_TIMER_RECON) {
+            uv_timer_stop(&protocol->reconnect_timeout);
+            uv_close(
+                    (uv_handle_t*) &protocol->reconnect_timeout,
+                    ch_chirp_close_cb);
+            ichirp->closing_tasks += 1;
+        }
+        if (uninit & CH_UNINIT_SIGNAL) {
+            uv_signal_stop(&ichirp->signals[0]);
+            uv_signal_stop(&ichirp->signals[1]);
+            uv_close((uv_handle_t*) &ichirp->signals[0], ch_chirp_close_cb);
+            uv_close((uv_handle_t*) &ichirp->signals[1], ch_chirp_close_cb);
+            ichirp->closing_tasks += 2;
+        }
+
+        uv_prepare_init(ichirp->loop, &ichirp->close_check);
+        ichirp->close_check.data = chirp;
+        uv_prepare_start(&ichirp->close_check, _ch_chirp_check_closing_cb);
+    } else {
+        chirp->_init = 0;
+        if (uninit & CH_UNINIT_ICHIRP) {
+            if (chirp->_->slot_pool != NULL) {
+                ch_bf_chirp_pool_close(chirp->_->slot_pool);
+            }
+            if (chirp->_->slab != NULL) {
+                ch_bf_slab_close(chirp->_->slab);
+            }
+            if (chirp->_->trace != NULL) {
+                ch_free(chirp->_->trace);
+            }
+            ch_free(chirp->_);
+        }
+    }
+    if (uninit & CH_UNINIT_INIT_LOCK) {
+        uv_mutex_unlock(&_ch_chirp_init_lock);
+    }
+}
+
+// .. c:function::
+static void
+_ch_chirp_done_cb(uv_async_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_done_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = handle->data;
+    ch_chirp_check_m(chirp);
+    ch_chirp_int_t* ichirp = chirp->_;
+    handle->data           = ichirp;
+    uv_close((uv_handle_t*) handle, _ch_chirp_stop_cb);
+    L(chirp, "Closed.", CH_NO_ARG);
+    if (ichirp->flags & CH_CHIRP_AUTO_STOP) {
+        LC(chirp,
+           "UV-Loop stopped by chirp. ",
+           "uv_loop_t:%p",
+           (void*) ichirp->loop);
+    }
+    if (ichirp->done_cb != NULL) {
+        ichirp->done_cb(chirp);
+    }
+}
+
+// .. c:function::
+static void
+_ch_chirp_init_signals(ch_chirp_t* chirp)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_init_signals`
+//
+// .. code-block:: cpp
+//
+{
+#ifndef CH_DISABLE_SIGNALS
+    ch_chirp_int_t* ichirp = chirp->_;
+    if (ichirp->config.DISABLE_SIGNALS) {
+        return;
+    }
+    uv_signal_init(ichirp->loop, &ichirp->signals[0]);
+    uv_signal_init(ichirp->loop, &ichirp->signals[1]);
+
+    ichirp->signals[0].data = chirp;
+    ichirp->signals[1].data = chirp;
+
+    if (uv_signal_start(&ichirp->signals[0], &_ch_chirp_sig_handler, SIGINT)) {
+        E(chirp, "Unable to set SIGINT handler", CH_NO_ARG);
+        return;
+    }
+
+    if (uv_signal_start(&ichirp->signals[1], &_ch_chirp_sig_handler, SIGTERM)) {
+        uv_signal_stop(&ichirp->signals[0]);
+        uv_close((uv_handle_t*) &ichirp->signals[0], NULL);
+        E(chirp, "Unable to set SIGTERM handler", CH_NO_ARG);
+    }
+#else
+    (void) (chirp);
+#endif
+}
+
+// .. c:function::
+static void
+_ch_chirp_sig_handler(uv_signal_t* handle, int signo)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_sig_handler`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = handle->data;
+    ch_chirp_check_m(chirp);
+
+    if (signo != SIGINT && signo != SIGTERM) {
+        return;
+    }
+
+    ch_chirp_close_ts(chirp);
+}
+
+// .. c:function::
+static void
+_ch_chirp_start_cb(uv_async_t* handle)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_start_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = handle->data;
+    ch_chirp_check_m(chirp);
+    ch_chirp_int_t* ichirp = chirp->_;
+    uv_close((uv_handle_t*) handle, NULL);
+    if (ichirp->start_cb != NULL) {
+        ichirp->start_cb(chirp);
+    }
+}
+
+// .. c:function::
+static ch_error_t
+_ch_chirp_verify_cfg(ch_chirp_t* chirp)
+//    :noindex:
+//
+//    see: :c:func:`_ch_chirp_verify_cfg`
+//
+// .. code-block:: cpp
+//
+{
+    ch_config_t* conf = &chirp->_->config;
+#ifndef CH_WITHOUT_TLS
+    if (!conf->DISABLE_ENCRYPTION) {
+        V(chirp,
+          conf->DH_PARAMS_PEM != NULL,
+          "Config: DH_PARAMS_PEM must be set.",
+          CH_NO_ARG);
+        V(chirp,
+          conf->CERT_CHAIN_PEM != NULL,
+          "Config: CERT_CHAIN_PEM must be set.",
+          CH_NO_ARG);
+        V(chirp,
+          ch_access(conf->CERT_CHAIN_PEM, F_OK) != -1,
+          "Config: cert %s does not exist.",
+          conf->CERT_CHAIN_PEM);
+        V(chirp,
+          ch_access(conf->DH_PARAMS_PEM, F_OK) != -1,
+          "Config: cert %s does not exist.",
+          conf->CERT_CHAIN_PEM);
+    }
+#endif
+    V(chirp,
+      conf->PORT > 1024,
+      "Config: port must be > 1024. (%d)",
+      conf->PORT);
+    V(chirp,
+      conf->BACKLOG < 128,
+      "Config: backlog must be < 128. (%d)",
+      conf->BACKLOG);
+    V(chirp,
+      conf->TIMEOUT <= 1200,
+      "Config: timeout must be <= 1200. (%f)",
+      conf->TIMEOUT);
+    V(chirp,
+      conf->TIMEOUT >= 0.1,
+      "Config: timeout must be >= 0.1. (%f)",
+      conf->TIMEOUT);
+    V(chirp,
+      conf->REUSE_TIME >= 0.5,
+      "Config: resuse time must be => 0.5. (%f)",
+      conf->REUSE_TIME);
+    V(chirp,
+      conf->REUSE_TIME <= 3600,
+      "Config: resuse time must be <= 3600. (%f)",
+      conf->REUSE_TIME);
+    V(chirp,
+      conf->TIMEOUT <= conf->REUSE_TIME,
+      "Config: timeout must be <= reuse time. (%f, %f)",
+      conf->TIMEOUT,
+      conf->REUSE_TIME);
+    V(chirp,
+      (conf->ALLOC_CB == NULL) == (conf->REALLOC_CB == NULL) &&
+              (conf->ALLOC_CB == NULL) == (conf->FREE_CB == NULL),
+      "Config: allocator must set all or none of the callbacks.",
+      CH_NO_ARG);
+    V(chirp,
+      conf->QUEUE_LOW_WATER < 100,
+      "Config: queue low water must be < 100. (%d)",
+      conf->QUEUE_LOW_WATER);
+    V(chirp,
+      conf->ACK_WINDOW <= CH_MAX_ACK_WINDOW,
+      "Config: ack window must be <= %d. (%d)",
+      CH_MAX_ACK_WINDOW,
+      conf->ACK_WINDOW);
+    V(chirp,
+      conf->ACK_COALESCE <= CH_MAX_ACK_WINDOW,
+      "Config: ack coalesce must be <= %d. (%d)",
+      CH_MAX_ACK_WINDOW,
+      conf->ACK_COALESCE);
+    V(chirp,
+      conf->ACK_DELAY < conf->TIMEOUT * 1000,
+      "Config: ack delay must be < timeout. (%d, %f)",
+      conf->ACK_DELAY,
+      conf->TIMEOUT);
+    if (conf->SYNCHRONOUS == 1) {
+        V(chirp,
+          conf->MAX_SLOTS == conf->ACK_WINDOW,
+          "Config: if synchronous is enabled max slots must equal ack window.",
+          CH_NO_ARG);
+    }
+    if (conf->SHARED_SLOTS == 0) {
+        V(chirp,
+          conf->MAX_SLOTS <= 32,
+          "Config: max slots must be <= 1.",
+          CH_NO_ARG);
+    }
+#ifndef SO_REUSEPORT
+    V(chirp,
+      !conf->REUSE_PORT,
+      "Config: reuse port is not supported on this platform.",
+      CH_NO_ARG);
+#endif
+    V(chirp,
+      conf->CHUNK_SIZE == 0 || conf->CHUNK_SIZE >= CH_MIN_BUFFER_SIZE,
+      "Config: chunk size must be >= %d. (%u)",
+      CH_MIN_BUFFER_SIZE,
+      conf->CHUNK_SIZE);
+#ifdef _WIN32
+    V(chirp,
+      conf->LOCAL_DIR == NULL,
+      "Config: the local socket is not supported on this platform.",
+      CH_NO_ARG);
+#else
+    V(chirp,
+      conf->LOCAL_DIR == NULL ||
+              strlen(conf->LOCAL_DIR) + sizeof("/libchirp-65535.sock") <=
+                      CH_PR_LOCAL_PATH_SIZE,
+      "Config: local dir %s is too long.",
+      conf->LOCAL_DIR);
+#endif
+#ifndef CH_ENABLE_COMPRESSION
+    V(chirp,
+      !conf->COMPRESSION,
+      "Config: compression requires CH_ENABLE_COMPRESSION.",
+      CH_NO_ARG);
+#endif
+    V(chirp,
+      conf->MAX_WRITE_BATCH <= CH_WR_MAX_BATCH,
+      "Config: max write batch must be <= %d. (%d)",
+      CH_WR_MAX_BATCH,
+      conf->MAX_WRITE_BATCH);
+    V(chirp,
+      conf->BUFFER_SIZE >= CH_MIN_BUFFER_SIZE || conf->BUFFER_SIZE == 0,
+      "Config: buffer size must be > %d (%u)",
+      CH_MIN_BUFFER_SIZE,
+      conf->BUFFER_SIZE);
+    V(chirp,
+      conf->BUFFER_SIZE >= sizeof(ch_message_t) || conf->BUFFER_SIZE == 0,
+      "Config: buffer size must be > %lu (%u)",
+      (unsigned long) sizeof(ch_message_t),
+      conf->BUFFER_SIZE);
+    V(chirp,
+      conf->BUFFER_SIZE >= CH_SR_HANDSHAKE_SIZE || conf->BUFFER_SIZE == 0,
+      "Config: buffer size must be > %lu (%u)",
+      (unsigned long) CH_SR_HANDSHAKE_SIZE,
+      conf->BUFFER_SIZE);
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_chirp_close_ts(ch_chirp_t* chirp)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_close_ts`
+//
+//    This function is thread-safe.
+//
+// .. code-block:: cpp
+//
+{
+    char            chirp_closed = 0;
+    ch_chirp_int_t* ichirp;
+    if (chirp == NULL || chirp->_init != CH_CHIRP_MAGIC) {
+        fprintf(stderr,
+                "%s:%d Fatal: chirp is not initialzed. ch_chirp_t:%p\n",
+                __FILE__,
+                __LINE__,
+                (void*) chirp);
+        return CH_NOT_INITIALIZED;
+    }
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    if (chirp->_ != NULL) {
+        ichirp = chirp->_;
+        if (ichirp->flags & CH_CHIRP_CLOSED) {
+            chirp_closed = 1;
+        }
+    } else {
+        chirp_closed = 1;
+    }
+    if (chirp_closed) {
+        fprintf(stderr,
+                "%s:%d Fatal: chirp is already closed. ch_chirp_t:%p\n",
+                __FILE__,
+                __LINE__,
+                (void*) chirp);
+        return CH_FATAL;
+    }
+    if (ichirp->flags & CH_CHIRP_CLOSING) {
+        E(chirp, "Close already in progress", CH_NO_ARG);
+        return CH_IN_PRORESS;
+    }
+    ichirp->flags |= CH_CHIRP_CLOSING;
+    ichirp->close.data = chirp;
+    L(chirp, "Closing chirp via callback", CH_NO_ARG);
+    if (uv_async_send(&ichirp->close) < 0) {
+        E(chirp, "Could not call close callback", CH_NO_ARG);
+        return CH_UV_ERROR;
+    }
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+CH_EXPORT
+void
+ch_chirp_config_init(ch_config_t* config)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_config_init`
+//
+// .. code-block:: cpp
+//
+{
+    *config = _ch_config_defaults;
+}
+
+// .. c:function::
+CH_EXPORT
+ch_identity_t
+ch_chirp_get_identity(ch_chirp_t* chirp)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_get_identity`
+//
+// .. code-block:: cpp
+//
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_identity_t id;
+    memcpy(id.data, chirp->_->identity, sizeof(id.data));
+    return id;
+}
+
+// .. c:function::
+CH_EXPORT
+uv_loop_t*
+ch_chirp_get_loop(ch_chirp_t* chirp)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_get_loop`
+//
+// .. code-block:: cpp
+//
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    return chirp->_->loop;
+}
+
+// .. c:function::
+CH_EXPORT
+void
+ch_chirp_get_tls_handshakes(
+        ch_chirp_t* chirp, uint64_t* full, uint64_t* resumed)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_get_tls_handshakes`
 //
 // .. code-block:: cpp
 //
 {
-    ch_chirp_t* chirp = handle->data;
     ch_chirp_check_m(chirp);
-    ch_chirp_int_t* ichirp = chirp->_;
-    A(ichirp->closing_tasks > -1, "Closing semaphore dropped below zero");
-    L(chirp, "Check closing semaphore (%d)", ichirp->closing_tasks);
-    /* In production we allow the semaphore to drop below zero but log it as
-     * an error. */
-    if (ichirp->closing_tasks < 1) {
-        int tmp_err;
-        tmp_err = uv_prepare_stop(handle);
-        A(tmp_err == CH_SUCCESS, "Could not stop prepare callback");
-        (void) (tmp_err);
-#ifndef CH_WITHOUT_TLS
-        if (!ichirp->config.DISABLE_ENCRYPTION) {
-            tmp_err = ch_en_stop(&ichirp->encryption);
-            A(tmp_err == CH_SUCCESS, "Could not stop encryption");
-        }
+#ifdef CH_WITHOUT_TLS
+    *full    = 0;
+    *resumed = 0;
+#else
+    *full    = chirp->_->encryption.handshakes_full;
+    *resumed = chirp->_->encryption.handshakes_resumed;
 #endif
-        uv_close((uv_handle_t*) handle, _ch_chirp_closing_down_cb);
+}
+
+// .. c:function::
+static uint32_t
+_ch_chirp_queue_length(ch_message_t* queue)
+//
+//    Count the messages in a queue.
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t length = 0;
+    qs_queue_iter_decl_cx_m(ch_msg, iter, msg);
+    ch_msg_iter_init(queue, &iter, &msg);
+    while (msg != NULL) {
+        length += 1;
+        ch_msg_iter_next(iter, &msg);
     }
-    if (ichirp->closing_tasks < 0) {
-        E(chirp, "Check closing semaphore dropped blow 0", CH_NO_ARG);
+    return length;
+}
+
+// .. c:function::
+CH_EXPORT
+void
+ch_chirp_get_stats(ch_chirp_t* chirp, ch_stats_t* stats)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_get_stats`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_check_m(chirp);
+    ch_chirp_int_t* ichirp   = chirp->_;
+    ch_protocol_t*  protocol = &ichirp->protocol;
+    *stats                   = ichirp->stats;
+    ch_chirp_get_tls_handshakes(
+            chirp, &stats->handshakes_full, &stats->handshakes_resumed);
+    stats->remotes = protocol->remote_count;
+    for (ch_remote_t* remote = protocol->remotes_lru; remote != NULL;
+         remote              = remote->lru_next) {
+        for (int i = 0; i < CH_MSG_PRIORITIES; i++) {
+            stats->queued += _ch_chirp_queue_length(remote->msg_queue[i]);
+        }
+        ch_connection_t* conn = remote->conn;
+        if (conn != NULL) {
+            stats->connections += 1;
+            if (conn->flags & CH_CN_WRITE_PENDING ||
+                conn->writer.batch != NULL || conn->writer.stream_chunk > 0) {
+                stats->writes_pending += 1;
+            }
+        }
     }
 }
 
 // .. c:function::
-static void
-_ch_chirp_close_async_cb(uv_async_t* handle)
+CH_EXPORT
+uint32_t
+ch_chirp_get_remote_stats(
+        ch_chirp_t* chirp, ch_remote_stats_t* stats, uint32_t count)
 //    :noindex:
 //
-//    see: :c:func:`_ch_chirp_close_async_cb`
+//    see: :c:func:`ch_chirp_get_remote_stats`
 //
 // .. code-block:: cpp
 //
 {
-    ch_chirp_t* chirp = handle->data;
     ch_chirp_check_m(chirp);
-    if (chirp->_ == NULL) {
-        E(chirp, "Chirp closing callback called on closed", CH_NO_ARG);
-        return;
+    uint32_t     filled = 0;
+    ch_remote_t* remote = chirp->_->protocol.remotes_lru;
+    while (remote != NULL && filled < count) {
+        ch_remote_stats_t* stat = &stats[filled];
+        memset(stat, 0, sizeof(*stat));
+        stat->ip_protocol = remote->ip_protocol;
+        memcpy(stat->address, remote->address, CH_IP_ADDR_SIZE);
+        stat->port     = remote->port;
+        stat->wait_ack = remote->wait_ack_count;
+        for (int i = 0; i < CH_MSG_PRIORITIES; i++) {
+            stat->queued[i] = _ch_chirp_queue_length(remote->msg_queue[i]);
+        }
+        ch_connection_t* conn = remote->conn;
+        stat->pinned = (remote->flags & CH_RM_PINNED) != 0;
+        if (conn != NULL) {
+            stat->connected     = 1;
+            stat->write_pending = conn->flags & CH_CN_WRITE_PENDING ||
+                                  conn->writer.batch != NULL ||
+                                  conn->writer.stream_chunk > 0;
+        }
+        filled += 1;
+        remote = remote->lru_next;
     }
-    ch_chirp_int_t* ichirp = chirp->_;
-    if (ichirp->flags & CH_CHIRP_CLOSED) {
-        E(chirp, "Chirp closing callback called on closed", CH_NO_ARG);
-        return;
+    return filled;
+}
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_chirp_init(
+        ch_chirp_t*        chirp,
+        const ch_config_t* config,
+        uv_loop_t*         loop,
+        ch_recv_cb_t       recv_cb,
+        ch_start_cb_t      start_cb,
+        ch_done_cb_t       done_cb,
+        ch_log_cb_t        log_cb)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_init`
+//
+// .. code-block:: cpp
+//
+{
+    int      tmp_err;
+    uint16_t uninit = 0;
+    uv_mutex_lock(&_ch_chirp_init_lock);
+    uninit |= CH_UNINIT_INIT_LOCK;
+    memset(chirp, 0, sizeof(*chirp));
+    chirp->_init           = CH_CHIRP_MAGIC;
+    chirp->_thread         = uv_thread_self();
+    ch_chirp_int_t* ichirp = ch_alloc(sizeof(*ichirp));
+    if (!ichirp) {
+        fprintf(stderr,
+                "%s:%d Fatal: Could not allocate memory for chirp. "
+                "ch_chirp_t:%p\n",
+                __FILE__,
+                __LINE__,
+                (void*) chirp);
+        uv_mutex_unlock(&_ch_chirp_init_lock);
+        return CH_ENOMEM;
     }
-    L(chirp, "Chirp closing callback called", CH_NO_ARG);
-    int tmp_err;
-    tmp_err = ch_pr_stop(&ichirp->protocol);
-    A(tmp_err == CH_SUCCESS, "Could not stop protocol");
-    (void) (tmp_err);
-#ifndef CH_DISABLE_SIGNALS
-    if (!ichirp->config.DISABLE_SIGNALS) {
-        uv_signal_stop(&ichirp->signals[0]);
-        uv_signal_stop(&ichirp->signals[1]);
-        uv_close((uv_handle_t*) &ichirp->signals[0], ch_chirp_close_cb);
-        uv_close((uv_handle_t*) &ichirp->signals[1], ch_chirp_close_cb);
-        ichirp->closing_tasks += 2;
+    uninit |= CH_UNINIT_ICHIRP;
+    memset(ichirp, 0, sizeof(*ichirp));
+    ichirp->done_cb         = done_cb;
+    ichirp->config          = *config;
+    ichirp->public_port     = config->PORT;
+    ichirp->loop            = loop;
+    ichirp->start_cb        = start_cb;
+    ichirp->recv_cb         = recv_cb;
+    ch_config_t*   tconf    = &ichirp->config;
+    ch_protocol_t* protocol = &ichirp->protocol;
+    chirp->_                = ichirp;
+    ch_bf_objects_init(
+            &ichirp->remote_pool,
+            sizeof(ch_remote_t),
+            tconf->ALLOC_CB,
+            tconf->FREE_CB);
+    ch_bf_objects_init(
+            &ichirp->conn_pool,
+            sizeof(ch_connection_t),
+            tconf->ALLOC_CB,
+            tconf->FREE_CB);
+    if (log_cb != NULL) {
+        ch_chirp_set_log_callback(chirp, log_cb);
+    }
+
+    unsigned int i = 0;
+    while (i < (sizeof(tconf->IDENTITY) - 1) && tconf->IDENTITY[i] == 0)
+        i += 1;
+    if (tconf->IDENTITY[i] == 0) {
+        ch_random_ints_as_bytes(ichirp->identity, sizeof(ichirp->identity));
+    } else {
+        memcpy(ichirp->identity, tconf->IDENTITY, sizeof(ichirp->identity));
+    }
+
+    if (tconf->ACK_WINDOW == 0) {
+        tconf->ACK_WINDOW = 1;
+    }
+    if (tconf->SYNCHRONOUS) {
+        tconf->MAX_SLOTS = tconf->ACK_WINDOW;
+    } else {
+        /* With shared slots 0 means: only limited by the fair share */
+        if (tconf->MAX_SLOTS == 0 && tconf->SHARED_SLOTS == 0) {
+            tconf->MAX_SLOTS = 16;
+        }
+    }
+    if (tconf->MAX_WRITE_BATCH == 0) {
+        tconf->MAX_WRITE_BATCH = CH_WR_MAX_BATCH;
+    }
+    if (tconf->SLAB_HIGH_WATER == 0) {
+        tconf->SLAB_HIGH_WATER = CH_BF_SLAB_HIGH_WATER;
+    }
+    ichirp->slab = ch_bf_slab_new(tconf->SLAB_HIGH_WATER);
+    if (ichirp->slab == NULL) {
+        E(chirp, "Could not allocate memory for slab", CH_NO_ARG);
+        _ch_chirp_uninit(chirp, uninit);
+        return CH_ENOMEM;
+    }
+    if (tconf->SHARED_SLOTS > 0) {
+        ichirp->slot_pool = ch_bf_chirp_pool_new(tconf->SHARED_SLOTS);
+        if (ichirp->slot_pool == NULL) {
+            E(chirp, "Could not allocate memory for shared slots", CH_NO_ARG);
+            _ch_chirp_uninit(chirp, uninit);
+            return CH_ENOMEM;
+        }
+    }
+    if (tconf->TRACE_SIZE > 0) {
+        ichirp->trace = ch_alloc(tconf->TRACE_SIZE * sizeof(*ichirp->trace));
+        if (ichirp->trace == NULL) {
+            E(chirp, "Could not allocate memory for tracing", CH_NO_ARG);
+            _ch_chirp_uninit(chirp, uninit);
+            return CH_ENOMEM;
+        }
+    }
+    tconf->REUSE_TIME = ch_max_float(tconf->REUSE_TIME, tconf->TIMEOUT * 3);
+
+    if (uv_async_init(loop, &ichirp->done, _ch_chirp_done_cb) < 0) {
+        E(chirp, "Could not initialize done handler", CH_NO_ARG);
+        _ch_chirp_uninit(chirp, uninit);
+        /* Small inaccuracy for ease of use. The user can await the done_cb,
+         * except if we return CH_ENOMEM */
+        return CH_ENOMEM;
+    }
+    ichirp->done.data = chirp;
+    uninit |= CH_UNINIT_ASYNC_DONE;
+
+    tmp_err = _ch_chirp_verify_cfg(chirp);
+    if (tmp_err != CH_SUCCESS) {
+        _ch_chirp_uninit(chirp, uninit);
+        return tmp_err;
+    }
+
+    if (uv_async_init(loop, &ichirp->close, _ch_chirp_close_async_cb) < 0) {
+        E(chirp, "Could not initialize close callback", CH_NO_ARG);
+        _ch_chirp_uninit(chirp, uninit);
+        return CH_INIT_FAIL;
+    }
+    ichirp->close.data = chirp;
+    uninit |= CH_UNINIT_ASYNC_CLOSE;
+    if (uv_async_init(loop, &ichirp->start, _ch_chirp_start_cb) < 0) {
+        E(chirp, "Could not initialize done handler", CH_NO_ARG);
+        _ch_chirp_uninit(chirp, uninit);
+        return CH_INIT_FAIL;
+    }
+    ichirp->start.data = chirp;
+    uninit |= CH_UNINIT_ASYNC_START;
+    if (uv_async_init(loop, &ichirp->send_ts, ch_wr_send_ts_cb) < 0) {
+        E(chirp, "Could not initialize send_ts handler", CH_NO_ARG);
+        _ch_chirp_uninit(chirp, uninit);
+        return CH_INIT_FAIL;
+    }
+    ichirp->send_ts.data = chirp;
+    uninit |= CH_UNINIT_ASYNC_SEND_TS;
+    if (uv_async_init(loop, &ichirp->release_ts, ch_chirp_release_ts_cb) < 0) {
+        E(chirp, "Could not initialize release_ts handler", CH_NO_ARG);
+        _ch_chirp_uninit(chirp, uninit);
+        return CH_INIT_FAIL;
+    }
+    ichirp->release_ts.data = chirp;
+    uninit |= CH_UNINIT_ASYNC_RELE_TS;
+
+    ch_pr_init(chirp, protocol);
+    tmp_err = ch_pr_start(protocol, &uninit);
+    if (tmp_err != CH_SUCCESS) {
+        E(chirp, "Could not start protocol: %d", tmp_err);
+        _ch_chirp_uninit(chirp, uninit);
+        return tmp_err;
+    }
+#ifndef CH_WITHOUT_TLS
+    ch_encryption_t* enc = &ichirp->encryption;
+    if (!tconf->DISABLE_ENCRYPTION) {
+        ch_en_init(chirp, enc);
+        tmp_err = ch_en_start(enc);
+        if (tmp_err != CH_SUCCESS) {
+#ifdef CH_ENABLE_LOGGING
+            ERR_print_errors_fp(stderr);
+#endif
+            E(chirp, "Could not start encryption: %d", tmp_err);
+            _ch_chirp_uninit(chirp, uninit);
+            return tmp_err;
+        }
     }
 #endif
-    uv_close((uv_handle_t*) &ichirp->send_ts, ch_chirp_close_cb);
-    uv_close((uv_handle_t*) &ichirp->release_ts, ch_chirp_close_cb);
-    uv_close((uv_handle_t*) &ichirp->close, ch_chirp_close_cb);
-    ichirp->closing_tasks += 3;
-    uv_mutex_destroy(&ichirp->send_ts_queue_lock);
-    uv_mutex_destroy(&ichirp->release_ts_queue_lock);
-    tmp_err = uv_prepare_init(ichirp->loop, &ichirp->close_check);
-    A(tmp_err == CH_SUCCESS, "Could not init prepare callback");
-    ichirp->close_check.data = chirp;
-    /* We use a semaphore to wait until all callbacks are done:
-     * 1. Every time a new callback is scheduled we do
-     *    ichirp->closing_tasks += 1
-     * 2. Every time a callback is called we do ichirp->closing_tasks -= 1
-     * 3. Every uv_loop iteration before it blocks we check
-     *    ichirp->closing_tasks == 0
-     * -> if we reach 0 all callbacks are done and we continue freeing memory
-     * etc. */
-    tmp_err =
-            uv_prepare_start(&ichirp->close_check, _ch_chirp_check_closing_cb);
-    A(tmp_err == CH_SUCCESS, "Could not start prepare callback");
+#ifdef CH_ENABLE_LOGGING
+    char id_str[CH_ID_SIZE * 2 + 1];
+    ch_bytes_to_hex(
+            ichirp->identity, sizeof(ichirp->identity), id_str, sizeof(id_str));
+    LC(chirp,
+       "Chirp initialized id: %s. ",
+       "uv_loop_t:%p",
+       id_str,
+       (void*) loop);
+#endif
+    _ch_chirp_init_signals(chirp);
+    uninit |= CH_UNINIT_SIGNAL;
+    if (uv_async_send(&ichirp->start) < 0) {
+        E(chirp, "Could not call start callback", CH_NO_ARG);
+        _ch_chirp_uninit(chirp, uninit);
+        return CH_UV_ERROR;
+    }
+    uv_mutex_unlock(&_ch_chirp_init_lock);
+    return CH_SUCCESS;
 }
 
 // .. c:function::
 void
-ch_chirp_close_cb(uv_handle_t* handle)
+ch_chirp_record_latency(uint64_t* histogram, uint64_t start)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_close_cb`
+//    see: :c:func:`ch_chirp_record_latency`
 //
 // .. code-block:: cpp
 //
 {
-    ch_chirp_t* chirp = handle->data;
-    ch_chirp_check_m(chirp);
-    chirp->_->closing_tasks -= 1;
-    LC(chirp,
-       "Closing semaphore (%d). ",
-       "uv_handle_t:%p",
-       chirp->_->closing_tasks,
-       (void*) handle);
+    uint64_t latency = (uv_hrtime() - start) / 1000; /* us */
+    int      bucket  = 0;
+    while (latency > 0 && bucket < CH_STATS_BUCKETS - 1) {
+        latency >>= 1;
+        bucket += 1;
+    }
+    histogram[bucket] += 1;
 }
 
 // .. c:function::
-static void
-_ch_chirp_closing_down_cb(uv_handle_t* handle)
+void
+ch_chirp_drop_acks(ch_connection_t* conn)
 //    :noindex:
 //
-//    see: :c:func:`_ch_chirp_closing_down_cb`
+//    see: :c:func:`ch_chirp_drop_acks`
 //
 // .. code-block:: cpp
 //
 {
-    ch_chirp_t* chirp = handle->data;
-    ch_chirp_check_m(chirp);
-    if (uv_async_send(&chirp->_->done) < 0) {
-        E(chirp, "Could not call done callback", CH_NO_ARG);
+    _ch_chirp_remove_pending_acks(conn);
+    uint32_t pending   = conn->pending_acks;
+    conn->pending_acks = 0;
+    while (pending != 0) {
+        int bit = ch_msb32(pending);
+        pending &= ~(1U << (bit - 1));
+        _ch_chirp_ack_send_cb(
+                conn->chirp, &conn->ack_msgs[32 - bit], CH_SHUTDOWN);
     }
 }
+
 // .. c:function::
-static void
-_ch_chirp_stop_cb(uv_handle_t* handle)
+void
+ch_chirp_flush_acks(ch_connection_t* conn)
 //    :noindex:
 //
-//    see: :c:func:`_ch_chirp_stop_cb`
+//    see: :c:func:`ch_chirp_flush_acks`
 //
 // .. code-block:: cpp
 //
 {
-    ch_chirp_int_t* ichirp = handle->data;
-    if (ichirp->flags & CH_CHIRP_AUTO_STOP) {
-        uv_stop(ichirp->loop);
+    _ch_chirp_remove_pending_acks(conn);
+    if (conn->pending_acks == 0 || conn->acks_slots != 0) {
+        return;
     }
-    ch_free(ichirp);
+    ch_chirp_t* chirp   = conn->chirp;
+    uint32_t    pending = conn->pending_acks;
+    int         bit     = ch_msb32(pending);
+    conn->pending_acks  = 0;
+    pending &= ~(1U << (bit - 1));
+    ch_message_t* first = &conn->ack_msgs[32 - bit];
+    if (pending == 0) {
+        ch_wr_send(chirp, first, _ch_chirp_ack_send_cb);
+        return;
+    }
+    /* The identity of the wire message is the first ACK, the data the
+     * others */
+    ch_message_t* acks_msg = &conn->acks->msg;
+    memcpy(acks_msg->identity, first->identity, CH_ID_SIZE);
+    acks_msg->data_len = 0;
+    conn->acks_slots   = pending | (1U << (bit - 1));
+    while (pending != 0) {
+        bit = ch_msb32(pending);
+        pending &= ~(1U << (bit - 1));
+        memcpy(conn->acks->data + acks_msg->data_len,
+               conn->ack_msgs[32 - bit].identity,
+               CH_ID_SIZE);
+        acks_msg->data_len += CH_ID_SIZE;
+    }
+    ch_wr_send(chirp, acks_msg, _ch_chirp_acks_send_cb);
 }
 
 // .. c:function::
-static void
-_ch_chirp_uninit(ch_chirp_t* chirp, uint16_t uninit)
+void
+ch_chirp_add_recv_batch(ch_chirp_t* chirp, ch_message_t* msg)
 //    :noindex:
 //
-//    see: :c:func:`_ch_chirp_uninit`
+//    see: :c:func:`ch_chirp_add_recv_batch`
 //
 // .. code-block:: cpp
 //
 {
-    /* The existence of this function shows a little technical dept. Classes
-     * like chirp/protocol/encryption only know how to close themselves when
-     * they are fully initialized. This should be streamlined one day. */
-    if (uninit & CH_UNINIT_ASYNC_DONE) {
-        ch_chirp_int_t* ichirp   = chirp->_;
-        ch_protocol_t*  protocol = &ichirp->protocol;
-
-        if (uninit & CH_UNINIT_ASYNC_SEND_TS) {
-            uv_close((uv_handle_t*) &ichirp->send_ts, ch_chirp_close_cb);
-            ichirp->closing_tasks += 1;
-        }
-        if (uninit & CH_UNINIT_ASYNC_RELE_TS) {
-            uv_close((uv_handle_t*) &ichirp->release_ts, ch_chirp_close_cb);
-            ichirp->closing_tasks += 1;
-        }
-        if (uninit & CH_UNINIT_ASYNC_CLOSE) {
-            uv_close((uv_handle_t*) &ichirp->close, ch_chirp_close_cb);
-            ichirp->closing_tasks += 1;
-        }
-        if (uninit & CH_UNINIT_ASYNC_START) {
-            uv_close((uv_handle_t*) &ichirp->start, ch_chirp_close_cb);
-            ichirp->closing_tasks += 1;
-        }
-        if (uninit & CH_UNINIT_SEND_TS_LOCK) {
-            uv_mutex_destroy(&ichirp->send_ts_queue_lock);
-        }
-        if (uninit & CH_UNINIT_RELE_TS_LOCK) {
-            uv_mutex_destroy(&ichirp->release_ts_queue_lock);
-        }
-        if (uninit & CH_UNINIT_SERVERV4) {
-            uv_close((uv_handle_t*) &protocol->serverv4, ch_chirp_close_cb);
-            ichirp->closing_tasks += 1;
+    ch_chirp_int_t* ichirp = chirp->_;
+    if (!(ichirp->flags & CH_CHIRP_RECV_BATCH)) {
+        /* Closing: The check handle is closed */
+        ichirp->recv_batch_cb(chirp, &msg, 1);
+        return;
+    }
+    if (ichirp->recv_batch_len == ichirp->recv_batch_size) {
+        uint32_t       size  = ichirp->recv_batch_size * 2;
+        size_t         bytes = sizeof(*ichirp->recv_batch);
+        ch_message_t** batch;
+        if (size == 0) {
+            size  = CH_CHIRP_RECV_BATCH_SIZE;
+            batch = ch_alloc(size * bytes);
+        } else {
+            batch = ch_realloc(ichirp->recv_batch, size * bytes);
         }
-        if (uninit & CH_UNINIT_SERVERV6) {
-            uv_close((uv_handle_t*) &protocol->serverv6, ch_chirp_close_cb);
-            ichirp->closing_tasks += 1;
+        if (batch == NULL) {
+            EC(chirp,
+               "Could not grow the recv batch, passing the message alone. ",
+               "ch_message_t:%p",
+               (void*) msg);
+            ichirp->recv_batch_cb(chirp, &msg, 1);
+            return;
         }
-        if (uninit & CH_UNINIT_TIMER_GC) {
-            uv_timer_stop(&protocol->gc_timeout);
-            uv_close((uv_handle_t*) &protocol->gc_timeout, ch_chirp_close_cb);
-            ichirp->closing_tasks += 1;
+        ichirp->recv_batch      = batch;
+        ichirp->recv_batch_size = size;
+    }
+    if (ichirp->recv_batch_len == 0) {
+        uv_check_start(&ichirp->recv_check, _ch_chirp_recv_check_cb);
+    }
+    ichirp->recv_batch[ichirp->recv_batch_len] = msg;
+    ichirp->recv_batch_len += 1;
+}
+
+// .. c:function::
+void
+ch_chirp_finish_message(
+        ch_chirp_t* chirp, ch_connection_t* conn, ch_message_t* msg, int status)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_finish_message`
+//
+// .. code-block:: cpp
+//
+{
+    char flags = msg->_flags;
+    if (flags & CH_MSG_ACK_RECEIVED && flags & CH_MSG_WRITE_DONE) {
+        msg->_flags &= ~(CH_MSG_ACK_RECEIVED | CH_MSG_WRITE_DONE);
+#ifdef CH_ENABLE_LOGGING
+        {
+            char  id[CH_ID_SIZE * 2 + 1];
+            char* action = "Success";
+            if (status != CH_SUCCESS) {
+                action = "Failure:";
+            }
+            ch_bytes_to_hex(
+                    msg->identity, sizeof(msg->identity), id, sizeof(id));
+            if (msg->type & CH_MSG_ACK) {
+                LC(chirp,
+                   "%s: sending ACK message id: %s\n"
+                   "                            ",
+                   "ch_message_t:%p",
+                   action,
+                   id,
+                   (void*) msg);
+            } else if (msg->type & CH_MSG_NOOP) {
+                LC(chirp,
+                   "%s: sending NOOP\n",
+                   "ch_message_t:%p",
+                   action,
+                   (void*) msg);
+            } else {
+                LC(chirp,
+                   "%s: finishing message id: %s\n"
+                   "                            ",
+                   "ch_message_t:%p",
+                   action,
+                   id,
+                   (void*) msg);
+            }
         }
-        if (uninit & CH_UNINIT_TIMER_RECON) {
-            uv_timer_stop(&protocol->reconnect_timeout);
-            uv_close(
-                    (uv_handle_t*) &protocol->reconnect_timeout,
-                    ch_chirp_close_cb);
-            ichirp->closing_tasks += 1;
+#else
+        (void) (chirp);
+#endif
+        /* Finishing a message of a batch might have started the next write,
+         * the timeout also covers messages still waiting for their ACK. */
+        if (conn->writer.batch == NULL && conn->writer.stream == NULL &&
+            (conn->remote == NULL || conn->remote->wait_ack_count == 0)) {
+            /* The timer stops itself, see _ch_wr_write_timeout_cb */
+            conn->writer.deadline = 0;
         }
-        if (uninit & CH_UNINIT_SIGNAL) {
-            uv_signal_stop(&ichirp->signals[0]);
-            uv_signal_stop(&ichirp->signals[1]);
-            uv_close((uv_handle_t*) &ichirp->signals[0], ch_chirp_close_cb);
-            uv_close((uv_handle_t*) &ichirp->signals[1], ch_chirp_close_cb);
-            ichirp->closing_tasks += 2;
+        msg->_flags &= ~CH_MSG_USED;
+        if (msg->_send_cb != NULL) {
+            /* The user may free the message in the cb */
+            ch_send_cb_t cb = msg->_send_cb;
+            msg->_send_cb   = NULL;
+            cb(chirp, msg, status);
         }
-
-        uv_prepare_init(ichirp->loop, &ichirp->close_check);
-        ichirp->close_check.data = chirp;
-        uv_prepare_start(&ichirp->close_check, _ch_chirp_check_closing_cb);
+    }
+    if (conn->remote != NULL) {
+        ch_wr_process_queues(conn->remote);
     } else {
-        chirp->_init = 0;
-        if (uninit & CH_UNINIT_ICHIRP) {
-            ch_free(chirp->_);
+        A(conn->flags & CH_CN_SHUTTING_DOWN, "Expected shutdown");
+        /* Late write callback after shutdown. These are perfectly valid, since
+         * we clear the remote early to improve consistency. We have to lookup
+         * the remote. */
+        ch_remote_t  key;
+        ch_remote_t* remote = NULL;
+        ch_rm_init_from_conn(chirp, &key, conn, 1);
+        remote = ch_pr_find_remote(&chirp->_->protocol, &key);
+        if (remote != NULL) {
+            ch_wr_process_queues(remote);
         }
     }
-    if (uninit & CH_UNINIT_INIT_LOCK) {
-        uv_mutex_unlock(&_ch_chirp_init_lock);
-    }
 }
 
-// .. c:function::
-static void
-_ch_chirp_done_cb(uv_async_t* handle)
+CH_EXPORT
+void
+ch_chirp_release_msg_slot(
+        ch_chirp_t* rchirp, ch_message_t* msg, ch_release_cb_t release_cb)
 //    :noindex:
 //
-//    see: :c:func:`_ch_chirp_done_cb`
+//    see: :c:func:`ch_chirp_release_msg_slot`
 //
 // .. code-block:: cpp
 //
 {
-    ch_chirp_t* chirp = handle->data;
-    ch_chirp_check_m(chirp);
-    ch_chirp_int_t* ichirp = chirp->_;
-    handle->data           = ichirp;
-    uv_close((uv_handle_t*) handle, _ch_chirp_stop_cb);
-    L(chirp, "Closed.", CH_NO_ARG);
-    if (ichirp->flags & CH_CHIRP_AUTO_STOP) {
-        LC(chirp,
-           "UV-Loop stopped by chirp. ",
-           "uv_loop_t:%p",
-           (void*) ichirp->loop);
+    ch_buffer_pool_t* pool = msg->_pool;
+    ch_connection_t*  conn = pool->conn;
+    if (!(msg->_flags & CH_MSG_HAS_SLOT)) {
+        fprintf(stderr,
+                "%s:%d Fatal: Message does not have a slot. "
+                "ch_buffer_pool_t:%p\n",
+                __FILE__,
+                __LINE__,
+                (void*) pool);
+        return;
     }
-    if (ichirp->done_cb != NULL) {
-        ichirp->done_cb(chirp);
+    ch_chirp_trace(rchirp->_, CH_TR_SLOT_RELEASE, msg, msg->serial);
+    int call_cb = 1;
+    /* If the connection does not exist, it is already shutdown. The user may
+     * release a message after a connection has been shutdown. We use reference
+     * counting in the buffer pool to delay ch_free of the pool. */
+    if (conn && !(conn->flags & CH_CN_SHUTTING_DOWN)) {
+        ch_chirp_t* chirp = conn->chirp;
+        A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+        if (msg->_flags & CH_MSG_SEND_ACK) {
+            msg->_flags &= ~CH_MSG_SEND_ACK;
+            /* Send the ack to the connection, in case the user changed the
+             * message for his need, which is absolutely ok, and valid use
+             * case. */
+            if (conn->free_acks == 0) {
+                /* The peer does not respect the ack window, it will
+                 * time out waiting for the ack. */
+                EC(chirp,
+                   "No free ack message, dropping ack. ",
+                   "ch_connection_t:%p",
+                   (void*) conn);
+            } else {
+                int free = ch_msb32(conn->free_acks);
+                /* The msb represents the first ack. So the value is
+                 * inverted. */
+                conn->free_acks &= ~(1U << (free - 1));
+                ch_message_t* ack_msg = &conn->ack_msgs[32 - free];
+                memcpy(ack_msg->identity, msg->identity, CH_ID_SIZE);
+                ack_msg->user_data = rchirp;
+                A(ack_msg->_release_cb == NULL, "ack_msg in use");
+                ack_msg->_release_cb             = release_cb;
+                conn->release_serials[32 - free] = msg->serial;
+                call_cb                          = 0;
+                if (conn->flags & CH_CN_ACKS) {
+                    _ch_chirp_queue_ack(conn, 32 - free);
+                } else {
+                    ch_wr_send(chirp, ack_msg, _ch_chirp_ack_send_cb);
+                }
+            }
+        }
+    }
+    if (msg->_flags & CH_MSG_FREE_DATA) {
+        ch_bf_slab_free(msg->data);
+    }
+    if (msg->_flags & CH_MSG_FREE_HEADER) {
+        ch_bf_slab_free(msg->header);
+    }
+    /* The message is the first member of its slot */
+    ch_bf_slot_t* slot = (ch_bf_slot_t*) msg;
+    if (slot->shared != NULL) {
+        ch_bf_shared_free(slot->shared);
+        slot->shared = NULL;
+    }
+    if (call_cb) {
+        if (release_cb != NULL) {
+            release_cb(rchirp, msg->identity, msg->serial);
+        }
+    }
+    int pool_is_empty = ch_bf_is_exhausted(pool);
+    ch_bf_release(pool, slot);
+    /* Connections waiting for a slot of the shared pool come first */
+    ch_buffer_pool_t* waiter = ch_bf_take_waiter(pool);
+    /* Decrement refcnt and free if zero */
+    ch_bf_free(pool);
+    if (waiter != NULL) {
+        ch_pr_restart_stream(waiter->conn);
+        ch_bf_free(waiter);
+    }
+    if (pool_is_empty && conn) {
+        ch_pr_restart_stream(conn);
     }
 }
 
 // .. c:function::
-static void
-_ch_chirp_init_signals(ch_chirp_t* chirp)
+CH_EXPORT
+ch_error_t
+ch_chirp_release_msg_slot_ts(
+        ch_chirp_t* rchirp, ch_message_t* msg, ch_release_cb_t release_cb)
 //    :noindex:
 //
-//    see: :c:func:`_ch_chirp_init_signals`
+//    see: :c:func:`ch_chirp_release_msg_slot_ts`
 //
 // .. code-block:: cpp
 //
 {
-#ifndef CH_DISABLE_SIGNALS
-    ch_chirp_int_t* ichirp = chirp->_;
-    if (ichirp->config.DISABLE_SIGNALS) {
-        return;
-    }
-    uv_signal_init(ichirp->loop, &ichirp->signals[0]);
-    uv_signal_init(ichirp->loop, &ichirp->signals[1]);
-
-    ichirp->signals[0].data = chirp;
-    ichirp->signals[1].data = chirp;
-
-    if (uv_signal_start(&ichirp->signals[0], &_ch_chirp_sig_handler, SIGINT)) {
-        E(chirp, "Unable to set SIGINT handler", CH_NO_ARG);
-        return;
+    A(rchirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    A(msg->_release_cb == NULL, "Message already released");
+    msg->_release_cb       = release_cb;
+    ch_chirp_int_t* ichirp = rchirp->_;
+    /* Only signal the loop if it doesn't already have pending releases */
+    if (!ch_msg_mpsc_push(&ichirp->release_ts_queue, msg)) {
+        return CH_SUCCESS;
     }
-
-    if (uv_signal_start(&ichirp->signals[1], &_ch_chirp_sig_handler, SIGTERM)) {
-        uv_signal_stop(&ichirp->signals[0]);
-        uv_close((uv_handle_t*) &ichirp->signals[0], NULL);
-        E(chirp, "Unable to set SIGTERM handler", CH_NO_ARG);
+    if (uv_async_send(&ichirp->release_ts) < 0) {
+        E(rchirp, "Could not call release_ts callback", CH_NO_ARG);
+        return CH_UV_ERROR;
     }
-#else
-    (void) (chirp);
-#endif
+    return CH_SUCCESS;
 }
 
 // .. c:function::
-static void
-_ch_chirp_sig_handler(uv_signal_t* handle, int signo)
+CH_EXPORT
+ch_error_t
+ch_chirp_release_batch_ts(
+        ch_chirp_t*     rchirp,
+        ch_message_t**  msgs,
+        size_t          count,
+        ch_release_cb_t release_cb)
 //    :noindex:
 //
-//    see: :c:func:`_ch_chirp_sig_handler`
+//    see: :c:func:`ch_chirp_release_batch_ts`
 //
 // .. code-block:: cpp
 //
 {
-    ch_chirp_t* chirp = handle->data;
-    ch_chirp_check_m(chirp);
-
-    if (signo != SIGINT && signo != SIGTERM) {
-        return;
+    A(rchirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    if (count == 0) {
+        return CH_SUCCESS;
     }
-
-    ch_chirp_close_ts(chirp);
+    for (size_t i = 0; i < count; i++) {
+        A(msgs[i]->_release_cb == NULL, "Message already released");
+        msgs[i]->_release_cb = release_cb;
+    }
+    ch_chirp_int_t* ichirp = rchirp->_;
+    /* Only signal the loop if it doesn't already have pending releases */
+    if (!ch_msg_mpsc_push_batch(&ichirp->release_ts_queue, msgs, count)) {
+        return CH_SUCCESS;
+    }
+    if (uv_async_send(&ichirp->release_ts) < 0) {
+        E(rchirp, "Could not call release_ts callback", CH_NO_ARG);
+        return CH_UV_ERROR;
+    }
+    return CH_SUCCESS;
 }
 
 // .. c:function::
-static void
-_ch_chirp_start_cb(uv_async_t* handle)
+void
+ch_chirp_release_ts_cb(uv_async_t* handle)
 //    :noindex:
 //
-//    see: :c:func:`_ch_chirp_start_cb`
+//    see: :c:func:`ch_chirp_release_ts_cb`
 //
 // .. code-block:: cpp
 //
@@ -6239,686 +9729,548 @@ _ch_chirp_start_cb(uv_async_t* handle)
     ch_chirp_t* chirp = handle->data;
     ch_chirp_check_m(chirp);
     ch_chirp_int_t* ichirp = chirp->_;
-    uv_close((uv_handle_t*) handle, NULL);
-    if (ichirp->start_cb != NULL) {
-        ichirp->start_cb(chirp);
+    ch_message_t*   cur    = ch_msg_mpsc_take_all(&ichirp->release_ts_queue);
+    while (cur != NULL) {
+        ch_message_t* next = cur->_next;
+        cur->_next         = NULL;
+        ch_chirp_release_msg_slot(chirp, cur, cur->_release_cb);
+        cur = next;
     }
 }
 
 // .. c:function::
-static ch_error_t
-_ch_chirp_verify_cfg(ch_chirp_t* chirp)
+CH_EXPORT
+ch_error_t
+ch_chirp_run(
+        const ch_config_t* config,
+        ch_chirp_t**       chirp_out,
+        ch_recv_cb_t       recv_cb,
+        ch_start_cb_t      start_cb,
+        ch_done_cb_t       done_cb,
+        ch_log_cb_t        log_cb)
 //    :noindex:
 //
-//    see: :c:func:`_ch_chirp_verify_cfg`
+//    see: :c:func:`ch_chirp_run`
 //
 // .. code-block:: cpp
 //
 {
-    ch_config_t* conf = &chirp->_->config;
-#ifndef CH_WITHOUT_TLS
-    if (!conf->DISABLE_ENCRYPTION) {
-        V(chirp,
-          conf->DH_PARAMS_PEM != NULL,
-          "Config: DH_PARAMS_PEM must be set.",
-          CH_NO_ARG);
-        V(chirp,
-          conf->CERT_CHAIN_PEM != NULL,
-          "Config: CERT_CHAIN_PEM must be set.",
-          CH_NO_ARG);
-        V(chirp,
-          ch_access(conf->CERT_CHAIN_PEM, F_OK) != -1,
-          "Config: cert %s does not exist.",
-          conf->CERT_CHAIN_PEM);
-        V(chirp,
-          ch_access(conf->DH_PARAMS_PEM, F_OK) != -1,
-          "Config: cert %s does not exist.",
-          conf->CERT_CHAIN_PEM);
+    ch_chirp_t chirp;
+    uv_loop_t  loop;
+    ch_error_t tmp_err;
+    if (chirp_out == NULL) {
+        return CH_NOT_INITIALIZED;
     }
-#endif
-    V(chirp,
-      conf->PORT > 1024,
-      "Config: port must be > 1024. (%d)",
-      conf->PORT);
-    V(chirp,
-      conf->BACKLOG < 128,
-      "Config: backlog must be < 128. (%d)",
-      conf->BACKLOG);
-    V(chirp,
-      conf->TIMEOUT <= 1200,
-      "Config: timeout must be <= 1200. (%f)",
-      conf->TIMEOUT);
-    V(chirp,
-      conf->TIMEOUT >= 0.1,
-      "Config: timeout must be >= 0.1. (%f)",
-      conf->TIMEOUT);
-    V(chirp,
-      conf->REUSE_TIME >= 0.5,
-      "Config: resuse time must be => 0.5. (%f)",
-      conf->REUSE_TIME);
-    V(chirp,
-      conf->REUSE_TIME <= 3600,
-      "Config: resuse time must be <= 3600. (%f)",
-      conf->REUSE_TIME);
-    V(chirp,
-      conf->TIMEOUT <= conf->REUSE_TIME,
-      "Config: timeout must be <= reuse time. (%f, %f)",
-      conf->TIMEOUT,
-      conf->REUSE_TIME);
-    if (conf->SYNCHRONOUS == 1) {
-        V(chirp,
-          conf->MAX_SLOTS == 1,
-          "Config: if synchronous is enabled max slots must be 1.",
-          CH_NO_ARG);
+    *chirp_out = NULL;
+
+    tmp_err    = ch_loop_init(&loop);
+    chirp._log = NULL; /* Bootstrap order problem. E checks _log but
+                        * ch_chirp_init() will initialize it. */
+    if (tmp_err != CH_SUCCESS) {
+        EC((&chirp),
+           "Could not init loop: %d. ",
+           "uv_loop_t:%p",
+           tmp_err,
+           (void*) &loop);
+        return CH_INIT_FAIL;
+    }
+    tmp_err = ch_chirp_init(
+            &chirp, config, &loop, recv_cb, start_cb, done_cb, log_cb);
+    if (tmp_err != CH_SUCCESS) {
+        EC((&chirp),
+           "Could not init chirp: %d. ",
+           "ch_chirp_t:%p",
+           tmp_err,
+           (void*) &chirp);
+        return tmp_err;
+    }
+    LC((&chirp), "UV-Loop run by chirp. ", "uv_loop_t:%p", (void*) &loop);
+    /* This works and is not TOO bad because the function blocks. */
+    // cppcheck-suppress autoVariables
+    *chirp_out = &chirp;
+    tmp_err    = ch_run(&loop);
+    *chirp_out = NULL;
+    if (tmp_err != 0) {
+        fprintf(stderr,
+                "uv_run returned with error: %d. uv_loop_t:%p",
+                tmp_err,
+                (void*) &loop);
+        return tmp_err;
+    }
+    if (ch_loop_close(&loop)) {
+        return CH_UV_ERROR;
     }
-    V(chirp,
-      conf->MAX_SLOTS <= 32,
-      "Config: max slots must be <= 1.",
-      CH_NO_ARG);
-    V(chirp,
-      conf->BUFFER_SIZE >= CH_MIN_BUFFER_SIZE || conf->BUFFER_SIZE == 0,
-      "Config: buffer size must be > %d (%u)",
-      CH_MIN_BUFFER_SIZE,
-      conf->BUFFER_SIZE);
-    V(chirp,
-      conf->BUFFER_SIZE >= sizeof(ch_message_t) || conf->BUFFER_SIZE == 0,
-      "Config: buffer size must be > %lu (%u)",
-      (unsigned long) sizeof(ch_message_t),
-      conf->BUFFER_SIZE);
-    V(chirp,
-      conf->BUFFER_SIZE >= CH_SR_HANDSHAKE_SIZE || conf->BUFFER_SIZE == 0,
-      "Config: buffer size must be > %lu (%u)",
-      (unsigned long) CH_SR_HANDSHAKE_SIZE,
-      conf->BUFFER_SIZE);
     return CH_SUCCESS;
 }
 
 // .. c:function::
 CH_EXPORT
-ch_error_t
-ch_chirp_close_ts(ch_chirp_t* chirp)
+void
+ch_chirp_set_auto_stop_loop(ch_chirp_t* chirp)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_close_ts`
+//    see: :c:func:`ch_chirp_set_auto_stop_loop`
 //
-//    This function is thread-safe.
+//    This function is thread-safe
 //
 // .. code-block:: cpp
 //
 {
-    char            chirp_closed = 0;
-    ch_chirp_int_t* ichirp;
-    if (chirp == NULL || chirp->_init != CH_CHIRP_MAGIC) {
-        fprintf(stderr,
-                "%s:%d Fatal: chirp is not initialzed. ch_chirp_t:%p\n",
-                __FILE__,
-                __LINE__,
-                (void*) chirp);
-        return CH_NOT_INITIALIZED;
-    }
-    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
-    if (chirp->_ != NULL) {
-        ichirp = chirp->_;
-        if (ichirp->flags & CH_CHIRP_CLOSED) {
-            chirp_closed = 1;
-        }
-    } else {
-        chirp_closed = 1;
-    }
-    if (chirp_closed) {
-        fprintf(stderr,
-                "%s:%d Fatal: chirp is already closed. ch_chirp_t:%p\n",
-                __FILE__,
-                __LINE__,
-                (void*) chirp);
-        return CH_FATAL;
-    }
-    if (ichirp->flags & CH_CHIRP_CLOSING) {
-        E(chirp, "Close already in progress", CH_NO_ARG);
-        return CH_IN_PRORESS;
-    }
-    ichirp->flags |= CH_CHIRP_CLOSING;
-    ichirp->close.data = chirp;
-    L(chirp, "Closing chirp via callback", CH_NO_ARG);
-    if (uv_async_send(&ichirp->close) < 0) {
-        E(chirp, "Could not call close callback", CH_NO_ARG);
-        return CH_UV_ERROR;
-    }
-    return CH_SUCCESS;
+    ch_chirp_check_m(chirp);
+    chirp->_->flags |= CH_CHIRP_AUTO_STOP;
+}
+
+// .. c:function::
+CH_EXPORT
+void
+ch_chirp_set_log_callback(ch_chirp_t* chirp, ch_log_cb_t log_cb)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_set_log_callback`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_check_m(chirp);
+    chirp->_log = log_cb;
 }
 
 // .. c:function::
 CH_EXPORT
 void
-ch_chirp_config_init(ch_config_t* config)
+ch_chirp_set_public_port(ch_chirp_t* chirp, uint16_t port)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_config_init`
+//    see: :c:func:`ch_chirp_set_public_port`
 //
 // .. code-block:: cpp
 //
 {
-    *config = _ch_config_defaults;
+    ch_chirp_check_m(chirp);
+    chirp->_->public_port = port;
 }
 
 // .. c:function::
 CH_EXPORT
-ch_identity_t
-ch_chirp_get_identity(ch_chirp_t* chirp)
+void
+ch_chirp_set_drain_callback(ch_chirp_t* chirp, ch_drain_cb_t drain_cb)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_get_identity`
+//    see: :c:func:`ch_chirp_set_drain_callback`
 //
 // .. code-block:: cpp
 //
 {
-    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
-    ch_identity_t id;
-    memcpy(id.data, chirp->_->identity, sizeof(id.data));
-    return id;
+    ch_chirp_check_m(chirp);
+    ch_chirp_int_t* ichirp = chirp->_;
+    ichirp->drain_cb       = drain_cb;
 }
 
 // .. c:function::
 CH_EXPORT
-uv_loop_t*
-ch_chirp_get_loop(ch_chirp_t* chirp)
+int
+ch_chirp_full_is_total(ch_chirp_t* chirp)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_get_loop`
+//    see: :c:func:`ch_chirp_full_is_total`
 //
 // .. code-block:: cpp
 //
 {
-    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
-    return chirp->_->loop;
+    ch_chirp_check_m(chirp);
+    return chirp->_->full_total;
 }
 
 // .. c:function::
 CH_EXPORT
-ch_error_t
-ch_chirp_init(
-        ch_chirp_t*        chirp,
-        const ch_config_t* config,
-        uv_loop_t*         loop,
-        ch_recv_cb_t       recv_cb,
-        ch_start_cb_t      start_cb,
-        ch_done_cb_t       done_cb,
-        ch_log_cb_t        log_cb)
+void
+ch_chirp_set_recv_callback(ch_chirp_t* chirp, ch_recv_cb_t recv_cb)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_init`
+//    see: :c:func:`ch_chirp_set_recv_callback`
 //
 // .. code-block:: cpp
 //
 {
-    int      tmp_err;
-    uint16_t uninit = 0;
-    uv_mutex_lock(&_ch_chirp_init_lock);
-    uninit |= CH_UNINIT_INIT_LOCK;
-    memset(chirp, 0, sizeof(*chirp));
-    chirp->_init           = CH_CHIRP_MAGIC;
-    chirp->_thread         = uv_thread_self();
-    ch_chirp_int_t* ichirp = ch_alloc(sizeof(*ichirp));
-    if (!ichirp) {
-        fprintf(stderr,
-                "%s:%d Fatal: Could not allocate memory for chirp. "
-                "ch_chirp_t:%p\n",
-                __FILE__,
-                __LINE__,
-                (void*) chirp);
-        uv_mutex_unlock(&_ch_chirp_init_lock);
-        return CH_ENOMEM;
-    }
-    uninit |= CH_UNINIT_ICHIRP;
-    memset(ichirp, 0, sizeof(*ichirp));
-    ichirp->done_cb         = done_cb;
-    ichirp->config          = *config;
-    ichirp->public_port     = config->PORT;
-    ichirp->loop            = loop;
-    ichirp->start_cb        = start_cb;
-    ichirp->recv_cb         = recv_cb;
-    ch_config_t*   tconf    = &ichirp->config;
-    ch_protocol_t* protocol = &ichirp->protocol;
-    chirp->_                = ichirp;
-    if (log_cb != NULL) {
-        ch_chirp_set_log_callback(chirp, log_cb);
-    }
-
-    unsigned int i = 0;
-    while (i < (sizeof(tconf->IDENTITY) - 1) && tconf->IDENTITY[i] == 0)
-        i += 1;
-    if (tconf->IDENTITY[i] == 0) {
-        ch_random_ints_as_bytes(ichirp->identity, sizeof(ichirp->identity));
-    } else {
-        *ichirp->identity = *tconf->IDENTITY;
-    }
-
-    if (tconf->SYNCHRONOUS) {
-        tconf->MAX_SLOTS = 1;
-    } else {
-        if (tconf->MAX_SLOTS == 0) {
-            tconf->MAX_SLOTS = 16;
-        }
-    }
-    tconf->REUSE_TIME = ch_max_float(tconf->REUSE_TIME, tconf->TIMEOUT * 3);
-
-    if (uv_async_init(loop, &ichirp->done, _ch_chirp_done_cb) < 0) {
-        E(chirp, "Could not initialize done handler", CH_NO_ARG);
-        _ch_chirp_uninit(chirp, uninit);
-        /* Small inaccuracy for ease of use. The user can await the done_cb,
-         * except if we return CH_ENOMEM */
-        return CH_ENOMEM;
-    }
-    ichirp->done.data = chirp;
-    uninit |= CH_UNINIT_ASYNC_DONE;
-
-    tmp_err = _ch_chirp_verify_cfg(chirp);
-    if (tmp_err != CH_SUCCESS) {
-        _ch_chirp_uninit(chirp, uninit);
-        return tmp_err;
-    }
-
-    if (uv_async_init(loop, &ichirp->close, _ch_chirp_close_async_cb) < 0) {
-        E(chirp, "Could not initialize close callback", CH_NO_ARG);
-        _ch_chirp_uninit(chirp, uninit);
-        return CH_INIT_FAIL;
-    }
-    ichirp->close.data = chirp;
-    uninit |= CH_UNINIT_ASYNC_CLOSE;
-    if (uv_async_init(loop, &ichirp->start, _ch_chirp_start_cb) < 0) {
-        E(chirp, "Could not initialize done handler", CH_NO_ARG);
-        _ch_chirp_uninit(chirp, uninit);
-        return CH_INIT_FAIL;
-    }
-    ichirp->start.data = chirp;
-    uninit |= CH_UNINIT_ASYNC_START;
-    if (uv_async_init(loop, &ichirp->send_ts, ch_wr_send_ts_cb) < 0) {
-        E(chirp, "Could not initialize send_ts handler", CH_NO_ARG);
-        _ch_chirp_uninit(chirp, uninit);
-        return CH_INIT_FAIL;
-    }
-    ichirp->send_ts.data = chirp;
-    uninit |= CH_UNINIT_ASYNC_SEND_TS;
-    if (uv_mutex_init(&ichirp->send_ts_queue_lock) < 0) {
-        E(chirp, "Could not initialize send_ts_lock", CH_NO_ARG);
-        _ch_chirp_uninit(chirp, uninit);
-        return CH_INIT_FAIL;
-    }
-    uninit |= CH_UNINIT_SEND_TS_LOCK;
-    if (uv_async_init(loop, &ichirp->release_ts, ch_chirp_release_ts_cb) < 0) {
-        E(chirp, "Could not initialize release_ts handler", CH_NO_ARG);
-        _ch_chirp_uninit(chirp, uninit);
-        return CH_INIT_FAIL;
-    }
-    ichirp->release_ts.data = chirp;
-    uninit |= CH_UNINIT_ASYNC_RELE_TS;
-    if (uv_mutex_init(&ichirp->release_ts_queue_lock) < 0) {
-        E(chirp, "Could not initialize release_ts_lock", CH_NO_ARG);
-        _ch_chirp_uninit(chirp, uninit);
-        return CH_INIT_FAIL;
-    }
-    uninit |= CH_UNINIT_RELE_TS_LOCK;
-
-    ch_pr_init(chirp, protocol);
-    tmp_err = ch_pr_start(protocol, &uninit);
-    if (tmp_err != CH_SUCCESS) {
-        E(chirp, "Could not start protocol: %d", tmp_err);
-        _ch_chirp_uninit(chirp, uninit);
-        return tmp_err;
-    }
-#ifndef CH_WITHOUT_TLS
-    ch_encryption_t* enc = &ichirp->encryption;
-    if (!tconf->DISABLE_ENCRYPTION) {
-        ch_en_init(chirp, enc);
-        tmp_err = ch_en_start(enc);
-        if (tmp_err != CH_SUCCESS) {
-#ifdef CH_ENABLE_LOGGING
-            ERR_print_errors_fp(stderr);
-#endif
-            E(chirp, "Could not start encryption: %d", tmp_err);
-            _ch_chirp_uninit(chirp, uninit);
-            return tmp_err;
-        }
-    }
-#endif
-#ifdef CH_ENABLE_LOGGING
-    char id_str[CH_ID_SIZE * 2 + 1];
-    ch_bytes_to_hex(
-            ichirp->identity, sizeof(ichirp->identity), id_str, sizeof(id_str));
-    LC(chirp,
-       "Chirp initialized id: %s. ",
-       "uv_loop_t:%p",
-       id_str,
-       (void*) loop);
-#endif
-    _ch_chirp_init_signals(chirp);
-    uninit |= CH_UNINIT_SIGNAL;
-    if (uv_async_send(&ichirp->start) < 0) {
-        E(chirp, "Could not call start callback", CH_NO_ARG);
-        _ch_chirp_uninit(chirp, uninit);
-        return CH_UV_ERROR;
-    }
-    uv_mutex_unlock(&_ch_chirp_init_lock);
-    return CH_SUCCESS;
+    ch_chirp_check_m(chirp);
+    ch_chirp_int_t* ichirp = chirp->_;
+    ichirp->recv_cb        = recv_cb;
 }
 
 // .. c:function::
+CH_EXPORT
 void
-ch_chirp_finish_message(
-        ch_chirp_t* chirp, ch_connection_t* conn, ch_message_t* msg, int status)
+ch_chirp_set_recv_batch_callback(
+        ch_chirp_t* chirp, ch_recv_batch_cb_t recv_batch_cb)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_finish_message`
+//    see: :c:func:`ch_chirp_set_recv_batch_callback`
 //
 // .. code-block:: cpp
 //
 {
-    char flags = msg->_flags;
-    if (flags & CH_MSG_ACK_RECEIVED && flags & CH_MSG_WRITE_DONE) {
-        msg->_flags &= ~(CH_MSG_ACK_RECEIVED | CH_MSG_WRITE_DONE);
-#ifdef CH_ENABLE_LOGGING
-        {
-            char  id[CH_ID_SIZE * 2 + 1];
-            char* action = "Success";
-            if (status != CH_SUCCESS) {
-                action = "Failure:";
-            }
-            ch_bytes_to_hex(
-                    msg->identity, sizeof(msg->identity), id, sizeof(id));
-            if (msg->type & CH_MSG_ACK) {
-                LC(chirp,
-                   "%s: sending ACK message id: %s\n"
-                   "                            ",
-                   "ch_message_t:%p",
-                   action,
-                   id,
-                   (void*) msg);
-            } else if (msg->type & CH_MSG_NOOP) {
-                LC(chirp,
-                   "%s: sending NOOP\n",
-                   "ch_message_t:%p",
-                   action,
-                   (void*) msg);
-            } else {
-                LC(chirp,
-                   "%s: finishing message id: %s\n"
-                   "                            ",
-                   "ch_message_t:%p",
-                   action,
-                   id,
-                   (void*) msg);
-            }
-        }
-#else
-        (void) (chirp);
-#endif
-        uv_timer_stop(&conn->writer.send_timeout);
-        msg->_flags &= ~CH_MSG_USED;
-        if (msg->_send_cb != NULL) {
-            /* The user may free the message in the cb */
-            ch_send_cb_t cb = msg->_send_cb;
-            msg->_send_cb   = NULL;
-            cb(chirp, msg, status);
-        }
-    }
-    if (conn->remote != NULL) {
-        ch_wr_process_queues(conn->remote);
-    } else {
-        A(conn->flags & CH_CN_SHUTTING_DOWN, "Expected shutdown");
-        /* Late write callback after shutdown. These are perfectly valid, since
-         * we clear the remote early to improve consistency. We have to lookup
-         * the remote. */
-        ch_remote_t  key;
-        ch_remote_t* remote = NULL;
-        ch_rm_init_from_conn(chirp, &key, conn, 1);
-        if (ch_rm_find(chirp->_->protocol.remotes, &key, &remote) ==
-            CH_SUCCESS) {
-            ch_wr_process_queues(remote);
-        }
+    ch_chirp_check_m(chirp);
+    ch_chirp_int_t* ichirp = chirp->_;
+    /* Pass pending messages to the previous callback */
+    _ch_chirp_flush_recv_batch(chirp);
+    ichirp->recv_batch_cb = recv_batch_cb;
+    if (recv_batch_cb != NULL &&
+        !(ichirp->flags & (CH_CHIRP_RECV_BATCH | CH_CHIRP_CLOSING))) {
+        int tmp_err = uv_check_init(ichirp->loop, &ichirp->recv_check);
+        A(tmp_err == CH_SUCCESS, "Could not init check handle");
+        (void) (tmp_err);
+        ichirp->recv_check.data = chirp;
+        ichirp->flags |= CH_CHIRP_RECV_BATCH;
     }
 }
 
+// .. c:function::
+CH_EXPORT
+void
+ch_chirp_set_stream_callback(ch_chirp_t* chirp, ch_stream_cb_t stream_cb)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_set_stream_callback`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_check_m(chirp);
+    ch_chirp_int_t* ichirp = chirp->_;
+    ichirp->stream_cb      = stream_cb;
+}
+
+// .. c:function::
 CH_EXPORT
 void
-ch_chirp_release_msg_slot(
-        ch_chirp_t* rchirp, ch_message_t* msg, ch_release_cb_t release_cb)
+ch_chirp_set_trace_callback(ch_chirp_t* chirp, ch_trace_cb_t trace_cb)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_release_msg_slot`
+//    see: :c:func:`ch_chirp_set_trace_callback`
 //
 // .. code-block:: cpp
 //
 {
-    ch_buffer_pool_t* pool = msg->_pool;
-    ch_connection_t*  conn = pool->conn;
-    if (!(msg->_flags & CH_MSG_HAS_SLOT)) {
-        fprintf(stderr,
-                "%s:%d Fatal: Message does not have a slot. "
-                "ch_buffer_pool_t:%p\n",
-                __FILE__,
-                __LINE__,
-                (void*) pool);
+    ch_chirp_check_m(chirp);
+    ch_chirp_int_t* ichirp = chirp->_;
+    ichirp->trace_cb       = trace_cb;
+}
+
+// .. c:function::
+void
+ch_chirp_trace_timeout(ch_chirp_t* chirp)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_trace_timeout`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_int_t* ichirp = chirp->_;
+    if (ichirp->trace == NULL) {
         return;
     }
-    int call_cb = 1;
-    /* If the connection does not exist, it is already shutdown. The user may
-     * release a message after a connection has been shutdown. We use reference
-     * counting in the buffer pool to delay ch_free of the pool. */
-    if (conn && !(conn->flags & CH_CN_SHUTTING_DOWN)) {
-        ch_chirp_t* chirp = conn->chirp;
-        A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
-        if (msg->_flags & CH_MSG_SEND_ACK) {
-            msg->_flags &= ~CH_MSG_SEND_ACK;
-            /* Send the ack to the connection, in case the user changed the
-             * message for his need, which is absolutely ok, and valid use
-             * case. */
-            ch_message_t* ack_msg = &conn->ack_msg;
-            memcpy(ack_msg->identity, msg->identity, CH_ID_SIZE);
-            ack_msg->user_data = rchirp;
-            A(ack_msg->_release_cb == NULL, "ack_msg in use");
-            ack_msg->_release_cb = release_cb;
-            conn->release_serial = msg->serial;
-            call_cb              = 0;
-            ch_wr_send(chirp, ack_msg, _ch_chirp_ack_send_cb);
-        }
-    }
-    if (msg->_flags & CH_MSG_FREE_DATA) {
-        ch_free(msg->data);
-    }
-    if (msg->_flags & CH_MSG_FREE_HEADER) {
-        ch_free(msg->header);
-    }
-    if (call_cb) {
-        if (release_cb != NULL) {
-            release_cb(rchirp, msg->identity, msg->serial);
-        }
-    }
-    int pool_is_empty = ch_bf_is_exhausted(pool);
-    ch_bf_release(pool, msg->_slot);
-    /* Decrement refcnt and free if zero */
-    ch_bf_free(pool);
-    if (pool_is_empty && conn) {
-        ch_pr_restart_stream(conn);
+    ch_chirp_trace(ichirp, CH_TR_TIMEOUT, NULL, 0);
+    if (ichirp->trace_cb != NULL) {
+        ichirp->trace_cb(chirp);
     }
 }
 
 // .. c:function::
 CH_EXPORT
-ch_error_t
-ch_chirp_release_msg_slot_ts(
-        ch_chirp_t* rchirp, ch_message_t* msg, ch_release_cb_t release_cb)
+uint32_t
+ch_chirp_get_trace(ch_chirp_t* chirp, ch_trace_event_t* events, uint32_t count)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_release_msg_slot_ts`
+//    see: :c:func:`ch_chirp_get_trace`
 //
 // .. code-block:: cpp
 //
 {
-    A(rchirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
-    A(msg->_release_cb == NULL, "Message already released");
-    msg->_release_cb       = release_cb;
-    ch_chirp_int_t* ichirp = rchirp->_;
-    uv_mutex_lock(&ichirp->release_ts_queue_lock);
-    ch_msg_enqueue(&ichirp->release_ts_queue, msg);
-    uv_mutex_unlock(&ichirp->release_ts_queue_lock);
-    if (uv_async_send(&ichirp->release_ts) < 0) {
-        E(rchirp, "Could not call release_ts callback", CH_NO_ARG);
-        return CH_UV_ERROR;
+    ch_chirp_check_m(chirp);
+    ch_chirp_int_t* ichirp = chirp->_;
+    uint32_t        size   = ichirp->config.TRACE_SIZE;
+    if (count > ichirp->trace_count) {
+        count = ichirp->trace_count;
     }
-    return CH_SUCCESS;
+    if (count == 0) {
+        return 0;
+    }
+    /* Start count events before the next position */
+    uint32_t pos = (ichirp->trace_pos + size - count) % size;
+    for (uint32_t i = 0; i < count; i++) {
+        events[i] = ichirp->trace[pos];
+        pos += 1;
+        if (pos == size) {
+            pos = 0;
+        }
+    }
+    return count;
 }
 
 // .. c:function::
+CH_EXPORT
 void
-ch_chirp_release_ts_cb(uv_async_t* handle)
+ch_chirp_dump_trace(ch_chirp_t* chirp, FILE* out)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_release_ts_cb`
+//    see: :c:func:`ch_chirp_dump_trace`
 //
 // .. code-block:: cpp
 //
 {
-    ch_chirp_t* chirp = handle->data;
+    static char* names[] = {
+            "",
+            "ENQUEUE",
+            "DEQUEUE",
+            "WRITE",
+            "WRITE_DONE",
+            "ACK",
+            "SLOT_ACQUIRE",
+            "SLOT_RELEASE",
+            "TIMEOUT",
+    };
     ch_chirp_check_m(chirp);
     ch_chirp_int_t* ichirp = chirp->_;
-    uv_mutex_lock(&ichirp->release_ts_queue_lock);
-    ch_message_t* cur;
-    ch_msg_dequeue(&ichirp->release_ts_queue, &cur);
-    while (cur != NULL) {
-        uv_mutex_unlock(&ichirp->release_ts_queue_lock);
-        ch_chirp_release_msg_slot(chirp, cur, cur->_release_cb);
-        uv_mutex_lock(&ichirp->release_ts_queue_lock);
-        ch_msg_dequeue(&ichirp->release_ts_queue, &cur);
+    uint32_t        size   = ichirp->config.TRACE_SIZE;
+    uint32_t        pos    = 0;
+    if (ichirp->trace_count == size) {
+        pos = ichirp->trace_pos; /* The ring is full, the oldest is next */
+    }
+    for (uint32_t i = 0; i < ichirp->trace_count; i++) {
+        char              id[CH_ID_SIZE * 2 + 1];
+        ch_trace_event_t* event = &ichirp->trace[pos];
+        ch_bytes_to_hex(event->identity, CH_ID_SIZE, id, sizeof(id));
+        fprintf(out,
+                "%llu %-12s id:%s serial:%u type:%u\n",
+                (unsigned long long) event->time,
+                names[event->type],
+                id,
+                event->serial,
+                event->msg_type);
+        pos += 1;
+        if (pos == size) {
+            pos = 0;
+        }
+    }
+}
+
+// .. c:function::
+static void
+_ch_shards_run(void* arg)
+//
+//    Thread of a shard: Initialize the chirp instance and run the loop.
+//
+//    :param void* arg: The ch_shard_t
+//
+// .. code-block:: cpp
+//
+{
+    ch_shard_t*      shard    = arg;
+    ch_shards_t*     shards   = shard->shards;
+    ch_shards_int_t* ishards  = shards->_;
+    int              loop_err = ch_loop_init(&shard->loop);
+    if (loop_err != CH_SUCCESS) {
+        shard->status = CH_INIT_FAIL;
+        uv_sem_post(&ishards->initialized);
+        return;
+    }
+    /* The chirp instance has to be initialized in the thread running it */
+    shard->status = ch_chirp_init(
+            &shard->chirp,
+            &ishards->config,
+            &shard->loop,
+            ishards->recv_cb,
+            ishards->start_cb,
+            ishards->done_cb,
+            ishards->log_cb);
+    if (shard->status == CH_SUCCESS) {
+        shard->chirp.user_data = shards;
     }
-    uv_mutex_unlock(&ichirp->release_ts_queue_lock);
+    uv_sem_post(&ishards->initialized);
+    /* Also finishes closing the handles if init failed */
+    ch_run(&shard->loop);
+    ch_loop_close(&shard->loop);
 }
 
 // .. c:function::
 CH_EXPORT
 ch_error_t
-ch_chirp_run(
-        const ch_config_t* config,
-        ch_chirp_t**       chirp_out,
-        ch_recv_cb_t       recv_cb,
-        ch_start_cb_t      start_cb,
-        ch_done_cb_t       done_cb,
-        ch_log_cb_t        log_cb)
+ch_shards_close_ts(ch_shards_t* shards)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_run`
+//    see: :c:func:`ch_shards_close_ts`
 //
 // .. code-block:: cpp
 //
 {
-    ch_chirp_t chirp;
-    uv_loop_t  loop;
-    ch_error_t tmp_err;
-    if (chirp_out == NULL) {
-        return CH_NOT_INITIALIZED;
-    }
-    *chirp_out = NULL;
-
-    tmp_err    = ch_loop_init(&loop);
-    chirp._log = NULL; /* Bootstrap order problem. E checks _log but
-                        * ch_chirp_init() will initialize it. */
-    if (tmp_err != CH_SUCCESS) {
-        EC((&chirp),
-           "Could not init loop: %d. ",
-           "uv_loop_t:%p",
-           tmp_err,
-           (void*) &loop);
-        return CH_INIT_FAIL;
-    }
-    tmp_err = ch_chirp_init(
-            &chirp, config, &loop, recv_cb, start_cb, done_cb, log_cb);
-    if (tmp_err != CH_SUCCESS) {
-        EC((&chirp),
-           "Could not init chirp: %d. ",
-           "ch_chirp_t:%p",
-           tmp_err,
-           (void*) &chirp);
-        return tmp_err;
-    }
-    LC((&chirp), "UV-Loop run by chirp. ", "uv_loop_t:%p", (void*) &loop);
-    /* This works and is not TOO bad because the function blocks. */
-    // cppcheck-suppress autoVariables
-    *chirp_out = &chirp;
-    tmp_err    = ch_run(&loop);
-    *chirp_out = NULL;
-    if (tmp_err != 0) {
-        fprintf(stderr,
-                "uv_run returned with error: %d. uv_loop_t:%p",
-                tmp_err,
-                (void*) &loop);
-        return tmp_err;
-    }
-    if (ch_loop_close(&loop)) {
-        return CH_UV_ERROR;
+    ch_error_t ret = CH_SUCCESS;
+    for (uint8_t i = 0; i < shards->count; i++) {
+        ch_shard_t* shard = &shards->_->shards[i];
+        if (shard->status == CH_SUCCESS) {
+            ch_error_t tmp_err = ch_chirp_close_ts(&shard->chirp);
+            if (tmp_err != CH_SUCCESS) {
+                ret = tmp_err;
+            }
+        }
     }
-    return CH_SUCCESS;
+    return ret;
 }
 
 // .. c:function::
 CH_EXPORT
-void
-ch_chirp_set_auto_stop_loop(ch_chirp_t* chirp)
+ch_chirp_t*
+ch_shards_get_chirp(ch_shards_t* shards, uint8_t index)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_set_auto_stop_loop`
+//    see: :c:func:`ch_shards_get_chirp`
 //
-//    This function is thread-safe
+// .. code-block:: cpp
+//
+{
+    A(index < shards->count, "Shard index out of range");
+    return &shards->_->shards[index].chirp;
+}
+
+// .. c:function::
+CH_EXPORT
+ch_chirp_t*
+ch_shards_get_owner(ch_shards_t* shards, const ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`ch_shards_get_owner`
 //
 // .. code-block:: cpp
 //
 {
-    ch_chirp_check_m(chirp);
-    chirp->_->flags |= CH_CHIRP_AUTO_STOP;
+    uint32_t hash = ch_rm_hash(msg->ip_protocol, msg->address, msg->port);
+    /* Use the high bits, the remote index of the shard uses the low bits */
+    uint32_t index = (uint32_t)(((uint64_t) hash * shards->count) >> 32);
+    return &shards->_->shards[index].chirp;
 }
 
 // .. c:function::
 CH_EXPORT
-void
-ch_chirp_set_log_callback(ch_chirp_t* chirp, ch_log_cb_t log_cb)
+ch_error_t
+ch_shards_init(
+        ch_shards_t*       shards,
+        uint8_t            count,
+        const ch_config_t* config,
+        ch_recv_cb_t       recv_cb,
+        ch_start_cb_t      start_cb,
+        ch_done_cb_t       done_cb,
+        ch_log_cb_t        log_cb)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_set_log_callback`
+//    see: :c:func:`ch_shards_init`
 //
 // .. code-block:: cpp
 //
 {
-    ch_chirp_check_m(chirp);
-    chirp->_log = log_cb;
+    if (count == 0) {
+        return CH_VALUE_ERROR;
+    }
+    ch_shards_int_t* ishards = ch_alloc(sizeof(*ishards));
+    if (ishards == NULL) {
+        return CH_ENOMEM;
+    }
+    memset(ishards, 0, sizeof(*ishards));
+    ishards->shards = ch_alloc(count * sizeof(*ishards->shards));
+    if (ishards->shards == NULL) {
+        ch_free(ishards);
+        return CH_ENOMEM;
+    }
+    memset(ishards->shards, 0, count * sizeof(*ishards->shards));
+    if (uv_sem_init(&ishards->initialized, 0) < 0) {
+        ch_free(ishards->shards);
+        ch_free(ishards);
+        return CH_INIT_FAIL;
+    }
+    ishards->config    = *config;
+    ishards->recv_cb   = recv_cb;
+    ishards->start_cb  = start_cb;
+    ishards->done_cb   = done_cb;
+    ishards->log_cb    = log_cb;
+    shards->count      = count;
+    shards->_          = ishards;
+    ch_config_t* tconf = &ishards->config;
+    tconf->REUSE_PORT  = 1;
+
+    uint8_t zero[CH_ID_SIZE] = {0};
+    if (memcmp(tconf->IDENTITY, zero, CH_ID_SIZE) == 0) {
+        /* One identity for all shards */
+        ch_random_ints_as_bytes(tconf->IDENTITY, CH_ID_SIZE);
+    }
+
+    ch_error_t ret     = CH_SUCCESS;
+    uint8_t    started = 0;
+    for (; started < count; started++) {
+        ch_shard_t* shard = &ishards->shards[started];
+        shard->shards     = shards;
+        shard->status     = CH_IN_PRORESS;
+        if (uv_thread_create(&shard->thread, _ch_shards_run, shard) < 0) {
+            ret = CH_INIT_FAIL;
+            break;
+        }
+    }
+    for (uint8_t i = 0; i < started; i++) {
+        uv_sem_wait(&ishards->initialized);
+    }
+    for (uint8_t i = 0; i < started; i++) {
+        if (ishards->shards[i].status != CH_SUCCESS) {
+            ret = ishards->shards[i].status;
+        }
+    }
+    if (ret != CH_SUCCESS) {
+        /* Only join the threads that were started */
+        shards->count = started;
+        ch_shards_close_ts(shards);
+        ch_shards_join(shards);
+    }
+    return ret;
 }
 
 // .. c:function::
 CH_EXPORT
-void
-ch_chirp_set_public_port(ch_chirp_t* chirp, uint16_t port)
+ch_error_t
+ch_shards_join(ch_shards_t* shards)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_set_public_port`
+//    see: :c:func:`ch_shards_join`
 //
 // .. code-block:: cpp
 //
 {
-    ch_chirp_check_m(chirp);
-    chirp->_->public_port = port;
+    ch_shards_int_t* ishards = shards->_;
+    ch_error_t       ret     = CH_SUCCESS;
+    if (ishards == NULL) {
+        return CH_NOT_INITIALIZED;
+    }
+    for (uint8_t i = 0; i < shards->count; i++) {
+        if (uv_thread_join(&ishards->shards[i].thread) < 0) {
+            ret = CH_UV_ERROR;
+        }
+    }
+    uv_sem_destroy(&ishards->initialized);
+    ch_free(ishards->shards);
+    ch_free(ishards);
+    shards->_     = NULL;
+    shards->count = 0;
+    return ret;
 }
 
 // .. c:function::
 CH_EXPORT
-void
-ch_chirp_set_recv_callback(ch_chirp_t* chirp, ch_recv_cb_t recv_cb)
+ch_error_t
+ch_shards_send_ts(ch_shards_t* shards, ch_message_t* msg, ch_send_cb_t send_cb)
 //    :noindex:
 //
-//    see: :c:func:`ch_chirp_set_recv_callback`
+//    see: :c:func:`ch_shards_send_ts`
 //
 // .. code-block:: cpp
 //
 {
-    ch_chirp_check_m(chirp);
-    ch_chirp_int_t* ichirp = chirp->_;
-    ichirp->recv_cb        = recv_cb;
+    return ch_chirp_send_ts(ch_shards_get_owner(shards, msg), msg, send_cb);
 }
 
 // .. c:function::
@@ -7085,32 +10437,99 @@ ch_run(uv_loop_t* loop)
 // Data Struct Prototypes
 // ======================
 //
-// .. code-block:: cpp
-
-rb_bind_impl_m(ch_cn, ch_connection_t) CH_ALLOW_NL;
+// .. code-block:: cpp
+
+rb_bind_impl_m(ch_cn, ch_connection_t) CH_ALLOW_NL;
+
+qs_stack_bind_impl_m(ch_cn_st, ch_connection_t) CH_ALLOW_NL;
+
+// Declarations
+// ============
+
+// .. c:function::
+static void
+_ch_cn_add_buffered(ch_connection_t* conn);
+//
+//    Add the connection to the buffered_conns list of chirp, if it is not in
+//    it and adaptive buffers are enabled.
+//
+//    :param ch_connection_t* conn: Connection
+//
+
+// .. c:function::
+static ch_error_t
+_ch_cn_allocate_buffers(ch_connection_t* conn);
+//
+//    Allocate the connections communication buffers.
+//
+//    :param ch_connection_t* conn: Connection
+//
+
+// .. c:function::
+static void
+_ch_cn_closing(ch_connection_t* conn);
+//
+//    Called by ch_cn_shutdown to enter the closing stage.
+//
+//    :param ch_connection_t: Connection to close
+//
 
-qs_stack_bind_impl_m(ch_cn_st, ch_connection_t) CH_ALLOW_NL;
+// .. c:function::
+static void
+_ch_cn_free_tls_buffers(ch_connection_t* conn);
+//
+//    Free the TLS buffers of the connection.
+//
+//    :param ch_connection_t* conn: Connection
+//
 
-// Declarations
-// ============
+// .. c:function::
+static ch_bf_shared_t*
+_ch_cn_idle_buffer(ch_chirp_int_t* ichirp, size_t size);
+//
+//    Return the idle buffer, a new one if messages point into it or a
+//    connection kept it.
+//
+//    :param ch_chirp_int_t* ichirp: Chirp internals
+//    :param size_t size: Size of the idle buffer
+//    :return: The idle buffer or NULL if out of memory.
+//    :rtype:  ch_bf_shared_t*
+//
 
 // .. c:function::
-static ch_error_t
-_ch_cn_allocate_buffers(ch_connection_t* conn);
+static void
+_ch_cn_remove_buffered(ch_connection_t* conn);
 //
-//    Allocate the connections communication buffers.
+//    Remove the connection from the buffered_conns list of chirp, if it is in
+//    it.
 //
 //    :param ch_connection_t* conn: Connection
 //
 
+#ifndef CH_WITHOUT_TLS
 // .. c:function::
 static void
-_ch_cn_closing(ch_connection_t* conn);
+_ch_cn_gather_plaintext(ch_connection_t* conn);
 //
-//    Called by ch_cn_shutdown to enter the closing stage.
+//    Copy the next small buffers of a write into the plaintext staging
+//    buffer, so they get encrypted as one full TLS record. Buffers of at
+//    least one record are left alone and encrypted in place.
 //
-//    :param ch_connection_t: Connection to close
+//    :param ch_connection_t* conn: Connection
+//
+#endif
+
+#ifndef CH_WITHOUT_TLS
+// .. c:function::
+static int
+_ch_cn_plaintext_left(ch_connection_t* conn);
+//
+//    Skip exhausted buffers and return 1 if plaintext of the current write
+//    has not been passed to the TLS library yet.
 //
+//    :param ch_connection_t* conn: Connection
+//
+#endif
 
 #ifndef CH_WITHOUT_TLS
 // .. c:function::
@@ -7165,6 +10584,28 @@ _ch_cn_send_handshake_cb(uv_write_t* req, int status);
 
 MINMAX_FUNCS(size_t)
 
+// .. c:function::
+void
+ch_cn_abort_cntl_messages(ch_remote_t* remote, ch_error_t error)
+//    :noindex:
+//
+//    see: :c:func:`ch_cn_abort_cntl_messages`
+//
+// .. code-block:: cpp
+//
+{
+    ch_message_t* msg;
+    ch_msg_dequeue(&remote->cntl_msg_queue, &msg);
+    while (msg != NULL) {
+        ch_send_cb_t cb = msg->_send_cb;
+        if (cb != NULL) {
+            msg->_send_cb = NULL;
+            cb(remote->chirp, msg, error);
+        }
+        ch_msg_dequeue(&remote->cntl_msg_queue, &msg);
+    }
+}
+
 // .. c:function::
 void
 ch_cn_abort_one_message(ch_remote_t* remote, ch_error_t error)
@@ -7175,11 +10616,13 @@ ch_cn_abort_one_message(ch_remote_t* remote, ch_error_t error)
 // .. code-block:: cpp
 //
 {
-    ch_message_t* msg = NULL;
+    ch_message_t*  msg   = NULL;
+    ch_message_t** queue = ch_rm_msg_queue(remote);
     if (remote->cntl_msg_queue != NULL) {
         ch_msg_dequeue(&remote->cntl_msg_queue, &msg);
-    } else if (remote->msg_queue != NULL) {
-        ch_msg_dequeue(&remote->msg_queue, &msg);
+    } else if (queue != NULL) {
+        ch_msg_dequeue(queue, &msg);
+        ch_rm_msg_dequeued(remote, msg);
     }
     if (msg != NULL) {
 #ifdef CH_ENABLE_LOGGING
@@ -7202,7 +10645,31 @@ ch_cn_abort_one_message(ch_remote_t* remote, ch_error_t error)
             msg->_send_cb = NULL;
             cb(remote->chirp, msg, error);
         }
+        ch_rm_check_drain(remote);
+    }
+}
+
+// .. c:function::
+static void
+_ch_cn_add_buffered(ch_connection_t* conn)
+//    :noindex:
+//
+//    See: :c:func:`_ch_cn_add_buffered`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_int_t* ichirp = conn->chirp->_;
+    if (conn->flags & CH_CN_BUFFERED || !ichirp->config.ADAPTIVE_BUFFERS) {
+        return;
     }
+    conn->flags |= CH_CN_BUFFERED;
+    conn->buffered_prev = NULL;
+    conn->buffered_next = ichirp->buffered_conns;
+    if (conn->buffered_next != NULL) {
+        conn->buffered_next->buffered_prev = conn;
+    }
+    ichirp->buffered_conns = conn;
 }
 
 // .. c:function::
@@ -7222,33 +10689,35 @@ _ch_cn_allocate_buffers(ch_connection_t* conn)
     if (size == 0) {
         size = CH_BUFFER_SIZE;
     }
-    conn->buffer_uv   = ch_alloc(size);
     conn->buffer_size = size;
-    if (conn->flags & CH_CN_ENCRYPTED) {
-        conn->buffer_wtls = ch_alloc(size);
-        size              = ch_min_size_t(size, CH_ENC_BUFFER_SIZE);
-        conn->buffer_rtls = ch_alloc(size);
+    conn->bufs        = ch_chirp_alloc(ichirp, sizeof(uv_buf_t) * 3);
+    conn->bufs_size   = 3;
+    if (conn->bufs == NULL) {
+        EC(chirp,
+           "Could not allocate memory for libuv. ",
+           "ch_connection_t:%p",
+           (void*) conn);
+        return CH_ENOMEM;
     }
-    int alloc_nok = 0;
-    if (conn->flags & CH_CN_ENCRYPTED) {
-        alloc_nok =
-                !(conn->buffer_uv && conn->buffer_wtls && conn->buffer_rtls);
-    } else {
-        alloc_nok = !conn->buffer_uv;
+    conn->flags |= CH_CN_INIT_BUFFERS;
+    if (ichirp->config.ADAPTIVE_BUFFERS) {
+        /* Allocated on first use: see ch_cn_read_alloc_cb and
+         * ch_cn_alloc_tls_buffers */
+        return CH_SUCCESS;
     }
-    if (alloc_nok) {
+    conn->buffer_shared = ch_bf_shared_new(size);
+    if (conn->buffer_shared == NULL) {
         EC(chirp,
-           "Could not allocate memory for libuv and tls. ",
+           "Could not allocate memory for libuv. ",
            "ch_connection_t:%p",
            (void*) conn);
         return CH_ENOMEM;
     }
-    conn->buffer_rtls_size = size;
-    conn->buffer_uv_uv     = uv_buf_init(conn->buffer_uv, conn->buffer_size);
-    conn->buffer_wtls_uv   = uv_buf_init(conn->buffer_wtls, conn->buffer_size);
-    conn->bufs             = ch_alloc(sizeof(uv_buf_t) * 3);
-    conn->bufs_size        = 3;
-    conn->flags |= CH_CN_INIT_BUFFERS;
+    conn->buffer_uv    = ch_bf_shared_data(conn->buffer_shared);
+    conn->buffer_uv_uv = uv_buf_init(conn->buffer_uv, conn->buffer_size);
+    if (conn->flags & CH_CN_ENCRYPTED) {
+        return ch_cn_alloc_tls_buffers(conn);
+    }
     A((conn->flags & CH_CN_INIT) == CH_CN_INIT,
       "Connection not fully initialized");
     return CH_SUCCESS;
@@ -7298,6 +10767,89 @@ _ch_cn_closing(ch_connection_t* conn)
     }
 }
 
+// .. c:function::
+static void
+_ch_cn_free_tls_buffers(ch_connection_t* conn)
+//    :noindex:
+//
+//    See: :c:func:`_ch_cn_free_tls_buffers`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_int_t* ichirp = conn->chirp->_;
+    if (conn->buffer_wtls != NULL) {
+        ch_chirp_free(ichirp, conn->buffer_wtls);
+        conn->buffer_wtls = NULL;
+    }
+    if (conn->buffer_rtls != NULL) {
+        ch_chirp_free(ichirp, conn->buffer_rtls);
+        conn->buffer_rtls = NULL;
+    }
+    if (conn->buffer_ptls != NULL) {
+        ch_chirp_free(ichirp, conn->buffer_ptls);
+        conn->buffer_ptls = NULL;
+    }
+}
+
+#ifndef CH_WITHOUT_TLS
+// .. c:function::
+static void
+_ch_cn_gather_plaintext(ch_connection_t* conn)
+//    :noindex:
+//
+//    See: :c:func:`_ch_cn_gather_plaintext`
+//
+// .. code-block:: cpp
+//
+{
+    conn->ptls_len     = 0;
+    conn->ptls_written = 0;
+    while (conn->bufs_index < conn->nbufs &&
+           conn->ptls_len < CH_ENC_BUFFER_SIZE) {
+        uv_buf_t* buf   = &conn->bufs[conn->bufs_index];
+        size_t    avail = buf->len - conn->write_written;
+        if (conn->ptls_len == 0 && avail >= CH_ENC_BUFFER_SIZE) {
+            return;
+        }
+        size_t space = CH_ENC_BUFFER_SIZE - conn->ptls_len;
+        size_t copy  = ch_min_size_t(avail, space);
+        memcpy(conn->buffer_ptls + conn->ptls_len,
+               buf->base + conn->write_written,
+               copy);
+        conn->ptls_len += copy;
+        conn->write_written += copy;
+        if (conn->write_written == buf->len) {
+            conn->bufs_index += 1;
+            conn->write_written = 0;
+        }
+    }
+}
+#endif
+
+#ifndef CH_WITHOUT_TLS
+// .. c:function::
+static int
+_ch_cn_plaintext_left(ch_connection_t* conn)
+//    :noindex:
+//
+//    See: :c:func:`_ch_cn_plaintext_left`
+//
+// .. code-block:: cpp
+//
+{
+    if (conn->ptls_written < conn->ptls_len) {
+        return 1;
+    }
+    while (conn->bufs_index < conn->nbufs &&
+           conn->bufs[conn->bufs_index].len == conn->write_written) {
+        conn->bufs_index += 1;
+        conn->write_written = 0;
+    }
+    return conn->bufs_index < conn->nbufs;
+}
+#endif
+
 #ifndef CH_WITHOUT_TLS
 // .. c:function::
 static void
@@ -7309,16 +10861,22 @@ _ch_cn_partial_write(ch_connection_t* conn)
 // .. code-block:: cpp
 //
 {
-    size_t      bytes_encrypted = 0;
-    size_t      bytes_read      = 0;
-    ch_chirp_t* chirp           = conn->chirp;
+    size_t      bytes_read = 0;
+    ch_chirp_t* chirp      = conn->chirp;
     ch_chirp_check_m(chirp);
     A(!(conn->flags & CH_CN_BUF_WTLS_USED), "The wtls buffer is still used");
     A(!(conn->flags & CH_CN_WRITE_PENDING), "Another uv write is pending");
+    if (conn->buffer_wtls == NULL && ch_cn_alloc_tls_buffers(conn)) {
+        ch_cn_shutdown(conn, CH_ENOMEM);
+        return;
+    }
+    /* Shrinking keeps the buffers while they are used */
+    conn->flags |= CH_CN_BUF_WTLS_USED;
 #ifdef CH_ENABLE_ASSERTS
     conn->flags |= CH_CN_WRITE_PENDING;
-    conn->flags |= CH_CN_BUF_WTLS_USED;
 #endif
+    /* Encrypt the pending buffers until the wtls buffer is full, so all of
+     * them go out with as few uv_writes as possible. */
     for (;;) {
         /* Read all data pending in BIO */
         int can_read_more = 1;
@@ -7342,45 +10900,39 @@ _ch_cn_partial_write(ch_connection_t* conn)
 
             pending = BIO_pending(conn->bio_app);
         }
-        if (!can_read_more) {
+        if (!can_read_more || !_ch_cn_plaintext_left(conn)) {
             break;
         }
-        uv_buf_t* buf      = &conn->bufs[conn->bufs_index];
-        int can_write_more = (bytes_encrypted + conn->write_written) < buf->len;
-        if (!can_write_more) {
-            /* Switch to next buffer if available or break */
-            int changed = 0;
-            while (conn->bufs_index < (conn->nbufs - 1)) {
-                conn->bufs_index += 1;
-                changed = 1;
-                if (conn->bufs[conn->bufs_index].len != 0) {
-                    break;
-                }
-            }
-            if (conn->bufs[conn->bufs_index].len == 0 || !changed) {
-                break;
-            }
-            conn->write_written = 0;
-            bytes_encrypted     = 0;
-            can_write_more      = 1;
-        }
-        buf = &conn->bufs[conn->bufs_index];
-        /* Write data into BIO */
-        if (can_read_more && can_write_more) {
-            int tmp_err = SSL_write(
-                    conn->ssl,
-                    buf->base + bytes_encrypted + conn->write_written,
-                    buf->len - bytes_encrypted - conn->write_written);
-            bytes_encrypted += tmp_err;
-            A(tmp_err > -1, "SSL_write failure unexpected");
-            if (tmp_err < 0) {
-                EC(chirp,
-                   "SSL error writing to BIO, shutting down connection. ",
-                   "ch_connection_t:%p",
-                   (void*) conn);
-                ch_cn_shutdown(conn, CH_TLS_ERROR);
-                return;
-            }
+        if (conn->ptls_written == conn->ptls_len) {
+            _ch_cn_gather_plaintext(conn);
+        }
+        /* Write data into BIO, either the gathered small buffers or a large
+         * buffer in place */
+        ch_buf* data;
+        size_t  len;
+        int     staged = conn->ptls_written < conn->ptls_len;
+        if (staged) {
+            data = conn->buffer_ptls + conn->ptls_written;
+            len  = conn->ptls_len - conn->ptls_written;
+        } else {
+            uv_buf_t* buf = &conn->bufs[conn->bufs_index];
+            data          = buf->base + conn->write_written;
+            len           = buf->len - conn->write_written;
+        }
+        int tmp_err = SSL_write(conn->ssl, data, len);
+        A(tmp_err > 0, "SSL_write failure unexpected");
+        if (tmp_err < 1) {
+            EC(chirp,
+               "SSL error writing to BIO, shutting down connection. ",
+               "ch_connection_t:%p",
+               (void*) conn);
+            ch_cn_shutdown(conn, CH_TLS_ERROR);
+            return;
+        }
+        if (staged) {
+            conn->ptls_written += tmp_err;
+        } else {
+            conn->write_written += tmp_err;
         }
     }
     conn->buffer_wtls_uv.len = bytes_read;
@@ -7395,7 +10947,6 @@ _ch_cn_partial_write(ch_connection_t* conn)
        "ch_connection_t:%p",
        (int) bytes_read,
        (void*) conn);
-    conn->write_written += bytes_encrypted;
 }
 #endif
 
@@ -7413,9 +10964,9 @@ _ch_cn_send_pending_cb(uv_write_t* req, int status)
     ch_connection_t* conn  = req->data;
     ch_chirp_t*      chirp = conn->chirp;
     ch_chirp_check_m(chirp);
+    conn->flags &= ~CH_CN_BUF_WTLS_USED;
 #ifdef CH_ENABLE_ASSERTS
     conn->flags &= ~CH_CN_WRITE_PENDING;
-    conn->flags &= ~CH_CN_BUF_WTLS_USED;
 #endif
     if (status < 0) {
         LC(chirp,
@@ -7454,9 +11005,9 @@ _ch_cn_write_cb(uv_write_t* req, int status)
     ch_connection_t* conn  = req->data;
     ch_chirp_t*      chirp = conn->chirp;
     ch_chirp_check_m(chirp);
+    conn->flags &= ~CH_CN_BUF_WTLS_USED;
 #ifdef CH_ENABLE_ASSERTS
     conn->flags &= ~CH_CN_WRITE_PENDING;
-    conn->flags &= ~CH_CN_BUF_WTLS_USED;
 #endif
     if (status < 0) {
         LC(chirp,
@@ -7470,22 +11021,21 @@ _ch_cn_write_cb(uv_write_t* req, int status)
         return;
     }
     /* Check if we can write data */
-    uv_buf_t* buf     = &conn->bufs[conn->bufs_index];
-    int       pending = BIO_pending(conn->bio_app);
-    if (buf->len > conn->write_written || pending) {
+    int pending = BIO_pending(conn->bio_app);
+    if (_ch_cn_plaintext_left(conn) || pending) {
         _ch_cn_partial_write(conn);
         LC(chirp,
-           "Partially encrypted %d of %d bytes. ",
+           "Partially encrypted %d of %d buffers. ",
            "ch_connection_t:%p",
-           (int) conn->write_written,
-           (int) buf->len,
+           (int) conn->bufs_index,
+           (int) conn->nbufs,
            (void*) conn);
     } else {
         A(pending == 0, "Unexpected pending data on TLS write");
         LC(chirp,
-           "Completely sent %d bytes (unenc). ",
+           "Completely sent %d buffers (unenc). ",
            "ch_connection_t:%p",
-           (int) conn->write_written,
+           (int) conn->nbufs,
            (void*) conn);
         conn->write_written = 0;
 #ifdef CH_ENABLE_ASSERTS
@@ -7538,15 +11088,15 @@ ch_cn_close_cb(uv_handle_t* handle)
                (void*) handle);
         }
         if (conn->flags & CH_CN_INIT_BUFFERS) {
-            A(conn->buffer_uv, "Initialized buffers inconsistent");
-            ch_free(conn->bufs);
-            ch_free(conn->buffer_uv);
-            if (conn->flags & CH_CN_ENCRYPTED) {
-                A(conn->buffer_wtls, "Initialized buffers inconsistent");
-                A(conn->buffer_rtls, "Initialized buffers inconsistent");
-                ch_free(conn->buffer_wtls);
-                ch_free(conn->buffer_rtls);
+            A(!(conn->flags & CH_CN_BUF_BORROWED), "Idle buffer not returned");
+            ch_chirp_free(ichirp, conn->bufs);
+            if (conn->buffer_shared != NULL) {
+                /* Messages the user did not release yet keep the buffer */
+                ch_bf_shared_free(conn->buffer_shared);
+                conn->buffer_shared = NULL;
             }
+            _ch_cn_free_tls_buffers(conn);
+            _ch_cn_remove_buffered(conn);
             conn->flags &= ~CH_CN_INIT_BUFFERS;
         }
 #ifndef CH_WITHOUT_TLS
@@ -7561,6 +11111,10 @@ ch_cn_close_cb(uv_handle_t* handle)
             }
         }
 #endif
+        if (conn->acks != NULL) {
+            ch_chirp_free(ichirp, conn->acks);
+            conn->acks = NULL;
+        }
         /* Since we define a unencrypted connection as CH_CN_INIT_ENCRYPTION. */
         conn->flags &= ~CH_CN_INIT_ENCRYPTION;
         A(!(conn->flags & CH_CN_INIT),
@@ -7576,7 +11130,7 @@ ch_cn_close_cb(uv_handle_t* handle)
                (void*) conn);
             ch_rm_free(remote);
         }
-        ch_free(conn);
+        ch_bf_objects_free(&ichirp->conn_pool, conn);
         LC(chirp,
            "Closed connection, closing semaphore (%d). ",
            "ch_connection_t:%p",
@@ -7585,6 +11139,36 @@ ch_cn_close_cb(uv_handle_t* handle)
     }
 }
 
+// .. c:function::
+ch_error_t
+ch_cn_alloc_tls_buffers(ch_connection_t* conn)
+//    :noindex:
+//
+//    see: :c:func:`ch_cn_alloc_tls_buffers`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_int_t* ichirp    = conn->chirp->_;
+    size_t          size      = conn->buffer_size;
+    size_t          rtls_size = ch_min_size_t(size, CH_ENC_BUFFER_SIZE);
+    conn->buffer_wtls         = ch_chirp_alloc(ichirp, size);
+    conn->buffer_rtls         = ch_chirp_alloc(ichirp, rtls_size);
+    conn->buffer_ptls         = ch_chirp_alloc(ichirp, CH_ENC_BUFFER_SIZE);
+    if (!(conn->buffer_wtls && conn->buffer_rtls && conn->buffer_ptls)) {
+        _ch_cn_free_tls_buffers(conn);
+        EC(conn->chirp,
+           "Could not allocate memory for tls. ",
+           "ch_connection_t:%p",
+           (void*) conn);
+        return CH_ENOMEM;
+    }
+    conn->buffer_rtls_size = rtls_size;
+    conn->buffer_wtls_uv   = uv_buf_init(conn->buffer_wtls, size);
+    _ch_cn_add_buffered(conn);
+    return CH_SUCCESS;
+}
+
 // .. c:function::
 ch_error_t
 ch_cn_init(ch_chirp_t* chirp, ch_connection_t* conn, uint8_t flags)
@@ -7624,6 +11208,23 @@ ch_cn_init(ch_chirp_t* chirp, ch_connection_t* conn, uint8_t flags)
     return _ch_cn_allocate_buffers(conn);
 }
 
+#ifndef CH_WITHOUT_TLS
+// .. c:function::
+void
+ch_cn_keep_tls_session(ch_connection_t* conn)
+//    :noindex:
+//
+//    see: :c:func:`ch_cn_keep_tls_session`
+//
+// .. code-block:: cpp
+//
+{
+    if (conn->flags & CH_CN_ENCRYPTED && conn->flags & CH_CN_INIT_ENCRYPTION) {
+        SSL_set_shutdown(conn->ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
+}
+#endif
+
 #ifndef CH_WITHOUT_TLS
 // .. c:function::
 ch_error_t
@@ -7636,7 +11237,11 @@ ch_cn_init_enc(ch_chirp_t* chirp, ch_connection_t* conn)
 //
 {
     ch_chirp_int_t* ichirp = chirp->_;
-    conn->ssl              = SSL_new(ichirp->encryption.ssl_ctx);
+    size_t          size   = ichirp->config.BUFFER_SIZE;
+    if (size == 0) {
+        size = CH_BUFFER_SIZE;
+    }
+    conn->ssl = SSL_new(ichirp->encryption.ssl_ctx);
     if (conn->ssl == NULL) {
 #ifdef CH_ENABLE_LOGGING
         ERR_print_errors_fp(stderr);
@@ -7644,7 +11249,14 @@ ch_cn_init_enc(ch_chirp_t* chirp, ch_connection_t* conn)
         EC(chirp, "Could not create SSL. ", "ch_connection_t:%p", (void*) conn);
         return CH_TLS_ERROR;
     }
-    if (BIO_new_bio_pair(&(conn->bio_ssl), 0, &(conn->bio_app), 0) != 1) {
+    /* Size the pair like the connection buffers: a whole wtls buffer of
+     * records can be encrypted and a whole read fed in without draining the
+     * pair in between. */
+    if (size < CH_CN_MIN_BIO_SIZE) {
+        size = CH_CN_MIN_BIO_SIZE;
+    }
+    if (BIO_new_bio_pair(&(conn->bio_ssl), size, &(conn->bio_app), size) !=
+        1) {
 #ifdef CH_ENABLE_LOGGING
         ERR_print_errors_fp(stderr);
 #endif
@@ -7656,6 +11268,24 @@ ch_cn_init_enc(ch_chirp_t* chirp, ch_connection_t* conn)
         return CH_TLS_ERROR;
     }
     SSL_set_bio(conn->ssl, conn->bio_ssl, conn->bio_ssl);
+    SSL_set_app_data(conn->ssl, conn);
+    /* Offer the last session of the remote on outgoing connections */
+    SSL_SESSION* session = NULL;
+    if (!(conn->flags & CH_CN_INCOMING)) {
+        session = ch_en_find_session(
+                &ichirp->encryption,
+                conn->ip_protocol,
+                conn->address,
+                conn->port);
+    }
+    if (session != NULL) {
+        if (SSL_set_session(conn->ssl, session) != 1) {
+            LC(chirp,
+               "Could not set TLS session for resumption. ",
+               "ch_connection_t:%p",
+               (void*) conn);
+        }
+    }
 #ifdef CH_CN_PRINT_CIPHERS
     STACK_OF(SSL_CIPHER)* ciphers = SSL_get_ciphers(conn->ssl);
     while (sk_SSL_CIPHER_num(ciphers) > 0)
@@ -7670,6 +11300,31 @@ ch_cn_init_enc(ch_chirp_t* chirp, ch_connection_t* conn)
 }
 #endif
 
+// .. c:function::
+static ch_bf_shared_t*
+_ch_cn_idle_buffer(ch_chirp_int_t* ichirp, size_t size)
+//    :noindex:
+//
+//    See: :c:func:`_ch_cn_idle_buffer`
+//
+// .. code-block:: cpp
+//
+{
+    ch_bf_shared_t* idle = ichirp->idle_buffer;
+    if (idle == NULL || idle->refcnt > 1) {
+        ch_bf_shared_t* shared = ch_bf_shared_new(size);
+        if (shared == NULL) {
+            return NULL;
+        }
+        if (idle != NULL) {
+            ch_bf_shared_free(idle);
+        }
+        ichirp->idle_buffer = shared;
+        idle                = shared;
+    }
+    return idle;
+}
+
 // .. c:function::
 void
 ch_cn_read_alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf)
@@ -7690,8 +11345,142 @@ ch_cn_read_alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf)
 #ifdef CH_ENABLE_ASSERTS
     conn->flags |= CH_CN_BUF_UV_USED;
 #endif
+    ch_bf_shared_t* shared = conn->buffer_shared;
+    size_t          size   = conn->buffer_size;
+    int             borrow = 0;
+    if (chirp->_->config.ADAPTIVE_BUFFERS && shared == NULL &&
+        !(conn->flags & CH_CN_BUF_BUSY)) {
+        /* An idle connection borrows the idle buffer for this read, see
+         * ch_cn_read_done */
+        size   = ch_min_size_t(size, CH_IDLE_BUFFER_SIZE);
+        shared = _ch_cn_idle_buffer(chirp->_, size);
+        borrow = 1;
+    } else if (shared == NULL || shared->refcnt > 1) {
+        /* Received messages still point into the buffer, we leave it to them
+         * and read into a new one. Adaptive buffers: A busy connection gets
+         * its own buffer. */
+        shared = ch_bf_shared_new(size);
+        if (shared != NULL) {
+            if (conn->buffer_shared != NULL) {
+                ch_bf_shared_free(conn->buffer_shared);
+            }
+            _ch_cn_add_buffered(conn);
+        }
+    }
+    if (shared == NULL) {
+        EC(chirp,
+           "Could not allocate memory for read buffer. ",
+           "ch_connection_t:%p",
+           (void*) conn);
+        /* libuv will call the read callback with UV_ENOBUFS. The old
+         * buffer stays with the connection, which frees it on close. */
+        buf->base = NULL;
+        buf->len  = 0;
+        return;
+    }
+    if (shared != conn->buffer_shared) {
+        conn->buffer_shared = shared;
+        conn->buffer_uv     = ch_bf_shared_data(shared);
+        conn->buffer_uv_uv  = uv_buf_init(conn->buffer_uv, size);
+    }
+    if (borrow) {
+        conn->flags |= CH_CN_BUF_BORROWED;
+        chirp->_->stats.reads_borrowed += 1;
+    }
     buf->base = conn->buffer_uv;
-    buf->len  = conn->buffer_size;
+    buf->len  = conn->buffer_uv_uv.len;
+}
+
+// .. c:function::
+void
+ch_cn_read_done(ch_connection_t* conn, ssize_t nread)
+//    :noindex:
+//
+//    see: :c:func:`ch_cn_read_done`
+//
+// .. code-block:: cpp
+//
+{
+    if (nread > 0 && (size_t) nread == conn->buffer_uv_uv.len) {
+        conn->flags |= CH_CN_BUF_BUSY;
+    }
+    if (!(conn->flags & CH_CN_BUF_BORROWED)) {
+        return;
+    }
+    conn->flags &= ~CH_CN_BUF_BORROWED;
+    if (conn->flags & CH_CN_STOPPED) {
+        /* The rest of the buffer is read on resume */
+        conn->chirp->_->idle_buffer = NULL;
+        _ch_cn_add_buffered(conn);
+    } else {
+        conn->buffer_shared = NULL;
+        conn->buffer_uv     = NULL;
+    }
+}
+
+// .. c:function::
+void
+ch_cn_shrink_buffers(ch_connection_t* conn)
+//    :noindex:
+//
+//    see: :c:func:`ch_cn_shrink_buffers`
+//
+// .. code-block:: cpp
+//
+{
+    if (conn->flags & CH_CN_BUF_BUSY) {
+        conn->flags &= ~CH_CN_BUF_BUSY;
+        return;
+    }
+    /* A stopped reader resumes from the read buffer */
+    if (conn->flags &
+        (CH_CN_STOPPED | CH_CN_SHUTTING_DOWN | CH_CN_TLS_HANDSHAKE)) {
+        return;
+    }
+    int shrunk = 0;
+    if (conn->buffer_shared != NULL) {
+        /* Messages the user did not release yet keep the buffer */
+        ch_bf_shared_free(conn->buffer_shared);
+        conn->buffer_shared = NULL;
+        conn->buffer_uv     = NULL;
+        shrunk              = 1;
+    }
+    if (!(conn->flags & CH_CN_BUF_WTLS_USED) && conn->writer.batch == NULL &&
+        conn->writer.stream == NULL) {
+        shrunk |= conn->buffer_wtls != NULL;
+        _ch_cn_free_tls_buffers(conn);
+    }
+    conn->chirp->_->stats.buffers_shrunk += shrunk;
+    if (conn->buffer_wtls == NULL) {
+        _ch_cn_remove_buffered(conn);
+    }
+}
+
+// .. c:function::
+static void
+_ch_cn_remove_buffered(ch_connection_t* conn)
+//    :noindex:
+//
+//    See: :c:func:`_ch_cn_remove_buffered`
+//
+// .. code-block:: cpp
+//
+{
+    if (!(conn->flags & CH_CN_BUFFERED)) {
+        return;
+    }
+    ch_chirp_int_t* ichirp = conn->chirp->_;
+    if (conn->buffered_prev != NULL) {
+        conn->buffered_prev->buffered_next = conn->buffered_next;
+    } else {
+        ichirp->buffered_conns = conn->buffered_next;
+    }
+    if (conn->buffered_next != NULL) {
+        conn->buffered_next->buffered_prev = conn->buffered_prev;
+    }
+    conn->buffered_prev = NULL;
+    conn->buffered_next = NULL;
+    conn->flags &= ~CH_CN_BUFFERED;
 }
 
 #ifndef CH_WITHOUT_TLS
@@ -7715,10 +11504,15 @@ ch_cn_send_if_pending(ch_connection_t* conn)
         }
         return;
     }
-#ifdef CH_ENABLE_ASSERTS
+    if (conn->buffer_wtls == NULL && ch_cn_alloc_tls_buffers(conn)) {
+        ch_cn_shutdown(conn, CH_ENOMEM);
+        return;
+    }
     A(!(conn->flags & CH_CN_WRITE_PENDING), "Another write is still pending");
     A(!(conn->flags & CH_CN_BUF_WTLS_USED), "The wtls buffer is still used");
+    /* Shrinking keeps the buffers while they are used */
     conn->flags |= CH_CN_BUF_WTLS_USED;
+#ifdef CH_ENABLE_ASSERTS
     conn->flags |= CH_CN_WRITE_PENDING;
 #endif
     ssize_t read =
@@ -7775,38 +11569,74 @@ ch_cn_shutdown(ch_connection_t* conn, int reason)
      * it up*/
     ch_cn_delete(&ichirp->protocol.old_connections, conn, &out);
     conn->remote = NULL; /* Disassociate from remote */
+    /* The ACKs waiting to be coalesced are not sent */
+    ch_chirp_drop_acks(conn);
     if (conn->flags & CH_CN_INIT_CLIENT) {
         uv_read_stop((uv_stream_t*) &conn->client);
     }
-    ch_message_t* msg = writer->msg;
-    ch_message_t* wam = NULL;
+    ch_message_t* msg;
+    ch_message_t* batch[CH_WR_MAX_BATCH + 1];
+    ch_message_t* wams[CH_MAX_ACK_WINDOW];
+    int           batch_count = 0;
+    uint8_t       wam_count   = 0;
+    /* The batch is finished here, late write callbacks are ignored. The
+     * messages are detached first, since the user may send them again in
+     * the callback. */
+    ch_msg_dequeue(&writer->batch, &msg);
+    while (msg != NULL) {
+        batch[batch_count] = msg;
+        batch_count += 1;
+        ch_msg_dequeue(&writer->batch, &msg);
+    }
+    /* The streamed message is only in the batch with its last chunk */
+    if (writer->stream != NULL) {
+        if (batch_count == 0 || batch[batch_count - 1] != writer->stream) {
+            batch[batch_count] = writer->stream;
+            batch_count += 1;
+        }
+        writer->stream        = NULL;
+        writer->stream_offset = 0;
+        writer->stream_chunk  = 0;
+    }
     /* In early handshake remote can empty, since we allocate resources after
      * successful handshake. */
     if (remote) {
-        /* We finish the message and therefore set wam to NULL. */
-        wam                      = remote->wait_ack_message;
-        remote->wait_ack_message = NULL;
+        /* We finish the messages and therefore clear the window. */
+        wam_count = remote->wait_ack_count;
+        memcpy(wams, remote->wait_ack_messages, wam_count * sizeof(*wams));
+        remote->wait_ack_count = 0;
         /* We could be a connection from old_connections and therefore we do
          * not want to invalidate an active connection. */
         if (remote->conn == conn) {
             remote->conn = NULL;
         }
         /* Abort all ack messsages */
-        remote->cntl_msg_queue = NULL;
+        ch_cn_abort_cntl_messages(remote, reason);
     }
-    if (wam != NULL) {
-        wam->_flags |= CH_MSG_FAILURE;
-        ch_chirp_finish_message(chirp, conn, wam, reason);
+    for (int i = 0; i < wam_count; i++) {
+        wams[i]->_flags |= CH_MSG_FAILURE;
+        ch_chirp_finish_message(chirp, conn, wams[i], reason);
     }
-    if (msg != NULL && msg != wam) {
-        msg->_flags |= CH_MSG_FAILURE;
-        ch_chirp_finish_message(chirp, conn, msg, reason);
+    int finished = wam_count > 0 || batch_count > 0;
+    for (int i = 0; i < batch_count; i++) {
+        /* Messages waiting for an ACK have been finished above */
+        int is_wam = 0;
+        for (int j = 0; j < wam_count; j++) {
+            if (batch[i] == wams[j]) {
+                is_wam = 1;
+                break;
+            }
+        }
+        if (!is_wam) {
+            batch[i]->_flags |= CH_MSG_FAILURE;
+            ch_chirp_finish_message(chirp, conn, batch[i], reason);
+        }
     }
     /* finish vs abort - finish: cancel a message on the current connection.
      * abort: means canceling a message that hasn't been queued yet. If
      * possible we don't want to cancel a message that hasn't been queued
      * yet.*/
-    if (wam == NULL && msg == NULL && remote != NULL) {
+    if (!finished && remote != NULL) {
         /* If we have not finished a message we abort one on the remote. */
         ch_cn_abort_one_message(remote, reason);
     }
@@ -7821,6 +11651,9 @@ ch_cn_shutdown(ch_connection_t* conn, int reason)
                (void*) conn);
         }
     }
+    if (reason == CH_SHUTDOWN) {
+        ch_cn_keep_tls_session(conn);
+    }
 #endif
     if (ichirp->flags & CH_CHIRP_CLOSING) {
         conn->flags |= CH_CN_DO_CLOSE_ACCOUTING;
@@ -7846,7 +11679,8 @@ ch_cn_write(
 {
     size_t buf_list_size = sizeof(uv_buf_t) * nbufs;
     if (nbufs > conn->bufs_size) {
-        conn->bufs      = ch_realloc(conn->bufs, buf_list_size);
+        conn->bufs =
+                ch_chirp_realloc(conn->chirp->_, conn->bufs, buf_list_size);
         conn->bufs_size = nbufs;
     }
     memcpy(conn->bufs, bufs, buf_list_size);
@@ -7856,6 +11690,8 @@ ch_cn_write(
         conn->write_written  = 0;
         conn->bufs_index     = 0;
         conn->nbufs          = nbufs;
+        conn->ptls_len       = 0;
+        conn->ptls_written   = 0;
 #ifdef CH_ENABLE_ASSERTS
         A(!(conn->flags & CH_CN_ENCRYPTED_WRITE), "Encrypted write pending");
         conn->flags |= CH_CN_ENCRYPTED_WRITE;
@@ -7937,13 +11773,30 @@ ch_cn_send_handshake(ch_connection_t* conn)
     LC(chirp, "Sending handshake to. ", "ch_connection_t:%p", (void*) conn);
     ch_chirp_int_t*   ichirp = chirp->_;
     ch_sr_handshake_t hs_tmp;
-    ch_buf            hs_buf[CH_SR_HANDSHAKE_SIZE];
-    hs_tmp.port = ichirp->public_port;
+    ch_message_t      features;
+    ch_buf            hs_buf[CH_SR_HANDSHAKE_SIZE + CH_SR_WIRE_MESSAGE_SIZE];
+    uint32_t          flags = CH_SR_HS_STREAMING | CH_SR_HS_ACKS;
+    hs_tmp.port             = ichirp->public_port;
     memcpy(hs_tmp.identity, ichirp->identity, CH_ID_SIZE);
+    if (ichirp->protocol.local_listen) {
+        flags |= CH_SR_HS_LOCAL;
+    }
+#ifdef CH_ENABLE_COMPRESSION
+    if (ichirp->config.COMPRESSION) {
+        flags |= CH_SR_HS_COMPRESSION;
+    }
+#endif
+    if (ichirp->config.SYNCHRONOUS) {
+        flags |= (uint32_t) ichirp->config.ACK_WINDOW << CH_SR_HS_WINDOW_SHIFT;
+    }
     ch_sr_hs_to_buf(&hs_tmp, hs_buf);
+    /* The features follow in a NOOP, older nodes ignore it */
+    memset(&features, 0, sizeof(features));
+    features.type = CH_MSG_NOOP | CH_MSG_FEATURES;
+    ch_sr_msg_to_buf(&features, hs_buf + CH_SR_HANDSHAKE_SIZE, flags);
     uv_buf_t buf;
     buf.base = hs_buf;
-    buf.len  = CH_SR_HANDSHAKE_SIZE;
+    buf.len  = sizeof(hs_buf);
     ch_cn_write(conn, &buf, 1, _ch_cn_send_handshake_cb);
 }
 // ==========
@@ -7975,6 +11828,46 @@ ch_cn_send_handshake(ch_connection_t* conn)
 // Declarations
 // ============
 
+// .. c:macro:: CH_EN_SESSION_ID_CONTEXT
+//
+//    Session id context of chirp TLS sessions. Sessions are only resumed
+//    within the same context.
+//
+// .. code-block:: cpp
+//
+#define CH_EN_SESSION_ID_CONTEXT "chirp"
+
+// .. c:function::
+static ch_en_session_t*
+_ch_en_session_slot(
+        ch_encryption_t* enc,
+        uint8_t          ip_protocol,
+        const uint8_t*   address,
+        int32_t          port);
+//
+//    Get the cache slot of a remote.
+//
+//    :param ch_encryption_t* enc: Pointer to a encryption object
+//    :param uint8_t ip_protocol: IP protocol of the remote
+//    :param const uint8_t* address: Address of the remote
+//    :param int32_t port: Port of the remote
+//    :return: The slot, it might hold the session of another remote
+//    :rtype: ch_en_session_t*
+//
+
+// .. c:function::
+static int
+_ch_en_new_session_cb(SSL* ssl, SSL_SESSION* session);
+//
+//    Called by openssl when a new session has been negotiated or a session
+//    ticket arrived. Caches the session of outgoing connections.
+//
+//    :param SSL* ssl: The SSL handle of the connection
+//    :param SSL_SESSION* session: The new session
+//    :return: 1 if the session reference has been taken, else 0
+//    :rtype: int
+//
+
 // .. c:var:: _ch_en_manual_tls
 //
 //    The user will call ch_en_tls_init() and ch_en_tls_cleanup().
@@ -8261,6 +12154,82 @@ ch_en_set_manual_tls_init(void)
 }
 
 #ifndef CH_WITHOUT_TLS
+// .. c:function::
+static ch_en_session_t*
+_ch_en_session_slot(
+        ch_encryption_t* enc,
+        uint8_t          ip_protocol,
+        const uint8_t*   address,
+        int32_t          port)
+//    :noindex:
+//
+//    see: :c:func:`_ch_en_session_slot`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t hash = ch_rm_hash(ip_protocol, address, port);
+    return &enc->sessions[hash & (CH_EN_SESSION_CACHE_SIZE - 1)];
+}
+
+// .. c:function::
+static int
+_ch_en_new_session_cb(SSL* ssl, SSL_SESSION* session)
+//    :noindex:
+//
+//    see: :c:func:`_ch_en_new_session_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_connection_t* conn = SSL_get_app_data(ssl);
+    if (SSL_is_server(ssl) || conn == NULL) {
+        return 0;
+    }
+    ch_en_session_t* slot = _ch_en_session_slot(
+            &conn->chirp->_->encryption,
+            conn->ip_protocol,
+            conn->address,
+            conn->port);
+    if (slot->session != NULL) {
+        SSL_SESSION_free(slot->session);
+    }
+    slot->ip_protocol = conn->ip_protocol;
+    memcpy(slot->address, conn->address, CH_IP_ADDR_SIZE);
+    slot->port = conn->port;
+    /* Returning 1 passes the reference to the cache */
+    slot->session = session;
+    LC(conn->chirp,
+       "Cached TLS session. ",
+       "ch_connection_t:%p",
+       (void*) conn);
+    return 1;
+}
+
+// .. c:function::
+SSL_SESSION*
+ch_en_find_session(
+        ch_encryption_t* enc,
+        uint8_t          ip_protocol,
+        const uint8_t*   address,
+        int32_t          port)
+//    :noindex:
+//
+//    see: :c:func:`ch_en_find_session`
+//
+// .. code-block:: cpp
+//
+{
+    ch_en_session_t* slot =
+            _ch_en_session_slot(enc, ip_protocol, address, port);
+    if (slot->session == NULL || slot->ip_protocol != ip_protocol ||
+        slot->port != port ||
+        memcmp(slot->address, address, CH_IP_ADDR_SIZE) != 0) {
+        return NULL;
+    }
+    return slot->session;
+}
+
 // .. c:function::
 ch_error_t
 ch_en_start(ch_encryption_t* enc)
@@ -8298,6 +12267,22 @@ ch_en_start(ch_encryption_t* enc)
     SSL_CTX_set_min_proto_version(enc->ssl_ctx, TLS1_2_VERSION);
 #endif
     SSL_CTX_set_verify_depth(enc->ssl_ctx, 5);
+    /* Servers resume from session tickets, clients keep their sessions in
+     * our cache (see ch_en_find_session), not in OpenSSL's. A session id
+     * context is required, because we verify the peer. */
+    SSL_CTX_set_session_cache_mode(
+            enc->ssl_ctx,
+            SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_SERVER |
+                    SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(enc->ssl_ctx, _ch_en_new_session_cb);
+    if (SSL_CTX_set_session_id_context(
+                enc->ssl_ctx,
+                (const unsigned char*) CH_EN_SESSION_ID_CONTEXT,
+                sizeof(CH_EN_SESSION_ID_CONTEXT) - 1) != 1) {
+        E(chirp, "Could not set the session id context", CH_NO_ARG);
+        SSL_CTX_free(enc->ssl_ctx);
+        return CH_TLS_ERROR;
+    }
     if (SSL_CTX_load_verify_locations(
                 enc->ssl_ctx, ichirp->config.CERT_CHAIN_PEM, NULL) != 1) {
         E(chirp,
@@ -8382,6 +12367,12 @@ ch_en_stop(ch_encryption_t* enc)
 // .. code-block:: cpp
 //
 {
+    for (int i = 0; i < CH_EN_SESSION_CACHE_SIZE; i++) {
+        if (enc->sessions[i].session != NULL) {
+            SSL_SESSION_free(enc->sessions[i].session);
+            enc->sessions[i].session = NULL;
+        }
+    }
     if (enc->ssl_ctx) {
         SSL_CTX_free(enc->ssl_ctx);
     }
@@ -8432,6 +12423,72 @@ _ch_en_thread_id_function(void)
 
 qs_queue_bind_impl_cx_m(ch_msg, ch_message_t) CH_ALLOW_NL;
 
+// Lock-free handoff definition
+// ----------------------------
+//
+// .. c:function::
+int
+ch_msg_mpsc_push(ch_message_t** stack, ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`ch_msg_mpsc_push`
+//
+// .. code-block:: cpp
+//
+{
+    return ch_msg_mpsc_push_batch(stack, &msg, 1);
+}
+
+// .. c:function::
+int
+ch_msg_mpsc_push_batch(ch_message_t** stack, ch_message_t** msgs, size_t count)
+//    :noindex:
+//
+//    see: :c:func:`ch_msg_mpsc_push_batch`
+//
+// .. code-block:: cpp
+//
+{
+    A(count > 0, "Nothing to push");
+    ch_message_t* bottom = msgs[0];
+    ch_message_t* top    = msgs[count - 1];
+    /* Link the messages like they were pushed one by one */
+    for (size_t i = 0; i < count; i++) {
+        A(msgs[i]->_next == NULL, "Message already in a queue");
+        if (i > 0) {
+            msgs[i]->_next = msgs[i - 1];
+        }
+    }
+    ch_message_t* head;
+    do {
+        head          = ch_atomic_load_ptr((void**) stack);
+        bottom->_next = head;
+    } while (!ch_atomic_cas_ptr((void**) stack, head, top));
+    return head == NULL;
+}
+
+// .. c:function::
+ch_message_t*
+ch_msg_mpsc_take_all(ch_message_t** stack)
+//    :noindex:
+//
+//    see: :c:func:`ch_msg_mpsc_take_all`
+//
+// .. code-block:: cpp
+//
+{
+    ch_message_t* cur  = ch_atomic_xchg_ptr((void**) stack, NULL);
+    ch_message_t* list = NULL;
+    /* The stack is LIFO, reverse it to get the send order */
+    while (cur != NULL) {
+        ch_message_t* next = cur->_next;
+        cur->_next         = list;
+        list               = cur;
+        cur                = next;
+    }
+    return list;
+}
+
 // Interface definitions
 // ---------------------
 
@@ -8447,12 +12504,12 @@ ch_msg_free_data(ch_message_t* message)
 //
 {
     if (message->_flags & CH_MSG_FREE_HEADER) {
-        ch_free(message->header);
+        ch_bf_slab_free(message->header);
         message->_flags &= ~CH_MSG_FREE_HEADER;
     }
     message->header = NULL;
     if (message->_flags & CH_MSG_FREE_DATA) {
-        ch_free(message->data);
+        ch_bf_slab_free(message->data);
         message->_flags &= ~CH_MSG_FREE_DATA;
     }
     message->data = NULL;
@@ -8584,8 +12641,161 @@ ch_msg_set_data(ch_message_t* message, ch_buf* data, uint32_t len)
 // .. code-block:: cpp
 //
 {
-    message->data     = data;
-    message->data_len = len;
+    message->data        = data;
+    message->data_len    = len;
+    message->_data_iov   = NULL;
+    message->_data_nbufs = 0;
+}
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_msg_set_data_iov(
+        ch_message_t* message, const uv_buf_t bufs[], unsigned int nbufs)
+//    :noindex:
+//
+//    see: :c:func:`ch_msg_set_data_iov`
+//
+// .. code-block:: cpp
+//
+{
+    if (nbufs > CH_MSG_MAX_IOV) {
+        return CH_VALUE_ERROR;
+    }
+    uint64_t len = 0;
+    for (unsigned int i = 0; i < nbufs; i++) {
+        len += bufs[i].len;
+    }
+    if (len > UINT32_MAX) {
+        return CH_VALUE_ERROR;
+    }
+    message->data        = NULL;
+    message->data_len    = len;
+    message->_data_iov   = bufs;
+    message->_data_nbufs = nbufs;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_msg_set_priority(ch_message_t* message, uint8_t priority)
+//    :noindex:
+//
+//    see: :c:func:`ch_msg_set_priority`
+//
+// .. code-block:: cpp
+//
+{
+    if (priority >= CH_MSG_PRIORITIES) {
+        return CH_VALUE_ERROR;
+    }
+    message->priority = priority;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+CH_EXPORT
+void
+ch_mc_free(ch_multicast_t* mc)
+//    :noindex:
+//
+//    see: :c:func:`ch_mc_free`
+//
+// .. code-block:: cpp
+//
+{
+    A(mc->_pending == 0, "Multicast is being sent");
+    if (mc->_msgs != NULL) {
+        ch_free(mc->_msgs);
+    }
+    mc->_msgs   = NULL;
+    mc->_msgs_p = NULL;
+    mc->status  = NULL;
+    mc->count   = 0;
+}
+
+// .. c:function::
+CH_EXPORT
+ch_message_t*
+ch_mc_get_message(ch_multicast_t* mc, uint32_t index)
+//    :noindex:
+//
+//    see: :c:func:`ch_mc_get_message`
+//
+// .. code-block:: cpp
+//
+{
+    A(index < mc->count, "Index out of range");
+    return &mc->_msgs[index];
+}
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_mc_init(ch_multicast_t* mc, uint32_t count)
+//    :noindex:
+//
+//    see: :c:func:`ch_mc_init`
+//
+// .. code-block:: cpp
+//
+{
+    memset(mc, 0, sizeof(*mc));
+    if (count == 0) {
+        return CH_VALUE_ERROR;
+    }
+    /* One allocation: The messages, the pointers to them and the status */
+    size_t size = sizeof(*mc->_msgs) + sizeof(*mc->_msgs_p) +
+                  sizeof(*mc->status);
+    mc->_msgs = ch_alloc(size * count);
+    if (mc->_msgs == NULL) {
+        return CH_ENOMEM;
+    }
+    mc->_msgs_p = (ch_message_t**) (mc->_msgs + count);
+    mc->status  = (ch_error_t*) (mc->_msgs_p + count);
+    mc->count   = count;
+    for (uint32_t i = 0; i < count; i++) {
+        ch_msg_init(&mc->_msgs[i]);
+        mc->_msgs_p[i] = &mc->_msgs[i];
+        mc->status[i]  = CH_SUCCESS;
+    }
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_mc_set_address(
+        ch_multicast_t*  mc,
+        uint32_t         index,
+        ch_ip_protocol_t ip_protocol,
+        const char*      address,
+        int32_t          port)
+//    :noindex:
+//
+//    see: :c:func:`ch_mc_set_address`
+//
+// .. code-block:: cpp
+//
+{
+    A(index < mc->count, "Index out of range");
+    return ch_msg_set_address(&mc->_msgs[index], ip_protocol, address, port);
+}
+
+// .. c:function::
+CH_EXPORT
+void
+ch_mc_set_data(ch_multicast_t* mc, ch_buf* data, uint32_t len)
+//    :noindex:
+//
+//    see: :c:func:`ch_mc_set_data`
+//
+// .. code-block:: cpp
+//
+{
+    mc->data     = data;
+    mc->data_len = len;
 }
 // ========
 // Protocol
@@ -8611,6 +12821,9 @@ ch_msg_set_data(ch_message_t* message, ch_buf* data, uint32_t len)
 #ifndef CH_WITHOUT_TLS
 #include <openssl/err.h>
 #endif
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
 
 // Declarations
 // ============
@@ -8668,6 +12881,15 @@ _ch_pr_new_connection_cb(uv_stream_t* server, int status);
 //                                communication channel) of the server,
 //                                containig a chirp object.
 
+// .. c:function::
+static inline int
+_ch_pr_owns_loopback(ch_config_t* config);
+//
+//    True if the node listens on "127.0.0.1", then it owns the local socket
+//    of its port.
+//
+//    :param ch_config_t* config: Config of the node
+
 // .. c:function::
 static void
 _ch_pr_read_data_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf);
@@ -8683,6 +12905,17 @@ _ch_pr_read_data_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf);
 //                          buffer; in that case buf.len and buf.base are both
 //                          set to 0.
 
+// .. c:function::
+static void
+_ch_pr_read_data(ch_connection_t* conn, ssize_t nread, const uv_buf_t* buf);
+//
+//    Handle nread bytes read on the connection, called by
+//    :c:func:`_ch_pr_read_data_cb`.
+//
+//    :param ch_connection_t* conn: Connection that data was read on.
+//    :param ssize_t nread: Number of bytes that were read.
+//    :param uv_buf_t* buf: Pointer to a libuv (data-) buffer.
+
 // .. c:function::
 static int
 _ch_pr_read_resume(ch_connection_t* conn, ch_resume_state_t* resume);
@@ -8702,6 +12935,25 @@ _ch_pr_resume(ch_connection_t* conn);
 //
 //    :param ch_connection_t* conn: Pointer to a connection handle.
 
+// .. c:function::
+static inline ch_error_t
+_ch_pr_start_local(ch_chirp_t* chirp);
+//
+//    Listen on the local socket, see :c:macro:`CH_LOCAL_PATH`. Connections
+//    to "127.0.0.1" use it instead of TCP.
+//
+//    :param ch_chirp_t* chirp: Chirp object
+
+// .. c:function::
+static inline ch_error_t
+_ch_pr_local_dir(ch_chirp_t* chirp);
+//
+//    Create LOCAL_DIR with mode 0700. An existing directory must be owned
+//    by the user and closed to others, else other users could connect to or
+//    replace the local socket.
+//
+//    :param ch_chirp_t* chirp: Chirp object
+
 // .. c:function::
 static inline ch_error_t
 _ch_pr_start_socket(
@@ -8748,17 +13000,20 @@ _ch_pr_abort_all_messages(ch_remote_t* remote, ch_error_t error)
 //
 {
     /* The remote is going away, we need to abort all messages */
-    ch_message_t* msg;
-    ch_msg_dequeue(&remote->msg_queue, &msg);
-    while (msg != NULL) {
+    ch_message_t*  msg;
+    ch_message_t** queue = ch_rm_msg_queue(remote);
+    while (queue != NULL) {
+        ch_msg_dequeue(queue, &msg);
+        ch_rm_msg_dequeued(remote, msg);
         ch_send_cb_t cb = msg->_send_cb;
         if (cb != NULL) {
             msg->_send_cb = NULL;
             cb(remote->chirp, msg, error);
         }
-        ch_msg_dequeue(&remote->msg_queue, &msg);
+        queue = ch_rm_msg_queue(remote);
     }
     remote->cntl_msg_queue = NULL;
+    ch_rm_check_drain(remote);
 }
 
 #ifndef CH_WITHOUT_TLS
@@ -8777,9 +13032,16 @@ _ch_pr_do_handshake(ch_connection_t* conn)
     if (SSL_is_init_finished(conn->ssl)) {
         conn->flags &= ~CH_CN_TLS_HANDSHAKE;
         if (conn->tls_handshake_state) {
+            ch_encryption_t* enc = &chirp->_->encryption;
+            if (SSL_session_reused(conn->ssl)) {
+                enc->handshakes_resumed += 1;
+            } else {
+                enc->handshakes_full += 1;
+            }
             LC(chirp,
-               "SSL handshake successful. ",
+               "SSL handshake successful (resumed: %d). ",
                "ch_connection_t:%p",
+               SSL_session_reused(conn->ssl),
                (void*) conn);
         } else {
 #ifdef CH_ENABLE_LOGGING
@@ -8832,23 +13094,58 @@ _ch_pr_gc_connections_cb(uv_timer_t* handle)
            "Garbage-collecting: shutdown.",
            "ch_connection_t:%p",
            cn_elem);
+        ichirp->stats.gc_connections += 1;
         ch_cn_shutdown(cn_elem, CH_SHUTDOWN);
     }
 
-    rb_iter_decl_cx_m(ch_rm, rm_iter, rm_elem);
-    rb_for_m (ch_rm, protocol->remotes, rm_iter, rm_elem) {
-        if (!(rm_elem->flags & CH_RM_CONN_BLOCKED) &&
-            now - rm_elem->timestamp > delta) {
+    /* Pinned remotes get a NOOP after REUSE_TIME / 2, before the remote
+     * collects the connection. Touching the remote keeps it from expiring,
+     * also if it can not connect. */
+    ch_remote_t* pinned = protocol->pinned_remotes;
+    while (pinned != NULL) {
+        if (now - pinned->timestamp > delta / 2) {
+            LC(chirp, "Keeping pinned remote alive.", "ch_remote_t:%p", pinned);
+            ch_pr_touch_remote(pinned, now);
+            ch_wr_enqueue_probe(pinned);
+            ch_wr_process_queues(pinned);
+        }
+        pinned = pinned->pinned_next;
+    }
+
+    /* Adaptive buffers: Free the buffers of connections that were idle
+     * since the last tick. */
+    ch_connection_t* buffered = ichirp->buffered_conns;
+    while (buffered != NULL) {
+        ch_connection_t* next = buffered->buffered_next;
+        ch_cn_shrink_buffers(buffered);
+        buffered = next;
+    }
+
+    /* The list is ordered by timestamp: stop at the first remote that has
+     * not expired, and visit at most CH_PR_GC_SLICE remotes per tick.
+     * Blocked and pinned remotes are moved to the tail, else every tick
+     * would walk them again before reaching the expired remotes. */
+    int          visited = 0;
+    ch_remote_t* rm_elem = protocol->remotes_lru;
+    while (rm_elem != NULL && now - rm_elem->timestamp > delta &&
+           visited < CH_PR_GC_SLICE) {
+        ch_remote_t* rm_next = rm_elem->lru_next;
+        if (rm_elem->flags & (CH_RM_CONN_BLOCKED | CH_RM_PINNED)) {
+            ch_pr_touch_remote(rm_elem, now);
+        } else {
             A(rm_elem->next == NULL, "Should not be in reconnect_remotes");
             ch_rm_st_push(&rm_del_stack, rm_elem);
         }
+        visited += 1;
+        rm_elem = rm_next;
     }
     ch_remote_t* remote     = NULL;
     ch_remote_t* tmp_remote = NULL;
     ch_rm_st_pop(&rm_del_stack, &remote);
     while (remote != NULL) {
+        ichirp->stats.gc_remotes += 1;
         _ch_pr_abort_all_messages(remote, CH_SHUTDOWN);
-        ch_rm_delete_node(&protocol->remotes, remote);
+        ch_pr_delete_remote(protocol, remote);
         ch_connection_t* conn = remote->conn;
         if (conn != NULL) {
             LC(chirp,
@@ -8866,8 +13163,14 @@ _ch_pr_gc_connections_cb(uv_timer_t* handle)
             ch_rm_free(tmp_remote);
         }
     }
-    uint64_t start = (config->REUSE_TIME * 1000 / 2);
-    start += rand() % start;
+    uint64_t start = 0;
+    if (visited < CH_PR_GC_SLICE) {
+        start = (config->REUSE_TIME * 1000 / 2);
+        start += rand() % start;
+        if (protocol->pinned_remotes != NULL) {
+            start = delta / 4;
+        }
+    } /* else: More remotes expired, continue on the next loop iteration */
     uv_timer_start(&protocol->gc_timeout, _ch_pr_gc_connections_cb, start, 0);
 }
 
@@ -8889,12 +13192,13 @@ _ch_pr_new_connection_cb(uv_stream_t* server, int status)
         return;
     }
     ch_protocol_t* protocol = &ichirp->protocol;
+    int            tmp_err;
     if (status < 0) {
         L(chirp, "New connection error %s", uv_strerror(status));
         return;
     }
 
-    ch_connection_t* conn = (ch_connection_t*) ch_alloc(sizeof(*conn));
+    ch_connection_t* conn = ch_bf_objects_alloc(&ichirp->conn_pool);
     if (!conn) {
         E(chirp, "Could not allocate memory for connection", CH_NO_ARG);
         return;
@@ -8903,12 +13207,19 @@ _ch_pr_new_connection_cb(uv_stream_t* server, int status)
     memset(conn, 0, sizeof(*conn));
     ch_cn_node_init(conn);
     ch_cn_insert(&protocol->handshake_conns, conn);
-    conn->chirp       = chirp;
-    conn->client.data = conn;
-    uv_tcp_t* client  = &conn->client;
-    if (uv_tcp_init(server->loop, client) < 0) {
+    conn->chirp           = chirp;
+    conn->client.tcp.data = conn;
+    uv_stream_t* client   = (uv_stream_t*) &conn->client;
+    int          local    = server == (uv_stream_t*) &protocol->server_local;
+    if (local) {
+        tmp_err = uv_pipe_init(server->loop, &conn->client.pipe, 0);
+        conn->flags |= CH_CN_LOCAL;
+    } else {
+        tmp_err = uv_tcp_init(server->loop, &conn->client.tcp);
+    }
+    if (tmp_err < 0) {
         EC(chirp,
-           "Could not initialize tcp. ",
+           "Could not initialize client. ",
            "ch_connection_t:%p",
            (void*) conn);
         ch_cn_shutdown(conn, CH_FATAL);
@@ -8916,12 +13227,22 @@ _ch_pr_new_connection_cb(uv_stream_t* server, int status)
     }
     conn->flags |= CH_CN_INIT_CLIENT | CH_CN_INCOMING;
 
-    if (uv_accept(server, (uv_stream_t*) client) == 0) {
+    if (uv_accept(server, client) != 0) {
+        ch_cn_shutdown(conn, CH_FATAL);
+    } else if (local && !ch_pr_local_peer_ok(chirp, &conn->client.pipe)) {
+        ch_cn_shutdown(conn, CH_PROTOCOL_ERROR);
+    } else if (local) {
+        /* The remote connects to "127.0.0.1", the local socket replaces it */
+        static const uint8_t loopback[] = {127, 0, 0, 1};
+        conn->ip_protocol               = AF_INET;
+        memcpy(&conn->address, loopback, sizeof(loopback));
+        ch_pr_conn_start(chirp, conn, client, 1);
+    } else {
         struct sockaddr_storage addr;
         int                     addr_len = sizeof(addr);
         ch_text_address_t       taddr;
         if (uv_tcp_getpeername(
-                    &conn->client, (struct sockaddr*) &addr, &addr_len) !=
+                    &conn->client.tcp, (struct sockaddr*) &addr, &addr_len) !=
             CH_SUCCESS) {
             EC(chirp,
                "Could not get remote address. ",
@@ -8946,11 +13267,66 @@ _ch_pr_new_connection_cb(uv_stream_t* server, int status)
         }
 #endif
         ch_pr_conn_start(chirp, conn, client, 1);
-    } else {
-        ch_cn_shutdown(conn, CH_FATAL);
     }
 }
 
+// .. c:function::
+static inline int
+_ch_pr_owns_loopback(ch_config_t* config)
+//    :noindex:
+//
+//    see: :c:func:`_ch_pr_owns_loopback`
+//
+// .. code-block:: cpp
+//
+{
+    static const uint8_t any[]      = {0, 0, 0, 0};
+    static const uint8_t loopback[] = {127, 0, 0, 1};
+    return (memcmp(config->BIND_V4, any, sizeof(any)) == 0 ||
+            memcmp(config->BIND_V4, loopback, sizeof(loopback)) == 0);
+}
+
+// .. c:function::
+static inline ch_error_t
+_ch_pr_local_dir(ch_chirp_t* chirp)
+//    :noindex:
+//
+//    see: :c:func:`_ch_pr_local_dir`
+//
+// .. code-block:: cpp
+//
+{
+#ifdef _WIN32
+    (void) (chirp);
+    return CH_INIT_FAIL;
+#else
+    ch_chirp_int_t* ichirp = chirp->_;
+    const char*     dir    = ichirp->config.LOCAL_DIR;
+    uv_fs_t         req;
+    int             tmp_err;
+    /* Fails if the directory exists, which is checked below */
+    uv_fs_mkdir(ichirp->loop, &req, dir, 0700, NULL);
+    uv_fs_req_cleanup(&req);
+    tmp_err = uv_fs_lstat(ichirp->loop, &req, dir, NULL);
+    if (tmp_err != 0) {
+        uv_fs_req_cleanup(&req);
+        E(chirp, "Could not create the local dir %s", dir);
+        return CH_INIT_FAIL;
+    }
+    uv_stat_t* stat = &req.statbuf;
+    int        safe = ((stat->st_mode & S_IFMT) == S_IFDIR &&
+                stat->st_uid == geteuid() && (stat->st_mode & 077) == 0);
+    uv_fs_req_cleanup(&req);
+    if (!safe) {
+        E(chirp,
+          "The local dir %s must be owned by the user with mode 0700",
+          dir);
+        return CH_INIT_FAIL;
+    }
+    return CH_SUCCESS;
+#endif
+}
+
 // .. c:function::
 static int
 _ch_pr_read_resume(ch_connection_t* conn, ch_resume_state_t* resume)
@@ -8975,6 +13351,50 @@ _ch_pr_read_resume(ch_connection_t* conn, ch_resume_state_t* resume)
     return !stop;
 }
 
+// .. c:function::
+static inline ch_error_t
+_ch_pr_start_local(ch_chirp_t* chirp)
+//    :noindex:
+//
+//    see: :c:func:`_ch_pr_start_local`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_int_t* ichirp   = chirp->_;
+    ch_protocol_t*  protocol = &ichirp->protocol;
+    ch_config_t*    config   = &ichirp->config;
+    char            path[CH_PR_LOCAL_PATH_SIZE];
+    uv_fs_t         req;
+    int             tmp_err;
+    tmp_err = _ch_pr_local_dir(chirp);
+    if (tmp_err != CH_SUCCESS) {
+        return tmp_err;
+    }
+    if (uv_pipe_init(ichirp->loop, &protocol->server_local, 0)) {
+        return CH_INIT_FAIL;
+    }
+    protocol->local_init        = 1;
+    protocol->server_local.data = chirp;
+    ch_pr_local_path(path, config->LOCAL_DIR, config->PORT);
+    /* We own the port, so an existing socket was left behind by a crash */
+    uv_fs_unlink(ichirp->loop, &req, path, NULL);
+    uv_fs_req_cleanup(&req);
+    tmp_err = uv_pipe_bind(&protocol->server_local, path);
+    if (tmp_err != CH_SUCCESS) {
+        return CH_EADDRINUSE;
+    }
+    tmp_err = uv_listen(
+            (uv_stream_t*) &protocol->server_local,
+            config->BACKLOG,
+            _ch_pr_new_connection_cb);
+    if (tmp_err != CH_SUCCESS) {
+        return CH_EADDRINUSE;
+    }
+    protocol->local_listen = 1;
+    return CH_SUCCESS;
+}
+
 // .. c:function::
 static inline ch_error_t
 _ch_pr_start_socket(
@@ -8997,11 +13417,28 @@ _ch_pr_start_socket(
     ch_chirp_int_t*   ichirp = chirp->_;
     ch_config_t*      config = &ichirp->config;
     *needs_uninit            = 0;
-    if (uv_tcp_init(ichirp->loop, server)) {
+    if (uv_tcp_init_ex(ichirp->loop, server, af)) {
         return CH_INIT_FAIL;
     }
     *needs_uninit = 1;
     server->data  = chirp;
+#ifdef SO_REUSEPORT
+    if (config->REUSE_PORT) {
+        /* The socket exists since we passed the address family */
+        uv_os_fd_t fd;
+        int        on = 1;
+        if (uv_fileno((uv_handle_t*) server, &fd) != 0 ||
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) {
+            fprintf(stderr,
+                    "%s:%d Fatal: cannot set SO_REUSEPORT (IPv%d:%d)\n",
+                    __FILE__,
+                    __LINE__,
+                    af == AF_INET6 ? 6 : 4,
+                    config->PORT);
+            return CH_UV_ERROR;
+        }
+    }
+#endif
 
     tmp_err = uv_inet_ntop(af, bind, tmp_addr.data, sizeof(tmp_addr.data));
     if (tmp_err != CH_SUCCESS) {
@@ -9069,7 +13506,10 @@ _ch_pr_update_resume(
 // .. c:function::
 ch_error_t
 ch_pr_conn_start(
-        ch_chirp_t* chirp, ch_connection_t* conn, uv_tcp_t* client, int accept)
+        ch_chirp_t*      chirp,
+        ch_connection_t* conn,
+        uv_stream_t*     client,
+        int              accept)
 //    :noindex:
 //
 //    see: :c:func:`ch_pr_conn_start`
@@ -9083,22 +13523,25 @@ ch_pr_conn_start(
         ch_cn_shutdown(conn, tmp_err);
         return tmp_err;
     }
-    tmp_err = uv_tcp_nodelay(client, 1);
-    if (tmp_err != CH_SUCCESS) {
-        E(chirp, "Could not set tcp nodelay on connection (%d)", tmp_err);
-        ch_cn_shutdown(conn, CH_UV_ERROR);
-        return CH_UV_ERROR;
-    }
+    if (!(conn->flags & CH_CN_LOCAL)) {
+        tmp_err = uv_tcp_nodelay((uv_tcp_t*) client, 1);
+        if (tmp_err != CH_SUCCESS) {
+            E(chirp, "Could not set tcp nodelay on connection (%d)", tmp_err);
+            ch_cn_shutdown(conn, CH_UV_ERROR);
+            return CH_UV_ERROR;
+        }
 
-    tmp_err = uv_tcp_keepalive(client, 1, CH_TCP_KEEPALIVE);
-    if (tmp_err != CH_SUCCESS) {
-        E(chirp, "Could not set tcp keepalive on connection (%d)", tmp_err);
-        ch_cn_shutdown(conn, CH_UV_ERROR);
-        return CH_UV_ERROR;
+        tmp_err = uv_tcp_keepalive((uv_tcp_t*) client, 1, CH_TCP_KEEPALIVE);
+        if (tmp_err != CH_SUCCESS) {
+            E(chirp,
+              "Could not set tcp keepalive on connection (%d)",
+              tmp_err);
+            ch_cn_shutdown(conn, CH_UV_ERROR);
+            return CH_UV_ERROR;
+        }
     }
 
-    uv_read_start(
-            (uv_stream_t*) client, ch_cn_read_alloc_cb, _ch_pr_read_data_cb);
+    uv_read_start(client, ch_cn_read_alloc_cb, _ch_pr_read_data_cb);
 #ifdef CH_WITHOUT_TLS
     (void) (accept);
 #else
@@ -9148,7 +13591,7 @@ ch_pr_close_free_remotes(ch_chirp_t* chirp, int only_conns)
             ch_remote_t* remote = protocol->remotes;
             /* Leaves the queue empty and therefor prevents reconnects. */
             _ch_pr_abort_all_messages(remote, CH_SHUTDOWN);
-            ch_rm_delete_node(&protocol->remotes, remote);
+            ch_pr_delete_remote(protocol, remote);
             ch_connection_t* conn = remote->conn;
             if (conn != NULL) {
                 conn->delete_remote = remote;
@@ -9159,6 +13602,12 @@ ch_pr_close_free_remotes(ch_chirp_t* chirp, int only_conns)
         }
         /* Remove all remotes, sync with reconnect_remotes */
         protocol->reconnect_remotes = NULL;
+        A(protocol->remote_count == 0, "Remote index not empty");
+        if (protocol->remote_index != NULL) {
+            ch_chirp_free(ichirp, protocol->remote_index);
+            protocol->remote_index      = NULL;
+            protocol->remote_index_size = 0;
+        }
     }
 }
 
@@ -9178,7 +13627,8 @@ ch_pr_debounce_connection(ch_connection_t* conn)
     ch_remote_t*    remote   = NULL;
     ch_protocol_t*  protocol = &ichirp->protocol;
     ch_rm_init_from_conn(chirp, &key, conn, 1);
-    if (ch_rm_find(protocol->remotes, &key, &remote) == CH_SUCCESS) {
+    remote = ch_pr_find_remote(protocol, &key);
+    if (remote != NULL) {
         if (protocol->reconnect_remotes == NULL) {
             uv_timer_start(
                     &protocol->reconnect_timeout,
@@ -9193,6 +13643,167 @@ ch_pr_debounce_connection(ch_connection_t* conn)
     }
 }
 
+// .. c:function::
+void
+ch_pr_delete_remote(ch_protocol_t* protocol, ch_remote_t* remote)
+//    :noindex:
+//
+//    see: :c:func:`ch_pr_delete_remote`
+//
+// .. code-block:: cpp
+//
+{
+    ch_remote_t** index = protocol->remote_index;
+    uint32_t      mask  = protocol->remote_index_size - 1;
+    uint32_t      pos   = remote->hash & mask;
+    A(index != NULL, "Remote index not allocated");
+    while (index[pos] != remote) {
+        A(index[pos] != NULL, "Remote not in index");
+        pos = (pos + 1) & mask;
+    }
+    ch_rm_delete_node(&protocol->remotes, remote);
+    ch_pr_pin_remote(protocol, remote, 0);
+    if (remote->lru_prev != NULL) {
+        remote->lru_prev->lru_next = remote->lru_next;
+    } else {
+        protocol->remotes_lru = remote->lru_next;
+    }
+    if (remote->lru_next != NULL) {
+        remote->lru_next->lru_prev = remote->lru_prev;
+    } else {
+        protocol->remotes_lru_tail = remote->lru_prev;
+    }
+    remote->lru_prev = NULL;
+    remote->lru_next = NULL;
+    index[pos]       = NULL;
+    protocol->remote_count -= 1;
+    /* Shift following entries back into the hole, so lookups do not stop
+     * early. An entry may move if its home slot is not between the hole and
+     * itself. */
+    uint32_t next = (pos + 1) & mask;
+    while (index[next] != NULL) {
+        ch_remote_t* moved = index[next];
+        uint32_t     home  = moved->hash & mask;
+        if (((next - home) & mask) >= ((next - pos) & mask)) {
+            index[pos]  = moved;
+            index[next] = NULL;
+            pos         = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+// .. c:function::
+ch_remote_t*
+ch_pr_find_remote(ch_protocol_t* protocol, ch_remote_t* key)
+//    :noindex:
+//
+//    see: :c:func:`ch_pr_find_remote`
+//
+// .. code-block:: cpp
+//
+{
+    ch_remote_t** index = protocol->remote_index;
+    if (index == NULL) {
+        return NULL;
+    }
+    uint32_t mask = protocol->remote_index_size - 1;
+    uint32_t pos  = key->hash & mask;
+    /* The index is at most half full, so there is always an empty entry */
+    for (;;) {
+        ch_remote_t* remote = index[pos];
+        if (remote == NULL) {
+            return NULL;
+        }
+        if (remote->hash == key->hash && ch_remote_cmp(remote, key) == 0) {
+            return remote;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
+
+// .. c:function::
+static void
+_ch_pr_index_remote(
+        ch_remote_t** index, uint32_t index_size, ch_remote_t* remote)
+//
+//    Put the remote into the first empty entry starting at its hash.
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t mask = index_size - 1;
+    uint32_t pos  = remote->hash & mask;
+    while (index[pos] != NULL) {
+        pos = (pos + 1) & mask;
+    }
+    index[pos] = remote;
+}
+
+// .. c:function::
+static void
+_ch_pr_lru_append(ch_protocol_t* protocol, ch_remote_t* remote)
+//
+//    Append the remote to the end of the garbage-collection list.
+//
+// .. code-block:: cpp
+//
+{
+    remote->lru_next = NULL;
+    remote->lru_prev = protocol->remotes_lru_tail;
+    if (protocol->remotes_lru_tail != NULL) {
+        protocol->remotes_lru_tail->lru_next = remote;
+    } else {
+        protocol->remotes_lru = remote;
+    }
+    protocol->remotes_lru_tail = remote;
+}
+
+// .. c:function::
+ch_error_t
+ch_pr_insert_remote(ch_protocol_t* protocol, ch_remote_t* remote)
+//    :noindex:
+//
+//    see: :c:func:`ch_pr_insert_remote`
+//
+// .. code-block:: cpp
+//
+{
+    A(ch_pr_find_remote(protocol, remote) == NULL, "Remote already indexed");
+    if ((protocol->remote_count + 1) * 2 > protocol->remote_index_size) {
+        uint32_t old_size = protocol->remote_index_size;
+        uint32_t size = old_size ? old_size * 2 : CH_PR_REMOTE_INDEX_SIZE;
+        ch_remote_t** index =
+                ch_chirp_alloc(protocol->chirp->_, size * sizeof(*index));
+        if (index == NULL) {
+            E(protocol->chirp,
+              "Could not allocate memory for remote index",
+              CH_NO_ARG);
+            return CH_ENOMEM;
+        }
+        memset(index, 0, size * sizeof(*index));
+        if (protocol->remote_index != NULL) {
+            for (uint32_t i = 0; i < old_size; i++) {
+                if (protocol->remote_index[i] != NULL) {
+                    _ch_pr_index_remote(
+                            index, size, protocol->remote_index[i]);
+                }
+            }
+            ch_chirp_free(protocol->chirp->_, protocol->remote_index);
+        }
+        protocol->remote_index      = index;
+        protocol->remote_index_size = size;
+    }
+    int tmp_err = ch_rm_insert(&protocol->remotes, remote);
+    A(tmp_err == 0, "Inserting remote failed");
+    (void) (tmp_err);
+    _ch_pr_index_remote(
+            protocol->remote_index, protocol->remote_index_size, remote);
+    protocol->remote_count += 1;
+    _ch_pr_lru_append(protocol, remote);
+    return CH_SUCCESS;
+}
+
 #ifndef CH_WITHOUT_TLS
 // .. c:function::
 static int
@@ -9252,6 +13863,10 @@ ch_pr_decrypt_read(ch_connection_t* conn, int* stop)
     ch_chirp_t* chirp = conn->chirp;
     ssize_t     tmp_err;
     *stop = 0;
+    if (conn->buffer_rtls == NULL && ch_cn_alloc_tls_buffers(conn)) {
+        ch_cn_shutdown(conn, CH_ENOMEM);
+        return;
+    }
     while ((tmp_err = SSL_read(
                     conn->ssl, conn->buffer_rtls, conn->buffer_rtls_size)) >
            0) {
@@ -9360,6 +13975,71 @@ ch_pr_restart_stream(ch_connection_t* conn)
     }
 }
 
+// .. c:function::
+void
+ch_pr_pin_remote(ch_protocol_t* protocol, ch_remote_t* remote, int pin)
+//    :noindex:
+//
+//    see: :c:func:`ch_pr_pin_remote`
+//
+// .. code-block:: cpp
+//
+{
+    if (!pin == !(remote->flags & CH_RM_PINNED)) {
+        return;
+    }
+    if (pin) {
+        ch_config_t* config = &protocol->chirp->_->config;
+        if (protocol->pinned_remotes == NULL) {
+            /* Collect often enough to keep the connection alive */
+            uv_timer_start(
+                    &protocol->gc_timeout,
+                    _ch_pr_gc_connections_cb,
+                    config->REUSE_TIME * 1000 / 4,
+                    0);
+        }
+        remote->flags |= CH_RM_PINNED;
+        remote->pinned_next      = protocol->pinned_remotes;
+        protocol->pinned_remotes = remote;
+    } else {
+        remote->flags &= ~CH_RM_PINNED;
+        ch_remote_t** pos = &protocol->pinned_remotes;
+        while (*pos != remote) {
+            pos = &(*pos)->pinned_next;
+        }
+        *pos                = remote->pinned_next;
+        remote->pinned_next = NULL;
+    }
+}
+
+// .. c:function::
+void
+ch_pr_touch_remote(ch_remote_t* remote, uint64_t now)
+//    :noindex:
+//
+//    see: :c:func:`ch_pr_touch_remote`
+//
+// .. code-block:: cpp
+//
+{
+    ch_protocol_t* protocol = &remote->chirp->_->protocol;
+    remote->timestamp       = now;
+    if (remote == protocol->remotes_lru_tail) {
+        return;
+    }
+    /* Remotes deleted by garbage-collection are not in the list */
+    if (remote->lru_prev == NULL && remote != protocol->remotes_lru) {
+        return;
+    }
+    if (remote->lru_prev != NULL) {
+        remote->lru_prev->lru_next = remote->lru_next;
+    } else {
+        protocol->remotes_lru = remote->lru_next;
+    }
+    remote->lru_next->lru_prev = remote->lru_prev;
+    _ch_pr_lru_append(protocol, remote);
+}
+
 // .. c:function::
 static int
 _ch_pr_resume(ch_connection_t* conn)
@@ -9397,16 +14077,15 @@ _ch_pr_resume(ch_connection_t* conn)
 
 // .. c:function::
 static void
-_ch_pr_read_data_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf)
+_ch_pr_read_data(ch_connection_t* conn, ssize_t nread, const uv_buf_t* buf)
 //    :noindex:
 //
-//    see: :c:func:`ch_pr_read_data_cb`
+//    see: :c:func:`_ch_pr_read_data`
 //
 // .. code-block:: cpp
 //
 {
-    ch_connection_t* conn  = stream->data;
-    ch_chirp_t*      chirp = conn->chirp;
+    ch_chirp_t* chirp = conn->chirp;
     ch_chirp_check_m(chirp);
     /* Ignore reads while shutting down */
     if (conn->flags & CH_CN_SHUTTING_DOWN) {
@@ -9417,6 +14096,10 @@ _ch_pr_read_data_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf)
     conn->flags &= ~CH_CN_BUF_UV_USED;
 #endif
     if (nread == UV_EOF) {
+#ifndef CH_WITHOUT_TLS
+        /* The remote closed the connection, keep the session */
+        ch_cn_keep_tls_session(conn);
+#endif
         ch_cn_shutdown(conn, CH_PROTOCOL_ERROR);
         return;
     }
@@ -9438,25 +14121,101 @@ _ch_pr_read_data_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf)
         ch_cn_shutdown(conn, CH_PROTOCOL_ERROR);
         return;
     }
-    LC(chirp,
-       "%d available bytes.",
-       "ch_connection_t:%p",
-       (int) nread,
-       (void*) conn);
-    int stop;
-#ifndef CH_WITHOUT_TLS
-    if (conn->flags & CH_CN_ENCRYPTED) {
-        bytes_handled = _ch_pr_decrypt_feed(conn, buf->base, nread, &stop);
-    } else {
-#endif
-        bytes_handled = ch_rd_read(conn, buf->base, nread, &stop);
-#ifndef CH_WITHOUT_TLS
+    LC(chirp,
+       "%d available bytes.",
+       "ch_connection_t:%p",
+       (int) nread,
+       (void*) conn);
+    int stop;
+#ifndef CH_WITHOUT_TLS
+    if (conn->flags & CH_CN_ENCRYPTED) {
+        bytes_handled = _ch_pr_decrypt_feed(conn, buf->base, nread, &stop);
+    } else {
+#endif
+        bytes_handled = ch_rd_read(conn, buf->base, nread, &stop);
+#ifndef CH_WITHOUT_TLS
+    }
+#endif
+    if (stop) {
+        _ch_pr_update_resume(
+                &conn->read_resume, buf->base, nread, bytes_handled);
+    }
+}
+
+// .. c:function::
+static void
+_ch_pr_read_data_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf)
+//    :noindex:
+//
+//    see: :c:func:`ch_pr_read_data_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_connection_t* conn = stream->data;
+    _ch_pr_read_data(conn, nread, buf);
+    ch_cn_read_done(conn, nread);
+}
+
+// .. c:function::
+void
+ch_pr_local_path(char* path, const char* dir, int port)
+//    :noindex:
+//
+//    see: :c:func:`ch_pr_local_path`
+//
+// .. code-block:: cpp
+//
+{
+    snprintf(path, CH_PR_LOCAL_PATH_SIZE, CH_LOCAL_PATH, dir, port);
+}
+
+// .. c:function::
+int
+ch_pr_local_peer_ok(ch_chirp_t* chirp, uv_pipe_t* pipe)
+//    :noindex:
+//
+//    see: :c:func:`ch_pr_local_peer_ok`
+//
+// .. code-block:: cpp
+//
+{
+#ifdef _WIN32
+    (void) (chirp);
+    (void) (pipe);
+    return 0;
+#else
+    uv_os_fd_t fd;
+    uid_t      uid;
+    if (uv_fileno((uv_handle_t*) pipe, &fd) != 0) {
+        return 0;
+    }
+#ifdef __linux__
+    /* struct ucred needs _GNU_SOURCE, this is its layout on linux */
+    struct {
+        pid_t pid;
+        uid_t uid;
+        gid_t gid;
+    } cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+        E(chirp, "Could not get the peer of the local socket", CH_NO_ARG);
+        return 0;
+    }
+    uid = cred.uid;
+#else
+    gid_t gid;
+    if (getpeereid(fd, &uid, &gid) != 0) {
+        E(chirp, "Could not get the peer of the local socket", CH_NO_ARG);
+        return 0;
     }
 #endif
-    if (stop) {
-        _ch_pr_update_resume(
-                &conn->read_resume, buf->base, nread, bytes_handled);
+    if (uid != geteuid()) {
+        E(chirp, "The peer of the local socket runs as uid %d", (int) uid);
+        return 0;
     }
+    return 1;
+#endif
 }
 
 // .. c:function::
@@ -9502,6 +14261,17 @@ ch_pr_start(ch_protocol_t* protocol, uint16_t* uninit)
     if (tmp_err != CH_SUCCESS) {
         return tmp_err;
     }
+    if (config->LOCAL_DIR != NULL && !config->REUSE_PORT &&
+        _ch_pr_owns_loopback(config)) {
+        tmp_err = _ch_pr_start_local(chirp);
+        if (protocol->local_init) {
+            *uninit |= CH_UNINIT_SERVER_LOCAL;
+        }
+        if (tmp_err != CH_SUCCESS) {
+            /* TCP still works */
+            E(chirp, "Could not listen on the local socket (%d)", tmp_err);
+        }
+    }
     tmp_err = uv_timer_init(ichirp->loop, &protocol->reconnect_timeout);
     if (tmp_err != CH_SUCCESS) {
         return CH_INIT_FAIL;
@@ -9536,6 +14306,20 @@ ch_pr_stop(ch_protocol_t* protocol)
     ch_pr_close_free_remotes(chirp, 0);
     uv_close((uv_handle_t*) &protocol->serverv4, ch_chirp_close_cb);
     uv_close((uv_handle_t*) &protocol->serverv6, ch_chirp_close_cb);
+    if (protocol->local_init) {
+        if (protocol->local_listen) {
+            char    path[CH_PR_LOCAL_PATH_SIZE];
+            uv_fs_t req;
+            ch_pr_local_path(
+                    path, chirp->_->config.LOCAL_DIR, chirp->_->config.PORT);
+            uv_fs_unlink(chirp->_->loop, &req, path, NULL);
+            uv_fs_req_cleanup(&req);
+        }
+        uv_close((uv_handle_t*) &protocol->server_local, ch_chirp_close_cb);
+        protocol->local_init   = 0;
+        protocol->local_listen = 0;
+        chirp->_->closing_tasks += 1;
+    }
     uv_timer_stop(&protocol->reconnect_timeout);
     uv_close((uv_handle_t*) &protocol->reconnect_timeout, ch_chirp_close_cb);
     uv_timer_stop(&protocol->gc_timeout);
@@ -9561,9 +14345,68 @@ ch_pr_stop(ch_protocol_t* protocol)
 /* #include "util.h" */
 /* #include "writer.h" */
 
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#ifdef CH_ENABLE_COMPRESSION
+#include <lz4.h>
+#endif
+
 // Declarations
 // ============
 
+#ifdef CH_ENABLE_COMPRESSION
+// .. c:function::
+static ch_error_t
+_ch_rd_decompress(ch_connection_t* conn, ch_bf_slot_t* slot);
+//
+//    Decompress the data of a received message into the slot. The data goes
+//    into the preallocated buffer of the slot if it fits, otherwise into a
+//    buffer from the slab. Shuts the connection down on error.
+//
+//    :param ch_connection_t* conn: Connection the message was read from.
+//    :param ch_bf_slot_t* slot:    Slot of the message.
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype: ch_error_t
+//
+#endif
+
+// .. c:function::
+static ch_error_t
+_ch_rd_open_stream(ch_connection_t* conn, ch_reader_t* reader);
+//
+//    Start reading a streamed message, after its first frame has been read
+//    into the current slot. The chunks are collected in a buffer from the
+//    slab, unless a stream callback is set.
+//    see: :c:func:`ch_chirp_set_stream_callback`
+//
+//    :param ch_connection_t* conn: Connection the message was read from.
+//    :param ch_reader_t* reader:   Pointer to a reader instance.
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype: ch_error_t
+//
+
+// .. c:function::
+static void
+_ch_rd_read_chunk(
+        ch_connection_t* conn,
+        ch_reader_t*     reader,
+        ch_buf*          src_buf,
+        size_t           to_read,
+        ssize_t*         bytes_handled);
+//
+//    Read a chunk of the streamed message, which may be partial. Hands the
+//    message to the user after the last chunk.
+//
+//    :param ch_connection_t* conn: Connection the data was read from.
+//    :param ch_reader_t* reader:   Pointer to a reader instance.
+//    :param ch_buf* src_buf:       The data read.
+//    :param size_t to_read:        Bytes in src_buf.
+//    :param ssize_t* bytes_handled: (Out) Increased by the bytes handled.
+//
+
 // .. c:function::
 static void
 _ch_rd_handshake(ch_connection_t* conn, ch_buf* buf, size_t read);
@@ -9600,6 +14443,54 @@ _ch_rd_handshake(ch_connection_t* conn, ch_buf* buf, size_t read);
 //                                  source
 //    :param size_t read:           Count of bytes read
 
+// .. c:function::
+static void
+_ch_rd_handle_features(ch_connection_t* conn, ch_message_t* wire_msg);
+//
+//    Enable the features the remote announced in the serial of a
+//    CH_MSG_FEATURES NOOP on the connection.
+//
+//    :param ch_connection_t* conn:  Pointer to a connection instance.
+//    :param ch_message_t* wire_msg: The NOOP received.
+//
+
+// .. c:function::
+static inline void
+_ch_rd_handle_ack_noop(ch_connection_t* conn, ch_message_t* wire_msg);
+//
+//    Handle a received ack or noop, which have neither header nor data.
+//
+//    :param ch_connection_t* conn:  Pointer to a connection instance.
+//    :param ch_message_t* wire_msg: The ack or noop received.
+//
+
+// .. c:function::
+static inline void
+_ch_rd_handle_acks(
+        ch_connection_t* conn, ch_message_t* wire_msg, ch_buf* acks);
+//
+//    Handle a received ack and the further identities acknowledged by a
+//    coalesced ack.
+//
+//    :param ch_connection_t* conn:  Pointer to a connection instance.
+//    :param ch_message_t* wire_msg: The ack received.
+//    :param ch_buf* acks:           The data of the ack: wire_msg->data_len
+//                                   bytes of identities.
+//
+
+// .. c:function::
+static void
+_ch_rd_msg_received(
+        ch_connection_t* conn, ch_reader_t* reader, ch_message_t* msg);
+//
+//    Touch the connection and the remote, count the message and take a
+//    reference to the pool, which is given back when the slot is released.
+//
+//    :param ch_connection_t* conn:  Pointer to a connection instance.
+//    :param ch_reader_t* reader:    Pointer to a reader instance.
+//    :param ch_message_t* msg:      Message that was received
+//
+
 // .. c:function::
 static void
 _ch_rd_handle_msg(
@@ -9632,6 +14523,41 @@ _ch_rd_read_buffer(
 //    message is small enough, otherwise a buffer will be allocated. The
 //    function also handles partial reads.
 
+// .. c:function::
+static inline ssize_t
+_ch_rd_read_fast(
+        ch_connection_t* conn,
+        ch_buf*          buf,
+        size_t           bytes_read,
+        ssize_t          bytes_handled);
+//
+//    Fast path of the reader: Handle all messages that are completely
+//    contained in the buffer in one loop. On unencrypted connections header
+//    and data are not copied, the message points into the reference counted
+//    read buffer of the connection. Returns as soon as a message is partial
+//    or no slot is free, the state machine then continues.
+//
+//    :param ch_connection_t* conn: Connection the data was read from.
+//    :param void* buffer:          The buffer containing ``read`` bytes read.
+//    :param size_t bytes_read:     The bytes read.
+//    :param size_t bytes_handled:  The bytes already handled
+//    :return: The bytes handled or -1 on shutdown.
+//    :rtype:  ssize_t
+//
+
+// .. c:function::
+static inline void
+_ch_rd_prepare_msg(
+        ch_connection_t* conn, ch_message_t* msg, ch_message_t* wire_msg);
+//
+//    Copy the wire message and the address of the connection to the message
+//    of a slot.
+//
+//    :param ch_connection_t* conn:  Connection the message came from.
+//    :param ch_message_t* msg:      Message of the slot.
+//    :param ch_message_t* wire_msg: Wire message read.
+//
+
 // .. c:function::
 static inline ssize_t
 _ch_rd_read_step(
@@ -9652,6 +14578,20 @@ _ch_rd_read_step(
 //    :param int* cont:             (Out) Request continuation
 //
 
+// .. c:function::
+static inline ch_message_t*
+_ch_rd_take_wam(ch_remote_t* remote, ch_message_t* ack_msg);
+//
+//    Find the message waiting for the ACK ``ack_msg`` in the ACK window of
+//    the remote and remove it from the window. ACKs usually arrive in send
+//    order, so the oldest message is checked first.
+//
+//    :param ch_remote_t* remote:   Remote the ACK was received from.
+//    :param ch_message_t* ack_msg: The ACK received.
+//    :return: The message or NULL if it is not (or no longer) waiting.
+//    :rtype:  ch_message_t*
+//
+
 // .. c:function::
 static inline ch_error_t
 _ch_rd_verify_msg(ch_connection_t* conn, ch_message_t* msg);
@@ -9677,6 +14617,8 @@ char* _ch_rd_state_names[] = {
         "CH_RD_SLOT",
         "CH_RD_HEADER",
         "CH_RD_DATA",
+        "CH_RD_STREAM",
+        "CH_RD_ACKS",
 };
 
 // .. c:function::
@@ -9715,20 +14657,44 @@ _ch_rd_handshake(ch_connection_t* conn, ch_buf* buf, size_t read)
     ch_sr_buf_to_hs(buf, &hs_tmp);
     conn->port = hs_tmp.port;
     memcpy(conn->remote_identity, hs_tmp.identity, CH_ID_SIZE);
-    ch_rm_init_from_conn(chirp, &search_remote, conn, 0);
-    if (ch_rm_find(protocol->remotes, &search_remote, &remote) != CH_SUCCESS) {
-        remote = ch_alloc(sizeof(*remote));
+    ch_rm_init_from_conn(chirp, &search_remote, conn, 1);
+    remote = ch_pr_find_remote(protocol, &search_remote);
+    if (remote == NULL) {
+        remote = ch_bf_objects_alloc(&ichirp->remote_pool);
         LC(chirp, "Remote allocated", "ch_remote_t:%p", remote);
         if (remote == NULL) {
             ch_cn_shutdown(conn, CH_ENOMEM);
             return;
         }
-        *remote     = search_remote;
-        int tmp_err = ch_rm_insert(&protocol->remotes, remote);
-        A(tmp_err == 0, "Inserting remote failed");
-        (void) (tmp_err);
+        ch_rm_init_from_conn(chirp, remote, conn, 0);
+        if (ch_pr_insert_remote(protocol, remote) != CH_SUCCESS) {
+            ch_rm_free(remote);
+            ch_cn_shutdown(conn, CH_ENOMEM);
+            return;
+        }
     }
     conn->remote = remote;
+    /* The features usually arrive with the handshake: apply them before the
+     * queues are processed. The reader handles the NOOP again. */
+    if (read >= CH_SR_HANDSHAKE_SIZE + CH_SR_WIRE_MESSAGE_SIZE) {
+        ch_message_t features;
+        ch_sr_buf_to_msg(buf + CH_SR_HANDSHAKE_SIZE, &features);
+        if (features.type & CH_MSG_FEATURES) {
+            _ch_rd_handle_features(conn, &features);
+        }
+    }
+    if (conn->flags & CH_CN_INCOMING) {
+        ichirp->stats.accepts += 1;
+    } else {
+        ichirp->stats.connects += 1;
+    }
+    if (conn->flags & CH_CN_LOCAL) {
+        ichirp->stats.local_connections += 1;
+    }
+    if (remote->flags & CH_RM_CONNECTED) {
+        ichirp->stats.reconnects += 1;
+    }
+    remote->flags |= CH_RM_CONNECTED;
     /* If there is a network race condition we replace the old connection and
      * leave the old one for garbage collection. */
     old_conn     = remote->conn;
@@ -9765,18 +14731,155 @@ _ch_rd_handshake(ch_connection_t* conn, ch_buf* buf, size_t read)
            (void*) conn);
     }
 #endif
-    ch_message_t* ack_msg = &conn->ack_msg;
-    memcpy(ack_msg->address, conn->address, CH_IP_ADDR_SIZE);
-    ack_msg->ip_protocol = conn->ip_protocol;
-    ack_msg->port        = conn->port;
-    ack_msg->type        = CH_MSG_ACK;
-    ack_msg->header_len  = 0;
-    ack_msg->data_len    = 0;
-    ack_msg->_pool       = conn;
+    for (int i = 0; i < CH_MAX_ACK_WINDOW; i++) {
+        ch_message_t* ack_msg = &conn->ack_msgs[i];
+        memcpy(ack_msg->address, conn->address, CH_IP_ADDR_SIZE);
+        ack_msg->ip_protocol = conn->ip_protocol;
+        ack_msg->port        = conn->port;
+        ack_msg->type        = CH_MSG_ACK;
+        ack_msg->header_len  = 0;
+        ack_msg->data_len    = 0;
+        ack_msg->_slot       = i;
+        ack_msg->_pool       = conn;
+    }
+    conn->free_acks = 0xFFFFFFFFU;
+    conn->free_acks <<= (32 - CH_MAX_ACK_WINDOW);
     A(conn->remote != NULL, "The remote has to be set");
     ch_wr_process_queues(conn->remote);
 }
 
+// .. c:function::
+static void
+_ch_rd_handle_features(ch_connection_t* conn, ch_message_t* wire_msg)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_handle_features`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_int_t* ichirp = conn->chirp->_;
+    uint32_t        flags  = wire_msg->serial;
+    if (ichirp->config.COMPRESSION && flags & CH_SR_HS_COMPRESSION) {
+        conn->flags |= CH_CN_COMPRESSION;
+    }
+    if (flags & CH_SR_HS_STREAMING) {
+        conn->flags |= CH_CN_STREAMING;
+    }
+    if (ichirp->config.ACK_COALESCE > 1 && flags & CH_SR_HS_ACKS) {
+        /* Waiting for more ACKs than the sender's window would stall it */
+        uint8_t window     = (flags >> CH_SR_HS_WINDOW_SHIFT) & 0xFF;
+        conn->ack_coalesce = ichirp->config.ACK_COALESCE;
+        if (window != 0 && window < conn->ack_coalesce) {
+            conn->ack_coalesce = window;
+        }
+        if (conn->ack_coalesce > 1 && conn->acks == NULL) {
+            /* Without the memory each message is acknowledged on its own */
+            conn->acks = ch_chirp_alloc(ichirp, sizeof(*conn->acks));
+            if (conn->acks != NULL) {
+                ch_message_t* acks_msg = &conn->acks->msg;
+                memset(acks_msg, 0, sizeof(*acks_msg));
+                memcpy(acks_msg->address, conn->address, CH_IP_ADDR_SIZE);
+                acks_msg->ip_protocol = conn->ip_protocol;
+                acks_msg->port        = conn->port;
+                acks_msg->type        = CH_MSG_ACK;
+                acks_msg->data        = conn->acks->data;
+                acks_msg->_pool       = conn;
+            }
+        }
+        if (conn->ack_coalesce > 1 && conn->acks != NULL) {
+            conn->flags |= CH_CN_ACKS;
+        }
+    }
+    if (conn->remote != NULL && !(conn->flags & CH_CN_LOCAL)) {
+        /* Only an announcement over TCP switches to the local socket */
+        if (flags & CH_SR_HS_LOCAL) {
+            conn->remote->flags |= CH_RM_LOCAL;
+        } else {
+            conn->remote->flags &= ~CH_RM_LOCAL;
+        }
+    }
+}
+
+// .. c:function::
+static inline void
+_ch_rd_handle_ack_noop(ch_connection_t* conn, ch_message_t* wire_msg)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_handle_ack_noop`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t*     chirp  = conn->chirp;
+    ch_chirp_int_t* ichirp = chirp->_;
+    if (wire_msg->type & CH_MSG_NOOP) {
+        LC(chirp, "Received NOOP.", "ch_connection_t", conn);
+        if (wire_msg->type & CH_MSG_FEATURES) {
+            _ch_rd_handle_features(conn, wire_msg);
+        }
+        conn->timestamp = uv_now(ichirp->loop);
+        if (conn->remote != NULL) {
+            ch_pr_touch_remote(conn->remote, conn->timestamp);
+        }
+    } else {
+        /* Since we abort wams on shutdown, we can receive acks for a old
+         * wam */
+        ch_message_t* wam = _ch_rd_take_wam(conn->remote, wire_msg);
+        if (wam != NULL) {
+            ch_chirp_trace(ichirp, CH_TR_ACK, wam, wam->serial);
+            ch_chirp_record_latency(
+                    ichirp->stats.ack_latency, wam->_send_time);
+            wam->_flags |= CH_MSG_ACK_RECEIVED;
+            ch_chirp_finish_message(chirp, conn, wam, CH_SUCCESS);
+        }
+    }
+}
+
+// .. c:function::
+static inline void
+_ch_rd_handle_acks(ch_connection_t* conn, ch_message_t* wire_msg, ch_buf* acks)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_handle_acks`
+//
+// .. code-block:: cpp
+//
+{
+    _ch_rd_handle_ack_noop(conn, wire_msg);
+    for (uint32_t i = 0; i < wire_msg->data_len; i += CH_ID_SIZE) {
+        /* A finished message can shutdown the connection */
+        if (conn->flags & CH_CN_SHUTTING_DOWN) {
+            return;
+        }
+        memcpy(wire_msg->identity, acks + i, CH_ID_SIZE);
+        _ch_rd_handle_ack_noop(conn, wire_msg);
+    }
+}
+
+// .. c:function::
+static void
+_ch_rd_msg_received(
+        ch_connection_t* conn, ch_reader_t* reader, ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_msg_received`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_int_t* ichirp = conn->chirp->_;
+    conn->timestamp        = uv_now(ichirp->loop);
+    if (conn->remote != NULL) {
+        ch_pr_touch_remote(conn->remote, conn->timestamp);
+    }
+    ichirp->stats.msgs_recv += 1;
+    ichirp->stats.bytes_recv += msg->header_len + msg->data_len;
+
+    /* Only increase refcnt if we know ch_chirp_release_msg_slot is called */
+    reader->pool->refcnt += 1;
+}
+
 // .. c:function::
 static void
 _ch_rd_handle_msg(ch_connection_t* conn, ch_reader_t* reader, ch_message_t* msg)
@@ -9813,16 +14916,12 @@ _ch_rd_handle_msg(ch_connection_t* conn, ch_reader_t* reader, ch_message_t* msg)
     }
 #endif
 
-    reader->state   = CH_RD_WAIT;
-    reader->slot    = NULL;
-    conn->timestamp = uv_now(ichirp->loop);
-    if (conn->remote != NULL) {
-        conn->remote->timestamp = conn->timestamp;
-    }
-
-    /* Only increase refcnt if we know ch_chirp_release_msg_slot is called */
-    reader->pool->refcnt += 1;
-    if (ichirp->recv_cb != NULL) {
+    reader->state = CH_RD_WAIT;
+    reader->slot  = NULL;
+    _ch_rd_msg_received(conn, reader, msg);
+    if (ichirp->recv_batch_cb != NULL) {
+        ch_chirp_add_recv_batch(chirp, msg);
+    } else if (ichirp->recv_cb != NULL) {
         ichirp->recv_cb(chirp, msg);
     } else {
         ch_chirp_release_msg_slot(chirp, msg, NULL);
@@ -9854,32 +14953,197 @@ _ch_rd_read_buffer(
             /* Preallocated buf is large enough */
             *assign_buf = dest_buf;
         } else {
-            *assign_buf = ch_alloc(expected);
-            if (*assign_buf == NULL) {
-                EC(conn->chirp,
-                   "Could not allocate memory for message. ",
-                   "ch_connection_t:%p",
-                   (void*) conn);
-                ch_cn_shutdown(conn, CH_ENOMEM);
-                return CH_ENOMEM;
+            *assign_buf = ch_bf_slab_alloc(conn->chirp->_->slab, expected);
+            if (*assign_buf == NULL) {
+                EC(conn->chirp,
+                   "Could not allocate memory for message. ",
+                   "ch_connection_t:%p",
+                   (void*) conn);
+                ch_cn_shutdown(conn, CH_ENOMEM);
+                return CH_ENOMEM;
+            }
+            msg->_flags |= free_flag;
+        }
+    }
+    if ((to_read + reader->bytes_read) >= expected) {
+        /* We can read everything */
+        size_t reading = expected - reader->bytes_read;
+        memcpy(*assign_buf + reader->bytes_read, src_buf, reading);
+        *bytes_handled += reading;
+        reader->bytes_read = 0; /* Reset partial buffer reads */
+        return CH_SUCCESS;
+    } else {
+        /* Only partial read possible */
+        memcpy(*assign_buf + reader->bytes_read, src_buf, to_read);
+        *bytes_handled += to_read;
+        reader->bytes_read += to_read;
+        return CH_MORE;
+    }
+}
+
+// .. c:function::
+static inline ch_message_t*
+_ch_rd_take_wam(ch_remote_t* remote, ch_message_t* ack_msg)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_take_wam`
+//
+// .. code-block:: cpp
+//
+{
+    int count = remote->wait_ack_count;
+    for (int i = 0; i < count; i++) {
+        ch_message_t* wam = remote->wait_ack_messages[i];
+        if (memcmp(wam->identity, ack_msg->identity, CH_ID_SIZE) == 0) {
+            memmove(&remote->wait_ack_messages[i],
+                    &remote->wait_ack_messages[i + 1],
+                    (count - i - 1) * sizeof(*remote->wait_ack_messages));
+            memmove(&remote->wait_ack_times[i],
+                    &remote->wait_ack_times[i + 1],
+                    (count - i - 1) * sizeof(*remote->wait_ack_times));
+            remote->wait_ack_count -= 1;
+            return wam;
+        }
+    }
+    return NULL;
+}
+
+// .. c:function::
+static inline void
+_ch_rd_prepare_msg(
+        ch_connection_t* conn, ch_message_t* msg, ch_message_t* wire_msg)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_prepare_msg`
+//
+// .. code-block:: cpp
+//
+{
+    /* Copy the wire message */
+    memcpy(msg, wire_msg, ((char*) &wire_msg->header) - ((char*) wire_msg));
+    msg->ip_protocol = conn->ip_protocol;
+    msg->port        = conn->port;
+    memcpy(msg->remote_identity, conn->remote_identity, CH_ID_SIZE);
+    memcpy(msg->address,
+           conn->address,
+           (msg->ip_protocol == AF_INET6) ? CH_IP_ADDR_SIZE : CH_IP4_ADDR_SIZE);
+    if (msg->type & CH_MSG_REQ_ACK) {
+        msg->_flags |= CH_MSG_SEND_ACK;
+    }
+    ch_chirp_trace(conn->chirp->_, CH_TR_SLOT_ACQUIRE, msg, msg->serial);
+}
+
+// .. c:function::
+static inline ssize_t
+_ch_rd_read_fast(
+        ch_connection_t* conn,
+        ch_buf*          buf,
+        size_t           bytes_read,
+        ssize_t          bytes_handled)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_read_fast`
+//
+// .. code-block:: cpp
+//
+{
+    ch_reader_t*  reader   = &conn->reader;
+    ch_message_t* wire_msg = &reader->wire_msg;
+    /* Over TLS the buffer is the decryption buffer, which is reused */
+    int zero_copy = !(conn->flags & CH_CN_ENCRYPTED);
+    A(reader->state == CH_RD_WAIT, "Reader not waiting for a message");
+    A(reader->bytes_read == 0, "Reader has a partial message");
+    A(zero_copy ? buf >= conn->buffer_uv &&
+                          buf + bytes_read <= conn->buffer_uv +
+                                                      conn->buffer_uv_uv.len
+                : 1,
+      "Buffer is not the read buffer");
+
+    while (bytes_read - bytes_handled >= CH_SR_WIRE_MESSAGE_SIZE) {
+        ch_buf* pos = buf + bytes_handled;
+        ch_sr_buf_to_msg(pos, wire_msg);
+        size_t payload = (size_t) wire_msg->header_len + wire_msg->data_len;
+        if (bytes_read - bytes_handled - CH_SR_WIRE_MESSAGE_SIZE < payload) {
+            break; /* Partial message: the state machine handles it */
+        }
+        int tmp_err = _ch_rd_verify_msg(conn, wire_msg);
+        if (tmp_err != CH_SUCCESS) {
+            ch_cn_shutdown(conn, tmp_err);
+            return -1; /* Shutdown */
+        }
+        if (wire_msg->type & (CH_MSG_NOOP | CH_MSG_ACK)) {
+            bytes_handled += CH_SR_WIRE_MESSAGE_SIZE + wire_msg->data_len;
+            _ch_rd_handle_acks(conn, wire_msg, pos + CH_SR_WIRE_MESSAGE_SIZE);
+            if (conn->flags & CH_CN_SHUTTING_DOWN) {
+                return -1; /* Shutdown */
+            }
+            continue;
+        }
+        if (wire_msg->type & CH_MSG_STREAM) {
+            break; /* The state machine handles streamed messages */
+        }
+        ch_bf_slot_t* slot = ch_bf_acquire(reader->pool);
+        if (slot == NULL) {
+            break; /* The state machine stops the stream */
+        }
+        ch_message_t* msg = &slot->msg;
+        reader->slot      = slot;
+        _ch_rd_prepare_msg(conn, msg, wire_msg);
+        bytes_handled += CH_SR_WIRE_MESSAGE_SIZE;
+        pos += CH_SR_WIRE_MESSAGE_SIZE;
+        if (zero_copy) {
+            if (msg->header_len > 0) {
+                msg->header = pos;
+            }
+            if (msg->data_len > 0) {
+                msg->data = pos + msg->header_len;
+            }
+            if (payload > 0) {
+                ch_bf_shared_ref(conn->buffer_shared);
+                slot->shared = conn->buffer_shared;
+            }
+            bytes_handled += payload;
+        } else {
+            if (msg->header_len > 0 &&
+                _ch_rd_read_buffer(
+                        conn,
+                        reader,
+                        msg,
+                        pos,
+                        msg->header_len,
+                        &msg->header,
+                        slot->header,
+                        CH_BF_PREALLOC_HEADER,
+                        msg->header_len,
+                        CH_MSG_FREE_HEADER,
+                        &bytes_handled) != CH_SUCCESS) {
+                return -1; /* Shutdown */
+            }
+            if (msg->data_len > 0 &&
+                _ch_rd_read_buffer(
+                        conn,
+                        reader,
+                        msg,
+                        pos + msg->header_len,
+                        msg->data_len,
+                        &msg->data,
+                        slot->data,
+                        CH_BF_PREALLOC_DATA,
+                        msg->data_len,
+                        CH_MSG_FREE_DATA,
+                        &bytes_handled) != CH_SUCCESS) {
+                return -1; /* Shutdown */
             }
-            msg->_flags |= free_flag;
         }
+#ifdef CH_ENABLE_COMPRESSION
+        if (msg->type & CH_MSG_COMPRESSED &&
+            _ch_rd_decompress(conn, slot) != CH_SUCCESS) {
+            return -1; /* Shutdown */
+        }
+#endif
+        _ch_rd_handle_msg(conn, reader, msg);
     }
-    if ((to_read + reader->bytes_read) >= expected) {
-        /* We can read everything */
-        size_t reading = expected - reader->bytes_read;
-        memcpy(*assign_buf + reader->bytes_read, src_buf, reading);
-        *bytes_handled += reading;
-        reader->bytes_read = 0; /* Reset partial buffer reads */
-        return CH_SUCCESS;
-    } else {
-        /* Only partial read possible */
-        memcpy(*assign_buf + reader->bytes_read, src_buf, to_read);
-        *bytes_handled += to_read;
-        reader->bytes_read += to_read;
-        return CH_MORE;
-    }
+    return bytes_handled;
 }
 
 // .. c:function::
@@ -9901,7 +15165,6 @@ _ch_rd_read_step(
     ch_message_t*   msg;
     ch_bf_slot_t*   slot;
     ch_chirp_t*     chirp   = conn->chirp;
-    ch_chirp_int_t* ichirp  = chirp->_;
     ch_reader_t*    reader  = &conn->reader;
     int             to_read = bytes_read - bytes_handled;
 
@@ -9918,7 +15181,7 @@ _ch_rd_read_step(
         /* We expect that complete handshake arrives at once,
          * check in _ch_rd_handshake */
         _ch_rd_handshake(conn, buf + bytes_handled, to_read);
-        bytes_handled += sizeof(ch_sr_handshake_t);
+        bytes_handled += CH_SR_HANDSHAKE_SIZE;
         reader->state = CH_RD_WAIT;
         break;
     }
@@ -9948,26 +15211,19 @@ _ch_rd_read_step(
             ch_cn_shutdown(conn, tmp_err);
             return -1; /* Shutdown */
         }
-        if (wire_msg->type & CH_MSG_NOOP) {
-            LC(chirp, "Received NOOP.", "ch_connection_t", conn);
-            conn->timestamp = uv_now(ichirp->loop);
-            if (conn->remote != NULL) {
-                conn->remote->timestamp = conn->timestamp;
+        if (wire_msg->type & CH_MSG_ACK && wire_msg->data_len > 0) {
+            /* The identities in the data are handled as they arrive */
+            _ch_rd_handle_ack_noop(conn, wire_msg);
+            if (conn->flags & CH_CN_SHUTTING_DOWN) {
+                return -1; /* Shutdown */
             }
+            reader->state = CH_RD_ACKS;
             break;
-        } else if (wire_msg->type & CH_MSG_ACK) {
-            ch_message_t* wam = conn->remote->wait_ack_message;
-            /* Since we abort wam on shutdown, we can receive acks for a old
-             * wam */
-            if (wam != NULL) {
-                if (memcmp(wam->identity, wire_msg->identity, CH_ID_SIZE) ==
-                    0) {
-                    wam->_flags |= CH_MSG_ACK_RECEIVED;
-                    conn->remote->wait_ack_message = NULL;
-                    ch_chirp_finish_message(chirp, conn, wam, CH_SUCCESS);
-                }
-            }
+        } else if (wire_msg->type & (CH_MSG_NOOP | CH_MSG_ACK)) {
+            _ch_rd_handle_ack_noop(conn, wire_msg);
             break;
+        } else if (wire_msg->type & CH_MSG_STREAM && reader->stream != NULL) {
+            reader->state = CH_RD_STREAM;
         } else {
             reader->state = CH_RD_SLOT;
         }
@@ -9986,6 +15242,7 @@ _ch_rd_read_step(
                 if (!(conn->flags & CH_CN_STOPPED)) {
                     LC(chirp, "Stop stream", "ch_connection_t:%p", conn);
                     uv_read_stop((uv_stream_t*) &conn->client);
+                    chirp->_->stats.slots_exhausted += 1;
                 }
                 conn->flags |= CH_CN_STOPPED;
                 *stop = 1;
@@ -9994,18 +15251,7 @@ _ch_rd_read_step(
         }
         slot = reader->slot;
         msg  = &slot->msg;
-        /* Copy the wire message */
-        memcpy(msg, wire_msg, ((char*) &wire_msg->header) - ((char*) wire_msg));
-        msg->ip_protocol = conn->ip_protocol;
-        msg->port        = conn->port;
-        memcpy(msg->remote_identity, conn->remote_identity, CH_ID_SIZE);
-        memcpy(msg->address,
-               conn->address,
-               (msg->ip_protocol == AF_INET6) ? CH_IP_ADDR_SIZE
-                                              : CH_IP4_ADDR_SIZE);
-        if (msg->type & CH_MSG_REQ_ACK) {
-            msg->_flags |= CH_MSG_SEND_ACK;
-        }
+        _ch_rd_prepare_msg(conn, msg, wire_msg);
         /* Direct jump to next read state */
         if (msg->header_len > 0) {
             reader->state = CH_RD_HEADER;
@@ -10062,9 +15308,55 @@ _ch_rd_read_step(
                     &bytes_handled) != CH_SUCCESS) {
             return -1; /* Shutdown */
         }
+        if (msg->type & CH_MSG_STREAM) {
+            if (_ch_rd_open_stream(conn, reader) != CH_SUCCESS) {
+                return -1; /* Shutdown */
+            }
+            break;
+        }
+#ifdef CH_ENABLE_COMPRESSION
+        if (msg->type & CH_MSG_COMPRESSED &&
+            _ch_rd_decompress(conn, slot) != CH_SUCCESS) {
+            return -1; /* Shutdown */
+        }
+#endif
         _ch_rd_handle_msg(conn, reader, msg);
         break;
     }
+    case CH_RD_STREAM: {
+        if (bytes_read == 0)
+            return -1;
+        _ch_rd_read_chunk(
+                conn, reader, buf + bytes_handled, to_read, &bytes_handled);
+        break;
+    }
+    case CH_RD_ACKS: {
+        if (bytes_read == 0)
+            return -1;
+        /* A partial identity waits in net_msg, the wire message is parsed
+         * already */
+        ch_message_t* wire_msg = &reader->wire_msg;
+        size_t        partial  = reader->bytes_read % CH_ID_SIZE;
+        ssize_t       reading  = CH_ID_SIZE - partial;
+        if (reading > to_read) {
+            reading = to_read;
+        }
+        memcpy(reader->net_msg + partial, buf + bytes_handled, reading);
+        reader->bytes_read += reading;
+        bytes_handled += reading;
+        if (partial + reading == CH_ID_SIZE) {
+            if (reader->bytes_read == wire_msg->data_len) {
+                reader->bytes_read = 0;
+                reader->state      = CH_RD_WAIT;
+            }
+            memcpy(wire_msg->identity, reader->net_msg, CH_ID_SIZE);
+            _ch_rd_handle_ack_noop(conn, wire_msg);
+            if (conn->flags & CH_CN_SHUTTING_DOWN) {
+                return -1; /* Shutdown */
+            }
+        }
+        break;
+    }
     default:
         A(0, "Unknown reader state");
         break;
@@ -10093,7 +15385,11 @@ _ch_rd_verify_msg(ch_connection_t* conn, ch_message_t* msg)
         return CH_ENOMEM;
     }
     if ((msg->type & CH_MSG_ACK) || (msg->type & CH_MSG_NOOP)) {
-        if (msg->header_len != 0 || msg->data_len != 0) {
+        /* The data of a coalesced ack are identities */
+        int acks = (msg->type & CH_MSG_ACK) &&
+                   msg->data_len % CH_ID_SIZE == 0 &&
+                   msg->data_len <= CH_SR_ACKS_SIZE;
+        if (msg->header_len != 0 || (msg->data_len != 0 && !acks)) {
             EC(chirp,
                "A ack/noop may not have header or data set. ",
                "ch_connection_t:%p",
@@ -10108,8 +15404,210 @@ _ch_rd_verify_msg(ch_connection_t* conn, ch_message_t* msg)
             return CH_PROTOCOL_ERROR;
         }
     }
+    if (msg->type & CH_MSG_COMPRESSED) {
+#ifdef CH_ENABLE_COMPRESSION
+        if (msg->data_len <= CH_SR_COMPRESSED_PREFIX) {
+            EC(chirp,
+               "Compressed message without data. ",
+               "ch_connection_t:%p",
+               (void*) conn);
+            return CH_PROTOCOL_ERROR;
+        }
+#else
+        EC(chirp,
+           "Compressed message, but compression is not supported. ",
+           "ch_connection_t:%p",
+           (void*) conn);
+        return CH_PROTOCOL_ERROR;
+#endif
+    }
+    if (msg->type & CH_MSG_STREAM) {
+        ch_reader_t*  reader = &conn->reader;
+        ch_bf_slot_t* stream = reader->stream;
+        int           valid;
+        if (stream == NULL) {
+            /* First frame: header and size of the data */
+            valid = msg->data_len == CH_SR_STREAM_PREFIX;
+        } else {
+            /* Chunk: part of the data, but not more than announced */
+            valid = msg->header_len == 0 && msg->data_len > 0 &&
+                    msg->data_len <=
+                            stream->msg.data_len - reader->stream_offset &&
+                    msg->serial == stream->msg.serial;
+        }
+        if (!valid || msg->type & CH_MSG_COMPRESSED) {
+            EC(chirp,
+               "Invalid frame of streamed message. ",
+               "ch_connection_t:%p",
+               (void*) conn);
+            return CH_PROTOCOL_ERROR;
+        }
+    }
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+static ch_error_t
+_ch_rd_open_stream(ch_connection_t* conn, ch_reader_t* reader)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_open_stream`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t*     chirp  = conn->chirp;
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_bf_slot_t*   slot   = reader->slot;
+    ch_message_t*   msg    = &slot->msg;
+    uint32_t        data_len;
+    A(msg->data == slot->data, "Expected the size in the slot");
+    memcpy(&data_len, msg->data, CH_SR_STREAM_PREFIX);
+    data_len = ntohl(data_len);
+    if (data_len == 0 || data_len > ichirp->config.MAX_MSG_SIZE) {
+        EC(chirp,
+           "Invalid size of streamed message. ",
+           "ch_connection_t:%p",
+           (void*) conn);
+        ch_cn_shutdown(conn, CH_PROTOCOL_ERROR);
+        return CH_PROTOCOL_ERROR;
+    }
+    msg->data = NULL;
+    if (ichirp->stream_cb == NULL) {
+        msg->data = ch_bf_slab_alloc(ichirp->slab, data_len);
+        if (msg->data == NULL) {
+            EC(chirp,
+               "Could not allocate memory for message. ",
+               "ch_connection_t:%p",
+               (void*) conn);
+            ch_cn_shutdown(conn, CH_ENOMEM);
+            return CH_ENOMEM;
+        }
+        msg->_flags |= CH_MSG_FREE_DATA;
+    }
+    msg->data_len = data_len;
+    msg->type &= ~CH_MSG_STREAM;
+    reader->stream        = slot;
+    reader->stream_offset = 0;
+    reader->slot          = NULL;
+    reader->state         = CH_RD_WAIT;
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+static void
+_ch_rd_read_chunk(
+        ch_connection_t* conn,
+        ch_reader_t*     reader,
+        ch_buf*          src_buf,
+        size_t           to_read,
+        ssize_t*         bytes_handled)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_read_chunk`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t*     chirp   = conn->chirp;
+    ch_chirp_int_t* ichirp  = chirp->_;
+    ch_message_t*   msg     = &reader->stream->msg;
+    uint32_t        offset  = reader->stream_offset;
+    size_t          reading = reader->wire_msg.data_len - reader->bytes_read;
+    if (to_read < reading) {
+        reading = to_read;
+    }
+    *bytes_handled += reading;
+    reader->bytes_read += reading;
+    reader->stream_offset += reading;
+    if (reader->bytes_read == reader->wire_msg.data_len) {
+        /* End of the chunk */
+        reader->bytes_read = 0;
+        reader->state      = CH_RD_WAIT;
+    }
+    int last = reader->stream_offset == msg->data_len;
+    if (ichirp->stream_cb == NULL) {
+        memcpy(msg->data + offset, src_buf, reading);
+        if (last) {
+            reader->stream = NULL;
+            _ch_rd_handle_msg(conn, reader, msg);
+        }
+        return;
+    }
+    if (last) {
+        reader->stream = NULL;
+        _ch_rd_msg_received(conn, reader, msg);
+    }
+    ichirp->stream_cb(chirp, msg, src_buf, reading, offset);
+}
+
+#ifdef CH_ENABLE_COMPRESSION
+// .. c:function::
+static ch_error_t
+_ch_rd_decompress(ch_connection_t* conn, ch_bf_slot_t* slot)
+//    :noindex:
+//
+//    see: :c:func:`_ch_rd_decompress`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t*   chirp = conn->chirp;
+    ch_message_t* msg   = &slot->msg;
+    uint32_t      data_len;
+    memcpy(&data_len, msg->data, CH_SR_COMPRESSED_PREFIX);
+    data_len = ntohl(data_len);
+    if (data_len == 0 || data_len > chirp->_->config.MAX_MSG_SIZE) {
+        EC(chirp,
+           "Invalid size of compressed message. ",
+           "ch_connection_t:%p",
+           (void*) conn);
+        ch_cn_shutdown(conn, CH_PROTOCOL_ERROR);
+        return CH_PROTOCOL_ERROR;
+    }
+    ch_buf* data;
+    if (data_len <= CH_BF_PREALLOC_DATA && msg->data != slot->data) {
+        data = slot->data;
+    } else {
+        data = ch_bf_slab_alloc(chirp->_->slab, data_len);
+        if (data == NULL) {
+            EC(chirp,
+               "Could not allocate memory for message. ",
+               "ch_connection_t:%p",
+               (void*) conn);
+            ch_cn_shutdown(conn, CH_ENOMEM);
+            return CH_ENOMEM;
+        }
+    }
+    int size = LZ4_decompress_safe(
+            msg->data + CH_SR_COMPRESSED_PREFIX,
+            data,
+            msg->data_len - CH_SR_COMPRESSED_PREFIX,
+            data_len);
+    if (size < 0 || (uint32_t) size != data_len) {
+        if (data != slot->data) {
+            ch_bf_slab_free(data);
+        }
+        EC(chirp,
+           "Could not decompress message. ",
+           "ch_connection_t:%p",
+           (void*) conn);
+        ch_cn_shutdown(conn, CH_PROTOCOL_ERROR);
+        return CH_PROTOCOL_ERROR;
+    }
+    if (msg->_flags & CH_MSG_FREE_DATA) {
+        ch_bf_slab_free(msg->data);
+        msg->_flags &= ~CH_MSG_FREE_DATA;
+    }
+    if (data != slot->data) {
+        msg->_flags |= CH_MSG_FREE_DATA;
+    }
+    msg->data     = data;
+    msg->data_len = data_len;
+    msg->type &= ~CH_MSG_COMPRESSED;
     return CH_SUCCESS;
 }
+#endif
 
 // .. c:function::
 void
@@ -10121,6 +15619,20 @@ ch_rd_free(ch_reader_t* reader)
 // .. code-block:: cpp
 //
 {
+    ch_bf_slot_t* stream = reader->stream;
+    if (stream != NULL) {
+        /* The connection was lost before the last chunk */
+        ch_message_t* msg = &stream->msg;
+        if (msg->_flags & CH_MSG_FREE_DATA) {
+            ch_bf_slab_free(msg->data);
+        }
+        if (msg->_flags & CH_MSG_FREE_HEADER) {
+            ch_bf_slab_free(msg->header);
+        }
+        msg->_flags &= ~(CH_MSG_FREE_DATA | CH_MSG_FREE_HEADER);
+        ch_bf_release(reader->pool, stream);
+        reader->stream = NULL;
+    }
     /* Remove the reference to connection, since it is now invalid */
     reader->pool->conn = NULL;
     ch_bf_free(reader->pool);
@@ -10137,11 +15649,19 @@ ch_rd_init(ch_reader_t* reader, ch_connection_t* conn, ch_chirp_int_t* ichirp)
 //
 {
     reader->state = CH_RD_HANDSHAKE;
-    reader->pool  = ch_alloc(sizeof(*reader->pool));
+    /* Like the read buffers the pool stays on the process-wide allocator:
+     * Messages the user did not release yet keep it, also after chirp is
+     * closed. */
+    reader->pool = ch_alloc(sizeof(*reader->pool));
     if (reader->pool == NULL) {
         return CH_ENOMEM;
     }
-    return ch_bf_init(reader->pool, conn, ichirp->config.MAX_SLOTS);
+    ch_config_t* config    = &ichirp->config;
+    uint32_t     max_slots = config->MAX_SLOTS;
+    if (ichirp->slot_pool != NULL && max_slots == 0) {
+        max_slots = config->SHARED_SLOTS;
+    }
+    return ch_bf_init(reader->pool, conn, max_slots, ichirp->slot_pool);
 }
 
 // .. c:function::
@@ -10167,8 +15687,17 @@ ch_rd_read(ch_connection_t* conn, ch_buf* buf, size_t bytes_read, int* stop)
         return bytes_read;
     }
 
+    ch_reader_t* reader = &conn->reader;
     do {
-        cont          = 0;
+        cont = 0;
+        if (reader->state == CH_RD_WAIT && reader->bytes_read == 0 &&
+            bytes_handled < (ssize_t) bytes_read) {
+            bytes_handled =
+                    _ch_rd_read_fast(conn, buf, bytes_read, bytes_handled);
+            if (bytes_handled == -1 || bytes_handled == (ssize_t) bytes_read) {
+                return bytes_handled;
+            }
+        }
         bytes_handled = _ch_rd_read_step(
                 conn, buf, bytes_read, bytes_handled, stop, &cont);
         if (*stop || bytes_handled == -1) {
@@ -10195,8 +15724,9 @@ ch_rd_read(ch_connection_t* conn, ch_buf* buf, size_t bytes_read, int* stop)
 // =================
 //
 // .. c:function::
-static int
+int
 ch_remote_cmp(ch_remote_t* x, ch_remote_t* y)
+//    :noindex:
 //
 //    Compare operator for connections.
 //
@@ -10235,65 +15765,247 @@ rb_bind_impl_m(ch_rm, ch_remote_t) CH_ALLOW_NL;
 //
 // .. code-block:: cpp
 
-qs_stack_bind_impl_m(ch_rm_st, ch_remote_t) CH_ALLOW_NL;
-
-// Definitions
-// ===========
+qs_stack_bind_impl_m(ch_rm_st, ch_remote_t) CH_ALLOW_NL;
+
+// Definitions
+// ===========
+//
+// .. code-block:: cpp
+
+uint32_t
+ch_rm_hash(uint8_t ip_protocol, const uint8_t* address, int32_t port)
+//    :noindex:
+//
+//    see: :c:func:`ch_rm_hash`
+//
+// .. code-block:: cpp
+//
+{
+    uint32_t hash = 2166136261U;
+    size_t size = ip_protocol == AF_INET6 ? CH_IP_ADDR_SIZE : CH_IP4_ADDR_SIZE;
+    hash        = (hash ^ ip_protocol) * 16777619U;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ address[i]) * 16777619U;
+    }
+    uint32_t uport = (uint32_t) port;
+    for (int i = 0; i < 4; i++) {
+        hash = (hash ^ (uport & 0xFF)) * 16777619U;
+        uport >>= 8;
+    }
+    return hash;
+}
+
+// .. c:function::
+static void
+_ch_rm_init(ch_chirp_t* chirp, ch_remote_t* remote, int key)
+//
+//    Initialize remote
+//
+// .. code-block:: cpp
+//
+{
+    memset(remote, 0, sizeof(*remote));
+    ch_rm_node_init(remote);
+    remote->chirp = chirp;
+    if (!key) {
+        ch_random_ints_as_bytes(
+                (uint8_t*) &remote->serial, sizeof(remote->serial));
+        remote->timestamp = uv_now(chirp->_->loop);
+    }
+}
+
+// .. c:function::
+void
+ch_rm_init_from_msg(
+        ch_chirp_t* chirp, ch_remote_t* remote, ch_message_t* msg, int key)
+//    :noindex:
+//
+//    see: :c:func:`ch_rm_init_from_msg`
+//
+// .. code-block:: cpp
+//
+{
+    _ch_rm_init(chirp, remote, key);
+    remote->ip_protocol = msg->ip_protocol;
+    remote->port        = msg->port;
+    memcpy(&remote->address, &msg->address, CH_IP_ADDR_SIZE);
+    remote->conn = NULL;
+    remote->hash =
+            ch_rm_hash(remote->ip_protocol, remote->address, remote->port);
+}
+
+// .. c:function::
+void
+ch_rm_init_from_conn(
+        ch_chirp_t* chirp, ch_remote_t* remote, ch_connection_t* conn, int key)
+//    :noindex:
+//
+//    see: :c:func:`ch_rm_init_from_conn`
+//
+// .. code-block:: cpp
+//
+{
+    _ch_rm_init(chirp, remote, key);
+    remote->ip_protocol = conn->ip_protocol;
+    remote->port        = conn->port;
+    memcpy(&remote->address, &conn->address, CH_IP_ADDR_SIZE);
+    remote->conn = NULL;
+    remote->hash =
+            ch_rm_hash(remote->ip_protocol, remote->address, remote->port);
+}
+
+// .. c:function::
+static int
+_ch_rm_low_water(
+        uint64_t msgs,
+        uint64_t bytes,
+        uint32_t max_msgs,
+        uint32_t max_bytes,
+        uint8_t  percent)
+//
+//    Check if a queue is at or below the low watermark.
+//
+//    :param uint64_t msgs: Messages in the queue
+//    :param uint64_t bytes: Bytes in the queue
+//    :param uint32_t max_msgs: High watermark in messages or 0
+//    :param uint32_t max_bytes: High watermark in bytes or 0
+//    :param uint8_t percent: Low watermark in percent of the high watermarks
+//    :rtype: int
+//
+// .. code-block:: cpp
+//
+{
+    return (max_msgs == 0 || msgs * 100 <= (uint64_t) max_msgs * percent) &&
+           (max_bytes == 0 || bytes * 100 <= (uint64_t) max_bytes * percent);
+}
+
+// .. c:function::
+ch_message_t**
+ch_rm_msg_queue(ch_remote_t* remote)
+//    :noindex:
+//
+//    see: :c:func:`ch_rm_msg_queue`
 //
 // .. code-block:: cpp
+//
+{
+    for (int i = CH_MSG_PRIORITIES - 1; i >= 0; i--) {
+        if (remote->msg_queue[i] != NULL) {
+            return &remote->msg_queue[i];
+        }
+    }
+    return NULL;
+}
 
-static void
-_ch_rm_init(ch_chirp_t* chirp, ch_remote_t* remote, int key)
+// .. c:function::
+void
+ch_rm_check_drain(ch_remote_t* remote)
+//    :noindex:
 //
-//    Initialize remote
+//    see: :c:func:`ch_rm_check_drain`
 //
 // .. code-block:: cpp
 //
 {
-    memset(remote, 0, sizeof(*remote));
-    ch_rm_node_init(remote);
-    remote->chirp = chirp;
-    if (!key) {
-        ch_random_ints_as_bytes(
-                (uint8_t*) &remote->serial, sizeof(remote->serial));
-        remote->timestamp = uv_now(chirp->_->loop);
+    ch_chirp_t*     chirp  = remote->chirp;
+    ch_chirp_int_t* ichirp = chirp->_;
+    ch_config_t*    config = &ichirp->config;
+    if (remote->flags & CH_RM_QUEUE_FULL &&
+        _ch_rm_low_water(
+                remote->queue_msgs,
+                remote->queue_bytes,
+                config->MAX_QUEUE_MSGS,
+                config->MAX_QUEUE_BYTES,
+                config->QUEUE_LOW_WATER)) {
+        remote->flags &= ~CH_RM_QUEUE_FULL;
+        if (ichirp->drain_cb != NULL) {
+            ichirp->drain_cb(
+                    chirp, remote->ip_protocol, remote->address, remote->port);
+        }
+    }
+    if (ichirp->flags & CH_CHIRP_QUEUE_FULL &&
+        _ch_rm_low_water(
+                ichirp->queue_msgs,
+                ichirp->queue_bytes,
+                config->MAX_TOTAL_QUEUE_MSGS,
+                config->MAX_TOTAL_QUEUE_BYTES,
+                config->QUEUE_LOW_WATER)) {
+        ichirp->flags &= ~CH_CHIRP_QUEUE_FULL;
+        if (ichirp->drain_cb != NULL) {
+            ichirp->drain_cb(chirp, 0, NULL, 0);
+        }
     }
 }
 
 // .. c:function::
 void
-ch_rm_init_from_msg(
-        ch_chirp_t* chirp, ch_remote_t* remote, ch_message_t* msg, int key)
+ch_rm_msg_dequeued(ch_remote_t* remote, ch_message_t* msg)
 //    :noindex:
 //
-//    see: :c:func:`ch_rm_init_from_msg`
+//    see: :c:func:`ch_rm_msg_dequeued`
 //
 // .. code-block:: cpp
 //
 {
-    _ch_rm_init(chirp, remote, key);
-    remote->ip_protocol = msg->ip_protocol;
-    remote->port        = msg->port;
-    memcpy(&remote->address, &msg->address, CH_IP_ADDR_SIZE);
-    remote->conn = NULL;
+    ch_chirp_int_t* ichirp = remote->chirp->_;
+    uint32_t        bytes  = msg->header_len + msg->data_len;
+    A(remote->queue_msgs > 0, "Queue count of remote inconsistent");
+    A(ichirp->queue_msgs > 0, "Queue count of chirp inconsistent");
+    remote->queue_msgs -= 1;
+    remote->queue_bytes -= bytes;
+    ichirp->queue_msgs -= 1;
+    ichirp->queue_bytes -= bytes;
 }
 
 // .. c:function::
 void
-ch_rm_init_from_conn(
-        ch_chirp_t* chirp, ch_remote_t* remote, ch_connection_t* conn, int key)
+ch_rm_msg_queued(ch_remote_t* remote, ch_message_t* msg)
 //    :noindex:
 //
-//    see: :c:func:`ch_rm_init_from_conn`
+//    see: :c:func:`ch_rm_msg_queued`
 //
 // .. code-block:: cpp
 //
 {
-    _ch_rm_init(chirp, remote, key);
-    remote->ip_protocol = conn->ip_protocol;
-    remote->port        = conn->port;
-    memcpy(&remote->address, &conn->address, CH_IP_ADDR_SIZE);
-    remote->conn = NULL;
+    ch_chirp_int_t* ichirp = remote->chirp->_;
+    uint32_t        bytes  = msg->header_len + msg->data_len;
+    remote->queue_msgs += 1;
+    remote->queue_bytes += bytes;
+    ichirp->queue_msgs += 1;
+    ichirp->queue_bytes += bytes;
+}
+
+// .. c:function::
+int
+ch_rm_queue_full(ch_remote_t* remote, ch_message_t* msg)
+//    :noindex:
+//
+//    see: :c:func:`ch_rm_queue_full`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_int_t* ichirp = remote->chirp->_;
+    ch_config_t*    config = &ichirp->config;
+    uint64_t        bytes  = msg->header_len + msg->data_len;
+    /* A message larger than the bytes watermark is sent alone */
+    if ((config->MAX_QUEUE_MSGS != 0 &&
+         remote->queue_msgs >= config->MAX_QUEUE_MSGS) ||
+        (config->MAX_QUEUE_BYTES != 0 && remote->queue_msgs > 0 &&
+         remote->queue_bytes + bytes > config->MAX_QUEUE_BYTES)) {
+        remote->flags |= CH_RM_QUEUE_FULL;
+        ichirp->full_total = 0;
+        return 1;
+    }
+    if ((config->MAX_TOTAL_QUEUE_MSGS != 0 &&
+         ichirp->queue_msgs >= config->MAX_TOTAL_QUEUE_MSGS) ||
+        (config->MAX_TOTAL_QUEUE_BYTES != 0 && ichirp->queue_msgs > 0 &&
+         ichirp->queue_bytes + bytes > config->MAX_TOTAL_QUEUE_BYTES)) {
+        ichirp->flags |= CH_CHIRP_QUEUE_FULL;
+        ichirp->full_total = 1;
+        return 1;
+    }
+    return 0;
 }
 
 // .. c:function::
@@ -10308,9 +16020,9 @@ ch_rm_free(ch_remote_t* remote)
 {
     LC(remote->chirp, "Remote freed", "ch_remote_t:%p", remote);
     if (remote->noop != NULL) {
-        ch_free(remote->noop);
+        ch_chirp_free(remote->chirp->_, remote->noop);
     }
-    ch_free(remote);
+    ch_bf_objects_free(&remote->chirp->_->remote_pool, remote);
 }
 // ==========
 // Serializer
@@ -10371,6 +16083,48 @@ ch_sr_msg_to_buf(ch_message_t* msg, ch_buf* buf, uint32_t msg_serial)
     return CH_SR_WIRE_MESSAGE_SIZE;
 }
 
+// .. c:function::
+void
+ch_sr_compressed_to_buf(ch_buf* buf, uint32_t compressed_len)
+//    :noindex:
+//
+//    see: :c:func:`ch_sr_compressed_to_buf`
+//
+// .. code-block:: cpp
+//
+{
+    CH_SR_WIRE_MESSAGE_LAYOUT;
+
+    (void) (identity);
+    (void) (serial);
+    (void) (header_len);
+    *type |= CH_MSG_COMPRESSED;
+    *data_len = htonl(compressed_len);
+}
+
+// .. c:function::
+void
+ch_sr_stream_to_buf(ch_buf* buf, uint16_t header_len, uint32_t data_len)
+//    :noindex:
+//
+//    see: :c:func:`ch_sr_stream_to_buf`
+//
+// .. code-block:: cpp
+//
+{
+    uint16_t frame_header_len = header_len;
+    uint32_t frame_data_len   = data_len;
+    {
+        CH_SR_WIRE_MESSAGE_LAYOUT;
+
+        (void) (identity);
+        (void) (serial);
+        *type |= CH_MSG_STREAM;
+        *header_len = htons(frame_header_len);
+        *data_len   = htonl(frame_data_len);
+    }
+}
+
 // .. c:function::
 int
 ch_sr_buf_to_hs(ch_buf* buf, ch_sr_handshake_t* hs)
@@ -10515,12 +16269,11 @@ ch_at_allocated(void* buf)
 }
 
 // .. c:function::
-static void*
-_ch_at_alloc(void* buf)
-//
-//    Track a memory allocation.
+void*
+ch_at_alloc(void* buf)
+//    :noindex:
 //
-//    :param void* buf: Pointer to the buffer to track.
+//    see: :c:func:`ch_at_alloc`
 //
 // .. code-block:: cpp
 //
@@ -10590,12 +16343,11 @@ ch_at_init(void)
 }
 
 // .. c:function::
-static void
-_ch_at_free(void* buf)
-//
-//    Track a freed memory allocation.
+void
+ch_at_free(void* buf)
+//    :noindex:
 //
-//    :param void* buf: Pointer to the buffer to track.
+//    see: :c:func:`ch_at_free`
 //
 // .. code-block:: cpp
 //
@@ -10657,12 +16409,28 @@ ch_alloc(size_t size)
 // .. code-block:: cpp
 //
 {
-    void* buf = _ch_alloc_cb(size);
+    return ch_alloc_with(_ch_alloc_cb, size);
+}
+
+// .. c:function::
+void*
+ch_alloc_with(ch_alloc_cb_t alloc, size_t size)
+//    :noindex:
+//
+//    see: :c:func:`ch_alloc_with`
+//
+// .. code-block:: cpp
+//
+{
+    if (alloc == NULL) {
+        alloc = _ch_alloc_cb;
+    }
+    void* buf = alloc(size);
     /* Assert memory (do not rely on this, implement it robust: be graceful and
      * return error to user) */
     A(buf, "Allocation failure");
 #ifdef CH_ENABLE_ASSERTS
-    return _ch_at_alloc(buf);
+    return ch_at_alloc(buf);
 #else
     return buf;
 #endif
@@ -10711,10 +16479,26 @@ ch_free(void* buf)
 // .. code-block:: cpp
 //
 {
+    ch_free_with(_ch_free_cb, buf);
+}
+
+// .. c:function::
+void
+ch_free_with(ch_free_cb_t free, void* buf)
+//    :noindex:
+//
+//    see: :c:func:`ch_free_with`
+//
+// .. code-block:: cpp
+//
+{
+    if (free == NULL) {
+        free = _ch_free_cb;
+    }
 #ifdef CH_ENABLE_ASSERTS
-    _ch_at_free(buf);
+    ch_at_free(buf);
 #endif
-    _ch_free_cb(buf);
+    free(buf);
 }
 
 // .. c:function::
@@ -10789,7 +16573,23 @@ ch_realloc(void* buf, size_t size)
 // .. code-block:: cpp
 //
 {
-    void* rbuf = _ch_realloc_cb(buf, size);
+    return ch_realloc_with(_ch_realloc_cb, buf, size);
+}
+
+// .. c:function::
+void*
+ch_realloc_with(ch_realloc_cb_t realloc, void* buf, size_t size)
+//    :noindex:
+//
+//    see: :c:func:`ch_realloc_with`
+//
+// .. code-block:: cpp
+//
+{
+    if (realloc == NULL) {
+        realloc = _ch_realloc_cb;
+    }
+    void* rbuf = realloc(buf, size);
     /* Assert memory (do not rely on this, implement it robust: be graceful and
      * return error to user) */
     A(rbuf, "Reallocation failure");
@@ -10921,6 +16721,15 @@ ch_write_log(
 /* #include "remote.h" */
 /* #include "util.h" */
 
+// System includes
+// ===============
+//
+// .. code-block:: cpp
+//
+#ifdef CH_ENABLE_COMPRESSION
+#include <lz4.h>
+#endif
+
 // Declarations
 // ============
 //
@@ -10928,6 +16737,74 @@ ch_write_log(
 
 MINMAX_FUNCS(uint64_t)
 
+#ifdef CH_ENABLE_COMPRESSION
+// .. c:function::
+static uint32_t
+_ch_wr_compress(ch_connection_t* conn, ch_message_t* msg, ch_buf** out);
+//
+//    Compress the data of a message into a buffer from the slab, prefixed by
+//    the size of the data.
+//
+//    :param ch_connection_t* conn:  Pointer to a connection instance.
+//    :param ch_message_t* msg:      The message to compress.
+//    :param ch_buf** out:           Out: The compressed buffer.
+//    :return: Size of the compressed buffer or 0 if the data is sent as is,
+//             because it does not get smaller.
+//    :rtype: uint32_t
+//
+#endif
+
+// .. c:function::
+static void
+_ch_wr_free_compressed(ch_writer_t* writer);
+//
+//    Free the compressed data of the batch.
+//
+//    :param ch_writer_t* writer:    Pointer to a writer instance.
+//
+
+// .. c:function::
+static uint32_t
+_ch_wr_chunk_size(ch_connection_t* conn);
+//
+//    Get the chunk size of streamed messages.
+//
+//    :param ch_connection_t* conn:  Pointer to a connection instance.
+//    :return: The chunk size or 0 if the remote can't receive streamed
+//             messages.
+//    :rtype: uint32_t
+//
+
+// .. c:function::
+static inline unsigned int
+_ch_wr_push_buf(uv_buf_t* buf, unsigned int nbufs, ch_buf* base, size_t len);
+//
+//    Add a buffer to the buffers of a write, consecutive memory is merged
+//    into the last buffer.
+//
+//    :param uv_buf_t* buf:          The buffers of the write.
+//    :param unsigned int nbufs:     Count of buffers.
+//    :param ch_buf* base:           The memory to add.
+//    :param size_t len:             Length of the memory.
+//    :return: The new count of buffers.
+//    :rtype: unsigned int
+//
+
+// .. c:function::
+static unsigned int
+_ch_wr_push_chunk(ch_connection_t* conn, uv_buf_t* buf, unsigned int nbufs);
+//
+//    Add the frames of the current chunk of the streamed message to the
+//    buffers of a write. The first chunk is preceded by the first frame,
+//    containing the header and the size of the data.
+//
+//    :param ch_connection_t* conn:  Pointer to a connection instance.
+//    :param uv_buf_t* buf:          The buffers of the write.
+//    :param unsigned int nbufs:     Count of buffers.
+//    :return: The new count of buffers.
+//    :rtype: unsigned int
+//
+
 // .. c:function::
 static int
 _ch_wr_check_write_error(
@@ -10967,6 +16844,14 @@ _ch_wr_connect_cb(uv_connect_t* req, int status);
 //
 //    :param uv_connect_t* req: Connect request, containing the connection.
 //    :param int status:        Status of the connection.
+
+// .. c:function::
+static ch_error_t
+_ch_wr_connect_local(ch_connection_t* conn);
+//
+//    Connect to the local socket of the remote of conn, instead of TCP.
+//
+//    :param ch_connection_t* conn: Connection object
 //
 
 // .. c:function::
@@ -10979,6 +16864,29 @@ _ch_wr_connect_timeout_cb(uv_timer_t* handle);
 //
 //    :param uv_timer_t* handle: uv timer handle, data contains chirp
 
+// .. c:function::
+static void
+_ch_wr_fill_batch(ch_remote_t* remote, ch_writer_t* writer);
+//
+//    Dequeue messages from the remote into the batch of the writer, using the
+//    priorities of :c:func:`ch_wr_process_queues`. Stops at
+//    :c:member:`ch_config_t.MAX_WRITE_BATCH` messages or if the next message
+//    would exceed :c:macro:`CH_WR_BATCH_BYTES`.
+//
+//    :param ch_remote_t* remote: Remote to dequeue the messages from.
+//    :param ch_writer_t* writer: Writer to fill the batch of.
+
+// .. c:function::
+static void
+_ch_wr_multicast_cb(ch_chirp_t* chirp, ch_message_t* msg, ch_error_t status);
+//
+//    Send callback of the messages of a multicast. Records the status of the
+//    destination and calls the multicast callback after the last one.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_message_t* msg: The message of the destination.
+//    :param ch_error_t status: The result of the destination.
+
 // .. c:function::
 static void
 _ch_wr_write_data_cb(uv_write_t* req, int status);
@@ -10993,8 +16901,9 @@ static void
 _ch_wr_write_finish(
         ch_chirp_t* chirp, ch_writer_t* writer, ch_connection_t* conn);
 //
-//    Finishes the current write operation, the message store on the writer is
-//    set to NULL and :c:func:`ch_chirp_finish_message` is called.
+//    Finishes the current write operation, the batch of the writer is set to
+//    NULL and :c:func:`ch_chirp_finish_message` is called for each message
+//    of the batch.
 //
 //    :param ch_chirp_t* chirp:      Pointer to a chirp instance.
 //    :param ch_writer_t* writer:    Pointer to a writer instance.
@@ -11037,23 +16946,169 @@ _ch_wr_check_write_error(
         int              status)
 //    :noindex:
 //
-//    see: :c:func:`_ch_wr_check_write_error`
+//    see: :c:func:`_ch_wr_check_write_error`
+//
+// .. code-block:: cpp
+//
+{
+    A(writer->batch != NULL || writer->stream_chunk > 0,
+      "writer->batch should be set on callback");
+    (void) (writer);
+    if (status != CH_SUCCESS) {
+        LC(chirp,
+           "Write failed with uv status: %d. ",
+           "ch_connection_t:%p",
+           status,
+           (void*) conn);
+        ch_cn_shutdown(conn, CH_PROTOCOL_ERROR);
+        return CH_PROTOCOL_ERROR;
+    }
+    return CH_SUCCESS;
+}
+
+#ifdef CH_ENABLE_COMPRESSION
+// .. c:function::
+static uint32_t
+_ch_wr_compress(ch_connection_t* conn, ch_message_t* msg, ch_buf** out)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_compress`
+//
+// .. code-block:: cpp
+//
+{
+    int     bound = LZ4_compressBound(msg->data_len);
+    size_t  size  = CH_SR_COMPRESSED_PREFIX + bound;
+    ch_buf* buf   = ch_bf_slab_alloc(conn->chirp->_->slab, size);
+    if (buf == NULL) {
+        return 0; /* Send the data as is */
+    }
+    int compressed = LZ4_compress_default(
+            msg->data, buf + CH_SR_COMPRESSED_PREFIX, msg->data_len, bound);
+    size = CH_SR_COMPRESSED_PREFIX + compressed;
+    if (compressed <= 0 || size >= msg->data_len) {
+        ch_bf_slab_free(buf);
+        return 0;
+    }
+    uint32_t data_len = htonl(msg->data_len);
+    memcpy(buf, &data_len, CH_SR_COMPRESSED_PREFIX);
+    *out = buf;
+    return size;
+}
+#endif
+
+// .. c:function::
+static void
+_ch_wr_free_compressed(ch_writer_t* writer)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_free_compressed`
+//
+// .. code-block:: cpp
+//
+{
+    for (int i = 0; i < CH_WR_MAX_BATCH; i++) {
+        if (writer->compressed[i] != NULL) {
+            ch_bf_slab_free(writer->compressed[i]);
+            writer->compressed[i] = NULL;
+        }
+    }
+}
+
+// .. c:function::
+static uint32_t
+_ch_wr_chunk_size(ch_connection_t* conn)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_chunk_size`
+//
+// .. code-block:: cpp
+//
+{
+    if (!(conn->flags & CH_CN_STREAMING)) {
+        return 0;
+    }
+    return conn->chirp->_->config.CHUNK_SIZE;
+}
+
+// .. c:function::
+static inline unsigned int
+_ch_wr_push_buf(uv_buf_t* buf, unsigned int nbufs, ch_buf* base, size_t len)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_push_buf`
+//
+// .. code-block:: cpp
+//
+{
+    if (len == 0) {
+        return nbufs;
+    }
+    if (nbufs > 0 && buf[nbufs - 1].base + buf[nbufs - 1].len == base) {
+        buf[nbufs - 1].len += len;
+        return nbufs;
+    }
+    buf[nbufs].base = base;
+    buf[nbufs].len  = len;
+    return nbufs + 1;
+}
+
+// .. c:function::
+static unsigned int
+_ch_wr_push_chunk(ch_connection_t* conn, uv_buf_t* buf, unsigned int nbufs)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_push_chunk`
 //
 // .. code-block:: cpp
 //
 {
-    A(writer->msg != NULL, "writer->msg should be set on callback");
-    (void) (writer);
-    if (status != CH_SUCCESS) {
-        LC(chirp,
-           "Write failed with uv status: %d. ",
-           "ch_connection_t:%p",
-           status,
-           (void*) conn);
-        ch_cn_shutdown(conn, CH_PROTOCOL_ERROR);
-        return CH_PROTOCOL_ERROR;
+    ch_writer_t*  writer      = &conn->writer;
+    ch_remote_t*  remote      = conn->remote;
+    ch_message_t* msg         = writer->stream;
+    ch_buf*       frame       = writer->stream_msg;
+    ch_buf*       chunk_frame = frame + CH_SR_WIRE_MESSAGE_SIZE;
+    uint32_t      start       = writer->stream_offset;
+    uint32_t      end         = start + writer->stream_chunk;
+    chunk_frame += CH_SR_STREAM_PREFIX;
+    if (start == 0) {
+        /* The first frame: header and size of the data */
+        remote->serial += 1;
+        msg->serial = remote->serial;
+        ch_sr_msg_to_buf(msg, frame, msg->serial);
+        ch_chirp_trace(conn->chirp->_, CH_TR_WRITE, msg, msg->serial);
+        ch_sr_stream_to_buf(frame, msg->header_len, CH_SR_STREAM_PREFIX);
+        uint32_t data_len = htonl(msg->data_len);
+        memcpy(frame + CH_SR_WIRE_MESSAGE_SIZE, &data_len, CH_SR_STREAM_PREFIX);
+        nbufs = _ch_wr_push_buf(buf, nbufs, frame, CH_SR_WIRE_MESSAGE_SIZE);
+        nbufs = _ch_wr_push_buf(buf, nbufs, msg->header, msg->header_len);
+        nbufs = _ch_wr_push_buf(
+                buf,
+                nbufs,
+                frame + CH_SR_WIRE_MESSAGE_SIZE,
+                CH_SR_STREAM_PREFIX);
     }
-    return CH_SUCCESS;
+    ch_sr_msg_to_buf(msg, chunk_frame, msg->serial);
+    ch_sr_stream_to_buf(chunk_frame, 0, writer->stream_chunk);
+    nbufs = _ch_wr_push_buf(buf, nbufs, chunk_frame, CH_SR_WIRE_MESSAGE_SIZE);
+    if (msg->_data_iov == NULL) {
+        return _ch_wr_push_buf(
+                buf, nbufs, msg->data + start, writer->stream_chunk);
+    }
+    /* Add the parts of the buffers within the chunk */
+    uint32_t pos = 0;
+    for (unsigned int i = 0; i < msg->_data_nbufs && pos < end; i++) {
+        const uv_buf_t* part     = &msg->_data_iov[i];
+        uint32_t        part_end = pos + part->len;
+        if (part_end > start) {
+            uint32_t from = (pos > start) ? pos : start;
+            uint32_t to   = (part_end < end) ? part_end : end;
+            nbufs         = _ch_wr_push_buf(
+                    buf, nbufs, part->base + (from - pos), to - from);
+        }
+        pos = part_end;
+    }
+    return nbufs;
 }
 
 // .. c:function::
@@ -11068,7 +17123,7 @@ _ch_wr_connect(ch_remote_t* remote)
 {
     ch_chirp_t*      chirp  = remote->chirp;
     ch_chirp_int_t*  ichirp = chirp->_;
-    ch_connection_t* conn   = ch_alloc(sizeof(*conn));
+    ch_connection_t* conn   = ch_bf_objects_alloc(&ichirp->conn_pool);
     if (!conn) {
         return CH_ENOMEM;
     }
@@ -11079,9 +17134,9 @@ _ch_wr_connect(ch_remote_t* remote)
     conn->port         = remote->port;
     conn->ip_protocol  = remote->ip_protocol;
     conn->connect.data = conn;
-    conn->remote       = remote;
-    conn->client.data  = conn;
-    int tmp_err        = uv_timer_init(ichirp->loop, &conn->connect_timeout);
+    conn->remote          = remote;
+    conn->client.tcp.data = conn;
+    int tmp_err = uv_timer_init(ichirp->loop, &conn->connect_timeout);
     if (tmp_err != CH_SUCCESS) {
         EC(chirp,
            "Initializing connect timeout failed: %d. ",
@@ -11120,7 +17175,11 @@ _ch_wr_connect(ch_remote_t* remote)
     }
 #endif
     memcpy(&conn->address, &remote->address, CH_IP_ADDR_SIZE);
-    if (uv_tcp_init(ichirp->loop, &conn->client) < 0) {
+    if (ichirp->config.LOCAL_DIR != NULL && remote->flags & CH_RM_LOCAL &&
+        remote->ip_protocol == AF_INET && ch_is_local_addr(&taddr)) {
+        return _ch_wr_connect_local(conn);
+    }
+    if (uv_tcp_init(ichirp->loop, &conn->client.tcp) < 0) {
         EC(chirp,
            "Could not initialize tcp. ",
            "ch_connection_t:%p",
@@ -11134,7 +17193,7 @@ _ch_wr_connect(ch_remote_t* remote)
     ch_textaddr_to_sockaddr(remote->ip_protocol, &taddr, remote->port, &addr);
     tmp_err = uv_tcp_connect(
             &conn->connect,
-            &conn->client,
+            &conn->client.tcp,
             (struct sockaddr*) &addr,
             _ch_wr_connect_cb);
     if (tmp_err != CH_SUCCESS) {
@@ -11172,6 +17231,10 @@ _ch_wr_connect_cb(uv_connect_t* req, int status)
     A(chirp == conn->chirp, "Chirp on connection should match");
     uv_inet_ntop(
             conn->ip_protocol, conn->address, taddr.data, sizeof(taddr.data));
+    if (status == CH_SUCCESS && conn->flags & CH_CN_LOCAL &&
+        !ch_pr_local_peer_ok(chirp, &conn->client.pipe)) {
+        status = UV_EACCES;
+    }
     if (status == CH_SUCCESS) {
         LC(chirp,
            "Connected to remote %s:%d. ",
@@ -11184,7 +17247,25 @@ _ch_wr_connect_cb(uv_connect_t* req, int status)
          * (_ch_wr_connection_cb) both code-paths will continue at
          * ch_pr_conn_start. From there on incoming and outgoing connections
          * are handled the same way. */
-        ch_pr_conn_start(chirp, conn, &conn->client, 0);
+        ch_pr_conn_start(chirp, conn, (uv_stream_t*) &conn->client, 0);
+    } else if (conn->flags & CH_CN_LOCAL && conn->remote != NULL) {
+        ch_remote_t* remote = conn->remote;
+        LC(chirp,
+           "Local socket of remote failed %s:%d (%d), using TCP. ",
+           "ch_connection_t:%p",
+           taddr.data,
+           conn->port,
+           status,
+           (void*) conn);
+        /* Detach the remote, so its messages are not aborted */
+        remote->flags &= ~CH_RM_LOCAL;
+        remote->conn = NULL;
+        conn->remote = NULL;
+        ch_cn_shutdown(conn, CH_CANNOT_CONNECT);
+        /* Bypass the debounce of the shutdown */
+        if (_ch_wr_connect(remote) == CH_ENOMEM) {
+            ch_cn_abort_one_message(remote, CH_ENOMEM);
+        }
     } else {
         EC(chirp,
            "Connection to remote failed %s:%d (%d). ",
@@ -11197,6 +17278,39 @@ _ch_wr_connect_cb(uv_connect_t* req, int status)
     }
 }
 
+// .. c:function::
+static ch_error_t
+_ch_wr_connect_local(ch_connection_t* conn)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_connect_local`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t* chirp = conn->chirp;
+    char        path[CH_PR_LOCAL_PATH_SIZE];
+    if (uv_pipe_init(chirp->_->loop, &conn->client.pipe, 0) < 0) {
+        EC(chirp,
+           "Could not initialize pipe. ",
+           "ch_connection_t:%p",
+           (void*) conn);
+        ch_cn_shutdown(conn, CH_CANNOT_CONNECT);
+        return CH_INIT_FAIL;
+    }
+    conn->flags |= CH_CN_INIT_CLIENT | CH_CN_LOCAL;
+    ch_pr_local_path(path, chirp->_->config.LOCAL_DIR, conn->port);
+    /* Errors are passed to _ch_wr_connect_cb, which falls back to TCP */
+    uv_pipe_connect(
+            &conn->connect, &conn->client.pipe, path, _ch_wr_connect_cb);
+    LC(chirp,
+       "Connecting to local socket %s. ",
+       "ch_connection_t:%p",
+       path,
+       (void*) conn);
+    return CH_SUCCESS;
+}
+
 // .. c:function::
 static void
 _ch_wr_connect_timeout_cb(uv_timer_t* handle)
@@ -11212,16 +17326,105 @@ _ch_wr_connect_timeout_cb(uv_timer_t* handle)
     ch_chirp_check_m(chirp);
     LC(chirp, "Connect timed out. ", "ch_connection_t:%p", (void*) conn);
     ch_cn_shutdown(conn, CH_TIMEOUT);
+    ch_chirp_trace_timeout(chirp);
     uv_timer_stop(&conn->connect_timeout);
     /* We have waited long enough, we send the next message */
     ch_remote_t  key;
     ch_remote_t* remote = NULL;
     ch_rm_init_from_conn(chirp, &key, conn, 1);
-    if (ch_rm_find(chirp->_->protocol.remotes, &key, &remote) == CH_SUCCESS) {
+    remote = ch_pr_find_remote(&chirp->_->protocol, &key);
+    if (remote != NULL) {
         ch_wr_process_queues(remote);
     }
 }
 
+// .. c:function::
+static void
+_ch_wr_fill_batch(ch_remote_t* remote, ch_writer_t* writer)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_fill_batch`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t*    chirp  = remote->chirp;
+    ch_config_t*   config = &chirp->_->config;
+    ch_message_t** queue;
+    ch_message_t*  msg;
+    int            count = 0;
+    size_t         bytes = 0;
+    unsigned int   nbufs = 0;
+    uint32_t       chunk = _ch_wr_chunk_size(remote->conn);
+    while (count < config->MAX_WRITE_BATCH) {
+        if (remote->cntl_msg_queue != NULL) {
+            queue = &remote->cntl_msg_queue;
+        } else if (
+                !(config->SYNCHRONOUS &&
+                  remote->wait_ack_count >= config->ACK_WINDOW)) {
+            /* Strict priority, the highest queue first */
+            queue = ch_rm_msg_queue(remote);
+            if (queue == NULL) {
+                break;
+            }
+        } else {
+            break;
+        }
+        ch_msg_head(*queue, &msg);
+        int streamed = chunk > 0 && msg->data_len > chunk &&
+                       !(msg->type & CH_MSG_ACK);
+        if (streamed && writer->stream != NULL) {
+            break; /* One stream at a time, the order is kept */
+        }
+        size_t size = CH_SR_WIRE_MESSAGE_SIZE + msg->header_len + msg->data_len;
+        if (!streamed && count > 0 && bytes + size > CH_WR_BATCH_BYTES) {
+            break;
+        }
+        unsigned int need = 2 + (msg->_data_iov ? msg->_data_nbufs : 1);
+        if (!streamed && nbufs + need > CH_WR_MAX_BUFS) {
+            break;
+        }
+        ch_msg_dequeue(queue, &msg);
+        if (queue != &remote->cntl_msg_queue) {
+            ch_rm_msg_dequeued(remote, msg);
+        }
+        ch_chirp_trace(chirp->_, CH_TR_DEQUEUE, msg, 0);
+        if (queue == &remote->cntl_msg_queue) {
+            A(msg->type & CH_MSG_ACK || msg->type & CH_MSG_NOOP,
+              "ACK/NOOP expected");
+        } else if (config->SYNCHRONOUS) {
+            A(msg->type & CH_MSG_REQ_ACK, "REQ_ACK expected");
+            remote->wait_ack_messages[remote->wait_ack_count] = msg;
+            remote->wait_ack_times[remote->wait_ack_count] =
+                    (uint32_t) uv_now(chirp->_->loop);
+            remote->wait_ack_count += 1;
+        } else {
+            A(!(msg->type & CH_MSG_REQ_ACK), "REQ_ACK unexpected");
+        }
+        if (streamed) {
+            /* Its chunks are written after the batches */
+            writer->stream        = msg;
+            writer->stream_offset = 0;
+            continue;
+        }
+        ch_msg_enqueue(&writer->batch, msg);
+        count += 1;
+        bytes += size;
+        nbufs += need;
+    }
+    if (writer->stream != NULL) {
+        ch_message_t* stream = writer->stream;
+        uint32_t      left   = stream->data_len - writer->stream_offset;
+        if (left <= chunk) {
+            writer->stream_chunk = left;
+            /* The message is finished with the batch */
+            ch_msg_enqueue(&writer->batch, stream);
+        } else {
+            writer->stream_chunk = chunk;
+        }
+    }
+}
+
 // .. c:function::
 static void
 _ch_wr_enqeue_probe_if_needed(ch_remote_t* remote)
@@ -11235,27 +17438,34 @@ _ch_wr_enqeue_probe_if_needed(ch_remote_t* remote)
     ch_chirp_t*     chirp  = remote->chirp;
     ch_chirp_int_t* ichirp = chirp->_;
     ch_config_t*    config = &ichirp->config;
-    ch_message_t*   noop   = remote->noop;
     uint64_t        now    = uv_now(ichirp->loop);
     uint64_t        delta  = (1000 * config->REUSE_TIME / 4 * 3);
     if (now - remote->timestamp > delta) {
-        if (noop == NULL) {
-            remote->noop = ch_alloc(sizeof(*remote->noop));
-            if (remote->noop == NULL) {
-                return; /* ENOMEM: Noop are not important, we don't send it. */
-            }
-            noop = remote->noop;
-            memset(noop, 0, sizeof(*noop));
-            memcpy(noop->address, remote->address, CH_IP_ADDR_SIZE);
-            noop->ip_protocol = remote->ip_protocol;
-            noop->port        = remote->port;
-            noop->type        = CH_MSG_NOOP;
-        }
-        /* The noop is not enqueued yet, enqueue it */
-        if (!(noop->_flags & CH_MSG_USED) && noop->_next == NULL) {
-            LC(chirp, "Sending NOOP.", "ch_remote_t:%p", remote);
-            ch_msg_enqueue(&remote->cntl_msg_queue, noop);
-        }
+        ch_wr_enqueue_probe(remote);
+    }
+}
+
+// .. c:function::
+static void
+_ch_wr_multicast_cb(ch_chirp_t* chirp, ch_message_t* msg, ch_error_t status)
+//    :noindex:
+//
+//    see: :c:func:`_ch_wr_multicast_cb`
+//
+// .. code-block:: cpp
+//
+{
+    ch_multicast_t* mc = msg->user_data;
+    A(mc->_pending > 0, "Multicast is not being sent");
+    /* Aborted messages keep their state, but the multicast can be resent */
+    msg->_flags &= ~(CH_MSG_USED | CH_MSG_FAILURE);
+    mc->status[msg - mc->_msgs] = status;
+    if (status != CH_SUCCESS) {
+        mc->failed += 1;
+    }
+    mc->_pending -= 1;
+    if (mc->_pending == 0 && mc->_multicast_cb != NULL) {
+        mc->_multicast_cb(chirp, mc);
     }
 }
 
@@ -11273,6 +17483,10 @@ _ch_wr_write_data_cb(uv_write_t* req, int status)
     ch_chirp_t*      chirp = conn->chirp;
     ch_chirp_check_m(chirp);
     ch_writer_t* writer = &conn->writer;
+    /* The batch has already been finished by ch_cn_shutdown */
+    if (conn->flags & CH_CN_SHUTTING_DOWN) {
+        return;
+    }
     if (_ch_wr_check_write_error(chirp, writer, conn, status)) {
         return;
     }
@@ -11290,18 +17504,49 @@ _ch_wr_write_finish(
 // .. code-block:: cpp
 //
 {
-    ch_message_t* msg = writer->msg;
-    A(msg != NULL, "Writer has no message");
-    if (!(msg->type & CH_MSG_REQ_ACK)) {
-        msg->_flags |= CH_MSG_ACK_RECEIVED; /* Emulate ACK */
+    ch_message_t* batch = writer->batch;
+    ch_message_t* msg;
+    A(batch != NULL || writer->stream_chunk > 0, "Writer has no message");
+    _ch_wr_free_compressed(writer);
+    if (writer->stream_chunk > 0) {
+        writer->stream_offset += writer->stream_chunk;
+        writer->stream_chunk = 0;
+        if (writer->stream_offset == writer->stream->data_len) {
+            /* The message is finished with the batch */
+            writer->stream        = NULL;
+            writer->stream_offset = 0;
+        }
     }
-    msg->_flags |= CH_MSG_WRITE_DONE;
-    writer->msg     = NULL;
+    /* Detach the batch, finishing a message might start the next write */
+    writer->batch   = NULL;
     conn->timestamp = uv_now(chirp->_->loop);
     if (conn->remote != NULL) {
-        conn->remote->timestamp = conn->timestamp;
+        ch_pr_touch_remote(conn->remote, conn->timestamp);
+        if (batch == NULL) {
+            /* Only a chunk was written, continue with the next */
+            ch_wr_process_queues(conn->remote);
+            return;
+        }
+    }
+    ch_stats_t* stats = &chirp->_->stats;
+    stats->writes += 1;
+    ch_msg_dequeue(&batch, &msg);
+    while (msg != NULL) {
+        ch_chirp_trace(chirp->_, CH_TR_WRITE_DONE, msg, msg->serial);
+        if (!(msg->type & CH_MSG_ACK || msg->type & CH_MSG_NOOP)) {
+            stats->msgs_sent += 1;
+            stats->bytes_sent += msg->header_len + msg->data_len;
+            ch_chirp_record_latency(stats->write_latency, msg->_send_time);
+        } else if (msg->type & CH_MSG_ACK) {
+            stats->acks_sent += 1;
+        }
+        if (!(msg->type & CH_MSG_REQ_ACK)) {
+            msg->_flags |= CH_MSG_ACK_RECEIVED; /* Emulate ACK */
+        }
+        msg->_flags |= CH_MSG_WRITE_DONE;
+        ch_chirp_finish_message(chirp, conn, msg, CH_SUCCESS);
+        ch_msg_dequeue(&batch, &msg);
     }
-    ch_chirp_finish_message(chirp, conn, msg, CH_SUCCESS);
 }
 
 // .. c:function::
@@ -11314,11 +17559,37 @@ _ch_wr_write_timeout_cb(uv_timer_t* handle)
 // .. code-block:: cpp
 //
 {
-    ch_connection_t* conn  = handle->data;
-    ch_chirp_t*      chirp = conn->chirp;
+    ch_connection_t* conn   = handle->data;
+    ch_chirp_t*      chirp  = conn->chirp;
+    ch_writer_t*     writer = &conn->writer;
+    ch_remote_t*     remote = conn->remote;
     ch_chirp_check_m(chirp);
+    if (writer->deadline == 0) {
+        return; /* Idle: nothing to time out */
+    }
+    uint64_t now      = uv_now(chirp->_->loop);
+    uint64_t deadline = writer->deadline;
+    if (remote != NULL && remote->conn == conn && remote->wait_ack_count > 0) {
+        /* Later writes must not extend the timeout of an unacknowledged
+         * message, wait_ack_messages is in send order */
+        uint32_t waited = (uint32_t) now - remote->wait_ack_times[0];
+        uint64_t oldest = now - waited + chirp->_->config.TIMEOUT * 1000;
+        if (oldest < deadline) {
+            deadline = oldest;
+        }
+    }
+    if (now < deadline) {
+        /* Writes happened since the timer was started */
+        uv_timer_start(
+                &writer->send_timeout,
+                _ch_wr_write_timeout_cb,
+                deadline - now,
+                0);
+        return;
+    }
     LC(chirp, "Write timed out. ", "ch_connection_t:%p", (void*) conn);
     ch_cn_shutdown(conn, CH_TIMEOUT);
+    ch_chirp_trace_timeout(chirp);
 }
 
 // .. c:function::
@@ -11341,6 +17612,125 @@ ch_chirp_send(ch_chirp_t* chirp, ch_message_t* msg, ch_send_cb_t send_cb)
     return ch_wr_send(chirp, msg, send_cb);
 }
 
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_chirp_send_batch_ts(
+        ch_chirp_t*    chirp,
+        ch_message_t** msgs,
+        size_t         count,
+        ch_send_cb_t   send_cb)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_send_batch_ts`
+//
+// .. code-block:: cpp
+//
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_chirp_int_t* ichirp = chirp->_;
+    if (count == 0) {
+        return CH_SUCCESS;
+    }
+    /* Check all messages first, so we send all or none. Checked messages are
+     * marked used, so a message twice in the batch is rejected too. */
+    for (size_t i = 0; i < count; i++) {
+        ch_message_t* msg = msgs[i];
+        if (msg->_flags & CH_MSG_USED || msg->_send_cb != NULL) {
+            EC(chirp, "Message already used. ", "ch_message_t:%p", (void*) msg);
+            while (i > 0) {
+                i -= 1;
+                msgs[i]->_flags &= ~CH_MSG_USED;
+            }
+            return CH_USED;
+        }
+        msg->_flags |= CH_MSG_USED;
+    }
+    for (size_t i = 0; i < count; i++) {
+        msgs[i]->_flags &= ~CH_MSG_USED;
+        msgs[i]->_send_cb = send_cb;
+    }
+    /* Only signal the loop if it doesn't already have pending sends */
+    if (!ch_msg_mpsc_push_batch(&ichirp->send_ts_queue, msgs, count)) {
+        return CH_SUCCESS;
+    }
+    if (uv_async_send(&ichirp->send_ts) < 0) {
+        E(chirp, "Could not call send_ts callback", CH_NO_ARG);
+        return CH_UV_ERROR;
+    }
+    return CH_SUCCESS;
+}
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_chirp_multicast_ts(
+        ch_chirp_t* chirp, ch_multicast_t* mc, ch_multicast_cb_t multicast_cb)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_multicast_ts`
+//
+// .. code-block:: cpp
+//
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    if (mc->_pending != 0) {
+        EC(chirp, "Multicast already used. ", "ch_multicast_t:%p", (void*) mc);
+        return CH_USED;
+    }
+    /* The messages only point to the shared header and data */
+    for (uint32_t i = 0; i < mc->count; i++) {
+        ch_message_t* msg = &mc->_msgs[i];
+        msg->header       = mc->header;
+        msg->header_len   = mc->header_len;
+        ch_msg_set_data(msg, mc->data, mc->data_len);
+        msg->user_data = mc;
+        mc->status[i]  = CH_SUCCESS;
+    }
+    mc->failed        = 0;
+    mc->_multicast_cb = multicast_cb;
+    mc->_pending      = mc->count;
+
+    ch_error_t tmp_err = ch_chirp_send_batch_ts(
+            chirp, mc->_msgs_p, mc->count, _ch_wr_multicast_cb);
+    if (tmp_err != CH_SUCCESS) {
+        mc->_pending = 0;
+    }
+    return tmp_err;
+}
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_chirp_connect_ts(
+        ch_chirp_t* chirp, ch_message_t* msg, int pin, ch_send_cb_t send_cb)
+//    :noindex:
+//
+//    see: :c:func:`ch_chirp_connect_ts`
+//
+// .. code-block:: cpp
+//
+{
+    A(chirp->_init == CH_CHIRP_MAGIC, "Not a ch_chirp_t*");
+    ch_chirp_int_t* ichirp = chirp->_;
+    if (msg->_flags & CH_MSG_USED || msg->_send_cb != NULL) {
+        EC(chirp, "Message already used. ", "ch_message_t:%p", (void*) msg);
+        return CH_USED;
+    }
+    msg->_send_cb = send_cb;
+    msg->type     = pin ? CH_MSG_PIN : 0;
+    msg->_flags |= CH_MSG_CONNECT;
+    /* Only signal the loop if it doesn't already have pending sends */
+    if (!ch_msg_mpsc_push(&ichirp->send_ts_queue, msg)) {
+        return CH_SUCCESS;
+    }
+    if (uv_async_send(&ichirp->send_ts) < 0) {
+        E(chirp, "Could not call send_ts callback", CH_NO_ARG);
+        return CH_UV_ERROR;
+    }
+    return CH_SUCCESS;
+}
+
 // .. c:function::
 CH_EXPORT
 ch_error_t
@@ -11359,9 +17749,10 @@ ch_chirp_send_ts(ch_chirp_t* chirp, ch_message_t* msg, ch_send_cb_t send_cb)
         return CH_USED;
     }
     msg->_send_cb = send_cb;
-    uv_mutex_lock(&ichirp->send_ts_queue_lock);
-    ch_msg_enqueue(&ichirp->send_ts_queue, msg);
-    uv_mutex_unlock(&ichirp->send_ts_queue_lock);
+    /* Only signal the loop if it doesn't already have pending sends */
+    if (!ch_msg_mpsc_push(&ichirp->send_ts_queue, msg)) {
+        return CH_SUCCESS;
+    }
     if (uv_async_send(&ichirp->send_ts) < 0) {
         E(chirp, "Could not call send_ts callback", CH_NO_ARG);
         return CH_UV_ERROR;
@@ -11380,11 +17771,44 @@ ch_wr_free(ch_writer_t* writer)
 //
 {
     ch_connection_t* conn = writer->send_timeout.data;
+    _ch_wr_free_compressed(writer);
     uv_timer_stop(&writer->send_timeout);
     uv_close((uv_handle_t*) &writer->send_timeout, ch_cn_close_cb);
     conn->shutdown_tasks += 1;
 }
 
+// .. c:function::
+void
+ch_wr_enqueue_probe(ch_remote_t* remote)
+//    :noindex:
+//
+//    see: :c:func:`ch_wr_enqueue_probe`
+//
+// .. code-block:: cpp
+//
+{
+    ch_chirp_t*   chirp = remote->chirp;
+    ch_message_t* noop  = remote->noop;
+    if (noop == NULL) {
+        remote->noop = ch_chirp_alloc(chirp->_, sizeof(*remote->noop));
+        if (remote->noop == NULL) {
+            return; /* ENOMEM: Noop are not important, we don't send it. */
+        }
+        noop = remote->noop;
+        memset(noop, 0, sizeof(*noop));
+        memcpy(noop->address, remote->address, CH_IP_ADDR_SIZE);
+        noop->ip_protocol = remote->ip_protocol;
+        noop->port        = remote->port;
+        noop->type        = CH_MSG_NOOP;
+    }
+    /* The noop is not enqueued yet, enqueue it */
+    if (!(noop->_flags & CH_MSG_USED) && noop->_next == NULL) {
+        LC(chirp, "Sending NOOP.", "ch_remote_t:%p", remote);
+        ch_msg_enqueue(&remote->cntl_msg_queue, noop);
+    }
+    (void) (chirp);
+}
+
 // .. c:function::
 ch_error_t
 ch_wr_init(ch_writer_t* writer, ch_connection_t* conn)
@@ -11426,13 +17850,13 @@ ch_wr_process_queues(ch_remote_t* remote)
     ch_chirp_t* chirp = remote->chirp;
     ch_chirp_check_m(chirp);
     ch_connection_t* conn = remote->conn;
-    ch_message_t*    msg  = NULL;
     if (conn == NULL) {
         if (remote->flags & CH_RM_CONN_BLOCKED) {
             return CH_BUSY;
         } else {
             /* Only connect of the queue is not empty */
-            if (remote->msg_queue != NULL || remote->cntl_msg_queue != NULL) {
+            if (ch_rm_msg_queue(remote) != NULL ||
+                remote->cntl_msg_queue != NULL) {
                 ch_error_t tmp_err;
                 tmp_err = _ch_wr_connect(remote);
                 if (tmp_err == CH_ENOMEM) {
@@ -11449,31 +17873,22 @@ ch_wr_process_queues(ch_remote_t* remote)
             /* CH_CN_WRITE_PENDING: the connection can be blocked by a low-level
              * write. */
             return CH_BUSY;
-        } else if (conn->writer.msg != NULL) {
+        } else if (
+                conn->writer.batch != NULL || conn->writer.stream_chunk > 0) {
             return CH_BUSY;
-        } else if (remote->cntl_msg_queue != NULL) {
-            ch_msg_dequeue(&remote->cntl_msg_queue, &msg);
-            A(msg->type & CH_MSG_ACK || msg->type & CH_MSG_NOOP,
-              "ACK/NOOP expected");
-            ch_wr_write(conn, msg);
-            return CH_SUCCESS;
-        } else if (remote->msg_queue != NULL) {
-            if (chirp->_->config.SYNCHRONOUS) {
-                if (remote->wait_ack_message == NULL) {
-                    ch_msg_dequeue(&remote->msg_queue, &msg);
-                    remote->wait_ack_message = msg;
-                    ch_wr_write(conn, msg);
-                    return CH_SUCCESS;
-                } else {
-                    return CH_BUSY;
-                }
-            } else {
-                ch_msg_dequeue(&remote->msg_queue, &msg);
-                A(!(msg->type & CH_MSG_REQ_ACK), "REQ_ACK unexpected");
-                ch_wr_write(conn, msg);
-                return CH_SUCCESS;
-            }
         }
+        ch_error_t ret = CH_EMPTY;
+        _ch_wr_fill_batch(remote, &conn->writer);
+        if (conn->writer.batch != NULL || conn->writer.stream_chunk > 0) {
+            ch_wr_write(conn);
+            ret = CH_SUCCESS;
+        } else if (ch_rm_msg_queue(remote) != NULL) {
+            /* Synchronous: waiting for the ack */
+            ret = CH_BUSY;
+        }
+        /* The writer is busy now, the callback can send again */
+        ch_rm_check_drain(remote);
+        return ret;
     }
     return CH_EMPTY;
 }
@@ -11488,7 +17903,9 @@ ch_wr_send(ch_chirp_t* chirp, ch_message_t* msg, ch_send_cb_t send_cb)
 // .. code-block:: cpp
 //
 {
-    ch_chirp_int_t* ichirp = chirp->_;
+    ch_chirp_int_t* ichirp  = chirp->_;
+    int             connect = msg->_flags & CH_MSG_CONNECT;
+    msg->_flags &= ~CH_MSG_CONNECT;
     if (ichirp->flags & CH_CHIRP_CLOSING || ichirp->flags & CH_CHIRP_CLOSED) {
         if (send_cb != NULL) {
             send_cb(chirp, msg, CH_SHUTDOWN);
@@ -11497,7 +17914,8 @@ ch_wr_send(ch_chirp_t* chirp, ch_message_t* msg, ch_send_cb_t send_cb)
     }
     ch_remote_t  search_remote;
     ch_remote_t* remote;
-    msg->_send_cb = send_cb;
+    msg->_send_cb   = send_cb;
+    msg->_send_time = uv_hrtime();
     A(!(msg->_flags & CH_MSG_USED), "Message should not be used");
     A(!((msg->_flags & CH_MSG_ACK_RECEIVED) ||
         (msg->_flags & CH_MSG_WRITE_DONE)),
@@ -11505,9 +17923,10 @@ ch_wr_send(ch_chirp_t* chirp, ch_message_t* msg, ch_send_cb_t send_cb)
     msg->_flags |= CH_MSG_USED;
     ch_protocol_t* protocol = &ichirp->protocol;
 
-    ch_rm_init_from_msg(chirp, &search_remote, msg, 0);
-    if (ch_rm_find(protocol->remotes, &search_remote, &remote) != CH_SUCCESS) {
-        remote = ch_alloc(sizeof(*remote));
+    ch_rm_init_from_msg(chirp, &search_remote, msg, 1);
+    remote = ch_pr_find_remote(protocol, &search_remote);
+    if (remote == NULL) {
+        remote = ch_bf_objects_alloc(&ichirp->remote_pool);
         LC(chirp, "Remote allocated", "ch_remote_t:%p", remote);
         if (remote == NULL) {
             if (send_cb != NULL) {
@@ -11515,10 +17934,28 @@ ch_wr_send(ch_chirp_t* chirp, ch_message_t* msg, ch_send_cb_t send_cb)
             }
             return CH_ENOMEM;
         }
-        *remote     = search_remote;
-        int tmp_err = ch_rm_insert(&protocol->remotes, remote);
-        A(tmp_err == 0, "Inserting remote failed");
-        (void) (tmp_err);
+        ch_rm_init_from_msg(chirp, remote, msg, 0);
+        if (ch_pr_insert_remote(protocol, remote) != CH_SUCCESS) {
+            ch_rm_free(remote);
+            if (send_cb != NULL) {
+                send_cb(chirp, msg, CH_ENOMEM);
+            }
+            return CH_ENOMEM;
+        }
+    }
+    if (connect) {
+        ch_pr_pin_remote(protocol, remote, msg->type & CH_MSG_PIN);
+        msg->type = CH_MSG_NOOP;
+    }
+    if (!(msg->type & CH_MSG_ACK || msg->type & CH_MSG_NOOP) &&
+        ch_rm_queue_full(remote, msg)) {
+        /* The message can be sent again after the drain callback */
+        msg->_flags &= ~CH_MSG_USED;
+        msg->_send_cb = NULL;
+        if (send_cb != NULL) {
+            send_cb(chirp, msg, CH_FULL);
+        }
+        return CH_FULL;
     }
     /* Remote isn't used for 3/4 REUSE_TIME we send a probe, before the
      * acutal message */
@@ -11529,9 +17966,16 @@ ch_wr_send(ch_chirp_t* chirp, ch_message_t* msg, ch_send_cb_t send_cb)
         queued = remote->cntl_msg_queue != NULL;
         ch_msg_enqueue(&remote->cntl_msg_queue, msg);
     } else {
-        queued = remote->msg_queue != NULL;
-        ch_msg_enqueue(&remote->msg_queue, msg);
+        A(msg->priority < CH_MSG_PRIORITIES, "Invalid priority");
+        uint8_t priority = msg->priority;
+        if (priority >= CH_MSG_PRIORITIES) {
+            priority = CH_MSG_PRIORITIES - 1;
+        }
+        queued = remote->msg_queue[priority] != NULL;
+        ch_msg_enqueue(&remote->msg_queue[priority], msg);
+        ch_rm_msg_queued(remote, msg);
     }
+    ch_chirp_trace(ichirp, CH_TR_ENQUEUE, msg, 0);
 
     ch_wr_process_queues(remote);
     if (queued)
@@ -11556,22 +18000,23 @@ ch_wr_send_ts_cb(uv_async_t* handle)
     if (ichirp->flags & CH_CHIRP_CLOSING) {
         return;
     }
-    uv_mutex_lock(&ichirp->send_ts_queue_lock);
-
-    ch_message_t* cur;
-    ch_msg_dequeue(&ichirp->send_ts_queue, &cur);
+    ch_message_t* cur = ch_msg_mpsc_take_all(&ichirp->send_ts_queue);
     while (cur != NULL) {
-        uv_mutex_unlock(&ichirp->send_ts_queue_lock);
-        ch_chirp_send(chirp, cur, cur->_send_cb);
-        uv_mutex_lock(&ichirp->send_ts_queue_lock);
-        ch_msg_dequeue(&ichirp->send_ts_queue, &cur);
+        ch_message_t* next = cur->_next;
+        cur->_next         = NULL;
+        if (cur->_flags & CH_MSG_CONNECT) {
+            /* Keep the type set by ch_chirp_connect_ts */
+            ch_wr_send(chirp, cur, cur->_send_cb);
+        } else {
+            ch_chirp_send(chirp, cur, cur->_send_cb);
+        }
+        cur = next;
     }
-    uv_mutex_unlock(&ichirp->send_ts_queue_lock);
 }
 
 // .. c:function::
 void
-ch_wr_write(ch_connection_t* conn, ch_message_t* msg)
+ch_wr_write(ch_connection_t* conn)
 //    :noindex:
 //
 //    see: :c:func:`ch_wr_write`
@@ -11583,29 +18028,96 @@ ch_wr_write(ch_connection_t* conn, ch_message_t* msg)
     ch_writer_t*    writer = &conn->writer;
     ch_remote_t*    remote = conn->remote;
     ch_chirp_int_t* ichirp = chirp->_;
-    A(writer->msg == NULL, "Message should be null on new write");
-    writer->msg = msg;
-    int tmp_err = uv_timer_start(
-            &writer->send_timeout,
-            _ch_wr_write_timeout_cb,
-            ichirp->config.TIMEOUT * 1000,
-            0);
-    if (tmp_err != CH_SUCCESS) {
-        EC(chirp,
-           "Starting send timeout failed: %d. ",
-           "ch_connection_t:%p",
-           tmp_err,
-           (void*) conn);
+    A(writer->batch != NULL || writer->stream_chunk > 0,
+      "Batch or chunk should be set on new write");
+    /* Only move the deadline, the timer is started when the writer becomes
+     * busy and re-arms itself, see _ch_wr_write_timeout_cb */
+    uint64_t timeout = ichirp->config.TIMEOUT * 1000;
+    writer->deadline = uv_now(ichirp->loop) + timeout;
+    if (!uv_is_active((uv_handle_t*) &writer->send_timeout)) {
+        int tmp_err = uv_timer_start(
+                &writer->send_timeout, _ch_wr_write_timeout_cb, timeout, 0);
+        if (tmp_err != CH_SUCCESS) {
+            EC(chirp,
+               "Starting send timeout failed: %d. ",
+               "ch_connection_t:%p",
+               tmp_err,
+               (void*) conn);
+        }
+    }
+
+#ifdef CH_ENABLE_COMPRESSION
+    uint32_t threshold = ichirp->config.COMPRESS_THRESHOLD;
+    if (threshold == 0) {
+        threshold = CH_COMPRESSION_THRESHOLD;
     }
+#endif
 
-    remote->serial += 1;
-    ch_sr_msg_to_buf(msg, writer->net_msg, remote->serial);
-    uv_buf_t buf[3];
-    buf[0].base = writer->net_msg;
-    buf[0].len  = CH_SR_WIRE_MESSAGE_SIZE;
-    buf[1].base = msg->header;
-    buf[1].len  = msg->header_len;
-    buf[2].base = msg->data;
-    buf[2].len  = msg->data_len;
-    ch_cn_write(conn, buf, 3, _ch_wr_write_data_cb);
+    uv_buf_t     buf[CH_WR_MAX_BUFS + CH_WR_CHUNK_BUFS];
+    unsigned int nbufs   = 0;
+    int          index   = 0;
+    ch_buf*      net_msg = writer->net_msg;
+    qs_queue_iter_decl_cx_m(ch_msg, iter, msg);
+    ch_msg_iter_init(writer->batch, &iter, &msg);
+    while (msg != NULL) {
+        if (msg == writer->stream) {
+            /* The last chunk is added below */
+            ch_msg_iter_next(iter, &msg);
+            continue;
+        }
+        remote->serial += 1;
+        /* Consecutive wire messages share one buffer */
+        if (nbufs > 0 && buf[nbufs - 1].base + buf[nbufs - 1].len == net_msg) {
+            buf[nbufs - 1].len += CH_SR_WIRE_MESSAGE_SIZE;
+        } else {
+            buf[nbufs].base = net_msg;
+            buf[nbufs].len  = CH_SR_WIRE_MESSAGE_SIZE;
+            nbufs += 1;
+        }
+        ch_buf*  data     = msg->data;
+        uint32_t data_len = msg->data_len;
+#ifdef CH_ENABLE_COMPRESSION
+        if (conn->flags & CH_CN_COMPRESSION && data_len >= threshold &&
+            msg->_data_iov == NULL && !(msg->type & CH_MSG_ACK)) {
+            ch_buf*  compressed = NULL;
+            uint32_t size       = _ch_wr_compress(conn, msg, &compressed);
+            if (size > 0) {
+                writer->compressed[index] = compressed;
+                data                      = compressed;
+                data_len                  = size;
+            }
+        }
+#endif
+        msg->serial = remote->serial;
+        ch_sr_msg_to_buf(msg, net_msg, msg->serial);
+        ch_chirp_trace(chirp->_, CH_TR_WRITE, msg, msg->serial);
+        if (data != msg->data) {
+            ch_sr_compressed_to_buf(net_msg, data_len);
+        }
+        net_msg += CH_SR_WIRE_MESSAGE_SIZE;
+        if (msg->header_len > 0) {
+            buf[nbufs].base = msg->header;
+            buf[nbufs].len  = msg->header_len;
+            nbufs += 1;
+        }
+        if (msg->_data_iov != NULL) {
+            /* The fragments of the data follow each other on the wire */
+            for (unsigned int i = 0; i < msg->_data_nbufs; i++) {
+                if (msg->_data_iov[i].len > 0) {
+                    buf[nbufs] = msg->_data_iov[i];
+                    nbufs += 1;
+                }
+            }
+        } else if (data_len > 0) {
+            buf[nbufs].base = data;
+            buf[nbufs].len  = data_len;
+            nbufs += 1;
+        }
+        index += 1;
+        ch_msg_iter_next(iter, &msg);
+    }
+    if (writer->stream_chunk > 0) {
+        nbufs = _ch_wr_push_chunk(conn, buf, nbufs);
+    }
+    ch_cn_write(conn, buf, nbufs, _ch_wr_write_data_cb);
 }
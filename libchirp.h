@@ -69,6 +69,25 @@ typedef enum { _CH_IPV4 = AF_INET, _CH_IPV6 = AF_INET6 } ch_ip_protocol_t;
 //
 #define CH_ID_SIZE 16
 
+// The maximum count of buffers the data of a message can be set to, see
+// :c:func:`ch_msg_set_data_iov`
+//
+// .. code-block:: cpp
+//
+#define CH_MSG_MAX_IOV 16
+
+// The count of message priorities, see :c:func:`ch_msg_set_priority`
+//
+// .. code-block:: cpp
+//
+#define CH_MSG_PRIORITIES 4
+
+// The count of buckets of the latency histograms, see :c:type:`ch_stats_t`
+//
+// .. code-block:: cpp
+//
+#define CH_STATS_BUCKETS 32
+
 #endif // ch_libchirp_const_h
 // ======
 // Errors
@@ -182,6 +201,12 @@ typedef enum { _CH_IPV4 = AF_INET, _CH_IPV6 = AF_INET6 } ch_ip_protocol_t;
 //
 //       Initializing some resource failed.
 //
+//    .. c:member:: CH_FULL
+//
+//       The send queue of the remote or of chirp reached its high watermark.
+//       The message will not be sent, see
+//       :c:member:`ch_config_t.MAX_QUEUE_MSGS`.
+//
 // .. code-block:: cpp
 //
 typedef enum {
@@ -205,6 +230,7 @@ typedef enum {
     CH_EMPTY           = 17,
     CH_WRITE_ERROR     = 18,
     CH_INIT_FAIL       = 19,
+    CH_FULL            = 20,
 } ch_error_t;
 
 #endif // ch_libchirp_error_h
@@ -290,6 +316,10 @@ struct ch_config_s;
 typedef struct ch_config_s ch_config_t;
 struct ch_message_s;
 typedef struct ch_message_s ch_message_t;
+struct ch_multicast_s;
+typedef struct ch_multicast_s ch_multicast_t;
+struct ch_shards_s;
+typedef struct ch_shards_s ch_shards_t;
 
 // Logging
 // =======
@@ -441,6 +471,23 @@ typedef void (*ch_log_cb_t)(char msg[], char error);
 typedef void (*ch_send_cb_t)(
         ch_chirp_t* chirp, ch_message_t* msg, ch_error_t status);
 
+// .. c:type:: ch_multicast_cb_t
+//
+//    Called by chirp when a multicast has been sent to all destinations, see
+//    :c:func:`ch_chirp_multicast_ts`.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Chirp instance sending
+//
+//    .. c:member:: ch_multicast_t* mc
+//
+//       The multicast, status contains the result of each destination
+//
+// .. code-block:: cpp
+//
+typedef void (*ch_multicast_cb_t)(ch_chirp_t* chirp, ch_multicast_t* mc);
+
 // .. c:type:: ch_recv_cb_t
 //
 //    Called by chirp when message is received.
@@ -458,6 +505,111 @@ typedef void (*ch_send_cb_t)(
 //
 typedef void (*ch_recv_cb_t)(ch_chirp_t* chirp, ch_message_t* msg);
 
+// .. c:type:: ch_recv_batch_cb_t
+//
+//    Called by chirp with the messages received in one iteration of the loop,
+//    see :c:func:`ch_chirp_set_recv_batch_callback`.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Chirp instance receiving
+//
+//    .. c:member:: ch_message_t** msgs
+//
+//       Received messages, the array is only valid during the callback. Each
+//       message has to be released like a message passed to
+//       :c:type:`ch_recv_cb_t`.
+//
+//    .. c:member:: uint32_t count
+//
+//       Count of messages
+//
+// .. code-block:: cpp
+//
+typedef void (*ch_recv_batch_cb_t)(
+        ch_chirp_t* chirp, ch_message_t** msgs, uint32_t count);
+
+// .. c:type:: ch_drain_cb_t
+//
+//    Called by chirp when a send queue that was full drains below the low
+//    watermark, see :c:func:`ch_chirp_set_drain_callback`.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Chirp instance sending
+//
+//    .. c:member:: uint8_t ip_protocol
+//
+//       IP protocol of the remote or 0 if the queue of chirp (all remotes)
+//       drained.
+//
+//    .. c:member:: const uint8_t* address
+//
+//       Address of the remote, only valid during the callback. NULL if the
+//       queue of chirp drained.
+//
+//    .. c:member:: int32_t port
+//
+//       Port of the remote
+//
+// .. code-block:: cpp
+//
+typedef void (*ch_drain_cb_t)(
+        ch_chirp_t*    chirp,
+        uint8_t        ip_protocol,
+        const uint8_t* address,
+        int32_t        port);
+
+// .. c:type:: ch_stream_cb_t
+//
+//    Called by chirp when a part of the data of a streamed message is
+//    received, see :c:func:`ch_chirp_set_stream_callback`.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Chirp instance receiving
+//
+//    .. c:member:: ch_message_t* msg
+//
+//       Received message, the same for all parts. data_len is the length of
+//       the whole data, data is NULL.
+//
+//    .. c:member:: ch_buf* data
+//
+//       The part of the data, only valid during the callback.
+//
+//    .. c:member:: uint32_t len
+//
+//       Length of the part.
+//
+//    .. c:member:: uint32_t offset
+//
+//       Offset of the part in the data. After the last part (offset + len ==
+//       data_len) the message has to be released using
+//       :c:func:`ch_chirp_release_msg_slot`.
+//
+// .. code-block:: cpp
+//
+typedef void (*ch_stream_cb_t)(
+        ch_chirp_t*   chirp,
+        ch_message_t* msg,
+        ch_buf*       data,
+        uint32_t      len,
+        uint32_t      offset);
+
+// .. c:type:: ch_trace_cb_t
+//
+//    Called by chirp when a connection timed out and tracing is enabled, see
+//    :c:func:`ch_chirp_set_trace_callback`.
+//
+//    .. c:member:: ch_chirp_t* chirp
+//
+//       Chirp instance
+//
+// .. code-block:: cpp
+//
+typedef void (*ch_trace_cb_t)(ch_chirp_t* chirp);
+
 // .. c:type:: ch_release_cb_t
 //
 //    Called by chirp when message is released.
@@ -550,13 +702,20 @@ typedef void* (*ch_realloc_cb_t)(void* buf, size_t new_size);
 //
 //       The serial number of the message. Increases monotonic. Be aware of
 //       overflows, if want to use it for ordering use the delta: serialA -
-//       serialB. Only received messages have a serial. But also received
+//       serialB. Received messages have the serial of the sender, sent
+//       messages get the serial they are written with. But also received
 //       messages can have the serial 0.
 //
 //    .. c:member:: uint8_t type
 //
 //       The type of the message.
 //
+//    .. c:member:: uint8_t priority
+//
+//       The priority of the message, only used by the sender. Messages with a
+//       higher priority are sent first. Please use
+//       :c:func:`ch_msg_set_priority` to set this.
+//
 //    .. c:member:: uint16_t header_len
 //
 //       Length of the message header.
@@ -644,6 +803,7 @@ struct ch_message_s {
     uint8_t  identity[CH_ID_SIZE];
     uint32_t serial;
     uint8_t  type;
+    uint8_t  priority; // Local only, fills the padding
     uint16_t header_len;
     uint32_t data_len;
     // These fields follow the message in this order (see *_len above)
@@ -662,6 +822,9 @@ struct ch_message_s {
     void*           _pool;
     void*           _ssl_context;
     ch_message_t*   _next;
+    const uv_buf_t* _data_iov;
+    unsigned int    _data_nbufs;
+    uint64_t        _send_time;
 };
 
 // IMPORTANT: The wire-message layout is different from the message layout.
@@ -783,9 +946,206 @@ ch_msg_set_data(ch_message_t* message, ch_buf* data, uint32_t len);
 //    :return: A chirp error. see: :c:type:`ch_error_t`
 //    :rtype:  ch_error_t
 
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_msg_set_data_iov(
+        ch_message_t* message, const uv_buf_t bufs[], unsigned int nbufs);
+//
+//    Set the messages' data to a list of buffers, which are sent one after
+//    another without being copied into one buffer. The receiver gets the
+//    data as one buffer. The list and the buffers have to be valid until the
+//    :c:type:`ch_send_cb_t` supplied in :c:func:`ch_chirp_send` has been
+//    called. data_len is set to the total length, data is set to NULL.
+//
+//    Messages with a list of buffers are not compressed.
+//
+//    :param ch_message_t* message: Pointer to the message
+//    :param uv_buf_t[] bufs: The buffers of the data
+//    :param unsigned int nbufs: Count of buffers, at most CH_MSG_MAX_IOV
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`. CH_VALUE_ERROR if
+//             there are too many buffers or the data is larger than 4G.
+//    :rtype:  ch_error_t
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_msg_set_priority(ch_message_t* message, uint8_t priority);
+//
+//    Set the messages' priority. Each remote has a queue per priority, the
+//    queue with the highest priority is always sent first. Messages with the
+//    same priority are sent in order. The default priority is 0.
+//
+//    :param ch_message_t* message: Pointer to the message
+//    :param uint8_t priority: The priority, less than CH_MSG_PRIORITIES
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`. CH_VALUE_ERROR if
+//             the priority is too high.
+//    :rtype:  ch_error_t
+
 // .. code-block:: cpp
 //
 #endif // ch_libchirp_message_h
+// =========
+// Multicast
+// =========
+//
+// Send the same header and data to many remotes.
+//
+// .. code-block:: cpp
+//
+#ifndef ch_libchirp_multicast_h
+#define ch_libchirp_multicast_h
+
+// Project includes
+// ================
+//
+// .. code-block:: cpp
+//
+/* #include "callbacks.h" */
+/* #include "common.h" */
+/* #include "message.h" */
+
+// Declarations
+// ============
+
+// .. c:type:: ch_multicast_t
+//
+//    Sends one header and data to many destinations. Each destination has its
+//    own message, that points to the shared header and data. So the payload
+//    is not copied per destination. The header and data must stay valid until
+//    the multicast callback is called.
+//
+//    .. c:member:: ch_buf* header
+//
+//       Header shared by all destinations, see :c:member:`ch_message_t.header`
+//
+//    .. c:member:: ch_buf* data
+//
+//       Data shared by all destinations. Please use :c:func:`ch_mc_set_data`
+//       to set this.
+//
+//    .. c:member:: uint16_t header_len
+//
+//       Length of the header.
+//
+//    .. c:member:: uint32_t data_len
+//
+//       Length of the data.
+//
+//    .. c:member:: uint32_t count
+//
+//       Count of destinations.
+//
+//    .. c:member:: uint32_t failed
+//
+//       Count of destinations the message could not be sent to. Valid in the
+//       multicast callback.
+//
+//    .. c:member:: ch_error_t* status
+//
+//       The result of each destination, see :c:type:`ch_send_cb_t`. Valid in
+//       the multicast callback.
+//
+//    .. c:member:: void* user_data
+//
+//       Pointer to user data, can be used to access user-data in the
+//       multicast-callback.
+//
+// .. code-block:: cpp
+//
+struct ch_multicast_s {
+    ch_buf*           header;
+    ch_buf*           data;
+    uint16_t          header_len;
+    uint32_t          data_len;
+    uint32_t          count;
+    uint32_t          failed;
+    ch_error_t*       status;
+    void*             user_data;
+    ch_multicast_cb_t _multicast_cb;
+    ch_message_t*     _msgs;
+    ch_message_t**    _msgs_p;
+    uint32_t          _pending;
+};
+
+// .. c:function::
+CH_EXPORT
+void
+ch_mc_free(ch_multicast_t* mc);
+//
+//    Free the messages of the destinations. Must not be called while the
+//    multicast is being sent.
+//
+//    :param ch_multicast_t* mc: Pointer to the multicast
+
+// .. c:function::
+CH_EXPORT
+ch_message_t*
+ch_mc_get_message(ch_multicast_t* mc, uint32_t index);
+//
+//    Get the message of a destination. It can be used to set the address or
+//    the priority. Header, data and user_data of the message are set by
+//    :c:func:`ch_chirp_multicast_ts`.
+//
+//    :param ch_multicast_t* mc: Pointer to the multicast
+//    :param uint32_t index: Index of the destination, less than count
+//
+//    :return: The message of the destination
+//    :rtype:  ch_message_t*
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_mc_init(ch_multicast_t* mc, uint32_t count);
+//
+//    Initialize a multicast to ``count`` destinations. Allocates and
+//    initializes a message per destination. The multicast can be sent
+//    repeatedly, call :c:func:`ch_mc_free` when it is not used anymore.
+//
+//    :param ch_multicast_t* mc: Pointer to the multicast
+//    :param uint32_t count: Count of destinations, greater than 0
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`. CH_VALUE_ERROR if
+//             count is 0, CH_ENOMEM if the messages could not be allocated.
+//    :rtype:  ch_error_t
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_mc_set_address(
+        ch_multicast_t*  mc,
+        uint32_t         index,
+        ch_ip_protocol_t ip_protocol,
+        const char*      address,
+        int32_t          port);
+//
+//    Set the address of a destination. See :c:func:`ch_msg_set_address`.
+//
+//    :param ch_multicast_t* mc: Pointer to the multicast
+//    :param uint32_t index: Index of the destination, less than count
+//    :param ch_ip_protocol_t ip_protocol: IP protocol
+//    :param const char* address: IPv4 or IPv6 address
+//    :param int32_t port: Port
+//
+//    :return: A chirp error. see: :c:type:`ch_error_t`
+//    :rtype:  ch_error_t
+
+// .. c:function::
+CH_EXPORT
+void
+ch_mc_set_data(ch_multicast_t* mc, ch_buf* data, uint32_t len);
+//
+//    Set the data shared by all destinations.
+//
+//    :param ch_multicast_t* mc: Pointer to the multicast
+//    :param ch_buf* data: Pointer to the data
+//    :param uint32_t len: The length of the data
+
+// .. code-block:: cpp
+//
+#endif // ch_libchirp_multicast_h
 // ==================
 // External functions
 // ==================
@@ -902,8 +1262,11 @@ ch_run(uv_loop_t* loop);
 //    .. c:member:: uint8_t MAX_SLOTS
 //
 //       The count of message-slots used. Allowed values are values between 1
-//       and 32. The default is 0: Use 16 slots if SYNCHRONOUS=0 and 1
-//       slot if SYNCHRONOUS=1.
+//       and 32. The default is 0: Use 16 slots if SYNCHRONOUS=0 and
+//       ACK_WINDOW slots if SYNCHRONOUS=1. With SHARED_SLOTS it is the
+//       maximum of slots a connection uses, values up to 255 are allowed and
+//       the default 0 means the connection is only limited by its share if
+//       SYNCHRONOUS=0.
 //
 //    .. c:member:: char SYNCHRONOUS
 //
@@ -918,6 +1281,9 @@ ch_run(uv_loop_t* loop);
 //
 //       Size of the buffer used for a connection. Defaults to 0, which means
 //       use the size requested by libuv. Should not be set below 1024.
+//       Messages that arrive in one read of an unencrypted connection point
+//       into this buffer until they are released. While such a message is not
+//       released, the connection reads into a new buffer.
 //
 //    .. c:member:: uint32_t MAX_MSG_SIZE
 //
@@ -965,6 +1331,171 @@ ch_run(uv_loop_t* loop);
 //       Connections to "127.0.0.1" and "::1" aren't encrypted anyways.
 //       Defaults to 0.
 //
+//    .. c:member:: uint8_t MAX_WRITE_BATCH
+//
+//       Maximum count of queued messages written to a remote in a single
+//       write. The wire headers of the batch are serialized into one buffer
+//       and the messages are finished in order once the write completes.
+//       Allowed values are values between 1 and :c:macro:`CH_WR_MAX_BATCH`,
+//       1 disables batching. The default is 0: Use
+//       :c:macro:`CH_WR_MAX_BATCH`.
+//
+//    .. c:member:: uint8_t ACK_WINDOW
+//
+//       Count of messages that may wait for an ACK per remote, if SYNCHRONOUS
+//       is enabled. ACKs can be received in any order, every message is
+//       finished once its ACK arrives. Allowed values are values between 1
+//       and :c:macro:`CH_MAX_ACK_WINDOW`. The default is 0: Use 1, which
+//       means one message per round-trip. Only the slots of the receiving
+//       node limit the messages processed concurrently, so the receiver
+//       should use an ACK_WINDOW (and therefore MAX_SLOTS) at least as large
+//       as the sender, otherwise it throttles the sender to its slot count.
+//
+//    .. c:member:: uint32_t SHARED_SLOTS
+//
+//       Count of message-slots shared by all connections. The default is 0:
+//       Every connection has its own MAX_SLOTS slots. Otherwise slots are
+//       allocated when needed up to SHARED_SLOTS and the connections that
+//       receive messages share them evenly. A connection that gets no slot
+//       stops reading until a slot is released.
+//
+//    .. c:member:: uint32_t SLAB_HIGH_WATER
+//
+//       Message buffers that do not fit into the slot are allocated from
+//       power-of-two size classes. Freed buffers are kept for reuse until
+//       SLAB_HIGH_WATER bytes are cached, above that they are returned to the
+//       system. The default is 0: Use :c:macro:`CH_BF_SLAB_HIGH_WATER`.
+//
+//    .. c:member:: char REUSE_PORT
+//
+//       Set SO_REUSEPORT on the listening sockets, so multiple chirp
+//       instances (or processes) can listen on the same port. The kernel
+//       distributes incoming connections between them, connections of the
+//       same peer can end up on different instances. Used by
+//       :c:func:`ch_shards_init`. Not supported on all platforms.
+//
+//    .. c:member:: char COMPRESSION
+//
+//       Compress the data of messages with LZ4, if the remote supports it.
+//       Support is announced after the handshake. The remote decompresses
+//       directly into the slot. Requires a build with
+//       :c:macro:`CH_ENABLE_COMPRESSION`.
+//
+//    .. c:member:: uint32_t COMPRESS_THRESHOLD
+//
+//       Messages with less data are sent uncompressed, as is data that does
+//       not get smaller. The default is 0: Use
+//       :c:macro:`CH_COMPRESSION_THRESHOLD`.
+//
+//    .. c:member:: uint32_t CHUNK_SIZE
+//
+//       Messages with more data are streamed in chunks of CHUNK_SIZE, if the
+//       remote supports it. The chunks are interleaved with other messages,
+//       so small messages do not wait for a large one. The remote receives
+//       the chunks one by one, see :c:func:`ch_chirp_set_stream_callback`.
+//       The default is 0: Messages are not streamed. Must be at least
+//       :c:macro:`CH_MIN_BUFFER_SIZE`, :c:macro:`CH_WR_CHUNK_SIZE` is a good
+//       value.
+//
+//    .. c:member:: uint32_t TRACE_SIZE
+//
+//       Count of events the tracing ring holds, see
+//       :c:func:`ch_chirp_get_trace`. The default is 0: Tracing is disabled.
+//
+//    .. c:member:: char* LOCAL_DIR
+//
+//       Directory of the local socket, setting it enables the local socket:
+//       Chirp creates the directory with mode 0700 and also listens on a unix
+//       domain socket named by the port in it (see :c:macro:`CH_LOCAL_PATH`).
+//       An existing directory must be owned by the user and closed to
+//       others. After a remote at "127.0.0.1" announced its local socket in a
+//       handshake over TCP, the next connections to it use the local socket,
+//       if both nodes use the same directory. Both ends check that the peer
+//       runs as the same user. Not used with REUSE_PORT or always encrypt
+//       and not supported on windows. Defaults to NULL: The local socket is
+//       disabled.
+//
+//    .. c:member:: char ADAPTIVE_BUFFERS
+//
+//       Allocate the buffers of a connection only while it is busy. Idle
+//       connections read through a buffer shared by all connections (see
+//       :c:macro:`CH_IDLE_BUFFER_SIZE`), a connection that fills it gets its
+//       own buffer of BUFFER_SIZE. The TLS buffers are allocated on first
+//       use. Garbage-collection frees the buffers of connections that did not
+//       fill their buffer since the last collection. Saves memory with many
+//       mostly idle connections. Defaults to 0.
+//
+//    .. c:member:: uint32_t MAX_QUEUE_MSGS
+//
+//       High watermark of the send queue of a remote in messages. Sending to
+//       a remote with a full queue fails with CH_FULL, until the queue drains
+//       below QUEUE_LOW_WATER, see :c:func:`ch_chirp_set_drain_callback`.
+//       Messages waiting for their ACK are not queued. The default is 0:
+//       The queue is not bounded.
+//
+//    .. c:member:: uint32_t MAX_QUEUE_BYTES
+//
+//       High watermark of the send queue of a remote in bytes of header and
+//       data. A message is always queued if the queue is empty. The default
+//       is 0: Not bounded.
+//
+//    .. c:member:: uint32_t MAX_TOTAL_QUEUE_MSGS
+//
+//       High watermark of the send queues of all remotes in messages. The
+//       default is 0: Not bounded.
+//
+//    .. c:member:: uint32_t MAX_TOTAL_QUEUE_BYTES
+//
+//       High watermark of the send queues of all remotes in bytes. The
+//       default is 0: Not bounded.
+//
+//    .. c:member:: uint8_t QUEUE_LOW_WATER
+//
+//       Low watermark in percent of the high watermarks. A full queue drains
+//       once it is at or below the low watermark. Must be < 100, defaults to
+//       50.
+//
+//    .. c:member:: ch_alloc_cb_t ALLOC_CB
+//
+//       Memory allocation callback of this instance, has the same signature
+//       as malloc. Used for the remotes and connections, their buffers, the
+//       probe messages and the remote index. Remotes and connections come
+//       from object pools that are freed in bulk when chirp is closed.
+//       Received messages, their buffers and slot pools can outlive the
+//       instance, they use the allocator of :c:func:`ch_set_alloc_funcs`.
+//       Either all or none of ALLOC_CB, REALLOC_CB and FREE_CB must be set.
+//       Defaults to NULL: The allocator of :c:func:`ch_set_alloc_funcs`.
+//
+//    .. c:member:: ch_realloc_cb_t REALLOC_CB
+//
+//       Memory reallocation callback of this instance, has the same signature
+//       as realloc. Defaults to NULL.
+//
+//    .. c:member:: ch_free_cb_t FREE_CB
+//
+//       Callback to free memory of this instance, has the same signature as
+//       free. Defaults to NULL.
+//
+//    .. c:member:: uint8_t ACK_COALESCE
+//
+//       Count of ACKs coalesced into one message, if SYNCHRONOUS is enabled.
+//       Released messages are acknowledged together, once ACK_COALESCE
+//       messages are released or after ACK_DELAY. ACKs released while a
+//       coalesced ACK is written are sent together when it is done. Only used
+//       if the remote announced after the handshake that it can receive
+//       coalesced ACKs, otherwise each message is acknowledged on its own.
+//       At most the ACK_WINDOW the sender announced after the handshake are
+//       coalesced, so the sender does not wait for ACK_DELAY. Allowed values
+//       are values up to :c:macro:`CH_MAX_ACK_WINDOW`. The default is 0: Do
+//       not coalesce.
+//
+//    .. c:member:: uint16_t ACK_DELAY
+//
+//       Maximum time in milliseconds a released message waits for its ACK to
+//       be coalesced. Must be less than TIMEOUT, so the sender does not give
+//       up waiting. The default is 0: The ACKs of messages released in the
+//       same loop iteration are coalesced.
+//
 //   You can create the certificate using the makepki Makefile_ on github. If
 //   you want to create it manually the chain has to contain:
 //
@@ -981,21 +1512,42 @@ ch_run(uv_loop_t* loop);
 // .. code-block:: cpp
 //
 struct ch_config_s {
-    float    REUSE_TIME;
-    float    TIMEOUT;
-    uint16_t PORT;
-    uint8_t  BACKLOG;
-    uint8_t  MAX_SLOTS;
-    char     SYNCHRONOUS;
-    char     DISABLE_SIGNALS;
-    uint32_t BUFFER_SIZE;
-    uint32_t MAX_MSG_SIZE;
-    uint8_t  BIND_V6[CH_IP_ADDR_SIZE];
-    uint8_t  BIND_V4[CH_IP4_ADDR_SIZE];
-    uint8_t  IDENTITY[CH_ID_SIZE]; // 16
-    char*    CERT_CHAIN_PEM;
-    char*    DH_PARAMS_PEM;
-    char     DISABLE_ENCRYPTION;
+    float           REUSE_TIME;
+    float           TIMEOUT;
+    uint16_t        PORT;
+    uint8_t         BACKLOG;
+    uint8_t         MAX_SLOTS;
+    char            SYNCHRONOUS;
+    char            DISABLE_SIGNALS;
+    uint32_t        BUFFER_SIZE;
+    uint32_t        MAX_MSG_SIZE;
+    uint8_t         BIND_V6[CH_IP_ADDR_SIZE];
+    uint8_t         BIND_V4[CH_IP4_ADDR_SIZE];
+    uint8_t         IDENTITY[CH_ID_SIZE]; // 16
+    char*           CERT_CHAIN_PEM;
+    char*           DH_PARAMS_PEM;
+    char            DISABLE_ENCRYPTION;
+    uint8_t         MAX_WRITE_BATCH;
+    uint8_t         ACK_WINDOW;
+    uint32_t        SHARED_SLOTS;
+    uint32_t        SLAB_HIGH_WATER;
+    char            REUSE_PORT;
+    char            COMPRESSION;
+    uint32_t        COMPRESS_THRESHOLD;
+    uint32_t        CHUNK_SIZE;
+    uint32_t        TRACE_SIZE;
+    char*           LOCAL_DIR;
+    char            ADAPTIVE_BUFFERS;
+    uint32_t        MAX_QUEUE_MSGS;
+    uint32_t        MAX_QUEUE_BYTES;
+    uint32_t        MAX_TOTAL_QUEUE_MSGS;
+    uint32_t        MAX_TOTAL_QUEUE_BYTES;
+    uint8_t         QUEUE_LOW_WATER;
+    ch_alloc_cb_t   ALLOC_CB;
+    ch_realloc_cb_t REALLOC_CB;
+    ch_free_cb_t    FREE_CB;
+    uint8_t         ACK_COALESCE;
+    uint16_t        ACK_DELAY;
 };
 
 // .. c:type:: ch_chirp_int_t
@@ -1030,33 +1582,303 @@ struct ch_chirp_s {
     int             _init;
 };
 
-// .. c:function::
-CH_EXPORT
-ch_error_t
-ch_chirp_close_ts(ch_chirp_t* chirp);
+// .. c:type:: ch_stats_t
 //
-//    Clean up chirp object. Close all connections. The chirp object can be
-//    freed after the done callback passed to :c:func:`ch_chirp_init` was
-//    called.
+//    Runtime statistics of a chirp instance, see
+//    :c:func:`ch_chirp_get_stats`. The counters are always enabled.
 //
-//    This function is thread-safe.
+//    The latency histograms have CH_STATS_BUCKETS buckets, bucket 0 counts
+//    latencies below 1us, bucket n counts latencies from 2^(n-1)us up to
+//    2^n us. The last bucket also counts all larger latencies.
 //
-//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    .. c:member:: uint64_t msgs_sent
 //
-//    :return: A chirp error. See: :c:type:`ch_error_t`.
-//    :rtype: ch_error_t
-
-// .. c:function::
-CH_EXPORT
-void
-ch_chirp_config_init(ch_config_t* config);
+//       Count of messages written, not counting acks and noops.
 //
-//    Initialize chirp configuration with defaults.
+//    .. c:member:: uint64_t writes
 //
-//    :param ch_config_t* config: Pointer to a chirp configuration.
-
-// .. c:function::
-CH_EXPORT
+//       Count of writes of message batches, including batches of acks.
+//
+//    .. c:member:: uint64_t bytes_sent
+//
+//       Bytes of header and data of the messages written.
+//
+//    .. c:member:: uint64_t acks_sent
+//
+//       Count of acks written, a coalesced ack counts once.
+//
+//    .. c:member:: uint64_t msgs_recv
+//
+//       Count of messages received.
+//
+//    .. c:member:: uint64_t bytes_recv
+//
+//       Bytes of header and data of the messages received.
+//
+//    .. c:member:: uint64_t slots_exhausted
+//
+//       How often a connection stopped reading, because no slot was free.
+//
+//    .. c:member:: uint64_t connects
+//
+//       Count of outgoing connections that completed the handshake.
+//
+//    .. c:member:: uint64_t accepts
+//
+//       Count of incoming connections that completed the handshake.
+//
+//    .. c:member:: uint64_t reconnects
+//
+//       Count of handshakes with a remote that already had a connection.
+//
+//    .. c:member:: uint64_t local_connections
+//
+//       Count of connections over the local socket that completed the
+//       handshake, incoming and outgoing, see
+//       :c:member:`ch_config_t.LOCAL_DIR`.
+//
+//    .. c:member:: uint64_t gc_connections
+//
+//       Count of old connections closed by the garbage-collector.
+//
+//    .. c:member:: uint64_t gc_remotes
+//
+//       Count of remotes deleted by the garbage-collector.
+//
+//    .. c:member:: uint64_t handshakes_full
+//
+//       Count of TLS handshakes that negotiated a new session, see
+//       :c:func:`ch_chirp_get_tls_handshakes`.
+//
+//    .. c:member:: uint64_t handshakes_resumed
+//
+//       Count of TLS handshakes that resumed a session.
+//
+//    .. c:member:: uint64_t reads_borrowed
+//
+//       Count of reads of idle connections into the shared idle buffer, see
+//       :c:member:`ch_config_t.ADAPTIVE_BUFFERS`.
+//
+//    .. c:member:: uint64_t buffers_shrunk
+//
+//       Count of idle connections whose buffers were freed, see
+//       :c:member:`ch_config_t.ADAPTIVE_BUFFERS`.
+//
+//    .. c:member:: uint32_t remotes
+//
+//       Current count of remotes.
+//
+//    .. c:member:: uint32_t connections
+//
+//       Current count of connected remotes.
+//
+//    .. c:member:: uint32_t queued
+//
+//       Current count of messages in the send queues of all remotes.
+//
+//    .. c:member:: uint32_t writes_pending
+//
+//       Current count of connections with a write in progress.
+//
+//    .. c:member:: uint64_t write_latency[CH_STATS_BUCKETS]
+//
+//       Histogram of the time from sending a message until it was written.
+//
+//    .. c:member:: uint64_t ack_latency[CH_STATS_BUCKETS]
+//
+//       Histogram of the time from sending a message until the ack was
+//       received. Synchronous mode only.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_stats_s {
+    uint64_t msgs_sent;
+    uint64_t writes;
+    uint64_t bytes_sent;
+    uint64_t acks_sent;
+    uint64_t msgs_recv;
+    uint64_t bytes_recv;
+    uint64_t slots_exhausted;
+    uint64_t connects;
+    uint64_t accepts;
+    uint64_t reconnects;
+    uint64_t local_connections;
+    uint64_t gc_connections;
+    uint64_t gc_remotes;
+    uint64_t handshakes_full;
+    uint64_t handshakes_resumed;
+    uint64_t reads_borrowed;
+    uint64_t buffers_shrunk;
+    uint32_t remotes;
+    uint32_t connections;
+    uint32_t queued;
+    uint32_t writes_pending;
+    uint64_t write_latency[CH_STATS_BUCKETS];
+    uint64_t ack_latency[CH_STATS_BUCKETS];
+} ch_stats_t;
+
+// .. c:type:: ch_remote_stats_t
+//
+//    Statistics of a remote, see :c:func:`ch_chirp_get_remote_stats`.
+//
+//    .. c:member:: uint8_t ip_protocol
+//
+//       AF_INET or AF_INET6.
+//
+//    .. c:member:: uint8_t[16] address
+//
+//       IPv4/6 address of the remote.
+//
+//    .. c:member:: int32_t port
+//
+//       Port of the remote.
+//
+//    .. c:member:: uint8_t connected
+//
+//       The remote has a connection.
+//
+//    .. c:member:: uint8_t pinned
+//
+//       The remote is pinned, see :c:func:`ch_chirp_connect_ts`.
+//
+//    .. c:member:: uint8_t write_pending
+//
+//       A write to the remote is in progress.
+//
+//    .. c:member:: uint8_t wait_ack
+//
+//       Count of messages waiting for their ack.
+//
+//    .. c:member:: uint32_t queued[CH_MSG_PRIORITIES]
+//
+//       Count of messages in the send queue of each priority.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_remote_stats_s {
+    uint8_t  ip_protocol;
+    uint8_t  address[CH_IP_ADDR_SIZE];
+    int32_t  port;
+    uint8_t  connected;
+    uint8_t  pinned;
+    uint8_t  write_pending;
+    uint8_t  wait_ack;
+    uint32_t queued[CH_MSG_PRIORITIES];
+} ch_remote_stats_t;
+
+// .. c:type:: ch_trace_type_t
+//
+//    Events of the lifecycle of a message, see :c:type:`ch_trace_event_t`.
+//
+//    .. c:member:: CH_TR_ENQUEUE
+//
+//       The message was added to the send queue of the remote.
+//
+//    .. c:member:: CH_TR_DEQUEUE
+//
+//       The message was taken from the queue into a write batch.
+//
+//    .. c:member:: CH_TR_WRITE
+//
+//       The write of the message started, its serial is assigned.
+//
+//    .. c:member:: CH_TR_WRITE_DONE
+//
+//       The message was written.
+//
+//    .. c:member:: CH_TR_ACK
+//
+//       The ack for the message was received.
+//
+//    .. c:member:: CH_TR_SLOT_ACQUIRE
+//
+//       A received message acquired a slot.
+//
+//    .. c:member:: CH_TR_SLOT_RELEASE
+//
+//       A received message released its slot.
+//
+//    .. c:member:: CH_TR_TIMEOUT
+//
+//       Connecting or writing to a remote timed out. Has no identity.
+//
+// .. code-block:: cpp
+//
+typedef enum {
+    CH_TR_ENQUEUE      = 1,
+    CH_TR_DEQUEUE      = 2,
+    CH_TR_WRITE        = 3,
+    CH_TR_WRITE_DONE   = 4,
+    CH_TR_ACK          = 5,
+    CH_TR_SLOT_ACQUIRE = 6,
+    CH_TR_SLOT_RELEASE = 7,
+    CH_TR_TIMEOUT      = 8,
+} ch_trace_type_t;
+
+// .. c:type:: ch_trace_event_t
+//
+//    An event of the tracing ring, see :c:member:`ch_config_t.TRACE_SIZE`.
+//
+//    .. c:member:: uint64_t time
+//
+//       Time of the event in nanoseconds, from uv_hrtime().
+//
+//    .. c:member:: uint8_t[16] identity
+//
+//       Identity of the message.
+//
+//    .. c:member:: uint32_t serial
+//
+//       Serial the message is written with, the same on the sender and the
+//       receiver. 0 for CH_TR_ENQUEUE and CH_TR_DEQUEUE, the serial is
+//       assigned when the message is written. The CH_TR_ACK of a message has
+//       its serial, not the serial of the ack.
+//
+//    .. c:member:: uint8_t type
+//
+//       The event, see :c:type:`ch_trace_type_t`.
+//
+//    .. c:member:: uint8_t msg_type
+//
+//       The type of the message, acks have the identity of their message.
+//
+// .. code-block:: cpp
+//
+typedef struct ch_trace_event_s {
+    uint64_t time;
+    uint8_t  identity[CH_ID_SIZE];
+    uint32_t serial;
+    uint8_t  type;
+    uint8_t  msg_type;
+} ch_trace_event_t;
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_chirp_close_ts(ch_chirp_t* chirp);
+//
+//    Clean up chirp object. Close all connections. The chirp object can be
+//    freed after the done callback passed to :c:func:`ch_chirp_init` was
+//    called.
+//
+//    This function is thread-safe.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//
+//    :return: A chirp error. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+CH_EXPORT
+void
+ch_chirp_config_init(ch_config_t* config);
+//
+//    Initialize chirp configuration with defaults.
+//
+//    :param ch_config_t* config: Pointer to a chirp configuration.
+
+// .. c:function::
+CH_EXPORT
 ch_identity_t
 ch_chirp_get_identity(ch_chirp_t* chirp);
 //
@@ -1081,6 +1903,89 @@ ch_chirp_get_loop(ch_chirp_t* chirp);
 //    :return: a pointer to a libuv event loop object.
 //    :rtype:  uv_loop_t*
 
+// .. c:function::
+CH_EXPORT
+void
+ch_chirp_get_tls_handshakes(
+        ch_chirp_t* chirp, uint64_t* full, uint64_t* resumed);
+//
+//    Get the count of TLS handshakes that negotiated a new session and the
+//    count of handshakes that resumed a session. Outgoing connections resume
+//    the cached session of their remote, so reconnecting after
+//    :c:member:`ch_config_t.REUSE_TIME` skips the full handshake. Both sides
+//    of a connection count its handshake. Has to be called on the uv-thread.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param uint64_t* full: Out: count of full handshakes.
+//    :param uint64_t* resumed: Out: count of resumed handshakes.
+
+// .. c:function::
+CH_EXPORT
+void
+ch_chirp_get_stats(ch_chirp_t* chirp, ch_stats_t* stats);
+//
+//    Get the runtime statistics of the chirp instance. Has to be called on the
+//    uv-thread. The counters are plain integers updated by the uv-thread, so
+//    collecting them costs nothing but a few additions.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_stats_t* stats: Out: the statistics.
+
+// .. c:function::
+CH_EXPORT
+uint32_t
+ch_chirp_get_remote_stats(
+        ch_chirp_t* chirp, ch_remote_stats_t* stats, uint32_t count);
+//
+//    Get the statistics of up to count remotes. Has to be called on the
+//    uv-thread. Use :c:member:`ch_stats_t.remotes` to size the array.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_remote_stats_t* stats: Out: array of count statistics.
+//    :param uint32_t count: Size of the array.
+//
+//    :return: The count of remotes filled in.
+//    :rtype:  uint32_t
+
+// .. c:function::
+CH_EXPORT
+uint32_t
+ch_chirp_get_trace(ch_chirp_t* chirp, ch_trace_event_t* events, uint32_t count);
+//
+//    Get the latest events of the tracing ring, the oldest first. Has to be
+//    called on the uv-thread. Recording an event copies the identity and
+//    takes a timestamp, nothing is formatted.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_trace_event_t* events: Out: array of count events.
+//    :param uint32_t count: Size of the array.
+//
+//    :return: The count of events filled in, 0 if tracing is disabled.
+//    :rtype:  uint32_t
+
+// .. c:function::
+CH_EXPORT
+void
+ch_chirp_dump_trace(ch_chirp_t* chirp, FILE* out);
+//
+//    Write the events of the tracing ring as text, one line per event, the
+//    oldest first. Has to be called on the uv-thread.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param FILE* out: File to write to.
+
+// .. c:function::
+CH_EXPORT
+void
+ch_chirp_set_trace_callback(ch_chirp_t* chirp, ch_trace_cb_t trace_cb);
+//
+//    Set a callback called after a connection timed out, so the tracing ring
+//    can be dumped while it still contains the events that led to the
+//    timeout. Only called if tracing is enabled.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_trace_cb_t trace_cb: Called on timeout, can be NULL.
+
 // .. c:function::
 CH_EXPORT
 ch_error_t
@@ -1118,6 +2023,28 @@ ch_chirp_init(
 //    :rtype: ch_error_t
 //
 
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_chirp_release_batch_ts(
+        ch_chirp_t*     rchirp,
+        ch_message_t**  msgs,
+        size_t          count,
+        ch_release_cb_t release_cb);
+//
+//    Release the internal message-slots of ``count`` messages. Behaves like
+//    calling :c:func:`ch_chirp_release_msg_slot_ts` for each message, but
+//    the messages are passed to the uv-loop-thread in one operation.
+//
+//    This function is thread-safe.
+//
+//    :param ch_chirp_t* rchirp: Chirp instances for release_cb
+//    :param ch_message_t** msgs: The messages representing the slots. The
+//                                array itself may be freed after the call.
+//    :param size_t count: Count of messages in msgs.
+//    :param ch_release_cb_t release_cb: Called once per message released.
+//
+
 // .. c:function::
 CH_EXPORT
 void
@@ -1214,7 +2141,11 @@ ch_chirp_send(ch_chirp_t* chirp, ch_message_t* msg, ch_send_cb_t send_cb);
 //    been placed in the send queue. CH_USED if the message is already used
 //    elsewhere, the message will not be sent.
 //
-//    The send message queue is not bounded, the user has to pause sending.
+//    The send message queue is not bounded by default, the user has to pause
+//    sending. Setting :c:member:`ch_config_t.MAX_QUEUE_MSGS` or the other
+//    watermarks bounds it: If the queue is full send_cb is called with
+//    CH_FULL and CH_FULL is returned. The message can be sent again after
+//    the drain callback, see :c:func:`ch_chirp_set_drain_callback`.
 //
 //    Sending only one message at the same time while having multiple peers
 //    would prevent concurrency, but since chirp is quite fast, it is a valid
@@ -1233,6 +2164,96 @@ ch_chirp_send(ch_chirp_t* chirp, ch_message_t* msg, ch_send_cb_t send_cb);
 //    :param ch_send_cb_t send_cb: The callback, that will be called after
 //                                 sending.
 
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_chirp_send_batch_ts(
+        ch_chirp_t*    chirp,
+        ch_message_t** msgs,
+        size_t         count,
+        ch_send_cb_t   send_cb);
+//
+//    Send ``count`` messages. Behaves like calling :c:func:`ch_chirp_send_ts`
+//    for each message, but the messages are passed to the uv-loop-thread in
+//    one operation with at most one wakeup. They are sent in array order.
+//
+//    This function is thread-safe. ATTENTION: Callback will be called by the
+//    uv-loop-thread.
+//
+//    Returns CH_SUCCESS when all messages have been successfully queued and
+//    CH_USED if any message is already used elsewhere or is in the array
+//    twice, in which case none of the messages will be sent.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_message_t** msgs: The messages to send. The memory of the
+//                                messages must stay valid until the callback
+//                                is called, the array itself may be freed
+//                                after the call.
+//    :param size_t count: Count of messages in msgs.
+//    :param ch_send_cb_t send_cb: The callback, that will be called after
+//                                 sending, once per message.
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_chirp_multicast_ts(
+        ch_chirp_t* chirp, ch_multicast_t* mc, ch_multicast_cb_t multicast_cb);
+//
+//    Send the header and data of the multicast to all its destinations. The
+//    message of each destination is queued on its remote like a message sent
+//    by :c:func:`ch_chirp_send_batch_ts`. Since the messages share the header
+//    and data, the payload is not copied per destination.
+//
+//    The multicast callback is called once all destinations are done, the
+//    result of each destination is in :c:member:`ch_multicast_t.status`.
+//
+//    This function is thread-safe. ATTENTION: Callback will be called by the
+//    uv-loop-thread.
+//
+//    Returns CH_SUCCESS when all messages have been successfully queued,
+//    CH_USED if the multicast is already being sent, in which case none of
+//    the messages will be sent, and CH_UV_ERROR if the loop could not be
+//    signalled. The callback is not called if an error is returned.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_multicast_t* mc: The multicast to send. The memory of the
+//                               multicast, its header and data must stay
+//                               valid until the callback is called.
+//    :param ch_multicast_cb_t multicast_cb: The callback, that will be called
+//                                           after sending to all
+//                                           destinations.
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_chirp_connect_ts(
+        ch_chirp_t* chirp, ch_message_t* msg, int pin, ch_send_cb_t send_cb);
+//
+//    Connect to a remote ahead of time, so the first message does not wait
+//    for the connect and the TLS handshake. The message addresses the remote
+//    (ip_protocol, address and port), it is sent as NOOP and should have no
+//    header and data. The callback is called once the NOOP is written or
+//    the connection failed.
+//
+//    If pin is 1 the remote is pinned: It is not garbage-collected after
+//    :c:member:`ch_config_t.REUSE_TIME`, instead a NOOP is sent after
+//    REUSE_TIME / 2 of silence, which keeps the connection alive or
+//    reconnects it. If pin is 0 the remote is unpinned.
+//
+//    This function is thread-safe. ATTENTION: Callback will be called by the
+//    uv-loop-thread.
+//
+//    Returns CH_SUCCESS when the message has been successfully queued and
+//    CH_USED if the message is already used elsewhere.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_message_t msg: The message addressing the remote. The memory
+//                             of the message must stay valid until the
+//                             callback is called.
+//    :param int pin: Pin (1) or unpin (0) the remote.
+//    :param ch_send_cb_t send_cb: The callback, that will be called after
+//                                 connecting.
+
 // .. c:function::
 CH_EXPORT
 ch_error_t
@@ -1316,7 +2337,229 @@ ch_chirp_set_recv_callback(ch_chirp_t* chirp, ch_recv_cb_t recv_cb);
 //    :param ch_chirp_t* chirp: Pointer to a chirp object.
 //    :param ch_recv_cb_t recv_cb: Called when chirp receives a message,
 //                                 can be NULL.
+
+// .. c:function::
+CH_EXPORT
+void
+ch_chirp_set_drain_callback(ch_chirp_t* chirp, ch_drain_cb_t drain_cb);
+//
+//    Set a callback for send queues draining. It is called once per full
+//    queue, when the queue of a remote or the queue of chirp (all remotes)
+//    dropped to the low watermark. See :c:member:`ch_config_t.MAX_QUEUE_MSGS`.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_drain_cb_t drain_cb: Called when a full queue drained, can be
+//                                   NULL.
+
+// .. c:function::
+CH_EXPORT
+int
+ch_chirp_full_is_total(ch_chirp_t* chirp);
+//
+//    Tell which watermark the last send that failed with CH_FULL hit, call
+//    it in the send callback. If the queue of chirp (all remotes) was full,
+//    the drain callback is called with address NULL, else with the address
+//    of the remote. See :c:member:`ch_config_t.MAX_TOTAL_QUEUE_MSGS`.
+//
+//    This function is NOT thread-safe.
 //
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :return: 1 if the queue of chirp was full, 0 if the queue of the remote
+//    :rtype: int
+
+// .. c:function::
+CH_EXPORT
+void
+ch_chirp_set_recv_batch_callback(
+        ch_chirp_t* chirp, ch_recv_batch_cb_t recv_batch_cb);
+//
+//    Set a callback for receiving the messages of a loop iteration at once.
+//    Chirp collects the messages received while polling and calls the
+//    callback once, before the loop blocks again. This saves the overhead of
+//    calling into bindings for every message. If set, the recv callback is
+//    not called.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_recv_batch_cb_t recv_batch_cb: Called with the messages
+//                                             received, can be NULL.
+
+// .. c:function::
+CH_EXPORT
+void
+ch_chirp_set_stream_callback(ch_chirp_t* chirp, ch_stream_cb_t stream_cb);
+//
+//    Set a callback for receiving the data of streamed messages in parts.
+//    Messages with more data than :c:member:`ch_config_t.CHUNK_SIZE` are
+//    streamed in chunks. Without a stream callback chirp collects the chunks
+//    and calls the recv callback with the whole message. If the connection is
+//    lost before the last part, the message is dropped without a further
+//    call and the sender gets an error.
+//
+//    :param ch_chirp_t* chirp: Pointer to a chirp object.
+//    :param ch_stream_cb_t stream_cb: Called for each part of the data of a
+//                                     streamed message, can be NULL.
+
+// Shards
+// ======
+//
+// Run one chirp node on multiple cores: Each shard is a chirp instance with
+// its own loop and thread. All shards share the identity and listen on the
+// same port using :c:member:`ch_config_t.REUSE_PORT`, the kernel distributes
+// incoming connections. Outgoing messages are routed to a shard by the hash
+// of their address, so every remote has one owning shard.
+//
+// Limitation: Inbound connections are not routed to the owning shard, the
+// kernel places them on any shard. A peer that connects to the node gets a
+// remote on that shard, while messages to the peer go out on the owning
+// shard, possibly creating a second connection and remote. Message order and
+// synchronous acknowledgements only hold per connection, so both directions
+// are unordered in respect to each other. Send replies with
+// :c:func:`ch_shards_send_ts` instead of :c:func:`ch_chirp_send` on the
+// shard that received the message, so a peer is always sent to from one
+// shard.
+//
+// .. c:type:: ch_shards_int_t
+//    :noindex:
+//
+//    Opaque pointer to internals.
+//
+//    see: :c:type:`ch_shards_int_t`
+//
+// .. code-block:: cpp
+//
+typedef struct ch_shards_int_s ch_shards_int_t;
+
+// .. c:type:: ch_shards_t
+//
+//    A group of chirp instances sharing one identity and port.
+//
+//    .. c:member:: void* user_data;
+//
+//       Pointer to user-data. The user_data of every shard's chirp object
+//       points to the ch_shards_t, so callbacks can access it.
+//
+//    .. c:member:: uint8_t count;
+//
+//       Count of shards.
+//
+// .. code-block:: cpp
+//
+struct ch_shards_s {
+    void*            user_data;
+    uint8_t          count;
+    ch_shards_int_t* _;
+};
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_shards_close_ts(ch_shards_t* shards);
+//
+//    Close all shards, see :c:func:`ch_chirp_close_ts`. Call
+//    :c:func:`ch_shards_join` to wait for the shards to finish.
+//
+//    This function is thread-safe.
+//
+//    :param ch_shards_t* shards: Pointer to a shards object.
+//
+//    :return: A chirp error. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+CH_EXPORT
+ch_chirp_t*
+ch_shards_get_chirp(ch_shards_t* shards, uint8_t index);
+//
+//    Get the chirp object of a shard.
+//
+//    :param ch_shards_t* shards: Pointer to a shards object.
+//    :param uint8_t index: Index of the shard, less than count.
+//
+//    :return: The chirp object.
+//    :rtype: ch_chirp_t*
+
+// .. c:function::
+CH_EXPORT
+ch_chirp_t*
+ch_shards_get_owner(ch_shards_t* shards, const ch_message_t* msg);
+//
+//    Get the chirp object of the shard owning the remote the message is
+//    addressed to.
+//
+//    :param ch_shards_t* shards: Pointer to a shards object.
+//    :param ch_message_t* msg: Message with address set.
+//
+//    :return: The chirp object.
+//    :rtype: ch_chirp_t*
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_shards_init(
+        ch_shards_t*       shards,
+        uint8_t            count,
+        const ch_config_t* config,
+        ch_recv_cb_t       recv_cb,
+        ch_start_cb_t      start_cb,
+        ch_done_cb_t       done_cb,
+        ch_log_cb_t        log_cb);
+//
+//    Start count shards, each running a chirp instance with the given config
+//    on its own uv-loop in its own thread. If the IDENTITY is not set, a
+//    random identity is created for all shards. REUSE_PORT is enabled.
+//
+//    Blocks until all shards are initialized. If a shard fails, the other
+//    shards are closed and joined and the error is returned.
+//
+//    The callbacks are called in the thread of the shard, once per shard.
+//    Messages are released with :c:func:`ch_chirp_release_msg_slot_ts`.
+//
+//    :param ch_shards_t* shards: Pointer to a shards object.
+//    :param uint8_t count: Count of shards, at least 1.
+//    :param ch_config_t* config: Pointer to a chirp configuration.
+//    :param ch_recv_cb_t recv_cb: Called when a shard receives a message,
+//                                 can be NULL.
+//    :param ch_start_cb_t start_cb: Called when a shard is started, can be
+//                                   NULL.
+//    :param ch_done_cb_t done_cb: Called when a shard is finished, can be
+//                                 NULL.
+//    :param ch_log_cb_t log_cb: Callback to the logging facility, can be
+//                               NULL.
+//    :return: A chirp error. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_shards_join(ch_shards_t* shards);
+//
+//    Wait until all shards are finished and free the internals. Must not be
+//    called from a shard's thread.
+//
+//    :param ch_shards_t* shards: Pointer to a shards object.
+//
+//    :return: A chirp error. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
+
+// .. c:function::
+CH_EXPORT
+ch_error_t
+ch_shards_send_ts(ch_shards_t* shards, ch_message_t* msg, ch_send_cb_t send_cb);
+//
+//    Send a message using the shard owning the remote, see
+//    :c:func:`ch_chirp_send_ts`. The send_cb is called in the thread of that
+//    shard.
+//
+//    This function is thread-safe.
+//
+//    :param ch_shards_t* shards: Pointer to a shards object.
+//    :param ch_message_t* msg: The message to send. The memory of the message
+//                              must stay valid until the callback is called.
+//    :param ch_send_cb_t send_cb: The callback that will be called after the
+//                                 message was sent.
+//
+//    :return: A chirp error. See: :c:type:`ch_error_t`.
+//    :rtype: ch_error_t
 //
 //    .. code-block:: cpp
 
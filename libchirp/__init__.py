@@ -1,7 +1,9 @@
 """Main module of libchirp, containing common and low level bindings."""
 import atexit
+from collections import deque
 from concurrent.futures import Future
 from concurrent.futures import TimeoutError as CFTimeoutError
+from functools import lru_cache
 from ipaddress import ip_address, IPv6Address
 import logging
 import sys
@@ -80,8 +82,11 @@ class Config(object):
     """
 
     _ips     = ('BIND_V4', 'BIND_V6')
-    _bools   = ('SYNCHRONOUS', 'DISABLE_SIGNALS', 'DISABLE_ENCRYPTION')
-    _strings = ('CERT_CHAIN_PEM', 'DH_PARAMS_PEM')
+    _bools   = (
+        'SYNCHRONOUS', 'DISABLE_SIGNALS', 'DISABLE_ENCRYPTION', 'REUSE_PORT',
+        'COMPRESSION', 'ADAPTIVE_BUFFERS'
+    )
+    _strings = ('CERT_CHAIN_PEM', 'DH_PARAMS_PEM', 'LOCAL_DIR')
 
     def __init__(self):
         self._sealed = False
@@ -121,7 +126,10 @@ class Config(object):
         elif name in Config._bools:
             return bool(getattr(conf, name)[0])
         elif name in Config._strings:
-            return ffi.string(getattr(conf, name)).decode("UTF-8")
+            string = getattr(conf, name)
+            if string == ffi.NULL:
+                return None
+            return ffi.string(string).decode("UTF-8")
         else:
             return getattr(conf, name)
 
@@ -141,6 +149,79 @@ class Config(object):
         """Set if chirp requests and waits for acknowledge messages."""
         self._setattr_ffi('SYNCHRONOUS', value)
 
+    @property
+    def ACK_COALESCE(self):
+        """Get the count of acknowledges coalesced into one message.
+
+        Only used if `SYNCHRONOUS` = `True`: The acknowledges of released
+        messages are sent together, once ACK_COALESCE messages are released or
+        after `ACK_DELAY`. Only used if the remote can receive them. At most
+        the `ACK_WINDOW` of the sender are coalesced. Allowed values are values
+        up to 32. The default is 0: Do not coalesce.
+        (uint8_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('ACK_COALESCE')
+
+    @ACK_COALESCE.setter
+    def ACK_COALESCE(self, value):
+        """Set the count of acknowledges coalesced."""
+        self._setattr_ffi('ACK_COALESCE', value)
+
+    @property
+    def ACK_DELAY(self):
+        """Get the time in ms a release waits for its acknowledge to coalesce.
+
+        Must be less than `TIMEOUT`. The default is 0: The acknowledges of
+        messages released in the same loop iteration are coalesced. (uint16_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('ACK_DELAY')
+
+    @ACK_DELAY.setter
+    def ACK_DELAY(self, value):
+        """Set the time in ms a release waits for its acknowledge."""
+        self._setattr_ffi('ACK_DELAY', value)
+
+    @property
+    def ACK_WINDOW(self):
+        """Get the count of messages that may wait for an acknowledge.
+
+        Only used if `SYNCHRONOUS` = `True`: Up to ACK_WINDOW messages per
+        remote are sent before their acknowledge arrives. Allowed values are
+        values between 1 and 32. The default is 0: Use 1. The receiver should
+        use at least the same ACK_WINDOW. (uint8_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('ACK_WINDOW')
+
+    @ACK_WINDOW.setter
+    def ACK_WINDOW(self, value):
+        """Set the count of messages that may wait for an acknowledge."""
+        self._setattr_ffi('ACK_WINDOW', value)
+
+    @property
+    def ADAPTIVE_BUFFERS(self):
+        """Get if connections only get their buffers while they are busy.
+
+        Idle connections read through a small buffer shared by all
+        connections, a busy connection gets its own buffer of `BUFFER_SIZE`.
+        The buffers of connections that are idle again are freed by the
+        garbage-collection. Saves memory with many mostly idle connections.
+        Python boolean expected. Defaults to False.
+
+        :rtype: bool
+        """
+        return self._getattr_ffi('ADAPTIVE_BUFFERS')
+
+    @ADAPTIVE_BUFFERS.setter
+    def ADAPTIVE_BUFFERS(self, value):
+        """Set if connections only get their buffers while they are busy."""
+        self._setattr_ffi('ADAPTIVE_BUFFERS', value)
+
     @property
     def AUTO_RELEASE(self):
         """Get if chirp releases messages.
@@ -255,6 +336,56 @@ class Config(object):
         """Set the path to the verification certificate."""
         self._setattr_ffi('CERT_CHAIN_PEM', value)
 
+    @property
+    def CHUNK_SIZE(self):
+        """Get the chunk size of streamed messages.
+
+        Messages with more data are streamed in chunks, interleaved with other
+        messages to the remote. The default is 0: Messages are not streamed,
+        65536 is a good value to enable streaming. (uint32_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('CHUNK_SIZE')
+
+    @CHUNK_SIZE.setter
+    def CHUNK_SIZE(self, value):
+        """Set the chunk size of streamed messages."""
+        self._setattr_ffi('CHUNK_SIZE', value)
+
+    @property
+    def COMPRESSION(self):
+        """Get if the data of messages is compressed with LZ4.
+
+        Only if the remote supports it, support is announced in the
+        handshake. Requires libchirp built with CH_ENABLE_COMPRESSION. Python
+        boolean expected. Defaults to False.
+
+        :rtype: bool
+        """
+        return self._getattr_ffi('COMPRESSION')
+
+    @COMPRESSION.setter
+    def COMPRESSION(self, value):
+        """Set if the data of messages is compressed with LZ4."""
+        self._setattr_ffi('COMPRESSION', value)
+
+    @property
+    def COMPRESS_THRESHOLD(self):
+        """Get the minimal data size of messages to compress.
+
+        Messages with less data are sent uncompressed. The default is 0: Use
+        1024. (uint32_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('COMPRESS_THRESHOLD')
+
+    @COMPRESS_THRESHOLD.setter
+    def COMPRESS_THRESHOLD(self, value):
+        """Set the minimal data size of messages to compress."""
+        self._setattr_ffi('COMPRESS_THRESHOLD', value)
+
     @property
     def DH_PARAMS_PEM(self):
         """Get the path to the file containing DH parameters. Python string.
@@ -317,6 +448,26 @@ class Config(object):
         """Override the chirp-nodes identity (this chirp instance)."""
         self._setattr_ffi('IDENTITY', value)
 
+    @property
+    def LOCAL_DIR(self):
+        """Get the directory of the local socket. Python string or None.
+
+        Setting it enables the local socket: chirp creates the directory with
+        mode 0700 and also listens on a unix domain socket in it. After a
+        remote at "127.0.0.1" announced its local socket over TCP, the next
+        connections to it use the local socket, if both use the same
+        directory. Both ends check that the peer runs as the same user.
+        Defaults to None: The local socket is disabled.
+
+        :rtype: str
+        """
+        return self._getattr_ffi('LOCAL_DIR')
+
+    @LOCAL_DIR.setter
+    def LOCAL_DIR(self, value):
+        """Set the directory of the local socket."""
+        self._setattr_ffi('LOCAL_DIR', value)
+
     @property
     def MAX_MSG_SIZE(self):
         """Get the max message size accepted by chirp. (uint32_t).
@@ -346,13 +497,50 @@ class Config(object):
         """Set the max message size accepted by chirp."""
         self._setattr_ffi('MAX_MSG_SIZE', value)
 
+    @property
+    def MAX_QUEUE_BYTES(self):
+        """Get the high watermark of the send queue of a remote in bytes.
+
+        Counts the bytes of header and data. A message is always queued if
+        the queue is empty. The default is 0: Not bounded. (uint32_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('MAX_QUEUE_BYTES')
+
+    @MAX_QUEUE_BYTES.setter
+    def MAX_QUEUE_BYTES(self, value):
+        """Set the high watermark of the send queue of a remote in bytes."""
+        self._setattr_ffi('MAX_QUEUE_BYTES', value)
+
+    @property
+    def MAX_QUEUE_MSGS(self):
+        """Get the high watermark of the send queue of a remote in messages.
+
+        Sending to a remote with a full queue raises
+        :py:class:`BlockingIOError`, see :py:meth:`ChirpBase.send`. Messages
+        waiting for their ACK are not queued. The default is 0: The queue is
+        not bounded. (uint32_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('MAX_QUEUE_MSGS')
+
+    @MAX_QUEUE_MSGS.setter
+    def MAX_QUEUE_MSGS(self, value):
+        """Set the high watermark of the send queue of a remote in messages."""
+        self._setattr_ffi('MAX_QUEUE_MSGS', value)
+
     @property
     def MAX_SLOTS(self):
         """Get the count of message-slots used.
 
         Allowed values are values between 1 and 32.  The default is 0: Use 16
-        slots of `SYNCHRONOUS` = `False` and 1 slot if `SYNCHRONOUS` = `True`.
-        (uint8_t)
+        slots of `SYNCHRONOUS` = `False` and `ACK_WINDOW` slots if
+        `SYNCHRONOUS` = `True`. With `SHARED_SLOTS` it is the maximum of slots
+        a connection uses, values up to 255 are allowed and the default 0
+        means the connection is only limited by its share if `SYNCHRONOUS` =
+        `False`. (uint8_t)
 
         :rtype: int
         """
@@ -363,6 +551,54 @@ class Config(object):
         """Set the count of message-slots used."""
         self._setattr_ffi('MAX_SLOTS', value)
 
+    @property
+    def MAX_TOTAL_QUEUE_BYTES(self):
+        """Get the high watermark of the send queues of all remotes in bytes.
+
+        The default is 0: Not bounded. (uint32_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('MAX_TOTAL_QUEUE_BYTES')
+
+    @MAX_TOTAL_QUEUE_BYTES.setter
+    def MAX_TOTAL_QUEUE_BYTES(self, value):
+        """Set the high watermark of the send queues in bytes."""
+        self._setattr_ffi('MAX_TOTAL_QUEUE_BYTES', value)
+
+    @property
+    def MAX_TOTAL_QUEUE_MSGS(self):
+        """Get the high watermark of the send queues of all remotes.
+
+        Counted in messages. The default is 0: Not bounded. (uint32_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('MAX_TOTAL_QUEUE_MSGS')
+
+    @MAX_TOTAL_QUEUE_MSGS.setter
+    def MAX_TOTAL_QUEUE_MSGS(self, value):
+        """Set the high watermark of the send queues of all remotes."""
+        self._setattr_ffi('MAX_TOTAL_QUEUE_MSGS', value)
+
+    @property
+    def MAX_WRITE_BATCH(self):
+        """Get the count of messages coalesced into a single write.
+
+        Queued messages to a remote are written together, the send-futures
+        finish in order once the write is done. Allowed values are values
+        between 1 and 16, 1 disables batching. The default is 0: Use 16.
+        (uint8_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('MAX_WRITE_BATCH')
+
+    @MAX_WRITE_BATCH.setter
+    def MAX_WRITE_BATCH(self, value):
+        """Set the count of messages coalesced into a single write."""
+        self._setattr_ffi('MAX_WRITE_BATCH', value)
+
     @property
     def PORT(self):
         """Get the Port for listening to connections. (uint16_t).
@@ -376,6 +612,39 @@ class Config(object):
         """Set the Port for listening to connections."""
         self._setattr_ffi('PORT', value)
 
+    @property
+    def QUEUE_LOW_WATER(self):
+        """Get the low watermark in percent of the high watermarks.
+
+        A full queue drains once it is at or below the low watermark. Must be
+        < 100, the default is 50. (uint8_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('QUEUE_LOW_WATER')
+
+    @QUEUE_LOW_WATER.setter
+    def QUEUE_LOW_WATER(self, value):
+        """Set the low watermark in percent of the high watermarks."""
+        self._setattr_ffi('QUEUE_LOW_WATER', value)
+
+    @property
+    def REUSE_PORT(self):
+        """Get if SO_REUSEPORT is set on the listening sockets.
+
+        Multiple chirp instances (or processes) can listen on the same port,
+        the kernel distributes incoming connections between them. Python
+        boolean expected. Defaults to False.
+
+        :rtype: bool
+        """
+        return self._getattr_ffi('REUSE_PORT')
+
+    @REUSE_PORT.setter
+    def REUSE_PORT(self, value):
+        """Set if SO_REUSEPORT is set on the listening sockets."""
+        self._setattr_ffi('REUSE_PORT', value)
+
     @property
     def REUSE_TIME(self):
         """Get the time until a connection gets garbage collected.
@@ -392,6 +661,41 @@ class Config(object):
         """Set the time until a connection gets garbage collected."""
         self._setattr_ffi('REUSE_TIME', value)
 
+    @property
+    def SHARED_SLOTS(self):
+        """Get the count of message-slots shared by all connections.
+
+        The default is 0: Every connection has its own `MAX_SLOTS` slots.
+        Otherwise slots are allocated when needed up to `SHARED_SLOTS` and the
+        connections that receive messages share them evenly. (uint32_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('SHARED_SLOTS')
+
+    @SHARED_SLOTS.setter
+    def SHARED_SLOTS(self, value):
+        """Set the count of message-slots shared by all connections."""
+        self._setattr_ffi('SHARED_SLOTS', value)
+
+    @property
+    def SLAB_HIGH_WATER(self):
+        """Get the maximum of bytes cached for reuse by the slab allocator.
+
+        Message buffers that do not fit into the slot are allocated from
+        power-of-two size classes. Freed buffers are kept for reuse until
+        `SLAB_HIGH_WATER` bytes are cached. The default is 0: Use 4MiB.
+        (uint32_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('SLAB_HIGH_WATER')
+
+    @SLAB_HIGH_WATER.setter
+    def SLAB_HIGH_WATER(self, value):
+        """Set the maximum of bytes cached for reuse by the slab allocator."""
+        self._setattr_ffi('SLAB_HIGH_WATER', value)
+
     @property
     def TIMEOUT(self):
         """Get send- and connect-timeout scaling in seconds.
@@ -408,6 +712,22 @@ class Config(object):
         """Set send- and connect-timeout scaling in seconds."""
         self._setattr_ffi('TIMEOUT', value)
 
+    @property
+    def TRACE_SIZE(self):
+        """Get the count of events the tracing ring holds.
+
+        See :py:meth:`ChirpBase.trace`. The default is 0: Tracing is
+        disabled. (uint32_t)
+
+        :rtype: int
+        """
+        return self._getattr_ffi('TRACE_SIZE')
+
+    @TRACE_SIZE.setter
+    def TRACE_SIZE(self, value):
+        """Set the count of events the tracing ring holds."""
+        self._setattr_ffi('TRACE_SIZE', value)
+
 
 @ffi.def_extern()
 def _release_cb(chirp_t, identity_t, serial):
@@ -417,6 +737,74 @@ def _release_cb(chirp_t, identity_t, serial):
     chirp._release_msg(identity, serial)
 
 
+# Maximum count of message structures kept for reuse
+_FREELIST_SIZE = 1024
+_freelist = deque()
+
+
+class _MessageStruct(object):
+    """A ch_message_t with a handle, reused once a message is sent.
+
+    While the message is sending, msg is the message using the handle.
+    """
+
+    __slots__ = ('msg_t', 'handle', 'msg')
+
+    def __init__(self):
+        self.msg_t = _new_nozero("ch_message_t*")
+        self.handle = ffi.new_handle(self)
+        self.msg = None
+
+
+def _get_struct():
+    """Get a message structure from the freelist or allocate one."""
+    try:
+        return _freelist.pop()
+    except IndexError:
+        return _MessageStruct()
+
+
+def _put_struct(struct):
+    """Return a message structure to the freelist."""
+    struct.msg = None
+    if len(_freelist) < _FREELIST_SIZE:
+        _freelist.append(struct)
+
+
+class _Multicast(object):
+    """A ch_multicast_t with a handle, alive until the multicast is sent.
+
+    The buffers are the header and data shared by the destinations.
+    """
+
+    __slots__ = ('mc_t', 'handle', 'fut', 'buffers')
+
+    def __init__(self):
+        self.mc_t = ffi.new("ch_multicast_t*")
+        self.handle = ffi.new_handle(self)
+        self.fut = Future()
+        self.buffers = None
+
+
+@lru_cache(maxsize=256)
+def _pack_address(addr):
+    """Return the protocol and the packed address of an ip_address."""
+    if isinstance(addr, IPv6Address):
+        return socket.AF_INET6, addr.packed
+    return socket.AF_INET, addr.packed
+
+
+# Replaces the zero-copy views of a message once its slot is released
+_released_view = object()
+
+
+def _check_view(value):
+    """Raise if value is a zero-copy view released with its slot."""
+    if value is _released_view:
+        raise RuntimeError("Zero-copy data accessed after release_slot()")
+    return value
+
+
 class MessageBase(object):
     """Chirp message. To answer to message just replace the data and send it.
 
@@ -437,41 +825,61 @@ class MessageBase(object):
         '_data',
         '_address',
         '_port',
+        '_priority',
         '_remote_identity',
+        '_views',
+        '_struct',
         '_fut',
         '_chirp',
     )
 
-    def __init__(self, cmsg=None):
+    def __init__(self, cmsg=None, zero_copy=False):
         self._msg_t = cmsg
-        self._copy_from_c()
+        self._struct = None
+        self._kheader = None
+        self._kdata = None
+        self._views = None
+        self._copy_from_c(bool(cmsg) and zero_copy)
         self._fut = None
         self._chirp = None
-        if cmsg:
+        if cmsg and not zero_copy:
             lib.ch_msg_free_data(self._msg_t)
 
     def _ensure_message(self):
         """Ensure that a message exists."""
         msg = self._msg_t
         if not msg:
-            msg = _new_nozero("ch_message_t*")
+            struct = _get_struct()
+            msg = struct.msg_t
             lib.ch_msg_init(msg)
             self._msg_t = msg
+            self._struct = struct
         return msg
 
-    def _copy_from_c(self):
-        """Copy messsage from C structure."""
+    def _copy_from_c(self, zero_copy=False):
+        """Copy messsage from C structure.
+
+        If zero_copy is True, header and data are memoryviews of the slot.
+        """
         msg = self._ensure_message()
         self._identity = ffi.buffer(msg.identity)[:]
         self._serial = msg.serial
-        self._header = ffi.buffer(msg.header, msg.header_len)[:]
-        self._data = ffi.buffer(msg.data, msg.data_len)[:]
+        header = ffi.buffer(msg.header, msg.header_len)
+        data = ffi.buffer(msg.data, msg.data_len)
+        if zero_copy:
+            self._header = memoryview(header)
+            self._data = memoryview(data)
+            self._views = (self._header, self._data)
+        else:
+            self._header = header[:]
+            self._data = data[:]
         if msg.ip_protocol == socket.AF_INET6:
             abuf = ffi.buffer(msg.address, lib.CH_IP_ADDR_SIZE)[:]
         else:
             abuf = ffi.buffer(msg.address, lib.CH_IP4_ADDR_SIZE)[:]
         self._address = ip_address(abuf)
         self._port = msg.port
+        self._priority = msg.priority
         self._remote_identity = ffi.buffer(msg.remote_identity)[:]
 
     def _copy_to_c(self):
@@ -480,30 +888,45 @@ class MessageBase(object):
         msg.identity = self._identity
         header_len = len(self.header)
         msg.header_len = header_len
+        _check_view(self._data)
         if header_len:
-            header = ffi.from_buffer(self._header)
-            msg.header = header
-            # Buffers must be kept alive
-            self._kheader = header
+            # Buffers must be kept alive, they are reused for the same header
+            kheader = self._kheader
+            if kheader is None or kheader[0] is not self._header:
+                kheader = (self._header, ffi.from_buffer(self._header))
+                self._kheader = kheader
+            msg.header = kheader[1]
         else:
             msg.header = ffi.NULL
-        data_len = len(self.data)
-        msg.data_len = data_len
-        if data_len:
-            data = ffi.from_buffer(self._data)
-            msg.data = data
-            # Buffers must be kept alive
-            self._kdata = data
-        else:
-            msg.data = ffi.NULL
-        addr = self._address
-        if isinstance(addr, IPv6Address):
-            msg.ip_protocol = socket.AF_INET6
-            msg.address = addr.packed
+        if isinstance(self._data, list):
+            self._copy_iov_to_c(msg)
         else:
-            msg.ip_protocol = socket.AF_INET
-            msg.address = addr.packed
+            data_len = len(self._data)
+            if data_len:
+                # Buffers must be kept alive, they are reused for the same data
+                kdata = self._kdata
+                if kdata is None or kdata[0] is not self._data:
+                    kdata = (self._data, ffi.from_buffer(self._data))
+                    self._kdata = kdata
+                lib.ch_msg_set_data(msg, kdata[1], data_len)
+            else:
+                lib.ch_msg_set_data(msg, ffi.NULL, 0)
+        msg.ip_protocol, msg.address = _pack_address(self._address)
         msg.port = self._port
+        msg.priority = self._priority
+
+    def _copy_iov_to_c(self, msg):
+        """Point the C structure to the parts of the data."""
+        parts = [ffi.from_buffer(part) for part in self._data]
+        bufs = ffi.new("uv_buf_t[]", len(parts))
+        for buf, part in zip(bufs, parts):
+            buf.base = part
+            buf.len = len(part)
+        res = lib.ch_msg_set_data_iov(msg, bufs, len(parts))
+        if res != lib.CH_SUCCESS:
+            raise chirp_error_to_exception(res, "Invalid data parts")
+        # Buffers must be kept alive
+        self._kdata = (bufs, parts)
 
     @property
     def identity(self):
@@ -537,9 +960,12 @@ class MessageBase(object):
 
         Users should not use it, except if you know what you are doing.
 
-        :rtype: bytes
+        A memoryview if the message was received by a zero-copy chirp, see
+        :py:attr:`ChirpBase.zero_copy`.
+
+        :rtype: bytes or memoryview
         """
-        return self._header
+        return _check_view(self._header)
 
     @header.setter
     def header(self, value):
@@ -554,18 +980,34 @@ class MessageBase(object):
     def data(self):
         """Get the data of the message.
 
-        :rtype: bytes
+        A memoryview if the message was received by a zero-copy chirp, see
+        :py:attr:`ChirpBase.zero_copy`.
+
+        :rtype: bytes or memoryview
         """
-        return self._data
+        data = _check_view(self._data)
+        if isinstance(data, list):
+            return b''.join(data)
+        return data
 
     @data.setter
     def data(self, value):
         """Set the data of the message.
 
-        :param bytes value: The value
+        A list of bytes-like objects (bytes, bytearray, memoryview) is sent
+        without joining the parts, the list may contain up to
+        CH_MSG_MAX_IOV parts. The parts must not change until the message is
+        sent.
+
+        :param value: The value
+        :type value: bytes or list
         """
-        assert isinstance(value, bytes)
-        self._data = value
+        if isinstance(value, list):
+            assert len(value) <= lib.CH_MSG_MAX_IOV
+            self._data = list(value)
+        else:
+            assert isinstance(value, bytes)
+            self._data = value
 
     @property
     def address(self):
@@ -617,6 +1059,26 @@ class MessageBase(object):
         assert value >= 0 and value <= 2**16
         self._port = value
 
+    @property
+    def priority(self):
+        """Get the priority of the message. (uint8_t).
+
+        Messages with a higher priority are sent first to the remote. Only
+        used when sending, received messages have the priority 0.
+
+        :rtype: int
+        """
+        return self._priority
+
+    @priority.setter
+    def priority(self, value):
+        """Set the priority, less than CH_MSG_PRIORITIES.
+
+        :param int value: The value
+        """
+        assert value >= 0 and value < lib.CH_MSG_PRIORITIES
+        self._priority = value
+
     @property
     def remote_identity(self):
         """Detect the remote instance. (uint8_t[16]).
@@ -642,6 +1104,21 @@ class MessageBase(object):
         msg = self._ensure_message()
         return lib.ch_msg_has_slot(msg) != 0
 
+    def _release_views(self):
+        """Release the zero-copy views before the slot is released.
+
+        Raises BufferError if a view is still exported, the slot is kept.
+        """
+        views = self._views
+        if views:
+            for view in views:
+                view.release()
+            self._views = None
+            if self._header is views[0]:
+                self._header = _released_view
+            if self._data is views[1]:
+                self._data = _released_view
+
 
 class MessageThread(MessageBase):
     """Chirp message. To answer to message just replace the data and send it.
@@ -670,11 +1147,26 @@ class MessageThread(MessageBase):
 
         :rtype: Future
         """
+        fut, msg_t = self._prepare_release()
+        if msg_t:
+            lib.ch_chirp_release_msg_slot_ts(
+                self._chirp._chirp_t, msg_t, lib._release_cb
+            )
+        return fut
+
+    release = release_slot
+
+    def _prepare_release(self):
+        """Detach the slot and get the future of the release.
+
+        Returns (future, msg_t), msg_t is None if the message had no slot.
+        """
         chirp = self._chirp
         doit = False
         if chirp:
             with chirp._lock:
                 if self.has_slot:
+                    self._release_views()
                     msg_t = self._msg_t
                     self._msg_t = None
                     fut = chirp._release_msgs[(self.identity, self.serial)][0]
@@ -684,15 +1176,10 @@ class MessageThread(MessageBase):
                 raise RuntimeError(
                     "Message still sending, please wait for the send() result"
                 )
-            lib.ch_chirp_release_msg_slot_ts(
-                chirp._chirp_t, msg_t, lib._release_cb
-            )
-            return fut
+            return fut, msg_t
         fut = Future()
         fut.set_result(None)
-        return fut
-
-    release = release_slot
+        return fut, None
 
 
 @ffi.def_extern()
@@ -903,24 +1390,78 @@ def _chirp_log_cb(msg, error):
 @ffi.def_extern()
 def _chirp_done_cb(chirp_t):
     """libchirp.c calls this when the chirp-instance is done."""
-    ffi.from_handle(chirp_t.user_data)._done.set_result(0)
+    chirp = ffi.from_handle(chirp_t.user_data)
+    with chirp._lock:
+        drained = list(chirp._drained.values())
+        chirp._drained.clear()
+    for fut in drained:
+        fut.set_result(None)
+    chirp._done.set_result(0)
 
 
 @ffi.def_extern()
 def _send_cb(chirp_t, msg_t, status):
     """libchirp.c calls this when a message is sent."""
     chirp = ffi.from_handle(chirp_t.user_data)
-    msg = ffi.from_handle(msg_t.user_data)
+    struct = ffi.from_handle(msg_t.user_data)
+    msg = struct.msg
+    if status == lib.CH_FULL:
+        if lib.ch_chirp_full_is_total(chirp_t):
+            # The drain callback is called with address NULL
+            key = None
+        else:
+            key = (
+                msg_t.ip_protocol, ffi.buffer(msg_t.address)[:], msg_t.port
+            )
     with chirp._lock:
         del chirp._await_msgs[msg]
         fut = msg._fut
         msg._fut = None
+        if msg._struct is struct:
+            # The next send of the message takes a structure from the freelist
+            msg._msg_t = None
+            msg._struct = None
+    _put_struct(struct)
     if status == lib.CH_SUCCESS:
         fut.set_result(msg)
     else:
-        fut.set_exception(
-            chirp_error_to_exception(status, _last_error.data)
-        )
+        excp = chirp_error_to_exception(status, _last_error.data)
+        if status == lib.CH_FULL:
+            with chirp._lock:
+                excp.drained = chirp._drained.setdefault(key, Future())
+        fut.set_exception(excp)
+
+
+@ffi.def_extern()
+def _drain_cb(chirp_t, ip_protocol, address, port):
+    """libchirp.c calls this when a full send queue drained."""
+    chirp = ffi.from_handle(chirp_t.user_data)
+    if address == ffi.NULL:
+        # The queue of all remotes drained
+        key = None
+    else:
+        address = ffi.buffer(address, lib.CH_IP_ADDR_SIZE)[:]
+        key = (ip_protocol, address, port)
+    with chirp._lock:
+        fut = chirp._drained.pop(key, None)
+    if fut is not None:
+        fut.set_result(None)
+
+
+@ffi.def_extern()
+def _multicast_cb(chirp_t, mc_t):
+    """libchirp.c calls this when a multicast is sent to all destinations."""
+    chirp = ffi.from_handle(chirp_t.user_data)
+    mc = ffi.from_handle(mc_t.user_data)
+    with chirp._lock:
+        chirp._multicasts.remove(mc)
+    results = [
+        None if status == lib.CH_SUCCESS else
+        chirp_error_to_exception(status, _last_error.data)
+        for status in mc_t.status[0:mc_t.count]
+    ]
+    lib.ch_mc_free(mc_t)
+    mc.fut.set_result(results)
 
 
 def chirp_error_to_exception(error, msg):
@@ -947,6 +1488,8 @@ def chirp_error_to_exception(error, msg):
         excp = TimeoutError(msg or "CH_TIMEOUT")
     elif error == lib.CH_ENOMEM:
         excp = MemoryError()
+    elif error == lib.CH_FULL:
+        excp = BlockingIOError(msg or "CH_FULL")
     else:
         excp = Exception(msg or "Unknown error: %d" % error)
     excp.ecode = error
@@ -978,13 +1521,16 @@ class ChirpBase(object):
     :param Loop     loop: libuv event-loop
     :param Config config: chirp config
     :param          recv: Recv callback
+    :param    recv_batch: Recv callback with the messages of a loop iteration
     """
 
-    def __init__(self, loop, config, recv=None):
+    def __init__(self, loop, config, recv=None, recv_batch=None):
         assert isinstance(loop, Loop)
         assert isinstance(config, Config)
         config.__dict__['_sealed'] = True
         self._await_msgs   = dict()
+        self._drained      = dict()
+        self._multicasts   = set()
         self._release_msgs = dict()
         self._requests     = dict()
         self._timeouts     = dict()
@@ -993,11 +1539,13 @@ class ChirpBase(object):
         self._loop         = loop
         self._config       = config
         self._auto_release = config.AUTO_RELEASE
+        self._zero_copy    = False
         self._stopped      = False
         if not recv:
             self._recv     = ffi.NULL
         else:
             self._recv     = recv
+        self._recv_batch   = recv_batch
         self._chirp_t      = _new_nozero("ch_chirp_t*")
         fut = Future()
         loop.call_soon(ChirpBase._chirp_init, self, fut)
@@ -1028,6 +1576,9 @@ class ChirpBase(object):
             self._data     = data
             chirp.user_data = data
         if res == 0:
+            lib.ch_chirp_set_drain_callback(chirp, lib._drain_cb)
+            if self._recv_batch:
+                lib.ch_chirp_set_recv_batch_callback(chirp, self._recv_batch)
             fut.set_result(0)
         else:
             fut.set_result(chirp_error_to_exception(
@@ -1040,13 +1591,33 @@ class ChirpBase(object):
         with self._lock:
             self._release_msgs[(msg.identity, msg.serial)] = (fut, msg)
 
+    def _register_batch(self, message_type, msgs_t, count):
+        """Register received messages and return those not answering requests.
+
+        The lock is only taken once for all messages.
+        """
+        msgs = [
+            message_type(msgs_t[i], self._zero_copy) for i in range(count)
+        ]
+        with self._lock:
+            for msg in msgs:
+                key = (msg.identity, msg.serial)
+                self._release_msgs[key] = (Future(), msg)
+        res = []
+        for msg in msgs:
+            msg._chirp = self
+            if not self._check_request(msg):
+                res.append(msg)
+        return res
+
     def _release_msg(self, identity, serial):
         """Call future of a released message."""
         key = (identity, serial)
         with self._lock:
-            fut = self._release_msgs[key][0]
-            del self._release_msgs[key]
-        fut.set_result(key)
+            fut, _ = self._release_msgs.pop(key, (None, None))
+        # The release of a failed batch is not awaited anymore
+        if fut is not None:
+            fut.set_result(key)
 
     @property
     def loop(self):
@@ -1056,6 +1627,33 @@ class ChirpBase(object):
         """
         return self._loop
 
+    @property
+    def zero_copy(self):
+        """Get if received messages are zero-copy.
+
+        By default the header and data of received messages are copied to
+        bytes. If zero_copy is True :py:attr:`MessageBase.header` and
+        :py:attr:`MessageBase.data` are memoryviews of the message-slot. They
+        are valid until :py:meth:`MessageThread.release_slot`, afterwards
+        accessing them raises a :py:class:`RuntimeError`. Do not use slices of
+        the views after the release. Releasing while a view is exported (for
+        example to numpy) raises :py:class:`BufferError` and keeps the slot.
+
+        The slot is released before the message is returned by
+        :py:meth:`libchirp.queue.Chirp.get` or the result of
+        :py:meth:`request`, when auto-release is enabled. Disable
+        :py:attr:`Config.AUTO_RELEASE` and use request(msg, False) to access
+        the data.
+
+        :rtype: bool
+        """
+        return self._zero_copy
+
+    @zero_copy.setter
+    def zero_copy(self, value):
+        """Set if received messages are zero-copy."""
+        self._zero_copy = value
+
     def stop(self):
         """Stop the chirp-instance."""
         with self._lock:
@@ -1090,6 +1688,36 @@ class ChirpBase(object):
                 self._data = None
                 self._loop = None
 
+    def connect(self, address, port, pin=False):
+        """Connect to a remote ahead of time. This method returns a Future.
+
+        The first message to the remote does not wait for the connect and the
+        TLS handshake. The future finishes once the connection has been
+        established, it can raise the same exceptions as :py:meth:`send`.
+
+        If `pin` is True the remote is pinned: Its connection is not closed
+        after :py:attr:`Config.REUSE_TIME`, instead it is kept alive and
+        reconnected if lost. If `pin` is False the remote is unpinned.
+
+        :param str address: IPv4 or IPv6 address of the remote
+        :param int port: Port of the remote
+        :param bool pin: Pin the remote (default False)
+        :rtype: concurrent.futures.Future
+        """
+        msg = MessageThread()
+        msg.address = address
+        msg.port = port
+        fut, msg_t = self._prepare_send(msg)
+        _last_error.data = ""
+        res = lib.ch_chirp_connect_ts(
+            self._chirp_t, msg_t, bool(pin), lib._send_cb
+        )
+        if res != lib.CH_SUCCESS:
+            self._abort_send(
+                [msg], chirp_error_to_exception(res, _last_error.data)
+            )
+        return fut
+
     def send(self, msg):
         """Send a message. This method returns a Future.
 
@@ -1105,6 +1733,13 @@ class ChirpBase(object):
         contains the last error message if any generated by chirp. Also
         :py:class:`Exception` for unknown errors. See :ref:`exceptions`.
 
+        If the send queue is full (see :py:attr:`Config.MAX_QUEUE_MSGS`)
+        :py:class:`BlockingIOError` is raised and the message is not sent.
+        Its attribute `drained` is a Future, which finishes once the full
+        queue, the one of the remote or the one of all remotes (see
+        :py:attr:`Config.MAX_TOTAL_QUEUE_MSGS`), drained below
+        :py:attr:`Config.QUEUE_LOW_WATER`. Then the message can be sent again.
+
         See also :ref:`concurrency`.
 
         Sending different messages from different threads is thread-safe.
@@ -1115,6 +1750,111 @@ class ChirpBase(object):
         :param MessageThread msg: The message to send.
         :rtype: concurrent.futures.Future
         """
+        fut, msg_t = self._prepare_send(msg)
+        _last_error.data = ""
+        lib.ch_chirp_send_ts(self._chirp_t, msg_t, lib._send_cb)
+        return fut
+
+    def send_many(self, msgs):
+        """Send multiple messages. This method returns a list of Futures.
+
+        Behaves like calling :py:meth:`send` for each message, but the messages
+        are passed to the event-loop at once. This saves a lot of overhead when
+        sending many small messages.
+
+        :param list msgs: The messages (:py:class:`MessageThread`) to send.
+        :rtype: list
+        """
+        futs = []
+        msgs_t = []
+        prepared = []
+        try:
+            for msg in msgs:
+                fut, msg_t = self._prepare_send(msg)
+                prepared.append(msg)
+                futs.append(fut)
+                msgs_t.append(msg_t)
+        except Exception as e:
+            self._abort_send(prepared, e)
+            raise
+        if msgs_t:
+            _last_error.data = ""
+            res = lib.ch_chirp_send_batch_ts(
+                self._chirp_t,
+                ffi.new("ch_message_t*[]", msgs_t),
+                len(msgs_t),
+                lib._send_cb
+            )
+            if res != lib.CH_SUCCESS:
+                self._abort_send(
+                    prepared, chirp_error_to_exception(res, _last_error.data)
+                )
+        return futs
+
+    def multicast(self, msg, destinations):
+        """Send a message to many remotes. This method returns a Future.
+
+        The header and data of the message are shared by all destinations, so
+        the payload is not copied per remote. The address and port of the
+        message are ignored. Data parts (a list) are joined once.
+
+        The result is a list with an entry per destination, in the order of
+        `destinations`: None if the message has been sent or the exception
+        :py:meth:`send` would raise.
+
+        :param MessageThread msg: The message to send.
+        :param list destinations: (address, port) tuples of the remotes. The
+                                  address is parsed by
+                                  :py:class:`ipaddress.ip_address`.
+        :rtype: concurrent.futures.Future
+        """
+        assert isinstance(msg, MessageThread)
+        mc = _Multicast()
+        if not destinations:
+            mc.fut.set_result([])
+            return mc.fut
+        mc_t = mc.mc_t
+        res = lib.ch_mc_init(mc_t, len(destinations))
+        if res != lib.CH_SUCCESS:
+            raise chirp_error_to_exception(res, "Could not init multicast")
+        try:
+            for i, (address, port) in enumerate(destinations):
+                msg_t = lib.ch_mc_get_message(mc_t, i)
+                msg_t.ip_protocol, msg_t.address = _pack_address(
+                    ip_address(address)
+                )
+                msg_t.port = port
+                msg_t.priority = msg._priority
+        except Exception:
+            lib.ch_mc_free(mc_t)
+            raise
+        header = _check_view(msg._header)
+        data = _check_view(msg._data)
+        if isinstance(data, list):
+            data = b"".join(data)
+        header_c = ffi.from_buffer(header) if header else ffi.NULL
+        data_c = ffi.from_buffer(data) if data else ffi.NULL
+        # Buffers must be kept alive until the multicast is sent
+        mc.buffers = (header_c, data_c)
+        mc_t.header = header_c
+        mc_t.header_len = len(header)
+        lib.ch_mc_set_data(mc_t, data_c, len(data))
+        mc_t.user_data = mc.handle
+        with self._lock:
+            self._multicasts.add(mc)
+        _last_error.data = ""
+        res = lib.ch_chirp_multicast_ts(self._chirp_t, mc_t, lib._multicast_cb)
+        if res != lib.CH_SUCCESS:
+            with self._lock:
+                self._multicasts.remove(mc)
+            lib.ch_mc_free(mc_t)
+            mc.fut.set_exception(
+                chirp_error_to_exception(res, _last_error.data)
+            )
+        return mc.fut
+
+    def _prepare_send(self, msg):
+        """Register the message for sending and prepare the C message."""
         assert isinstance(msg, MessageThread)
         fut = Future()
         with self._lock:
@@ -1125,14 +1865,67 @@ class ChirpBase(object):
             msg._ensure_message()
             msg._fut = fut
             msg_t = msg._msg_t
-            handle = ffi.new_handle(msg)
-            msg_t.user_data = handle
+            struct = msg._struct
+            if struct is None:
+                # Received message: Only the handle of the structure is used
+                struct = _get_struct()
+            struct.msg = msg
+            msg_t.user_data = struct.handle
             # msg/handle must be kept alive
-            self._await_msgs[msg] = handle
-        _last_error.data = ""
+            self._await_msgs[msg] = struct
         msg._copy_to_c()
-        lib.ch_chirp_send_ts(self._chirp_t, msg_t, lib._send_cb)
-        return fut
+        return fut, msg_t
+
+    def _abort_send(self, msgs, excp):
+        """Unregister messages chirp did not accept and fail their futures."""
+        for msg in msgs:
+            with self._lock:
+                struct = self._await_msgs.pop(msg)
+                fut = msg._fut
+                msg._fut = None
+                if msg._struct is struct:
+                    msg._msg_t = None
+                    msg._struct = None
+            _put_struct(struct)
+            fut.set_exception(excp)
+
+    def release_many(self, msgs):
+        """Release the message-slots of multiple messages.
+
+        This method returns a list of Futures. Behaves like calling
+        :py:meth:`MessageThread.release_slot` for each message, but the
+        messages are passed to the event-loop at once.
+
+        The messages have to be received by this chirp-instance.
+
+        :param list msgs: The messages (:py:class:`MessageThread`) to release.
+        :rtype: list
+        """
+        futs = []
+        msgs_t = []
+        keys = []
+        for msg in msgs:
+            fut, msg_t = msg._prepare_release()
+            futs.append(fut)
+            if msg_t:
+                assert msg._chirp is self
+                msgs_t.append(msg_t)
+                keys.append((msg.identity, msg.serial))
+        if msgs_t:
+            _last_error.data = ""
+            res = lib.ch_chirp_release_batch_ts(
+                self._chirp_t,
+                ffi.new("ch_message_t*[]", msgs_t),
+                len(msgs_t),
+                lib._release_cb
+            )
+            if res != lib.CH_SUCCESS:
+                excp = chirp_error_to_exception(res, _last_error.data)
+                with self._lock:
+                    rel_futs = [self._release_msgs.pop(key)[0] for key in keys]
+                for fut in rel_futs:
+                    fut.set_exception(excp)
+        return futs
 
     def request(self, msg, auto_release=True):
         """Send a message and wait for an answer.
@@ -1193,3 +1986,81 @@ class ChirpBase(object):
         return ffi.buffer(
             lib.ch_chirp_get_identity(self._chirp_t).data
         )[:]
+
+    def stats(self):
+        """Get the runtime statistics of chirp.
+
+        The statistics are collected in the event-loop. The dict contains the
+        fields of :c:type:`ch_stats_t`, the latency histograms as lists and
+        ``remotes``, a list with a dict per remote. Bucket 0 of a histogram
+        counts latencies below 1us, bucket n counts latencies from 2^(n-1)us
+        up to 2^n us.
+
+        :rtype: dict
+        """
+        fut = Future()
+        self._loop.call_soon(ChirpBase._stats, self, fut)
+        return fut.result()
+
+    def _stats(self, fut):
+        try:
+            stats_t = ffi.new("ch_stats_t*")
+            lib.ch_chirp_get_stats(self._chirp_t, stats_t)
+            count = stats_t.remotes
+            remotes_t = ffi.new("ch_remote_stats_t[]", max(count, 1))
+            count = lib.ch_chirp_get_remote_stats(
+                self._chirp_t, remotes_t, count
+            )
+            stats = _struct_to_dict(stats_t[0])
+            remotes = []
+            for remote_t in remotes_t[0:count]:
+                remote = _struct_to_dict(remote_t)
+                if remote_t.ip_protocol == socket.AF_INET6:
+                    abuf = ffi.buffer(remote_t.address, lib.CH_IP_ADDR_SIZE)
+                else:
+                    abuf = ffi.buffer(remote_t.address, lib.CH_IP4_ADDR_SIZE)
+                remote['address'] = ip_address(abuf[:]).compressed
+                del remote['ip_protocol']
+                remotes.append(remote)
+            stats['remotes'] = remotes
+            fut.set_result(stats)
+        except Exception as e:
+            fut.set_exception(e)
+
+    def trace(self):
+        """Get the events of the tracing ring, the oldest first.
+
+        Each event is a dict with the fields of :c:type:`ch_trace_event_t`,
+        the time is in nanoseconds. The list is empty if
+        :py:attr:`Config.TRACE_SIZE` is 0.
+
+        :rtype: list
+        """
+        fut = Future()
+        self._loop.call_soon(ChirpBase._trace, self, fut)
+        return fut.result()
+
+    def _trace(self, fut):
+        try:
+            size = max(self._config.TRACE_SIZE, 1)
+            events_t = ffi.new("ch_trace_event_t[]", size)
+            count = lib.ch_chirp_get_trace(self._chirp_t, events_t, size)
+            events = []
+            for event_t in events_t[0:count]:
+                event = _struct_to_dict(event_t)
+                event['identity'] = ffi.buffer(event_t.identity)[:]
+                events.append(event)
+            fut.set_result(events)
+        except Exception as e:
+            fut.set_exception(e)
+
+
+def _struct_to_dict(cdata):
+    """Convert a C structure of integers and arrays to a dict."""
+    res = dict()
+    for name, _ in ffi.typeof(cdata).fields:
+        value = getattr(cdata, name)
+        if isinstance(value, ffi.CData):
+            value = list(value)
+        res[name] = value
+    return res
@@ -78,7 +78,7 @@ async def _async_handler(chirp, msg):
 def _async_recv_cb(chirp_t, msg_t):
     """libchirp.c calls this when a message has arrived."""
     chirp = ffi.from_handle(chirp_t.user_data)
-    msg = Message(msg_t)
+    msg = Message(msg_t, chirp._zero_copy)
     chirp._register_msg(msg)
     msg._chirp = chirp
     if not chirp._check_request(msg):
@@ -87,6 +87,36 @@ def _async_recv_cb(chirp_t, msg_t):
         )
 
 
+@ffi.def_extern()
+def _async_recv_batch_cb(chirp_t, msgs_t, count):
+    """libchirp.c calls this with the messages of a loop iteration."""
+    chirp = ffi.from_handle(chirp_t.user_data)
+    msgs = chirp._register_batch(Message, msgs_t, count)
+    if msgs:
+        chirp._asyncio_loop.call_soon_threadsafe(chirp._dispatch_batch, msgs)
+
+
+class _Batches(object):
+    """Async iterator over the batches of received messages."""
+
+    def __init__(self, chirp):
+        self._chirp = chirp
+        self._last = None
+
+    def __aiter__(self):
+        """Return the iterator."""
+        return self
+
+    async def __anext__(self):
+        """Release the last batch if AUTO_RELEASE=1 and wait for the next."""
+        chirp = self._chirp
+        last, self._last = self._last, None
+        if last and chirp._auto_release:
+            ChirpBase.release_many(chirp, last)
+        self._last = await chirp._batches.get()
+        return self._last
+
+
 class Chirp(ChirpBase):
     """Runs chirp in a :py:mod:`asyncio` environment.
 
@@ -109,7 +139,72 @@ class Chirp(ChirpBase):
     def __init__(self, loop, config, asyncio_loop):
         assert isinstance(asyncio_loop, asyncio.AbstractEventLoop)
         self._asyncio_loop = asyncio_loop
-        ChirpBase.__init__(self, loop, config, lib._async_recv_cb)
+        self._batches = None
+        ChirpBase.__init__(
+            self, loop, config, lib._async_recv_cb, lib._async_recv_batch_cb
+        )
+
+    def _dispatch_batch(self, msgs):
+        """Pass received messages to :py:meth:`batches` or the handler."""
+        if self._batches is not None:
+            self._batches.put_nowait(msgs)
+        else:
+            for msg in msgs:
+                self._asyncio_loop.create_task(_async_handler(self, msg))
+
+    def batches(self):
+        """Iterate over the received messages in batches.
+
+        Returns an async iterator, each item is a list of the messages received
+        in one iteration of the libuv event-loop. Once batches() is called
+        :py:meth:`handler` is not called anymore. If
+        :py:attr:`libchirp.Config.AUTO_RELEASE` is enabled, the messages of a
+        batch are released when the next batch is requested.
+
+        .. code-block:: python
+
+            async for batch in chirp.batches():
+                for msg in batch:
+                    print(msg.data)
+
+        May only be used from asyncio-event-loop-thread.
+
+        :rtype: async iterator
+        """
+        if self._batches is None:
+            self._batches = asyncio.Queue()
+        return _Batches(self)
+
+    def connect(self, address, port, pin=False):
+        """Connect to a remote ahead of time. This method is await-able.
+
+        Behaves like :py:meth:`libchirp.ChirpBase.connect`.
+
+        May only be used from asyncio-event-loop-thread.
+
+        :param str address: IPv4 or IPv6 address of the remote
+        :param int port: Port of the remote
+        :param bool pin: Pin the remote (default False)
+        :rtype: asyncio.Future
+        """
+        return asyncio.wrap_future(
+            ChirpBase.connect(self, address, port, pin)
+        )
+
+    def multicast(self, msg, destinations):
+        """Send a message to many remotes. This method is await-able.
+
+        Behaves like :py:meth:`libchirp.ChirpBase.multicast`.
+
+        May only be used from asyncio-event-loop-thread.
+
+        :param Message msg: The message to send.
+        :param list destinations: (address, port) tuples of the remotes
+        :rtype: asyncio.Future
+        """
+        return asyncio.wrap_future(
+            ChirpBase.multicast(self, msg, destinations)
+        )
 
     def send(self, msg):
         """Send a message. This method is await-able.
@@ -136,6 +231,57 @@ class Chirp(ChirpBase):
         """
         return asyncio.wrap_future(ChirpBase.send(self, msg))
 
+    async def send_wait(self, msg):
+        """Send a message, waiting for capacity. This method is await-able.
+
+        Behaves like :py:meth:`send`, but if the send queue is full (see
+        :py:attr:`libchirp.Config.MAX_QUEUE_MSGS`) it waits until the queue
+        drained and sends the message again.
+
+        May only be used from asyncio-event-loop-thread.
+
+        :param libchirp.asyncio.Message msg: The message to send.
+        :rtype: libchirp.asyncio.Message
+        """
+        while True:
+            try:
+                return await self.send(msg)
+            except BlockingIOError as e:
+                await asyncio.wrap_future(e.drained)
+
+    def send_many(self, msgs):
+        """Send multiple messages. Returns a list of await-able Futures.
+
+        Behaves like calling :py:meth:`send` for each message, but the
+        messages are passed to the libuv event-loop at once.
+
+        May only be used from asyncio-event-loop-thread.
+
+        :param list msgs: The messages (:py:class:`libchirp.asyncio.Message`)
+                          to send.
+        :rtype: list
+        """
+        return [
+            asyncio.wrap_future(fut)
+            for fut in ChirpBase.send_many(self, msgs)
+        ]
+
+    def release_many(self, msgs):
+        """Release the message-slots of multiple messages.
+
+        Returns a list of await-able Futures. Behaves like calling
+        :py:meth:`libchirp.asyncio.Message.release_slot` for each message, but
+        the messages are passed to the libuv event-loop at once.
+
+        :param list msgs: The messages (:py:class:`libchirp.asyncio.Message`)
+                          to release.
+        :rtype: list
+        """
+        return [
+            asyncio.wrap_future(fut)
+            for fut in ChirpBase.release_many(self, msgs)
+        ]
+
     def request(self, msg, auto_release=True):
         """Send a message and wait for an answer.
 
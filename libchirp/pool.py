@@ -43,7 +43,7 @@ def _loop_handler(chirp, msg):
 def _pool_recv_cb(chirp_t, msg_t):
     """libchirp.c calls this when a message has arrived."""
     chirp = ffi.from_handle(chirp_t.user_data)
-    msg = Message(msg_t)
+    msg = Message(msg_t, chirp._zero_copy)
     chirp._register_msg(msg)
     msg._chirp = chirp
     if not chirp._check_request(msg):
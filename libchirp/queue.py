@@ -26,7 +26,7 @@ class Message(MessageThread):  # noqa
 def _queue_recv_cb(chirp_t, msg_t):
     """libchirp.c calls this when a message has arrived."""
     chirp = ffi.from_handle(chirp_t.user_data)
-    msg = Message(msg_t)
+    msg = Message(msg_t, chirp._zero_copy)
     chirp._register_msg(msg)
     msg._chirp = chirp
     if not chirp._check_request(msg):
@@ -36,6 +36,19 @@ def _queue_recv_cb(chirp_t, msg_t):
             chirp.put(msg)
 
 
+@ffi.def_extern()
+def _queue_recv_batch_cb(chirp_t, msgs_t, count):
+    """libchirp.c calls this with the messages of a loop iteration."""
+    chirp = ffi.from_handle(chirp_t.user_data)
+    msgs = chirp._register_batch(Message, msgs_t, count)
+    if not msgs:
+        return
+    if chirp._disable_queue:
+        chirp.release_many(msgs)
+    else:
+        chirp._put_batch(msgs)
+
+
 class Chirp(ChirpBase, Queue):
     """Implements the :py:class:`queue.Queue`-based interface.
 
@@ -52,7 +65,16 @@ class Chirp(ChirpBase, Queue):
     def __init__(self, loop, config):
         self._disable_queue = False
         Queue.__init__(self)
-        ChirpBase.__init__(self, loop, config, lib._queue_recv_cb)
+        ChirpBase.__init__(
+            self, loop, config, lib._queue_recv_cb, lib._queue_recv_batch_cb
+        )
+
+    def _put_batch(self, msgs):
+        """Put the messages into the queue, waking up the consumers once."""
+        with self.not_empty:
+            self.queue.extend(msgs)
+            self.unfinished_tasks += len(msgs)
+            self.not_empty.notify(len(msgs))
 
     @property
     def disable_queue(self):
@@ -83,6 +105,21 @@ class Chirp(ChirpBase, Queue):
             msg.release()
         return msg
 
+    def get_batch(self, block=True, timeout=None):
+        """Remove, release and return all messages in the queue as a list.
+
+        Waits for the first message like :py:meth:`get`, the other messages
+        are taken without waiting. Messages received in the same iteration of
+        the libuv event-loop are put into the queue at once.
+        """
+        msgs = [Queue.get(self, block, timeout)]
+        with self.mutex:
+            msgs.extend(self.queue)
+            self.queue.clear()
+        if self._auto_release:
+            self.release_many(msgs)
+        return msgs
+
     def get_nowait(self):
         """Equivalent to get(False)."""
         msg = Queue.get(self, False)
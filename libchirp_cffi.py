@@ -7,6 +7,7 @@ import sys
 
 here = os.environ.get("LICHIRP_HERE") or path.abspath(path.dirname(__file__))
 static = os.environ.get("LIBCHIRP_STATIC") == "True"
+compression = os.environ.get("LIBCHIRP_COMPRESSION") == "True"
 
 comp = ["-DCH_DISABLE_SIGNALS"]
 link = []
@@ -57,6 +58,12 @@ else:
             "ssl",
             "crypto",
         ])
+    if compression:
+        comp.append("-DCH_ENABLE_COMPRESSION")
+        if static:
+            link.append(path.join(here, "liblz4.a"))
+        else:
+            libs.append("lz4")
     if sys.platform != "darwin":
         libs.append("rt")
     else:
@@ -93,6 +100,7 @@ typedef enum {
     CH_EMPTY           = 17,
     CH_WRITE_ERROR     = 18,
     CH_INIT_FAIL       = 19,
+    CH_FULL            = 20,
 } ch_error_t;
 
 /* libchirp init */
@@ -108,6 +116,9 @@ ch_libchirp_init(void);
 #define CH_IP_ADDR_SIZE 16
 #define CH_IP4_ADDR_SIZE 4
 #define CH_ID_SIZE 16
+#define CH_MSG_MAX_IOV 16
+#define CH_MSG_PRIORITIES 4
+#define CH_STATS_BUCKETS 32
 
 // Forward decls
 
@@ -119,22 +130,46 @@ struct uv_handle_s;
 typedef struct uv_handle_s uv_handle_t;
 struct uv_async_s;
 typedef struct uv_async_s uv_async_t;
+typedef struct {
+  char* base;
+  size_t len;
+  ...;
+} uv_buf_t;
 struct ch_chirp_s;
 typedef struct ch_chirp_s ch_chirp_t;
 struct ch_config_s;
 typedef struct ch_config_s ch_config_t;
 struct ch_message_s;
 typedef struct ch_message_s ch_message_t;
+struct ch_multicast_s;
+typedef struct ch_multicast_s ch_multicast_t;
 
 // Callbacks
 
 typedef void (*uv_timer_cb)(uv_timer_t* handle);
+typedef void* (*ch_alloc_cb_t)(size_t size);
+typedef void* (*ch_realloc_cb_t)(void* buf, size_t new_size);
+typedef void (*ch_free_cb_t)(void* buf);
 typedef void (*ch_done_cb_t)(ch_chirp_t* chirp);
 typedef void (*ch_log_cb_t)(char msg[], char error);
 typedef void (*ch_send_cb_t)(
         ch_chirp_t* chirp, ch_message_t* msg, ch_error_t status);
+typedef void (*ch_multicast_cb_t)(ch_chirp_t* chirp, ch_multicast_t* mc);
 typedef void (*ch_recv_cb_t)(ch_chirp_t* chirp, ch_message_t* msg);
+typedef void (*ch_recv_batch_cb_t)(
+        ch_chirp_t* chirp, ch_message_t** msgs, uint32_t count);
+typedef void (*ch_drain_cb_t)(
+        ch_chirp_t*    chirp,
+        uint8_t        ip_protocol,
+        const uint8_t* address,
+        int32_t        port);
 typedef void (*ch_start_cb_t)(ch_chirp_t* chirp);
+typedef void (*ch_stream_cb_t)(
+        ch_chirp_t*   chirp,
+        ch_message_t* msg,
+        ch_buf*       data,
+        uint32_t      len,
+        uint32_t      offset);
 typedef void (*ch_release_cb_t)(
         ch_chirp_t* chirp, uint8_t identity[CH_ID_SIZE], uint32_t serial);
 
@@ -148,9 +183,19 @@ extern "Python" void _chirp_log_cb(char msg[], char error);
 extern "Python" void _chirp_done_cb(ch_chirp_t* chirp);
 extern "Python" void _send_cb(
         ch_chirp_t* chirp, ch_message_t* msg, ch_error_t status);
+extern "Python" void _multicast_cb(ch_chirp_t* chirp, ch_multicast_t* mc);
+extern "Python" void _drain_cb(
+        ch_chirp_t*    chirp,
+        uint8_t        ip_protocol,
+        const uint8_t* address,
+        int32_t        port);
 extern "Python" void _queue_recv_cb(ch_chirp_t* chirp, ch_message_t* msg);
 extern "Python" void _pool_recv_cb(ch_chirp_t* chirp, ch_message_t* msg);
 extern "Python" void _async_recv_cb(ch_chirp_t* chirp, ch_message_t* msg);
+extern "Python" void _queue_recv_batch_cb(
+        ch_chirp_t* chirp, ch_message_t** msgs, uint32_t count);
+extern "Python" void _async_recv_batch_cb(
+        ch_chirp_t* chirp, ch_message_t** msgs, uint32_t count);
 extern "Python" void _release_cb(
         ch_chirp_t* chirp, uint8_t identity[CH_ID_SIZE], uint32_t serial);
 // UV
@@ -221,21 +266,42 @@ uv_timer_stop(uv_timer_t* handle);
 // Config
 
 struct ch_config_s {
-    float    REUSE_TIME;
-    float    TIMEOUT;
-    uint16_t PORT;
-    uint8_t  BACKLOG;
-    uint8_t  MAX_SLOTS;
-    char     SYNCHRONOUS;
-    char     DISABLE_SIGNALS;
-    uint32_t BUFFER_SIZE;
-    uint32_t MAX_MSG_SIZE;
-    uint8_t  BIND_V6[CH_IP_ADDR_SIZE];
-    uint8_t  BIND_V4[CH_IP4_ADDR_SIZE];
-    uint8_t  IDENTITY[CH_ID_SIZE]; // 16
-    char*    CERT_CHAIN_PEM;
-    char*    DH_PARAMS_PEM;
-    char     DISABLE_ENCRYPTION;
+    float           REUSE_TIME;
+    float           TIMEOUT;
+    uint16_t        PORT;
+    uint8_t         BACKLOG;
+    uint8_t         MAX_SLOTS;
+    char            SYNCHRONOUS;
+    char            DISABLE_SIGNALS;
+    uint32_t        BUFFER_SIZE;
+    uint32_t        MAX_MSG_SIZE;
+    uint8_t         BIND_V6[CH_IP_ADDR_SIZE];
+    uint8_t         BIND_V4[CH_IP4_ADDR_SIZE];
+    uint8_t         IDENTITY[CH_ID_SIZE]; // 16
+    char*           CERT_CHAIN_PEM;
+    char*           DH_PARAMS_PEM;
+    char            DISABLE_ENCRYPTION;
+    uint8_t         MAX_WRITE_BATCH;
+    uint8_t         ACK_WINDOW;
+    uint32_t        SHARED_SLOTS;
+    uint32_t        SLAB_HIGH_WATER;
+    char            REUSE_PORT;
+    char            COMPRESSION;
+    uint32_t        COMPRESS_THRESHOLD;
+    uint32_t        CHUNK_SIZE;
+    uint32_t        TRACE_SIZE;
+    char*           LOCAL_DIR;
+    char            ADAPTIVE_BUFFERS;
+    uint32_t        MAX_QUEUE_MSGS;
+    uint32_t        MAX_QUEUE_BYTES;
+    uint32_t        MAX_TOTAL_QUEUE_MSGS;
+    uint32_t        MAX_TOTAL_QUEUE_BYTES;
+    uint8_t         QUEUE_LOW_WATER;
+    ch_alloc_cb_t   ALLOC_CB;
+    ch_realloc_cb_t REALLOC_CB;
+    ch_free_cb_t    FREE_CB;
+    uint8_t         ACK_COALESCE;
+    uint16_t        ACK_DELAY;
 };
 
 void
@@ -248,6 +314,7 @@ struct ch_message_s {
     uint8_t  identity[CH_ID_SIZE];
     uint32_t serial;
     uint8_t  type;
+    uint8_t  priority;
     uint16_t header_len;
     uint32_t data_len;
     // These fields follow the message in this order (see *_len above)
@@ -266,14 +333,53 @@ struct ch_message_s {
     void*           _pool;
     void*           _ssl_context;
     ch_message_t*   _next;
+    const uv_buf_t* _data_iov;
+    unsigned int    _data_nbufs;
+    uint64_t        _send_time;
 };
 
 void
 ch_msg_free_data(ch_message_t* message);
 
+ch_error_t
+ch_msg_set_data_iov(
+        ch_message_t* message, const uv_buf_t bufs[], unsigned int nbufs);
+
+ch_error_t
+ch_msg_set_priority(ch_message_t* message, uint8_t priority);
+
 ch_error_t
 ch_msg_init(ch_message_t* message);
 
+// Multicast
+
+struct ch_multicast_s {
+    ch_buf*           header;
+    ch_buf*           data;
+    uint16_t          header_len;
+    uint32_t          data_len;
+    uint32_t          count;
+    uint32_t          failed;
+    ch_error_t*       status;
+    void*             user_data;
+    ch_multicast_cb_t _multicast_cb;
+    ch_message_t*     _msgs;
+    ch_message_t**    _msgs_p;
+    uint32_t          _pending;
+};
+
+void
+ch_mc_free(ch_multicast_t* mc);
+
+ch_message_t*
+ch_mc_get_message(ch_multicast_t* mc, uint32_t index);
+
+ch_error_t
+ch_mc_init(ch_multicast_t* mc, uint32_t count);
+
+void
+ch_mc_set_data(ch_multicast_t* mc, ch_buf* data, uint32_t len);
+
 int
 ch_msg_has_slot(ch_message_t* message);
 
@@ -281,6 +387,13 @@ ch_error_t
 ch_chirp_release_msg_slot_ts(
         ch_chirp_t* rchirp, ch_message_t* msg, ch_release_cb_t release_cb);
 
+ch_error_t
+ch_chirp_release_batch_ts(
+        ch_chirp_t*     rchirp,
+        ch_message_t**  msgs,
+        size_t          count,
+        ch_release_cb_t release_cb);
+
 // Chirp
 
 struct ch_chirp_s {
@@ -301,18 +414,145 @@ ch_chirp_init(
 ch_error_t
 ch_chirp_close_ts(ch_chirp_t* chirp);
 
+void
+ch_chirp_set_drain_callback(ch_chirp_t* chirp, ch_drain_cb_t drain_cb);
+
+int
+ch_chirp_full_is_total(ch_chirp_t* chirp);
+
+void
+ch_chirp_set_recv_batch_callback(
+        ch_chirp_t* chirp, ch_recv_batch_cb_t recv_batch_cb);
+
+void
+ch_chirp_set_stream_callback(ch_chirp_t* chirp, ch_stream_cb_t stream_cb);
+
 int
 ch_loop_close(uv_loop_t* loop);
 
+ch_error_t
+ch_chirp_connect_ts(
+        ch_chirp_t* chirp, ch_message_t* msg, int pin, ch_send_cb_t send_cb);
+
+ch_error_t
+ch_chirp_multicast_ts(
+        ch_chirp_t* chirp, ch_multicast_t* mc, ch_multicast_cb_t multicast_cb);
+
 ch_error_t
 ch_chirp_send_ts(ch_chirp_t* chirp, ch_message_t* msg, ch_send_cb_t send_cb);
 
+ch_error_t
+ch_chirp_send_batch_ts(
+        ch_chirp_t*    chirp,
+        ch_message_t** msgs,
+        size_t         count,
+        ch_send_cb_t   send_cb);
+
 typedef struct ch_identity_s {
     uint8_t data[CH_ID_SIZE];
 } ch_identity_t;
 
 ch_identity_t
 ch_chirp_get_identity(ch_chirp_t* chirp);
+
+typedef struct ch_stats_s {
+    uint64_t msgs_sent;
+    uint64_t writes;
+    uint64_t bytes_sent;
+    uint64_t acks_sent;
+    uint64_t msgs_recv;
+    uint64_t bytes_recv;
+    uint64_t slots_exhausted;
+    uint64_t connects;
+    uint64_t accepts;
+    uint64_t reconnects;
+    uint64_t local_connections;
+    uint64_t gc_connections;
+    uint64_t gc_remotes;
+    uint64_t handshakes_full;
+    uint64_t handshakes_resumed;
+    uint64_t reads_borrowed;
+    uint64_t buffers_shrunk;
+    uint32_t remotes;
+    uint32_t connections;
+    uint32_t queued;
+    uint32_t writes_pending;
+    uint64_t write_latency[CH_STATS_BUCKETS];
+    uint64_t ack_latency[CH_STATS_BUCKETS];
+} ch_stats_t;
+
+typedef struct ch_remote_stats_s {
+    uint8_t  ip_protocol;
+    uint8_t  address[CH_IP_ADDR_SIZE];
+    int32_t  port;
+    uint8_t  connected;
+    uint8_t  pinned;
+    uint8_t  write_pending;
+    uint8_t  wait_ack;
+    uint32_t queued[CH_MSG_PRIORITIES];
+} ch_remote_stats_t;
+
+void
+ch_chirp_get_stats(ch_chirp_t* chirp, ch_stats_t* stats);
+
+uint32_t
+ch_chirp_get_remote_stats(
+        ch_chirp_t* chirp, ch_remote_stats_t* stats, uint32_t count);
+
+typedef enum {
+    CH_TR_ENQUEUE      = 1,
+    CH_TR_DEQUEUE      = 2,
+    CH_TR_WRITE        = 3,
+    CH_TR_WRITE_DONE   = 4,
+    CH_TR_ACK          = 5,
+    CH_TR_SLOT_ACQUIRE = 6,
+    CH_TR_SLOT_RELEASE = 7,
+    CH_TR_TIMEOUT      = 8,
+} ch_trace_type_t;
+
+typedef struct ch_trace_event_s {
+    uint64_t time;
+    uint8_t  identity[CH_ID_SIZE];
+    uint32_t serial;
+    uint8_t  type;
+    uint8_t  msg_type;
+} ch_trace_event_t;
+
+uint32_t
+ch_chirp_get_trace(
+        ch_chirp_t* chirp, ch_trace_event_t* events, uint32_t count);
+
+typedef struct ch_shards_s {
+    void*           user_data;
+    uint8_t         count;
+    ...;
+} ch_shards_t;
+
+ch_error_t
+ch_shards_close_ts(ch_shards_t* shards);
+
+ch_chirp_t*
+ch_shards_get_chirp(ch_shards_t* shards, uint8_t index);
+
+ch_chirp_t*
+ch_shards_get_owner(ch_shards_t* shards, const ch_message_t* msg);
+
+ch_error_t
+ch_shards_init(
+        ch_shards_t*       shards,
+        uint8_t            count,
+        const ch_config_t* config,
+        ch_recv_cb_t       recv_cb,
+        ch_start_cb_t      start_cb,
+        ch_done_cb_t       done_cb,
+        ch_log_cb_t        log_cb);
+
+ch_error_t
+ch_shards_join(ch_shards_t* shards);
+
+ch_error_t
+ch_shards_send_ts(
+        ch_shards_t* shards, ch_message_t* msg, ch_send_cb_t send_cb);
 """
 if __name__ == "__main__":
     if len(sys.argv) > 1 and sys.argv[1] == "debug":
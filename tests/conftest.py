@@ -66,6 +66,30 @@ def queue(loop, config):
     a.stop()
 
 
+@pytest.fixture
+def receiver(loop):
+    """Return a factory of libchirp.queue receivers.
+
+    The keyword arguments are set on the config of the receiver, it listens on
+    port 2998 by default. The receivers are stopped after the test.
+    """
+    chirps = []
+
+    def make(**kwargs):
+        config = Config()
+        config.DH_PARAMS_PEM = "./tests/dh.pem"
+        config.CERT_CHAIN_PEM = "./tests/cert.pem"
+        for name, value in kwargs.items():
+            setattr(config, name, value)
+        chirp = Chirp(loop, config)
+        chirps.append(chirp)
+        return chirp
+
+    yield make
+    for chirp in chirps:
+        chirp.stop()
+
+
 @pytest.fixture
 def fast_sender(loop, config):
     """Return a libchirp sender."""
@@ -131,6 +131,31 @@ def test_recv_await_release(config, sender, message):
     a.stop()
 
 
+def test_batches(config, sender, message):
+    """test_batches."""
+    config = Config()
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.AUTO_RELEASE = False
+    aio_loop = asyncio.get_event_loop()
+    a = Chirp(sender.loop, config, aio_loop)
+    batches = a.batches()
+    message.data = b'hello'
+    message.address = "127.0.0.1"
+    message.port = config.PORT
+    fut = sender.send(message)
+
+    async def next_batch():
+        return await batches.__anext__()
+
+    batch = aio_loop.run_until_complete(next_batch())
+    assert [msg.data for msg in batch] == [b'hello']
+    assert batch[0].has_slot
+    aio_loop.run_until_complete(batch[0].release())
+    fut.result()
+    a.stop()
+
+
 def test_echo(config, queue, message):
     """test_echo."""
     config = Config()
@@ -2,10 +2,12 @@
 import gc
 import platform
 import pytest
+import socket
+import threading
 import time
 import os
 
-from libchirp import ChirpBase, Loop, MessageThread, lib
+from libchirp import ChirpBase, Config, Loop, MessageThread, ffi, lib
 
 _echo_test = os.path.exists("./echo_test") or os.path.exists("./echo_test.exe")
 
@@ -27,6 +29,46 @@ def test_too_high_timeout(loop, config):
         assert "Config: timeout must be <= 1200." in e.args[0]
 
 
+def test_too_high_write_batch(loop, config):
+    """test_too_high_write_batch."""
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.MAX_WRITE_BATCH = 17
+    with pytest.raises(ValueError) as e:
+        ChirpBase(loop, config)
+    assert "Config: max write batch must be <= 16." in e.value.args[0]
+
+
+def test_too_high_ack_window(loop, config):
+    """test_too_high_ack_window."""
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.ACK_WINDOW = 33
+    with pytest.raises(ValueError) as e:
+        ChirpBase(loop, config)
+    assert "Config: ack window must be <= 32." in e.value.args[0]
+
+
+def test_too_high_ack_coalesce(loop, config):
+    """test_too_high_ack_coalesce."""
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.ACK_COALESCE = 33
+    with pytest.raises(ValueError) as e:
+        ChirpBase(loop, config)
+    assert "Config: ack coalesce must be <= 32." in e.value.args[0]
+
+
+def test_too_low_chunk_size(loop, config):
+    """test_too_low_chunk_size."""
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.CHUNK_SIZE = 1023
+    with pytest.raises(ValueError) as e:
+        ChirpBase(loop, config)
+    assert "Config: chunk size must be >= 1024." in e.value.args[0]
+
+
 def test_lifecycle(config, ref_count_offset):
     """test_lifecycle."""
     loop = Loop()
@@ -61,6 +103,106 @@ def test_listen_error(loop, config):
         a.stop()
 
 
+@pytest.mark.skipif(platform.system() == "Windows", reason="No REUSE_PORT")
+def test_reuse_port(loop, config):
+    """test_reuse_port."""
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.REUSE_PORT = True
+    a = ChirpBase(loop, config)
+    try:
+        b = ChirpBase(loop, config)
+        b.stop()
+    finally:
+        a.stop()
+
+
+@pytest.mark.skipif(platform.system() == "Windows", reason="No REUSE_PORT")
+def test_shards(loop, config, message):
+    """test_shards."""
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.PORT = 2997
+    shards = ffi.new("ch_shards_t*")
+    assert lib.ch_shards_init(
+        shards, 2, config._conf_t, ffi.NULL, ffi.NULL, ffi.NULL, ffi.NULL
+    ) == lib.CH_SUCCESS
+    try:
+        assert shards.count == 2
+        chirps = [lib.ch_shards_get_chirp(shards, i) for i in range(2)]
+        ids = [
+            bytes(lib.ch_chirp_get_identity(c).data) for c in chirps
+        ]
+        assert ids[0] == ids[1]
+        msg_t = ffi.new("ch_message_t*")
+        msg_t.ip_protocol = socket.AF_INET
+        msg_t.address[0:4] = socket.inet_aton("127.0.0.1")
+        msg_t.port = 2998
+        owner = lib.ch_shards_get_owner(shards, msg_t)
+        assert owner in chirps
+        assert lib.ch_shards_get_owner(shards, msg_t) == owner
+        # Inbound connections land on any shard, the shards release the
+        # message and acknowledge it
+        sconfig = Config()
+        sconfig.DH_PARAMS_PEM = "./tests/dh.pem"
+        sconfig.CERT_CHAIN_PEM = "./tests/cert.pem"
+        sconfig.PORT = 2996
+        a = ChirpBase(loop, sconfig)
+        try:
+            message.address = "127.0.0.1"
+            message.port = 2997
+            a.send(message).result()
+        finally:
+            a.stop()
+    finally:
+        assert lib.ch_shards_close_ts(shards) == lib.CH_SUCCESS
+        assert lib.ch_shards_join(shards) == lib.CH_SUCCESS
+
+
+def test_stream_callback(loop, config, message):
+    """test_stream_callback."""
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.PORT = 2998
+    parts = []
+    done = threading.Event()
+
+    @ffi.callback("ch_stream_cb_t")
+    def stream_cb(chirp_t, msg_t, data, length, offset):
+        parts.append((offset, ffi.buffer(data, length)[:]))
+        if offset + length == msg_t.data_len:
+            lib.ch_chirp_release_msg_slot_ts(chirp_t, msg_t, ffi.NULL)
+            done.set()
+
+    a = ChirpBase(loop, config)
+    try:
+        lib.ch_chirp_set_stream_callback(a._chirp_t, stream_cb)
+        sconfig = Config()
+        sconfig.DH_PARAMS_PEM = "./tests/dh.pem"
+        sconfig.CERT_CHAIN_PEM = "./tests/cert.pem"
+        sconfig.PORT = 2996
+        sconfig.CHUNK_SIZE = 1024
+        b = ChirpBase(loop, sconfig)
+        try:
+            data = bytes(range(256)) * 20
+            message.data = data
+            message.address = "127.0.0.1"
+            message.port = 2998
+            b.send(message).result()
+            assert done.wait(5)
+            # At least one part per chunk, in order
+            assert len(parts) >= 5
+            received = b''
+            for offset, part in parts:
+                assert offset == len(received)
+                received += part
+            assert received == data
+        finally:
+            b.stop()
+    finally:
+        a.stop()
+
+
 def test_send_msg_conn_fail(loop, config, message):
     """test_send_msg_conn_fail."""
     config.DH_PARAMS_PEM = "./tests/dh.pem"
@@ -16,6 +16,7 @@ def test_init(message):
     assert len(message.data) == 0
     assert message.address == "0.0.0.0"
     assert message.port == 0
+    assert message.priority == 0
     assert message.remote_identity == b'\0' * lib.CH_ID_SIZE
     assert message.has_slot is False
 
@@ -66,6 +67,12 @@ def test_data_bad_type(message):
         message.data = "bla"
 
 
+def test_data_parts_bad_count(message):
+    """test_data_parts_bad_count."""
+    with pytest.raises(AssertionError):
+        message.data = [b'x'] * (lib.CH_MSG_MAX_IOV + 1)
+
+
 def test_address_bad_format(message):
     """test_address_bad_format."""
     with pytest.raises(ValueError):
@@ -80,6 +87,14 @@ def test_port_bad_range(message):
         message.port = 65537
 
 
+def test_priority_bad_range(message):
+    """test_priority_bad_range."""
+    with pytest.raises(AssertionError):
+        message.priority = -1
+    with pytest.raises(AssertionError):
+        message.priority = lib.CH_MSG_PRIORITIES
+
+
 def test_identity_quality():
     """test_identity_quality."""
     for _ in range(100):
@@ -1,11 +1,17 @@
 """Queue tests."""
 
+import pytest
 import queue
+import socket
 import time
 import gc
+import os
 
+from libchirp import ffi, lib
 from libchirp.queue import Chirp, Config, Message
 
+_compression = os.environ.get("LIBCHIRP_COMPRESSION") == "True"
+
 
 def test_initialize(loop, config):
     """test_initialize."""
@@ -71,6 +77,414 @@ def test_recv_msg(config, sender, message, ref_count_offset):
     assert len(gc.get_referrers(a)) == 1 + ref_count_offset
 
 
+def test_send_release_many(config, fast_sender, ref_count_offset):
+    """test_send_release_many."""
+    config = Config()
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.AUTO_RELEASE = False
+    config.SYNCHRONOUS = False
+    a = Chirp(fast_sender.loop, config)
+    msgs = []
+    for i in range(5):
+        message = Message()
+        message.data = b'hello%d' % i
+        message.address = "127.0.0.1"
+        message.port = config.PORT
+        msgs.append(message)
+    futs = fast_sender.send_many(msgs)
+    assert [fut.result() for fut in futs] == msgs
+    recv = [a.get() for _ in range(5)]
+    assert sorted(msg.data for msg in recv) == [
+        b'hello%d' % i for i in range(5)
+    ]
+    for fut in a.release_many(recv):
+        fut.result()
+    assert all(msg._msg_t is None for msg in recv)
+    a.stop()
+    recv = None
+    assert len(gc.get_referrers(a)) == 1 + ref_count_offset
+
+
+def test_send_many_twice(sender, receiver):
+    """test_send_many_twice."""
+    a = receiver()
+    message = Message()
+    message.data = b'hello'
+    message.address = "127.0.0.1"
+    message.port = 2998
+    with pytest.raises(RuntimeError):
+        sender.send_many([message, message])
+    # The message is not registered anymore and can be sent
+    fut = sender.send(message)
+    assert a.get().data == b'hello'
+    assert fut.result() is message
+
+
+def test_write_batch(fast_sender, receiver):
+    """test_write_batch."""
+    a = receiver(SYNCHRONOUS=False)
+    msgs = []
+    for i in range(5):
+        message = Message()
+        message.data = b'hello%d' % i
+        message.address = "127.0.0.1"
+        message.port = 2998
+        msgs.append(message)
+    futs = fast_sender.send_many(msgs)
+    assert [fut.result() for fut in futs] == msgs
+    assert [a.get().data for _ in range(5)] == [
+        b'hello%d' % i for i in range(5)
+    ]
+    # The messages are queued while connecting and written at once
+    stats = fast_sender.stats()
+    assert stats['writes'] == 1
+    assert stats['msgs_sent'] == 5
+
+
+def _external_address():
+    """Return a non-loopback address of this host or None."""
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        s.connect(("10.255.255.255", 1))
+        addr = s.getsockname()[0]
+    except OSError:
+        return None
+    finally:
+        s.close()
+    if addr.startswith("127."):
+        return None
+    return addr
+
+
+@pytest.mark.skipif(not _external_address(), reason="No external address")
+def test_tls_small_buffer(receiver):
+    """test_tls_small_buffer."""
+    # Connections to 127.0.0.1 are not encrypted, an external address is
+    a = receiver(BUFFER_SIZE=1024)
+    b = receiver(PORT=2996, BUFFER_SIZE=1024)
+    message = Message()
+    message.data = bytes(range(256)) * 400
+    message.address = _external_address()
+    message.port = 2998
+    fut = b.send(message)
+    assert a.get().data == message.data
+    assert fut.result() == message
+    assert b.stats()['handshakes_full'] == 1
+
+
+@pytest.mark.skipif(not _external_address(), reason="No external address")
+def test_tls_resume(receiver):
+    """test_tls_resume."""
+    a = receiver()
+    b = receiver(PORT=2996, REUSE_TIME=0.5, TIMEOUT=0.5)
+    message = Message()
+    message.data = b'hello'
+    message.address = _external_address()
+    message.port = 2998
+    fut = b.send(message)
+    assert a.get().data == b'hello'
+    assert fut.result() == message
+    # Wait until the connection is garbage-collected
+    for _ in range(100):
+        if b.stats()['connections'] == 0:
+            break
+        time.sleep(0.1)
+    assert b.stats()['connections'] == 0
+    message = Message()
+    message.data = b'hello again'
+    message.address = _external_address()
+    message.port = 2998
+    fut = b.send(message)
+    assert a.get().data == b'hello again'
+    assert fut.result() == message
+    stats = b.stats()
+    assert stats['handshakes_full'] == 1
+    assert stats['handshakes_resumed'] == 1
+
+
+@pytest.mark.skipif(not _compression, reason="Built without compression")
+def test_compression(receiver):
+    """test_compression."""
+    a = receiver(COMPRESSION=True)
+    b = receiver(PORT=2996, COMPRESSION=True, CHUNK_SIZE=65536)
+    # Below the threshold, compressed, incompressible and streamed
+    datas = [b'a' * 10, b'b' * 5000, bytes(range(256)) * 20, b'c' * 100000]
+    for data in datas:
+        message = Message()
+        message.data = data
+        message.address = "127.0.0.1"
+        message.port = 2998
+        fut = b.send(message)
+        assert a.get().data == data
+        assert fut.result() == message
+
+
+def test_stream_interleave(receiver):
+    """test_stream_interleave."""
+    a = receiver(SYNCHRONOUS=False)
+    b = receiver(PORT=2996, SYNCHRONOUS=False, CHUNK_SIZE=1024)
+    msgs = []
+    for data in [bytes(range(256)) * 1000, b'small']:
+        message = Message()
+        message.data = data
+        message.address = "127.0.0.1"
+        message.port = 2998
+        msgs.append(message)
+    futs = b.send_many(msgs)
+    assert [fut.result() for fut in futs] == msgs
+    # The small message is written with the first chunk of the large one
+    assert a.get().data == b'small'
+    assert a.get().data == msgs[0].data
+
+
+def test_priority(fast_sender, receiver):
+    """test_priority."""
+    a = receiver(SYNCHRONOUS=False)
+    msgs = []
+    for i, priority in enumerate([0, 0, 1, 0, 3]):
+        message = Message()
+        message.data = b'hello%d' % i
+        message.priority = priority
+        message.address = "127.0.0.1"
+        message.port = 2998
+        msgs.append(message)
+    futs = fast_sender.send_many(msgs)
+    assert [fut.result() for fut in futs] == msgs
+    # Queued while connecting, higher priorities overtake, equal ones keep
+    # their order
+    assert [a.get().data for _ in range(5)] == [
+        b'hello4', b'hello2', b'hello0', b'hello1', b'hello3'
+    ]
+
+
+def test_ack_window(receiver):
+    """test_ack_window."""
+    a = receiver(AUTO_RELEASE=False, ACK_WINDOW=4)
+    b = receiver(PORT=2996, ACK_WINDOW=4)
+    msgs = []
+    for i in range(4):
+        message = Message()
+        message.data = b'hello%d' % i
+        message.address = "127.0.0.1"
+        message.port = 2998
+        msgs.append(message)
+    futs = b.send_many(msgs)
+    # All messages are in flight before the first ack
+    recv = [a.get() for _ in range(4)]
+    remote, = b.stats()['remotes']
+    assert remote['wait_ack'] == 4
+    # The acks arrive in reverse order
+    for msg in reversed(recv):
+        msg.release_slot().result()
+    assert [fut.result() for fut in futs] == msgs
+    remote, = b.stats()['remotes']
+    assert remote['wait_ack'] == 0
+
+
+def test_ack_window_timeout(receiver):
+    """test_ack_window_timeout."""
+    a = receiver(AUTO_RELEASE=False, ACK_WINDOW=4)
+    b = receiver(PORT=2996, ACK_WINDOW=4, TIMEOUT=0.5)
+    held = Message()
+    held.data = b'held'
+    held.address = "127.0.0.1"
+    held.port = 2998
+    held_fut = b.send(held)
+    held_msg = a.get()
+    # The other messages keep flowing, they must not extend the timeout
+    start = time.time()
+    while not held_fut.done() and time.time() - start < 3:
+        message = Message()
+        message.data = b'hello'
+        message.address = "127.0.0.1"
+        message.port = 2998
+        fut = b.send(message)
+        try:
+            a.get(timeout=1).release_slot().result()
+            fut.result()
+        except (queue.Empty, TimeoutError):
+            break
+        time.sleep(0.05)
+    with pytest.raises(TimeoutError):
+        held_fut.result(timeout=1)
+    assert time.time() - start < 2
+    held_msg.release_slot()
+
+
+def test_shared_slots(config, fast_sender, ref_count_offset):
+    """test_shared_slots."""
+    config = Config()
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.AUTO_RELEASE = False
+    config.SYNCHRONOUS = False
+    config.SHARED_SLOTS = 2
+    a = Chirp(fast_sender.loop, config)
+    msgs = []
+    for i in range(5):
+        message = Message()
+        message.data = b'hello%d' % i
+        message.address = "127.0.0.1"
+        message.port = config.PORT
+        msgs.append(message)
+    futs = fast_sender.send_many(msgs)
+    recv = [a.get() for _ in range(2)]
+    # Both shared slots are used, reading stopped
+    with pytest.raises(queue.Empty):
+        a.get(timeout=0.2)
+    for msg in recv:
+        msg.release_slot().result()
+    recv += [a.get() for _ in range(3)]
+    assert sorted(msg.data for msg in recv) == [
+        b'hello%d' % i for i in range(5)
+    ]
+    for msg in recv[2:]:
+        msg.release_slot().result()
+    assert [fut.result() for fut in futs] == msgs
+    a.stop()
+    recv = None
+    assert len(gc.get_referrers(a)) == 1 + ref_count_offset
+
+
+def test_slab_high_water(config, fast_sender, ref_count_offset):
+    """test_slab_high_water."""
+    config = Config()
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.AUTO_RELEASE = False
+    config.SYNCHRONOUS = False
+    config.SLAB_HIGH_WATER = 4096
+    a = Chirp(fast_sender.loop, config)
+    msgs = []
+    # Buffers of 2k fit below the high-water mark, 8k is returned to the
+    # system, 2M is larger than the largest size class
+    for size in (2000, 2000, 8000, 2000000):
+        message = Message()
+        message.header = b'h' * 100
+        message.data = b'd' * size
+        message.address = "127.0.0.1"
+        message.port = config.PORT
+        msgs.append(message)
+    for _ in range(2):
+        futs = fast_sender.send_many(msgs)
+        recv = [a.get() for _ in msgs]
+        assert sorted(len(msg.data) for msg in recv) == [
+            2000, 2000, 8000, 2000000
+        ]
+        assert all(msg.header == b'h' * 100 for msg in recv)
+        for msg in recv:
+            msg.release_slot().result()
+        assert [fut.result() for fut in futs] == msgs
+    a.stop()
+    recv = None
+    assert len(gc.get_referrers(a)) == 1 + ref_count_offset
+
+
+def test_data_parts(config, sender, message, ref_count_offset):
+    """test_data_parts."""
+    config = Config()
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.AUTO_RELEASE = False
+    a = Chirp(sender.loop, config)
+    big = bytearray(b'b' * 100000)
+    message.data = [b'hello ', memoryview(big), b'', b' world']
+    message.address = "127.0.0.1"
+    message.port = config.PORT
+    assert message.data == b'hello ' + bytes(big) + b' world'
+    sender.send(message).result()
+    msg = a.get()
+    assert msg.data == b'hello ' + bytes(big) + b' world'
+    msg.release_slot().result()
+    a.stop()
+    msg = None
+    assert len(gc.get_referrers(a)) == 1 + ref_count_offset
+
+
+def test_stats(sender, receiver, message):
+    """test_stats."""
+    a = receiver()
+    message.data = b'hello'
+    message.address = "127.0.0.1"
+    message.port = 2998
+    fut = sender.send(message)
+    a.get()
+    fut.result()
+    stats = sender.stats()
+    assert stats['msgs_sent'] == 1
+    assert stats['bytes_sent'] == 5
+    assert stats['connects'] == 1
+    assert sum(stats['write_latency']) == 1
+    assert sum(stats['ack_latency']) == 1
+    assert len(stats['ack_latency']) == lib.CH_STATS_BUCKETS
+    remote, = stats['remotes']
+    assert remote['address'] == "127.0.0.1"
+    assert remote['port'] == 2998
+    assert remote['connected'] == 1
+    stats = a.stats()
+    assert stats['msgs_recv'] == 1
+    assert stats['bytes_recv'] == 5
+    assert stats['accepts'] == 1
+
+
+def test_trace(sender, receiver, message):
+    """test_trace."""
+    a = receiver(TRACE_SIZE=16)
+    message.data = b'hello'
+    message.address = "127.0.0.1"
+    message.port = 2998
+    fut = sender.send(message)
+    msg = a.get()
+    fut.result()
+    events = a.trace()
+    assert len(events) <= 16
+    types = [
+        event['type'] for event in events if event['identity'] == msg.identity
+    ]
+    # The ack has the identity of the message
+    assert types[:3] == [
+        lib.CH_TR_SLOT_ACQUIRE,
+        lib.CH_TR_SLOT_RELEASE,
+        lib.CH_TR_ENQUEUE,
+    ]
+    assert sender.trace() == []
+
+
+def test_trace_serial(receiver):
+    """test_trace_serial."""
+    a = receiver(TRACE_SIZE=32)
+    b = receiver(PORT=2996, TRACE_SIZE=32)
+    message = Message()
+    message.data = b'hello'
+    message.address = "127.0.0.1"
+    message.port = 2998
+    fut = b.send(message)
+    msg = a.get()
+    assert fut.result() == message
+    sent = {
+        event['type']: event['serial']
+        for event in b.trace() if event['identity'] == msg.identity
+    }
+    received = {
+        event['type']: event['serial']
+        for event in a.trace() if event['identity'] == msg.identity and
+        event['type'] in (lib.CH_TR_SLOT_ACQUIRE, lib.CH_TR_SLOT_RELEASE)
+    }
+    # The serial is assigned when the message is written
+    assert sent == {
+        lib.CH_TR_ENQUEUE: 0,
+        lib.CH_TR_DEQUEUE: 0,
+        lib.CH_TR_WRITE: msg.serial,
+        lib.CH_TR_WRITE_DONE: msg.serial,
+        lib.CH_TR_ACK: msg.serial,
+    }
+    assert received == {
+        lib.CH_TR_SLOT_ACQUIRE: msg.serial,
+        lib.CH_TR_SLOT_RELEASE: msg.serial,
+    }
+
+
 def test_disable_queue(config, sender, message):
     """test_disable_queue."""
     config = Config()
@@ -86,6 +500,403 @@ def test_disable_queue(config, sender, message):
     a.stop()
 
 
+def _send(a, b, data, address="127.0.0.1"):
+    """Send data from b to a at address."""
+    message = Message()
+    message.data = data
+    message.address = address
+    message.port = 2998
+    fut = b.send(message)
+    assert a.get().data == data
+    assert fut.result() == message
+
+
+def _restart_local(a, b, receiver, **kwargs):
+    """Restart a and wait until b's connection to it is closed."""
+    a.stop()
+    for _ in range(100):
+        if b.stats()['connections'] == 0:
+            break
+        time.sleep(0.1)
+    assert b.stats()['connections'] == 0
+    return receiver(**kwargs)
+
+
+def test_local(receiver, tmpdir):
+    """test_local."""
+    local_dir = str(tmpdir.join("local"))
+    a = receiver(LOCAL_DIR=local_dir)
+    b = receiver(PORT=2996, LOCAL_DIR=local_dir)
+    assert os.stat(local_dir).st_mode & 0o777 == 0o700
+    assert os.path.exists(os.path.join(local_dir, "libchirp-2998.sock"))
+    # The first connection uses TCP, a announces its local socket
+    _send(a, b, b'tcp')
+    assert b.stats()['local_connections'] == 0
+    a = _restart_local(a, b, receiver, LOCAL_DIR=local_dir)
+    _send(a, b, b'local')
+    stats = b.stats()
+    assert stats['connects'] == 2
+    assert stats['local_connections'] == 1
+    assert a.stats()['local_connections'] == 1
+
+
+def test_local_fallback(receiver, tmpdir):
+    """test_local_fallback."""
+    a = receiver(LOCAL_DIR=str(tmpdir.join("a")))
+    b = receiver(PORT=2996, LOCAL_DIR=str(tmpdir.join("b")))
+    _send(a, b, b'tcp')
+    a = _restart_local(a, b, receiver, LOCAL_DIR=str(tmpdir.join("a")))
+    # b connects to a socket that does not exist, it falls back to TCP
+    _send(a, b, b'fallback')
+    stats = b.stats()
+    assert stats['connects'] == 2
+    assert stats['local_connections'] == 0
+    # Without LOCAL_DIR nothing listens and TCP is used
+    c = receiver(PORT=2994)
+    assert Config().LOCAL_DIR is None
+    _send(a, c, b'tcp')
+    assert c.stats()['local_connections'] == 0
+
+
+def _wait_shrunk(chirps, a, b, address="127.0.0.1"):
+    """Keep the connection from b to a busy until the chirps shrunk."""
+    for _ in range(100):
+        _send(a, b, b'keep', address)
+        if all(chirp.stats()['buffers_shrunk'] for chirp in chirps):
+            break
+        time.sleep(0.05)
+    for chirp in chirps:
+        assert chirp.stats()['buffers_shrunk'] > 0
+        assert chirp.stats()['connections'] == 1
+
+
+def test_adaptive_buffers(receiver):
+    """test_adaptive_buffers."""
+    # The shortest gc interval: the buffers are shrunk on gc
+    a = receiver(ADAPTIVE_BUFFERS=True, REUSE_TIME=0.5, TIMEOUT=0.2)
+    b = receiver(PORT=2996, ADAPTIVE_BUFFERS=True)
+    _send(a, b, b'a' * 10)
+    # The idle connection reads into the shared idle buffer
+    borrowed = a.stats()['reads_borrowed']
+    assert borrowed > 0
+    # Reading a full buffer makes the connection busy: it gets its own
+    _send(a, b, b'b' * 200000)
+    _wait_shrunk([a], a, b)
+    for size in (5000, 3):
+        _send(a, b, b'c' * size)
+    assert a.stats()['reads_borrowed'] > borrowed
+
+
+@pytest.mark.skipif(not _external_address(), reason="No external address")
+def test_adaptive_buffers_tls(receiver):
+    """test_adaptive_buffers_tls."""
+    address = _external_address()
+    a = receiver(ADAPTIVE_BUFFERS=True, REUSE_TIME=0.5, TIMEOUT=0.3)
+    b = receiver(
+        PORT=2996, ADAPTIVE_BUFFERS=True, REUSE_TIME=0.5, TIMEOUT=0.3
+    )
+    # The TLS buffers are allocated by the first handshake write, read and
+    # message write
+    _send(a, b, b'a' * 10, address)
+    _send(a, b, b'b' * 200000, address)
+    assert b.stats()['handshakes_full'] == 1
+    # The TLS buffers are freed and allocated again on the same connection
+    _wait_shrunk([a, b], a, b, address)
+    _send(a, b, b'c' * 200000, address)
+    stats = b.stats()
+    assert stats['connects'] == 1
+    assert stats['handshakes_full'] == 1
+
+
+def test_queue_full(receiver):
+    """test_queue_full."""
+    a = receiver()
+    b = receiver(PORT=2996, MAX_QUEUE_MSGS=1)
+    msgs = []
+    for _ in range(3):
+        message = Message()
+        message.data = b'hello'
+        message.address = "127.0.0.1"
+        message.port = 2998
+        msgs.append(message)
+    # Not connected yet: the first message is queued
+    futs = b.send_many(msgs)
+    for fut in futs[1:]:
+        excp = fut.exception()
+        assert isinstance(excp, BlockingIOError)
+    assert a.get().data == b'hello'
+    futs[0].result()
+    excp.drained.result()
+    fut = b.send(msgs[1])
+    assert a.get().data == b'hello'
+    fut.result()
+
+
+def test_queue_full_total(receiver):
+    """test_queue_full_total."""
+    # x accepts connections, but never sends its handshake: the queue of x
+    # stays full
+    x = socket.socket()
+    x.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    x.bind(("127.0.0.1", 2990))
+    x.listen(1)
+    a = receiver()
+    b = receiver(PORT=2996, MAX_QUEUE_MSGS=1, MAX_TOTAL_QUEUE_MSGS=2)
+    msgs = []
+    for port in (2990, 2990, 2998, 2994):
+        message = Message()
+        message.data = b'hello'
+        message.address = "127.0.0.1"
+        message.port = port
+        msgs.append(message)
+    futs = b.send_many(msgs)
+    # The queue of x is full, then the queue of all remotes
+    remote_drained = futs[1].exception().drained
+    total_drained = futs[3].exception().drained
+    assert remote_drained is not total_drained
+    assert a.get().data == b'hello'
+    futs[2].result()
+    total_drained.result(timeout=5)
+    assert not remote_drained.done()
+    x.close()
+
+
+def test_alloc_callbacks(sender):
+    """test_alloc_callbacks."""
+    live = {}
+    counts = {'alloc': 0, 'free': 0}
+
+    def alloc(size):
+        buf = ffi.new("char[]", max(size, 1))
+        ptr = ffi.cast("void*", buf)
+        live[int(ffi.cast("uintptr_t", ptr))] = buf
+        counts['alloc'] += 1
+        return ptr
+
+    def free(ptr):
+        if ptr != ffi.NULL:
+            del live[int(ffi.cast("uintptr_t", ptr))]
+            counts['free'] += 1
+
+    @ffi.callback("ch_alloc_cb_t")
+    def alloc_cb(size):
+        return alloc(size)
+
+    @ffi.callback("ch_realloc_cb_t")
+    def realloc_cb(ptr, size):
+        new = alloc(size)
+        if ptr != ffi.NULL:
+            old = live[int(ffi.cast("uintptr_t", ptr))]
+            ffi.memmove(new, old, min(len(old), size))
+            free(ptr)
+        return new
+
+    @ffi.callback("ch_free_cb_t")
+    def free_cb(ptr):
+        free(ptr)
+
+    config = Config()
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config._conf_t.ALLOC_CB = alloc_cb
+    config._conf_t.REALLOC_CB = realloc_cb
+    config._conf_t.FREE_CB = free_cb
+    a = Chirp(sender.loop, config)
+    try:
+        for data in (b'hello', b'a' * 200000):
+            message = Message()
+            message.data = data
+            message.address = "127.0.0.1"
+            message.port = config.PORT
+            fut = sender.send(message)
+            assert a.get().data == data
+            fut.result()
+        assert counts['alloc'] > 0
+    finally:
+        a.stop()
+    # The pools are freed by the last close callback, after stop() returned
+    for _ in range(100):
+        if not live:
+            break
+        time.sleep(0.01)
+    assert counts['alloc'] == counts['free']
+    assert not live
+
+
+def test_ack_coalesce(receiver):
+    """test_ack_coalesce."""
+    a = receiver(AUTO_RELEASE=False, ACK_WINDOW=8, ACK_COALESCE=4)
+    b = receiver(PORT=2996, ACK_WINDOW=8)
+    msgs = []
+    for i in range(10):
+        message = Message()
+        message.data = b'hello%d' % i
+        message.address = "127.0.0.1"
+        message.port = 2998
+        msgs.append(message)
+    futs = b.send_many(msgs)
+    for _ in range(2):
+        recv = [a.get() for _ in range(5)]
+        for fut in a.release_many(recv):
+            fut.result()
+    assert [fut.result() for fut in futs] == msgs
+    # Without coalescing each message is acknowledged on its own
+    assert a.stats()['acks_sent'] < 10
+
+
+def test_ack_coalesce_window(receiver):
+    """test_ack_coalesce_window."""
+    a = receiver(ACK_WINDOW=8, ACK_COALESCE=8, ACK_DELAY=4000)
+    b = receiver(PORT=2996, ACK_WINDOW=2)
+    msgs = []
+    for i in range(10):
+        message = Message()
+        message.data = b'hello%d' % i
+        message.address = "127.0.0.1"
+        message.port = 2998
+        msgs.append(message)
+    start = time.time()
+    futs = b.send_many(msgs)
+    assert [a.get().data for _ in range(10)] == [
+        b'hello%d' % i for i in range(10)
+    ]
+    assert [fut.result() for fut in futs] == msgs
+    # Capped to the window of the sender, no ACK waits for ACK_DELAY
+    assert time.time() - start < 2
+    assert a.stats()['acks_sent'] < 10
+
+
+def test_gc_many_remotes(receiver):
+    """test_gc_many_remotes."""
+    a = receiver(REUSE_TIME=0.5, TIMEOUT=0.5)
+    futs = []
+    # More remotes than a garbage-collection tick collects, the failed
+    # connects block the remotes for a moment
+    for port in range(5001, 5301):
+        message = Message()
+        message.address = "127.0.0.1"
+        message.port = port
+        futs.append(a.send(message))
+    for fut in futs:
+        with pytest.raises(ConnectionError):
+            fut.result()
+    for _ in range(100):
+        if a.stats()['remotes'] == 0:
+            break
+        time.sleep(0.1)
+    stats = a.stats()
+    assert stats['remotes'] == 0
+    assert stats['gc_remotes'] == 300
+
+
+def test_connect(sender, receiver):
+    """test_connect."""
+    a = receiver()
+    sender.connect("127.0.0.1", 2998, pin=True).result()
+    remote, = sender.stats()['remotes']
+    assert remote['connected'] == 1
+    assert remote['pinned'] == 1
+    # Connecting again unpins the remote and reuses the connection
+    sender.connect("127.0.0.1", 2998).result()
+    remote, = sender.stats()['remotes']
+    assert remote['pinned'] == 0
+    assert sender.stats()['connects'] == 1
+    # The NOOP is not received
+    assert a.empty()
+
+
+def test_multicast(sender, receiver):
+    """test_multicast."""
+    a = receiver()
+    b = receiver(PORT=2999)
+    message = Message()
+    message.header = b'head'
+    message.data = b'hello'
+    fut = sender.multicast(message, [
+        ("127.0.0.1", 2998), ("127.0.0.1", 2999), ("127.0.0.1", 2997)
+    ])
+    for chirp in (a, b):
+        msg = chirp.get()
+        assert msg.header == b'head'
+        assert msg.data == b'hello'
+        msg.release_slot().result()
+    res = fut.result()
+    assert res[:2] == [None, None]
+    assert isinstance(res[2], ConnectionError)
+    assert sender.multicast(message, []).result() == []
+
+
+def test_get_batch(config, sender):
+    """test_get_batch."""
+    config = Config()
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    a = Chirp(sender.loop, config)
+    futs = []
+    for _ in range(2):
+        message = Message()
+        message.data = b'hello'
+        message.address = "127.0.0.1"
+        message.port = config.PORT
+        futs.append(sender.send(message))
+    msgs = []
+    while len(msgs) < 2:
+        msgs.extend(a.get_batch())
+    assert [msg.data for msg in msgs] == [b'hello', b'hello']
+    assert not msgs[0].has_slot
+    for fut in futs:
+        fut.result()
+    a.stop()
+
+
+def test_message_freelist(config, sender, message):
+    """test_message_freelist."""
+    config = Config()
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    a = Chirp(sender.loop, config)
+    message.data = b'hello'
+    message.address = "127.0.0.1"
+    message.port = config.PORT
+    struct = message._struct
+    fut = sender.send(message)
+    a.get()
+    fut.result()
+    # The structure is recycled once the message is sent
+    assert message._msg_t is None
+    assert Message()._struct is struct
+    fut = sender.send(message)
+    assert a.get().data == b'hello'
+    fut.result()
+    a.stop()
+
+
+def test_zero_copy(config, sender, message):
+    """test_zero_copy."""
+    config = Config()
+    config.DH_PARAMS_PEM = "./tests/dh.pem"
+    config.CERT_CHAIN_PEM = "./tests/cert.pem"
+    config.AUTO_RELEASE = False
+    a = Chirp(sender.loop, config)
+    a.zero_copy = True
+    message.data = b'hello'
+    message.address = "127.0.0.1"
+    message.port = config.PORT
+    fut = sender.send(message)
+    msg = a.get()
+    data = msg.data
+    assert isinstance(data, memoryview)
+    assert data == b'hello'
+    assert msg.header == b''
+    msg.release().result()
+    fut.result()
+    with pytest.raises(RuntimeError):
+        msg.data
+    with pytest.raises(ValueError):
+        data[0]
+    a.stop()
+
+
 def test_recv_msg_wait(config, sender, message):
     """test_recv_msg_wait."""
     config = Config()